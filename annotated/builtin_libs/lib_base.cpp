@@ -64,7 +64,104 @@ DEEGEN_DEFINE_LIB_FUNC(base_assert)
 //
 DEEGEN_DEFINE_LIB_FUNC(base_collectgarbage)
 {
-    ThrowError("Library function 'collectgarbage' is not implemented yet!");
+    enum class GcOption
+    {
+        Collect,
+        Stop,
+        Restart,
+        Count,
+        Step,
+        SetPause,
+        SetStepMul
+    };
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    GcOption option = GcOption::Collect;
+    if (GetNumArgs() >= 1 && !GetArg(0).Is<tNil>())
+    {
+        TValue opt = GetArg(0);
+        if (unlikely(!opt.Is<tString>()))
+        {
+            ThrowError("bad argument #1 to 'collectgarbage' (string expected)");
+        }
+        HeapPtr<HeapString> str = opt.As<tString>();
+        auto optionIs = [&](const char* name) ALWAYS_INLINE -> bool
+        {
+            size_t len = strlen(name);
+            return str->m_length == len && memcmp(TranslateToRawPointer(vm, str->m_string), name, len) == 0;
+        };
+        if (optionIs("collect")) { option = GcOption::Collect; }
+        else if (optionIs("stop")) { option = GcOption::Stop; }
+        else if (optionIs("restart")) { option = GcOption::Restart; }
+        else if (optionIs("count")) { option = GcOption::Count; }
+        else if (optionIs("step")) { option = GcOption::Step; }
+        else if (optionIs("setpause")) { option = GcOption::SetPause; }
+        else if (optionIs("setstepmul")) { option = GcOption::SetStepMul; }
+        else
+        {
+            ThrowError("bad argument #1 to 'collectgarbage' (invalid option)");
+        }
+    }
+
+    double arg = 0;
+    if (GetNumArgs() >= 2)
+    {
+        auto [success, val] = LuaLib_ToNumber(GetArg(1));
+        if (unlikely(!success))
+        {
+            ThrowError("bad argument #2 to 'collectgarbage' (number expected)");
+        }
+        arg = val;
+    }
+
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+    switch (option)
+    {
+    case GcOption::Collect:
+    {
+        if (!gc->IsCollectionDeferred())
+        {
+            gc->Collect(UserHeapGarbageCollector::CollectionKind::Full);
+        }
+        Return(TValue::Create<tDouble>(0));
+    }
+    case GcOption::Stop:
+    {
+        gc->SetAutomaticCollectionEnabled(false);
+        Return(TValue::Create<tDouble>(0));
+    }
+    case GcOption::Restart:
+    {
+        gc->SetAutomaticCollectionEnabled(true);
+        Return(TValue::Create<tDouble>(0));
+    }
+    case GcOption::Count:
+    {
+        Return(TValue::Create<tDouble>(static_cast<double>(gc->GetHeapSizeBytes()) / 1024));
+    }
+    case GcOption::Step:
+    {
+        // Our collector is not incremental, so a step is an Eden collection, which always finishes a cycle
+        //
+        if (!gc->IsCollectionDeferred())
+        {
+            gc->Collect(UserHeapGarbageCollector::CollectionKind::Eden);
+        }
+        Return(TValue::Create<tBool>(true));
+    }
+    case GcOption::SetPause:
+    {
+        double oldValue = gc->GetLuaPause();
+        gc->SetLuaPause(arg);
+        Return(TValue::Create<tDouble>(oldValue));
+    }
+    case GcOption::SetStepMul:
+    {
+        double oldValue = gc->GetLuaStepMultiplier();
+        gc->SetLuaStepMultiplier(arg);
+        Return(TValue::Create<tDouble>(oldValue));
+    }
+    }   /*switch*/
 }
 
 DEEGEN_DEFINE_LIB_FUNC_CONTINUATION(base_dofile_continuation)
@@ -102,12 +199,12 @@ DEEGEN_DEFINE_LIB_FUNC(base_dofile)
 {
     if (GetNumArgs() < 1 || GetArg(0).Is<tNil>())
     {
-        // Read from stdin, in this case we can just use io_lines_iter as the iterator function and do a load
+        // Read from stdin, in this case we can just use a lines iterator over stdin as the reader function and do a load
         //
         VM* vm = VM::GetActiveVMForCurrentThread();
         TValue* callframe = GetStackBase();
         callframe[0] = vm->GetLibFn<VM::LibFn::BaseLoad>();
-        callframe[x_numSlotsForStackFrameHeader] = vm->GetLibFn<VM::LibFn::IoLinesIter>();
+        callframe[x_numSlotsForStackFrameHeader] = vm->GetLibFn<VM::LibFn::IoStdinChunkReader>();
         MakeInPlaceCall(callframe + x_numSlotsForStackFrameHeader, 1 /*numArgs*/, DEEGEN_LIB_FUNC_RETURN_CONTINUATION(base_dofile_read_stdin_continuation));
     }
 
@@ -375,12 +472,12 @@ DEEGEN_DEFINE_LIB_FUNC(base_loadfile)
 {
     if (GetNumArgs() < 1 || GetArg(0).Is<tNil>())
     {
-        // Read from stdin, in this case we can just use io_lines_iter as the iterator function and do a load
+        // Read from stdin, in this case we can just use a lines iterator over stdin as the reader function and do a load
         //
         VM* vm = VM::GetActiveVMForCurrentThread();
         TValue* callframe = GetStackBase();
         callframe[0] = vm->GetLibFn<VM::LibFn::BaseLoad>();
-        callframe[x_numSlotsForStackFrameHeader] = vm->GetLibFn<VM::LibFn::IoLinesIter>();
+        callframe[x_numSlotsForStackFrameHeader] = vm->GetLibFn<VM::LibFn::IoStdinChunkReader>();
         MakeInPlaceCall(callframe + x_numSlotsForStackFrameHeader, 1 /*numArgs*/, DEEGEN_LIB_FUNC_RETURN_CONTINUATION(base_loadfile_continuation));
     }
 
@@ -626,10 +723,12 @@ static bool WARN_UNUSED TryPrintUsingFastPath(VM* vm, FILE* fp, TValue tv)
 
     if (ty == HeapEntityType::Userdata)
     {
-        // TODO: support userdata
-        //
-        assert(false && "unimplemented");
-        __builtin_unreachable();
+        if (unlikely(tv.As<tUserdata>()->m_metatable.m_value != 0))
+        {
+            return false;
+        }
+        fprintf(fp, "userdata: %p", static_cast<void*>(p));
+        return true;
     }
 
     assert(ty == HeapEntityType::Table);
@@ -1312,11 +1411,8 @@ static TValue WARN_UNUSED LuaDefaultStringifyValue(VM* vm, TValue value)
         }
         else
         {
-            // TODO: support userdata
-            //
             assert(p->m_type == HeapEntityType::Userdata);
-            assert(false && "unimplemented");
-            __builtin_unreachable();
+            sprintf(buf, "userdata: %p", static_cast<void*>(p));
         }
 
         return TValue::Create<tString>(vm->CreateStringObjectFromRawCString(buf));
@@ -1512,10 +1608,15 @@ DEEGEN_DEFINE_LIB_FUNC(base_unpack)
 
     size_t numValues = static_cast<size_t>(ub - lb + 1);
 
+    TValue* sb = GetStackBase();
+    if (unlikely(numValues > CoroutineRuntimeContext::x_maxStackSlots || !GetCurrentCoroutine()->HasSpaceForValues(sb, numValues + x_minNilFillReturnValues)))
+    {
+        ThrowError("too many results to unpack");
+    }
+
     GetByIntegerIndexICInfo info;
     TableObject::PrepareGetByIntegerIndex(tableObj, info /*out*/);
 
-    TValue* sb = GetStackBase();
     if (likely(info.m_isContinuous))
     {
         // Value exists iff index is in [1, endIdx]
@@ -39,9 +39,9 @@ DEEGEN_DEFINE_LIB_FUNC_CONTINUATION(coro_finish)
     currentCoro->m_coroutineStatus.SetDead(true);
     assert(currentCoro->m_coroutineStatus.IsDead() && !currentCoro->m_coroutineStatus.IsResumable());
 
-    // Set up the arguments returned to the parent coroutine
+    // Set up the arguments returned to the parent coroutine, growing its stack if it cannot hold them
     //
-    TValue* dstStackBase = targetCoro->m_suspendPointStackBase;
+    TValue* dstStackBase = targetCoro->EnsureStackSpace(targetCoro->m_suspendPointStackBase, numRets + x_minNilFillReturnValues + 1 /*numSlotsNeeded*/);
     StackFrameHeader* dstHdr = StackFrameHeader::Get(dstStackBase);
     // DEVNOTE: 'm_numVariadicArguments' is repurposed by us here to distinguish whether
     // it is a coroutine.wrap or a coroutine.resume... 0 means coroutine.resume and 1 mean coroutine.wrap
@@ -52,11 +52,12 @@ DEEGEN_DEFINE_LIB_FUNC_CONTINUATION(coro_finish)
         // Note that we also need to pad nils to x_minNilFillReturnValues, as required by our internal call scheme.
         // However, since we know that the incoming return values also follows this scheme, it's sufficient to memcpy at least that many elements.
         //
-        // TODO: we need to check for stack overflow here once we implement resizable stack
-        //
         dstStackBase[0] = TValue::Create<tBool>(true);
         MoveArgumentsForCoroutine(dstStackBase + 1, retStart, std::max(numRets, static_cast<size_t>(x_minNilFillReturnValues) - 1));
 
+        // The return values have been copied out, so the stack of the dead coroutine can be recycled
+        //
+        currentCoro->ReleaseStack();
         CoroSwitch(targetCoro, dstStackBase, numRets + 1);
     }
     else
@@ -64,10 +65,9 @@ DEEGEN_DEFINE_LIB_FUNC_CONTINUATION(coro_finish)
         assert(dstHdr->m_numVariadicArguments == 1);
         // For coroutine.wrap, we should simply store all the return values
         //
-        // TODO: we need to check for stack overflow here once we implement resizable stack
-        //
         MoveArgumentsForCoroutine(dstStackBase, retStart, std::max(numRets, static_cast<size_t>(x_minNilFillReturnValues)));
 
+        currentCoro->ReleaseStack();
         CoroSwitch(targetCoro, dstStackBase, numRets);
     }
 }
@@ -181,11 +181,10 @@ DEEGEN_DEFINE_LIB_FUNC(coroutine_resume)
         targetCoro->m_parent = currentCoro;
         currentCoro->m_suspendPointStackBase = GetStackBase();
 
-        // Set up the arguments passed to the resumed coroutine
-        // TODO: we need to check for stack overflow here once we implement resizable stack
+        // Set up the arguments passed to the resumed coroutine, growing its stack if it cannot hold them
         //
-        TValue* dstStackBase = targetCoro->m_suspendPointStackBase;
         size_t numArgsToPass = GetNumArgs() - 1;
+        TValue* dstStackBase = targetCoro->EnsureStackSpace(targetCoro->m_suspendPointStackBase, numArgsToPass + x_minNilFillReturnValues + 1 /*numSlotsNeeded*/);
         MoveArgumentsForCoroutine(dstStackBase, GetStackBase() + 1, numArgsToPass);
         for (size_t i = 0; i < x_minNilFillReturnValues; i++) { dstStackBase[numArgsToPass + i] = TValue::Create<tNil>(); }
 
@@ -319,11 +318,10 @@ DEEGEN_DEFINE_LIB_FUNC(coroutine_wrap_call)
     targetCoro->m_parent = currentCoro;
     currentCoro->m_suspendPointStackBase = GetStackBase();
 
-    // Set up the arguments passed to the resumed coroutine
-    // TODO: we need to check for stack overflow here once we implement resizable stack
+    // Set up the arguments passed to the resumed coroutine, growing its stack if it cannot hold them
     //
-    TValue* dstStackBase = targetCoro->m_suspendPointStackBase;
     size_t numArgsToPass = GetNumArgs();
+    TValue* dstStackBase = targetCoro->EnsureStackSpace(targetCoro->m_suspendPointStackBase, numArgsToPass + x_minNilFillReturnValues + 1 /*numSlotsNeeded*/);
     MoveArgumentsForCoroutine(dstStackBase, GetStackBase(), numArgsToPass);
     for (size_t i = 0; i < x_minNilFillReturnValues; i++) { dstStackBase[numArgsToPass + i] = TValue::Create<tNil>(); }
 
@@ -393,9 +391,9 @@ DEEGEN_DEFINE_LIB_FUNC(coroutine_yield)
     currentCoro->m_coroutineStatus.SetResumable(true);
     currentCoro->m_suspendPointStackBase = sb;
 
-    // Set up the arguments returned to the parent coroutine
+    // Set up the arguments returned to the parent coroutine, growing its stack if it cannot hold them
     //
-    TValue* dstStackBase = targetCoro->m_suspendPointStackBase;
+    TValue* dstStackBase = targetCoro->EnsureStackSpace(targetCoro->m_suspendPointStackBase, numArgs + x_minNilFillReturnValues + 1 /*numSlotsNeeded*/);
     StackFrameHeader* dstHdr = StackFrameHeader::Get(dstStackBase);
     // DEVNOTE: 'm_numVariadicArguments' is repurposed by us here to distinguish whether
     // it is a coroutine.wrap or a coroutine.resume... 0 means coroutine.resume and 1 mean coroutine.wrap
@@ -405,8 +403,6 @@ DEEGEN_DEFINE_LIB_FUNC(coroutine_yield)
         // For coroutine.resume, we should store 'true' plus all return values
         // Note that we also need to pad nils to x_minNilFillReturnValues, as required by our internal call scheme.
         //
-        // TODO: we need to check for stack overflow here once we implement resizable stack
-        //
         dstStackBase[0] = TValue::Create<tBool>(true);
         MoveArgumentsForCoroutine(dstStackBase + 1, sb, numArgs);
         // Pad x_minNilFillReturnValues - 1 nils
@@ -422,8 +418,6 @@ DEEGEN_DEFINE_LIB_FUNC(coroutine_yield)
         assert(dstHdr->m_numVariadicArguments == 1);
         // For coroutine.wrap, we should simply store all the return values
         //
-        // TODO: we need to check for stack overflow here once we implement resizable stack
-        //
         MoveArgumentsForCoroutine(dstStackBase, sb, numArgs);
         // Pad x_minNilFillReturnValues nils
         //
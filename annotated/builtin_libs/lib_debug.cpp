@@ -222,8 +222,10 @@ DEEGEN_DEFINE_LIB_FUNC(debug_setmetatable)
         }
         else
         {
-            // TODO: support USERDATA
-            ReleaseAssert(false && "unimplemented");
+            assert(ty == HeapEntityType::Userdata);
+            HeapCDataObject* obj = TranslateToRawPointer(vm, value.As<tUserdata>());
+            setExoticMetatable(obj->m_metatable);
+            WriteBarrier(obj);
         }
     }
     else if (value.Is<tMIV>())
@@ -1,14 +1,256 @@
 #include "deegen_api.h"
+#include "lualib_tonumber_util.h"
 #include "runtime_utils.h"
+#include "lua_file.h"
+
+// Create the error message returned (together with nil and the error code) by the io functions on failure
+//
+static TValue WARN_UNUSED CreateIoErrorMessage(VM* vm, const char* fileName, int err)
+{
+    const char* errstr = strerror(err);
+    if (fileName == nullptr)
+    {
+        return TValue::Create<tString>(vm->CreateStringObjectFromRawCString(errstr));
+    }
+    std::pair<const void*, size_t> chunks[3] = {
+        std::make_pair(fileName, strlen(fileName)),
+        std::make_pair(": ", 2),
+        std::make_pair(errstr, strlen(errstr))
+    };
+    return TValue::Create<tString>(vm->CreateStringObjectFromConcatenation(chunks, 3 /*len*/).As());
+}
+
+// The file mode must match "[rwa]%+?b*", as in Lua 5.2+, since an invalid mode is undefined behavior for fopen
+//
+static bool WARN_UNUSED IsValidFileMode(const char* mode, size_t len)
+{
+    if (len == 0 || (mode[0] != 'r' && mode[0] != 'w' && mode[0] != 'a'))
+    {
+        return false;
+    }
+    size_t i = 1;
+    if (i < len && mode[i] == '+')
+    {
+        i++;
+    }
+    while (i < len && mode[i] == 'b')
+    {
+        i++;
+    }
+    return i == len;
+}
+
+static LuaFile* WARN_UNUSED GetDefaultFile(UserHeapPointer<HeapCDataObject> defaultFile)
+{
+    LuaFile* file = TryGetLuaFile(TValue::Create<tUserdata>(defaultFile.As()));
+    assert(file != nullptr);
+    return file;
+}
+
+enum class ReadFormatsStatus
+{
+    Ok,
+    InvalidFormat,
+    StringTooLong,
+    IoError
+};
+
+// Read from 'file' according to the formats, as file:read does, and store the value read for each format in place of the format.
+// Like in Lua, reading stops at the first format that fails, and nil is returned for that format.
+// 'numResults' is set to the number of values returned, or the index of the format if it is invalid.
+//
+static ReadFormatsStatus WARN_UNUSED ReadFileByFormats(VM* vm, LuaFile* file, TValue* formats, size_t numFormats, size_t& numResults /*out*/)
+{
+    for (size_t i = 0; i < numFormats; i++)
+    {
+        TValue format = formats[i];
+        bool success;
+        if (format.Is<tDouble>() || format.Is<tInt32>())
+        {
+            double n = format.Is<tDouble>() ? format.As<tDouble>() : static_cast<double>(format.As<tInt32>());
+            if (n >= 1)
+            {
+                UserHeapPointer<HeapString> str;
+                success = file->ReadChars(vm, static_cast<size_t>(std::min(n, 1e15)), str /*out*/);
+                if (success)
+                {
+                    formats[i] = TValue::Create<tString>(str.As());
+                }
+                else if (unlikely(errno == EFBIG))
+                {
+                    return ReadFormatsStatus::StringTooLong;
+                }
+            }
+            else
+            {
+                success = file->TestEof();
+                if (success)
+                {
+                    formats[i] = TValue::Create<tString>(vm->m_emptyString);
+                }
+            }
+        }
+        else if (format.Is<tString>())
+        {
+            HeapString* hs = TranslateToRawPointer(vm, format.As<tString>());
+            // The leading '*' is required in Lua 5.1 but optional since Lua 5.3, accept both
+            //
+            size_t k = (hs->m_length > 0 && hs->m_string[0] == '*') ? 1 : 0;
+            char c = (k < hs->m_length) ? static_cast<char>(hs->m_string[k]) : '\0';
+            switch (c)
+            {
+            case 'n':
+            {
+                double value;
+                success = file->ReadNumber(value /*out*/);
+                if (success)
+                {
+                    formats[i] = TValue::Create<tDouble>(value);
+                }
+                break;
+            }
+            case 'l':
+            case 'L':
+            {
+                UserHeapPointer<HeapString> str;
+                success = file->ReadLine(vm, c == 'L' /*keepNewline*/, str /*out*/);
+                if (success)
+                {
+                    formats[i] = TValue::Create<tString>(str.As());
+                }
+                else if (unlikely(errno == EFBIG))
+                {
+                    return ReadFormatsStatus::StringTooLong;
+                }
+                break;
+            }
+            case 'a':
+            {
+                UserHeapPointer<HeapString> str;
+                if (!file->ReadAll(vm, str /*out*/))
+                {
+                    return ReadFormatsStatus::IoError;
+                }
+                formats[i] = TValue::Create<tString>(str.As());
+                success = true;
+                break;
+            }
+            default:
+            {
+                numResults = i;
+                return ReadFormatsStatus::InvalidFormat;
+            }
+            }   /*switch*/
+        }
+        else
+        {
+            numResults = i;
+            return ReadFormatsStatus::InvalidFormat;
+        }
+
+        if (!success)
+        {
+            formats[i] = TValue::Create<tNil>();
+            numResults = i + 1;
+            return ReadFormatsStatus::Ok;
+        }
+    }
+    numResults = numFormats;
+    return ReadFormatsStatus::Ok;
+}
+
+enum class WriteValuesStatus
+{
+    Ok,
+    BadArgument,
+    IoError
+};
+
+// Write the values to 'file', as file:write does
+// 'badArgOrd' is set to the index of the value if it is neither a string nor a number
+//
+static WriteValuesStatus WARN_UNUSED WriteValuesToFile(VM* vm, LuaFile* file, TValue* values, size_t numValues, size_t& badArgOrd /*out*/)
+{
+    for (size_t i = 0; i < numValues; i++)
+    {
+        TValue val = values[i];
+        bool success;
+        if (val.Is<tString>())
+        {
+            HeapString* hs = TranslateToRawPointer(vm, val.As<tString>());
+            success = file->Write(hs->m_string, hs->m_length);
+        }
+        else if (val.Is<tDouble>())
+        {
+            char buf[x_default_tostring_buffersize_double];
+            char* bufEnd = StringifyDoubleUsingDefaultLuaFormattingOptions(buf /*out*/, val.As<tDouble>());
+            success = file->Write(buf, static_cast<size_t>(bufEnd - buf));
+        }
+        else if (val.Is<tInt32>())
+        {
+            char buf[x_default_tostring_buffersize_int];
+            char* bufEnd = StringifyInt32UsingDefaultLuaFormattingOptions(buf /*out*/, val.As<tInt32>());
+            success = file->Write(buf, static_cast<size_t>(bufEnd - buf));
+        }
+        else
+        {
+            badArgOrd = i;
+            return WriteValuesStatus::BadArgument;
+        }
+        if (unlikely(!success))
+        {
+            return WriteValuesStatus::IoError;
+        }
+    }
+    return WriteValuesStatus::Ok;
+}
+
+static HeapPtr<FunctionObject> WARN_UNUSED CreateLinesIterator(VM* vm, TValue file, bool closeAtEof)
+{
+    HeapPtr<FunctionObject> iter = FunctionObject::CreateCFunc(vm, vm->GetLibFnProto<VM::LibFnProto::IoLinesIter>(), 3 /*numUpvalues*/).As();
+    TCSet(iter->m_upvalues[0], file);
+    TCSet(iter->m_upvalues[1], TValue::Create<tBool>(closeAtEof));
+    TCSet(iter->m_upvalues[2], TValue::Create<tBool>(false) /*keepNewline*/);
+    return iter;
+}
 
 // io.close -- https://www.lua.org/manual/5.1/manual.html#pdf-io.close
 //
 // io.close ([file])
 // Equivalent to file:close(). Without a file, closes the default output file.
 //
+// This is also the implementation of file:close, same as in Lua.
+//
 DEEGEN_DEFINE_LIB_FUNC(io_close)
 {
-    ThrowError("Library function 'io.close' is not implemented yet!");
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    LuaFile* file;
+    if (GetNumArgs() == 0)
+    {
+        file = GetDefaultFile(vm->m_ioDefaultOutput);
+    }
+    else
+    {
+        file = TryGetLuaFile(GetArg(0));
+        if (unlikely(file == nullptr))
+        {
+            ThrowError("bad argument #1 to 'close' (FILE* expected)");
+        }
+    }
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("attempt to use a closed file");
+    }
+    if (unlikely(file->IsStandardStream()))
+    {
+        Return(TValue::Create<tNil>(), TValue::Create<tString>(vm->CreateStringObjectFromRawCString("cannot close standard file")));
+    }
+    if (unlikely(!file->Close()))
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    Return(TValue::Create<tBool>(true));
 }
 
 // io.flush -- https://www.lua.org/manual/5.1/manual.html#pdf-io.flush
@@ -18,139 +260,128 @@ DEEGEN_DEFINE_LIB_FUNC(io_close)
 //
 DEEGEN_DEFINE_LIB_FUNC(io_flush)
 {
-    ThrowError("Library function 'io.flush' is not implemented yet!");
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    LuaFile* file = GetDefaultFile(vm->m_ioDefaultOutput);
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("default output file is closed");
+    }
+    if (unlikely(!file->Flush()))
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    Return(TValue::Create<tBool>(true));
 }
 
-// io.input -- https://www.lua.org/manual/5.1/manual.html#pdf-io.input
-//
-// io.input ([file])
-// When called with a file name, it opens the named file (in text mode), and sets its handle as the default input file.
-// When called with a file handle, it simply sets this file handle as the default input file.
-// When called without parameters, it returns the current default input file.
-//
-// In case of errors this function raises the error, instead of returning an error code.
-//
-DEEGEN_DEFINE_LIB_FUNC(io_input)
+enum class SetDefaultFileStatus
 {
-    ThrowError("Library function 'io.input' is not implemented yet!");
-}
+    Ok,
+    BadArgument,
+    ClosedFile,
+    CannotOpen
+};
 
-// 'buf' must be 'limit + 1' bytes long
-// If -1 is returned, it means 'limit' bytes have been read but end-of-line is still not reached.
-// If -2 is returned, it means the file hit EOF without reading in any bytes
-// Otherwise, returns the length of the line, minus the '\n' if it exists.
+// The common implementation of io.input and io.output: 'arg' is either a file name to open with 'mode', or a file handle
 //
-static size_t WARN_UNUSED TryReadLineOnce(FILE* fp, char* buf, size_t limit)
+static SetDefaultFileStatus WARN_UNUSED SetDefaultFile(VM* vm, TValue arg, const char* mode, UserHeapPointer<HeapCDataObject>& defaultFile /*inout*/)
 {
-    // Set up a sentry value so we know if 'fgets' read exactly 'limit' bytes
-    //
-    buf[limit] = 1;
-
-    // Let fgets read at most 'limit' bytes and append the '\0'
-    //
-    char* fgetsRet = fgets(buf, static_cast<int>(limit + 1), fp);
-    if (unlikely(fgetsRet == nullptr))
-    {
-        // EOF without any bytes read, or error. For error just treat it as EOF for now.
-        //
-        return static_cast<size_t>(-2);
-    }
-
-    // If our sentry value 1 is not overwritten, it means 'fgets' stopped short before reading 'x_internalBufferSize' characters.
-    // So a newline (or EOF) must have been encountered. We can quit now.
-    //
-    if (buf[limit] != '\0')
+    if (arg.Is<tString>())
     {
-        size_t len = strlen(buf);
-        assert(len < limit);
-        if (len >= 1 && buf[len - 1] == '\n')
+        HeapString* fileName = TranslateToRawPointer(vm, arg.As<tString>());
+        LuaFile* file = LuaFile::Open(reinterpret_cast<const char*>(fileName->m_string), mode);
+        if (file == nullptr)
         {
-            len--;
+            return SetDefaultFileStatus::CannotOpen;
         }
-        return len;
+        defaultFile = CreateLuaFileObject(vm, file);
+        return SetDefaultFileStatus::Ok;
     }
-
-    // Now we know fgets has read exactly 'limit' characters.
-    //
-    if (buf[limit - 1] == '\n')
+    LuaFile* file = TryGetLuaFile(arg);
+    if (file == nullptr)
     {
-        // The line (including '\n') happens to have exactly 'limit' bytes.
-        //
-        return limit - 1;
+        return SetDefaultFileStatus::BadArgument;
     }
-
-    // The line might have more to read.
-    // (Note that it is possible that we have reached EOF here and the file doesn't end with a newline,
-    // but we won't know until we call fgets again).
-    //
-    return static_cast<size_t>(-1);
+    if (file->IsClosed())
+    {
+        return SetDefaultFileStatus::ClosedFile;
+    }
+    defaultFile = arg.As<tUserdata>();
+    return SetDefaultFileStatus::Ok;
 }
 
-static HeapPtr<HeapString> NO_INLINE ReadLinesSlowPath(FILE* fp, VM* vm, char* firstChunk, size_t firstChunkLen)
+// io.input -- https://www.lua.org/manual/5.1/manual.html#pdf-io.input
+//
+// io.input ([file])
+// When called with a file name, it opens the named file (in text mode), and sets its handle as the default input file.
+// When called with a file handle, it simply sets this file handle as the default input file.
+// When called without parameters, it returns the current default input file.
+//
+// In case of errors this function raises the error, instead of returning an error code.
+//
+DEEGEN_DEFINE_LIB_FUNC(io_input)
 {
-    // Just use a vector for simplicity now
-    //
-    std::vector<std::pair<const void*, size_t>> chunkList;
-    chunkList.push_back(std::make_pair(firstChunk, firstChunkLen));
-
-    constexpr size_t x_chunkSize = 65280;
-    while (true)
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    if (GetNumArgs() > 0 && !GetArg(0).Is<tNil>())
     {
-        char* buf = new char[x_chunkSize + 1];
-        size_t len = TryReadLineOnce(fp, buf, x_chunkSize);
-        if (len == static_cast<size_t>(-2))
+        switch (SetDefaultFile(vm, GetArg(0), "r" /*mode*/, vm->m_ioDefaultInput /*inout*/))
+        {
+        case SetDefaultFileStatus::Ok:
         {
-            // It means we reached EOF and the file did not end with a newline, we are done.
-            // We didn't read in anything useful in this iteration.
-            //
-            chunkList.push_back(std::make_pair(buf, 0));
             break;
         }
-        if (len == static_cast<size_t>(-1))
+        case SetDefaultFileStatus::BadArgument:
         {
-            // We read in full x_chunkSize bytes but still may have more to read.
-            //
-            chunkList.push_back(std::make_pair(buf, x_chunkSize));
-            continue;
+            ThrowError("bad argument #1 to 'input' (FILE* expected)");
         }
-
-        assert(len < x_chunkSize);
-        // We found a newline or EOF, we are done.
-        //
-        chunkList.push_back(std::make_pair(buf, len));
-        break;
-    }
-
-    HeapPtr<HeapString> result = vm->CreateStringObjectFromConcatenation(chunkList.data(), chunkList.size()).As();
-
-    // The first element in 'chunkList' is the internal buffer, we must not free it. Free everything else.
-    //
-    for (size_t i = 1; i < chunkList.size(); i++)
-    {
-        char* ptr = const_cast<char*>(reinterpret_cast<const char*>(chunkList[i].first));
-        delete [] ptr;
+        case SetDefaultFileStatus::ClosedFile:
+        {
+            ThrowError("attempt to use a closed file");
+        }
+        case SetDefaultFileStatus::CannotOpen:
+        {
+            int err = errno;
+            HeapString* fileName = TranslateToRawPointer(vm, GetArg(0).As<tString>());
+            ThrowError(CreateIoErrorMessage(vm, reinterpret_cast<const char*>(fileName->m_string), err));
+        }
+        }   /*switch*/
     }
-
-    return result;
+    Return(TValue::Create<tUserdata>(vm->m_ioDefaultInput.As()));
 }
 
+// The iterator returned by io.lines and file:lines
+// Upvalue 0 is the file, upvalue 1 is whether the file should be closed at EOF, and upvalue 2 is whether the '\n' is kept.
+// The VM also uses such an iterator that keeps the '\n' to load a chunk from stdin (see LibFn::IoStdinChunkReader).
+//
 DEEGEN_DEFINE_LIB_FUNC(io_lines_iter)
 {
+    HeapPtr<FunctionObject> func = GetStackFrameHeader()->m_func;
+    assert(func->m_numUpvalues == 3);
+    LuaFile* file = TryGetLuaFile(TCGet(func->m_upvalues[0]));
+    assert(file != nullptr);
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("file is already closed");
+    }
+
     VM* vm = VM::GetActiveVMForCurrentThread();
-    constexpr size_t x_internalBufferSize = 8192;
-    char internalBuf[x_internalBufferSize + 1];
-    size_t len = TryReadLineOnce(stdin, internalBuf, x_internalBufferSize);
-    if (len == static_cast<size_t>(-2))
+    UserHeapPointer<HeapString> line;
+    bool keepNewline = TCGet(func->m_upvalues[2]).As<tBool>();
+    if (likely(file->ReadLine(vm, keepNewline, line /*out*/)))
     {
-        Return(TValue::Create<tNil>());
+        Return(TValue::Create<tString>(line.As()));
+    }
+    if (unlikely(errno == EFBIG))
+    {
+        ThrowError("string length overflow");
     }
-    if (len != static_cast<size_t>(-1))
+
+    bool closeAtEof = TCGet(func->m_upvalues[1]).As<tBool>();
+    if (closeAtEof)
     {
-        assert(len < x_internalBufferSize);
-        Return(TValue::Create<tString>(vm->CreateStringObjectFromRawString(internalBuf, static_cast<uint32_t>(len)).As()));
+        std::ignore = file->Close();
     }
-    HeapPtr<HeapString> result = ReadLinesSlowPath(stdin, vm, internalBuf, x_internalBufferSize);
-    Return(TValue::Create<tString>(result));
+    Return(TValue::Create<tNil>());
 }
 
 // io.lines -- https://www.lua.org/manual/5.1/manual.html#pdf-io.lines
@@ -165,16 +396,29 @@ DEEGEN_DEFINE_LIB_FUNC(io_lines_iter)
 // The call io.lines() (with no file name) is equivalent to io.input():lines(); that is, it iterates over the lines of the
 // default input file. In this case it does not close the file when the loop ends.
 //
-// TODO: This is a makeshift implementation. This is not standard conforming.
-// Currently we are always read from stdin and does not support file input.
-//
 DEEGEN_DEFINE_LIB_FUNC(io_lines)
 {
-    if (GetNumArgs() > 0 && !GetArg(0).Is<tNil>())
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    if (GetNumArgs() == 0 || GetArg(0).Is<tNil>())
+    {
+        TValue defaultInput = TValue::Create<tUserdata>(vm->m_ioDefaultInput.As());
+        if (unlikely(TryGetLuaFile(defaultInput)->IsClosed()))
+        {
+            ThrowError("default input file is closed");
+        }
+        Return(TValue::Create<tFunction>(CreateLinesIterator(vm, defaultInput, false /*closeAtEof*/)));
+    }
+
+    GET_ARG_AS_STRING(lines, 1, fileName, fileNameLen);
+    std::ignore = fileNameLen;
+    LuaFile* file = LuaFile::Open(fileName, "r");
+    if (unlikely(file == nullptr))
     {
-        ThrowError("Library function 'io.lines' with file input is not implemented yet!");
+        int err = errno;
+        ThrowError(CreateIoErrorMessage(vm, fileName, err));
     }
-    Return(VM_GetLibFunctionObject<VM::LibFn::IoLinesIter>());
+    TValue tvFile = TValue::Create<tUserdata>(CreateLuaFileObject(vm, file));
+    Return(TValue::Create<tFunction>(CreateLinesIterator(vm, tvFile, true /*closeAtEof*/)));
 }
 
 // io.open -- https://www.lua.org/manual/5.1/manual.html#pdf-io.open
@@ -195,7 +439,37 @@ DEEGEN_DEFINE_LIB_FUNC(io_lines)
 //
 DEEGEN_DEFINE_LIB_FUNC(io_open)
 {
-    ThrowError("Library function 'io.open' is not implemented yet!");
+    if (unlikely(GetNumArgs() == 0))
+    {
+        ThrowError("bad argument #1 to 'open' (string expected, got no value)");
+    }
+    GET_ARG_AS_STRING(open, 1, fileName, fileNameLen);
+    std::ignore = fileNameLen;
+
+    const char* mode = "r";
+    if (GetNumArgs() > 1 && !GetArg(1).Is<tNil>())
+    {
+        TValue tvMode = GetArg(1);
+        if (unlikely(!tvMode.Is<tString>()))
+        {
+            ThrowError("bad argument #2 to 'open' (string expected)");
+        }
+        HeapString* hs = TranslateToRawPointer(tvMode.As<tString>());
+        mode = reinterpret_cast<const char*>(hs->m_string);
+        if (unlikely(!IsValidFileMode(mode, hs->m_length)))
+        {
+            ThrowError("bad argument #2 to 'open' (invalid mode)");
+        }
+    }
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    LuaFile* file = LuaFile::Open(fileName, mode);
+    if (unlikely(file == nullptr))
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, fileName, err), TValue::Create<tDouble>(err));
+    }
+    Return(TValue::Create<tUserdata>(CreateLuaFileObject(vm, file)));
 }
 
 // io.output -- https://www.lua.org/manual/5.1/manual.html#pdf-io.output
@@ -205,7 +479,32 @@ DEEGEN_DEFINE_LIB_FUNC(io_open)
 //
 DEEGEN_DEFINE_LIB_FUNC(io_output)
 {
-    ThrowError("Library function 'io.output' is not implemented yet!");
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    if (GetNumArgs() > 0 && !GetArg(0).Is<tNil>())
+    {
+        switch (SetDefaultFile(vm, GetArg(0), "w" /*mode*/, vm->m_ioDefaultOutput /*inout*/))
+        {
+        case SetDefaultFileStatus::Ok:
+        {
+            break;
+        }
+        case SetDefaultFileStatus::BadArgument:
+        {
+            ThrowError("bad argument #1 to 'output' (FILE* expected)");
+        }
+        case SetDefaultFileStatus::ClosedFile:
+        {
+            ThrowError("attempt to use a closed file");
+        }
+        case SetDefaultFileStatus::CannotOpen:
+        {
+            int err = errno;
+            HeapString* fileName = TranslateToRawPointer(vm, GetArg(0).As<tString>());
+            ThrowError(CreateIoErrorMessage(vm, reinterpret_cast<const char*>(fileName->m_string), err));
+        }
+        }   /*switch*/
+    }
+    Return(TValue::Create<tUserdata>(vm->m_ioDefaultOutput.As()));
 }
 
 // io.popen -- https://www.lua.org/manual/5.1/manual.html#pdf-io.popen
@@ -218,7 +517,40 @@ DEEGEN_DEFINE_LIB_FUNC(io_output)
 //
 DEEGEN_DEFINE_LIB_FUNC(io_popen)
 {
-    ThrowError("Library function 'io.popen' is not implemented yet!");
+    if (unlikely(GetNumArgs() == 0))
+    {
+        ThrowError("bad argument #1 to 'popen' (string expected, got no value)");
+    }
+    GET_ARG_AS_STRING(popen, 1, command, commandLen);
+    std::ignore = commandLen;
+
+    const char* mode = "r";
+    if (GetNumArgs() > 1 && !GetArg(1).Is<tNil>())
+    {
+        TValue tvMode = GetArg(1);
+        if (unlikely(!tvMode.Is<tString>()))
+        {
+            ThrowError("bad argument #2 to 'popen' (string expected)");
+        }
+        HeapString* hs = TranslateToRawPointer(tvMode.As<tString>());
+        mode = reinterpret_cast<const char*>(hs->m_string);
+        if (unlikely(hs->m_length != 1 || (mode[0] != 'r' && mode[0] != 'w')))
+        {
+            ThrowError("bad argument #2 to 'popen' (invalid mode)");
+        }
+    }
+
+    // The child process inherits our stdio buffers, so flush them first to not have the buffered output written twice
+    //
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    std::ignore = fflush(nullptr);
+    LuaFile* file = LuaFile::OpenProcess(command, mode);
+    if (unlikely(file == nullptr))
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, command, err), TValue::Create<tDouble>(err));
+    }
+    Return(TValue::Create<tUserdata>(CreateLuaFileObject(vm, file)));
 }
 
 // io.read -- https://www.lua.org/manual/5.1/manual.html#pdf-io.read
@@ -228,7 +560,53 @@ DEEGEN_DEFINE_LIB_FUNC(io_popen)
 //
 DEEGEN_DEFINE_LIB_FUNC(io_read)
 {
-    ThrowError("Library function 'io.read' is not implemented yet!");
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    LuaFile* file = GetDefaultFile(vm->m_ioDefaultInput);
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("default input file is closed");
+    }
+
+    if (GetNumArgs() == 0)
+    {
+        UserHeapPointer<HeapString> line;
+        if (file->ReadLine(vm, false /*keepNewline*/, line /*out*/))
+        {
+            Return(TValue::Create<tString>(line.As()));
+        }
+        if (unlikely(errno == EFBIG))
+        {
+            ThrowError("string length overflow");
+        }
+        Return(TValue::Create<tNil>());
+    }
+
+    // The values read are stored in place of the formats
+    //
+    TValue* formats = GetStackBase();
+    size_t numResults;
+    switch (ReadFileByFormats(vm, file, formats, GetNumArgs(), numResults /*out*/))
+    {
+    case ReadFormatsStatus::Ok:
+    {
+        ReturnValueRange(formats, numResults);
+    }
+    case ReadFormatsStatus::InvalidFormat:
+    {
+        char buf[100];
+        snprintf(buf, 100, "bad argument #%d to 'read' (invalid format)", static_cast<int>(numResults + 1));
+        ThrowError(TValue::Create<tString>(vm->CreateStringObjectFromRawCString(buf)));
+    }
+    case ReadFormatsStatus::StringTooLong:
+    {
+        ThrowError("string length overflow");
+    }
+    case ReadFormatsStatus::IoError:
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    }   /*switch*/
 }
 
 // io.tmpfile -- https://www.lua.org/manual/5.1/manual.html#pdf-io.tmpfile
@@ -238,7 +616,14 @@ DEEGEN_DEFINE_LIB_FUNC(io_read)
 //
 DEEGEN_DEFINE_LIB_FUNC(io_tmpfile)
 {
-    ThrowError("Library function 'io.tmpfile' is not implemented yet!");
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    LuaFile* file = LuaFile::OpenTemporaryFile();
+    if (unlikely(file == nullptr))
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    Return(TValue::Create<tUserdata>(CreateLuaFileObject(vm, file)));
 }
 
 // io.type -- https://www.lua.org/manual/5.1/manual.html#pdf-io.type
@@ -249,7 +634,17 @@ DEEGEN_DEFINE_LIB_FUNC(io_tmpfile)
 //
 DEEGEN_DEFINE_LIB_FUNC(io_type)
 {
-    ThrowError("Library function 'io.type' is not implemented yet!");
+    if (unlikely(GetNumArgs() == 0))
+    {
+        ThrowError("bad argument #1 to 'type' (value expected)");
+    }
+    LuaFile* file = TryGetLuaFile(GetArg(0));
+    if (file == nullptr)
+    {
+        Return(TValue::Create<tNil>());
+    }
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    Return(TValue::Create<tString>(vm->CreateStringObjectFromRawCString(file->IsClosed() ? "closed file" : "file")));
 }
 
 // io.write -- https://www.lua.org/manual/5.1/manual.html#pdf-io.write
@@ -257,62 +652,347 @@ DEEGEN_DEFINE_LIB_FUNC(io_type)
 // io.write (···)
 // Equivalent to io.output():write.
 //
-// TODO: This is a makeshift implementation. This is not standard conforming.
-// Currently we are always printing to stdout.
-//
 DEEGEN_DEFINE_LIB_FUNC(io_write)
 {
     VM* vm = VM::GetActiveVMForCurrentThread();
-    FILE* fp = vm->GetStdout();
-    size_t numElementsToPrint = GetNumArgs();
-    bool success = true;
-    for (uint32_t i = 0; i < numElementsToPrint; i++)
+    LuaFile* file = GetDefaultFile(vm->m_ioDefaultOutput);
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("default output file is closed");
+    }
+    size_t badArgOrd;
+    switch (WriteValuesToFile(vm, file, GetStackBase(), GetNumArgs(), badArgOrd /*out*/))
+    {
+    case WriteValuesStatus::Ok: [[likely]]
+    {
+        Return(TValue::Create<tBool>(true));
+    }
+    case WriteValuesStatus::BadArgument:
+    {
+        char buf[100];
+        snprintf(buf, 100, "bad argument #%d to 'write' (string expected)", static_cast<int>(badArgOrd + 1));
+        ThrowError(TValue::Create<tString>(vm->CreateStringObjectFromRawCString(buf)));
+    }
+    case WriteValuesStatus::IoError:
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    }   /*switch*/
+}
+
+// file:flush -- https://www.lua.org/manual/5.1/manual.html#pdf-file:flush
+//
+// file:flush ()
+// Saves any written data to file.
+//
+DEEGEN_DEFINE_LIB_FUNC(io_file_flush)
+{
+    LuaFile* file = (GetNumArgs() > 0) ? TryGetLuaFile(GetArg(0)) : nullptr;
+    if (unlikely(file == nullptr))
+    {
+        ThrowError("bad argument #1 to 'flush' (FILE* expected)");
+    }
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("attempt to use a closed file");
+    }
+    if (unlikely(!file->Flush()))
+    {
+        int err = errno;
+        VM* vm = VM::GetActiveVMForCurrentThread();
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    Return(TValue::Create<tBool>(true));
+}
+
+// file:lines -- https://www.lua.org/manual/5.1/manual.html#pdf-file:lines
+//
+// file:lines ()
+// Returns an iterator function that, each time it is called, returns a new line from the file. Therefore, the construction
+//     for line in file:lines() do body end
+// will iterate over all lines of the file. (Unlike io.lines, this function does not close the file when the loop ends.)
+//
+DEEGEN_DEFINE_LIB_FUNC(io_file_lines)
+{
+    LuaFile* file = (GetNumArgs() > 0) ? TryGetLuaFile(GetArg(0)) : nullptr;
+    if (unlikely(file == nullptr))
+    {
+        ThrowError("bad argument #1 to 'lines' (FILE* expected)");
+    }
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("attempt to use a closed file");
+    }
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    Return(TValue::Create<tFunction>(CreateLinesIterator(vm, GetArg(0), false /*closeAtEof*/)));
+}
+
+// file:read -- https://www.lua.org/manual/5.1/manual.html#pdf-file:read
+//
+// file:read (···)
+// Reads the file file, according to the given formats, which specify what to read. For each format, the function returns a string
+// (or a number) with the characters read, or nil if it cannot read data with the specified format. When called without formats, it
+// uses a default format that reads the entire next line (see below).
+//
+// The available formats are
+//     "*n": reads a number; this is the only format that returns a number instead of a string.
+//     "*a": reads the whole file, starting at the current position. On end of file, it returns the empty string.
+//     "*l": reads the next line (skipping the end of line), returning nil on end of file. This is the default format.
+//     number: reads a string with up to this number of characters, returning nil on end of file. If number is zero, it reads
+//             nothing and returns an empty string, or nil on end of file.
+//
+DEEGEN_DEFINE_LIB_FUNC(io_file_read)
+{
+    LuaFile* file = (GetNumArgs() > 0) ? TryGetLuaFile(GetArg(0)) : nullptr;
+    if (unlikely(file == nullptr))
     {
-        TValue val = GetArg(i);
-#if 0
-        if (val.Is<tInt32>())
+        ThrowError("bad argument #1 to 'read' (FILE* expected)");
+    }
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("attempt to use a closed file");
+    }
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    if (GetNumArgs() == 1)
+    {
+        UserHeapPointer<HeapString> line;
+        if (file->ReadLine(vm, false /*keepNewline*/, line /*out*/))
         {
-            char buf[x_default_tostring_buffersize_int];
-            char* bufEnd = StringifyInt32UsingDefaultLuaFormattingOptions(buf /*out*/, val.As<tInt32>());
-            size_t len = static_cast<size_t>(bufEnd - buf);
-            size_t written = fwrite(buf, 1, len, fp);
-            if (unlikely(len != written)) { success = false; break; }
+            Return(TValue::Create<tString>(line.As()));
         }
-        else
-#endif
-        if (val.Is<tDouble>())
+        if (unlikely(errno == EFBIG))
         {
-            double dbl = val.As<tDouble>();
-            char buf[x_default_tostring_buffersize_double];
-            char* bufEnd = StringifyDoubleUsingDefaultLuaFormattingOptions(buf /*out*/, dbl);
-            size_t len = static_cast<size_t>(bufEnd - buf);
-            size_t written = fwrite(buf, 1, len, fp);
-            if (unlikely(len != written)) { success = false; break; }
+            ThrowError("string length overflow");
+        }
+        Return(TValue::Create<tNil>());
+    }
+
+    // The values read are stored in place of the formats
+    //
+    TValue* formats = GetStackBase() + 1;
+    size_t numResults;
+    switch (ReadFileByFormats(vm, file, formats, GetNumArgs() - 1, numResults /*out*/))
+    {
+    case ReadFormatsStatus::Ok:
+    {
+        ReturnValueRange(formats, numResults);
+    }
+    case ReadFormatsStatus::InvalidFormat:
+    {
+        char buf[100];
+        snprintf(buf, 100, "bad argument #%d to 'read' (invalid format)", static_cast<int>(numResults + 1));
+        ThrowError(TValue::Create<tString>(vm->CreateStringObjectFromRawCString(buf)));
+    }
+    case ReadFormatsStatus::StringTooLong:
+    {
+        ThrowError("string length overflow");
+    }
+    case ReadFormatsStatus::IoError:
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    }   /*switch*/
+}
+
+// file:seek -- https://www.lua.org/manual/5.1/manual.html#pdf-file:seek
+//
+// file:seek ([whence] [, offset])
+// Sets and gets the file position, measured from the beginning of the file, to the position given by offset plus a base specified
+// by the string whence, as follows:
+//     "set": base is position 0 (beginning of the file);
+//     "cur": base is current position;
+//     "end": base is end of file;
+// In case of success, function seek returns the final file position, measured in bytes from the beginning of the file. If this
+// function fails, it returns nil, plus a string describing the error.
+//
+// The default value for whence is "cur", and for offset is 0.
+//
+DEEGEN_DEFINE_LIB_FUNC(io_file_seek)
+{
+    LuaFile* file = (GetNumArgs() > 0) ? TryGetLuaFile(GetArg(0)) : nullptr;
+    if (unlikely(file == nullptr))
+    {
+        ThrowError("bad argument #1 to 'seek' (FILE* expected)");
+    }
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("attempt to use a closed file");
+    }
+
+    int whence = SEEK_CUR;
+    if (GetNumArgs() > 1 && !GetArg(1).Is<tNil>())
+    {
+        TValue tvWhence = GetArg(1);
+        if (unlikely(!tvWhence.Is<tString>()))
+        {
+            ThrowError("bad argument #1 to 'seek' (string expected)");
         }
-        else if (val.Is<tString>())
+        HeapString* hs = TranslateToRawPointer(tvWhence.As<tString>());
+        const char* str = reinterpret_cast<const char*>(hs->m_string);
+        if (strcmp(str, "set") == 0)
         {
-            HeapString* hs = TranslateToRawPointer(vm, val.As<tString>());
-            size_t written = fwrite(hs->m_string, sizeof(char), hs->m_length /*length*/, fp);
-            if (unlikely(hs->m_length != written)) { success = false; break; }
+            whence = SEEK_SET;
+        }
+        else if (strcmp(str, "cur") == 0)
+        {
+            whence = SEEK_CUR;
+        }
+        else if (strcmp(str, "end") == 0)
+        {
+            whence = SEEK_END;
         }
         else
         {
-            // TODO: make error message consistent with Lua
-            ThrowError("bad argument to 'write' (string expected)");
+            ThrowError("bad argument #1 to 'seek' (invalid option)");
         }
     }
 
-    if (likely(success))
+    int64_t offset = 0;
+    if (GetNumArgs() > 2 && !GetArg(2).Is<tNil>())
     {
-        Return(TValue::Create<tBool>(true));
+        auto [success, value] = LuaLib_ToNumber(GetArg(2));
+        if (unlikely(!success))
+        {
+            ThrowError("bad argument #2 to 'seek' (number expected)");
+        }
+        offset = static_cast<int64_t>(value);
+    }
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    int64_t newPosition;
+    if (unlikely(!file->Seek(whence, offset, newPosition /*out*/)))
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    Return(TValue::Create<tDouble>(static_cast<double>(newPosition)));
+}
+
+// file:setvbuf -- https://www.lua.org/manual/5.1/manual.html#pdf-file:setvbuf
+//
+// file:setvbuf (mode [, size])
+// Sets the buffering mode for an output file. There are three available modes:
+//     "no": no buffering; the result of any output operation appears immediately.
+//     "full": full buffering; output operation is performed only when the buffer is full (or when you explicitly flush the file).
+//     "line": line buffering; output is buffered until a newline is output or there is any input from some special files.
+// For the last two cases, size specifies the size of the buffer, in bytes. The default is an appropriate size.
+//
+DEEGEN_DEFINE_LIB_FUNC(io_file_setvbuf)
+{
+    LuaFile* file = (GetNumArgs() > 0) ? TryGetLuaFile(GetArg(0)) : nullptr;
+    if (unlikely(file == nullptr))
+    {
+        ThrowError("bad argument #1 to 'setvbuf' (FILE* expected)");
+    }
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("attempt to use a closed file");
+    }
+    if (unlikely(GetNumArgs() < 2 || !GetArg(1).Is<tString>()))
+    {
+        ThrowError("bad argument #1 to 'setvbuf' (string expected)");
+    }
+
+    HeapString* hs = TranslateToRawPointer(GetArg(1).As<tString>());
+    const char* str = reinterpret_cast<const char*>(hs->m_string);
+    int mode = _IOFBF;
+    if (strcmp(str, "no") == 0)
+    {
+        mode = _IONBF;
+    }
+    else if (strcmp(str, "full") == 0)
+    {
+        mode = _IOFBF;
+    }
+    else if (strcmp(str, "line") == 0)
+    {
+        mode = _IOLBF;
     }
     else
+    {
+        ThrowError("bad argument #1 to 'setvbuf' (invalid option)");
+    }
+
+    size_t size = BUFSIZ;
+    if (GetNumArgs() > 2 && !GetArg(2).Is<tNil>())
+    {
+        auto [success, value] = LuaLib_ToNumber(GetArg(2));
+        if (unlikely(!success || value < 0))
+        {
+            ThrowError("bad argument #2 to 'setvbuf' (number expected)");
+        }
+        size = static_cast<size_t>(value);
+    }
+
+    if (unlikely(!file->SetVBuf(mode, size)))
     {
         int err = errno;
-        const char* errstr = strerror(err);
-        TValue tvErrStr = TValue::CreatePointer(vm->CreateStringObjectFromRawString(errstr, static_cast<uint32_t>(strlen(errstr))));
-        Return(TValue::Create<tNil>(), tvErrStr, TValue::Create<tDouble>(err));
+        VM* vm = VM::GetActiveVMForCurrentThread();
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    Return(TValue::Create<tBool>(true));
+}
+
+// file:write -- https://www.lua.org/manual/5.1/manual.html#pdf-file:write
+//
+// file:write (···)
+// Writes the value of each of its arguments to the file. The arguments must be strings or numbers. To write other values, use
+// tostring or string.format before write.
+//
+DEEGEN_DEFINE_LIB_FUNC(io_file_write)
+{
+    LuaFile* file = (GetNumArgs() > 0) ? TryGetLuaFile(GetArg(0)) : nullptr;
+    if (unlikely(file == nullptr))
+    {
+        ThrowError("bad argument #1 to 'write' (FILE* expected)");
+    }
+    if (unlikely(file->IsClosed()))
+    {
+        ThrowError("attempt to use a closed file");
+    }
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    size_t badArgOrd;
+    switch (WriteValuesToFile(vm, file, GetStackBase() + 1, GetNumArgs() - 1, badArgOrd /*out*/))
+    {
+    case WriteValuesStatus::Ok: [[likely]]
+    {
+        Return(TValue::Create<tBool>(true));
+    }
+    case WriteValuesStatus::BadArgument:
+    {
+        char buf[100];
+        snprintf(buf, 100, "bad argument #%d to 'write' (string expected)", static_cast<int>(badArgOrd + 1));
+        ThrowError(TValue::Create<tString>(vm->CreateStringObjectFromRawCString(buf)));
+    }
+    case WriteValuesStatus::IoError:
+    {
+        int err = errno;
+        Return(TValue::Create<tNil>(), CreateIoErrorMessage(vm, nullptr /*fileName*/, err), TValue::Create<tDouble>(err));
+    }
+    }   /*switch*/
+}
+
+// The '__tostring' metamethod of file handles
+//
+DEEGEN_DEFINE_LIB_FUNC(io_file_tostring)
+{
+    LuaFile* file = (GetNumArgs() > 0) ? TryGetLuaFile(GetArg(0)) : nullptr;
+    if (unlikely(file == nullptr))
+    {
+        ThrowError("bad argument #1 to 'tostring' (FILE* expected)");
+    }
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    if (file->IsClosed())
+    {
+        Return(TValue::Create<tString>(vm->CreateStringObjectFromRawCString("file (closed)")));
     }
+    char buf[100];
+    snprintf(buf, 100, "file (%p)", static_cast<void*>(TranslateToRawPointer(vm, GetArg(0).As<tUserdata>())));
+    Return(TValue::Create<tString>(vm->CreateStringObjectFromRawCString(buf)));
 }
 
 DEEGEN_END_LIB_FUNC_DEFINITIONS
@@ -2,6 +2,8 @@
 #include "lualib_tonumber_util.h"
 #include "runtime_utils.h"
 #include "lj_strfmt.h"
+#include "bytecode_snapshot.h"
+#include "lua_pattern.h"
 
 // string.byte -- https://www.lua.org/manual/5.1/manual.html#pdf-string.byte
 //
@@ -64,6 +66,10 @@ DEEGEN_DEFINE_LIB_FUNC(string_byte)
     }
 
     TValue* sb = GetStackBase();
+    if (unlikely(!GetCurrentCoroutine()->HasSpaceForValues(sb, static_cast<size_t>(ub - lb + 1) + x_minNilFillReturnValues)))
+    {
+        ThrowError("string slice too long");
+    }
     ptr--;
     for (int64_t i = lb; i <= ub; i++)
     {
@@ -145,9 +151,130 @@ DEEGEN_DEFINE_LIB_FUNC(string_char)
 // Returns a string containing a binary representation of the given function, so that a later loadstring on this string returns a copy
 // of the function. function must be a Lua function without upvalues.
 //
+// The result is a bytecode snapshot (see bytecode_snapshot.h), which loadstring, load, loadfile and dofile accept in place of source code.
+// Note that the snapshot is only valid for the same build of the VM.
+//
 DEEGEN_DEFINE_LIB_FUNC(string_dump)
 {
-    ThrowError("Library function 'string.dump' is not implemented yet!");
+    if (unlikely(GetNumArgs() < 1))
+    {
+        ThrowError("bad argument #1 to 'dump' (function expected, got no value)");
+    }
+    if (!GetArg(0).Is<tFunction>())
+    {
+        ThrowError("bad argument #1 to 'dump' (function expected)");
+    }
+
+    HeapPtr<FunctionObject> func = GetArg(0).As<tFunction>();
+    ExecutableCode* ec = TranslateToRawPointer(TCGet(func->m_executable).As());
+    if (!ec->IsBytecodeFunction())
+    {
+        ThrowError("unable to dump given function");
+    }
+
+    HeapPtr<HeapString> res;
+    {
+        std::string out;
+        if (!BytecodeSnapshot::Dump(static_cast<CodeBlock*>(ec)->m_owner, out /*out*/) || out.length() > std::numeric_limits<uint32_t>::max())
+        {
+            goto fail;
+        }
+        res = VM::GetActiveVMForCurrentThread()->CreateStringObjectFromRawString(out.data(), static_cast<uint32_t>(out.length())).As();
+    }
+    Return(TValue::Create<tString>(res));
+
+fail:
+    ThrowError("unable to dump given function");
+}
+
+// The pattern functions work on heap strings: the compiled pattern is cached by the pattern string,
+// and string.gmatch and string.gsub hold on to the subject string across calls.
+// Convert the value in 'slot' to a string in place if it is a number.
+// Return nullptr if the value is neither a string nor a number.
+//
+static HeapString* WARN_UNUSED TryConvertPatternFunctionArgToString(VM* vm, TValue* slot)
+{
+    TValue tv = *slot;
+    if (likely(tv.Is<tString>()))
+    {
+        return TranslateToRawPointer(vm, tv.As<tString>());
+    }
+
+    char buf[std::max(x_default_tostring_buffersize_double, x_default_tostring_buffersize_int)];
+    size_t len;
+    if (tv.Is<tDouble>())
+    {
+        len = static_cast<size_t>(StringifyDoubleUsingDefaultLuaFormattingOptions(buf, tv.As<tDouble>()) - buf);
+    }
+    else if (tv.Is<tInt32>())
+    {
+        len = static_cast<size_t>(StringifyInt32UsingDefaultLuaFormattingOptions(buf, tv.As<tInt32>()) - buf);
+    }
+    else
+    {
+        return nullptr;
+    }
+    HeapPtr<HeapString> s = vm->CreateStringObjectFromRawString(buf, static_cast<uint32_t>(len)).As();
+    *slot = TValue::Create<tString>(s);
+    return TranslateToRawPointer(vm, s);
+}
+
+// Compute the 0-based start offset from the optional 'init' argument of string.find and string.match, same as Lua 5.1
+// Return false if the argument is not a number.
+//
+static bool WARN_UNUSED TryGetPatternSearchStartOffset(TValue* args, size_t numArgs, size_t len, size_t& result /*out*/)
+{
+    int64_t init = 1;
+    if (numArgs >= 3 && !args[2].Is<tNil>())
+    {
+        auto [success, val] = LuaLib_ToNumber(args[2]);
+        if (unlikely(!success))
+        {
+            return false;
+        }
+        init = static_cast<int64_t>(val);
+    }
+    int64_t slen = static_cast<int64_t>(len);
+    if (init < 0)
+    {
+        init += slen + 1;
+    }
+    init--;
+    if (init < 0) { init = 0; }
+    if (init > slen) { init = slen; }
+    result = static_cast<size_t>(init);
+    return true;
+}
+
+// The value of capture 'ord' of a successful match [matchStart, matchEnd).
+// If the pattern has no captures, capture 0 is the whole match.
+//
+static TValue WARN_UNUSED GetPatternCaptureValue(VM* vm, LuaPattern::MatchState& ms, size_t ord, const char* matchStart, const char* matchEnd)
+{
+    if (ord >= ms.m_level)
+    {
+        assert(ord == 0);
+        return TValue::Create<tString>(vm->CreateStringObjectFromRawString(matchStart, static_cast<uint32_t>(matchEnd - matchStart)).As());
+    }
+    const LuaPattern::Capture& cap = ms.m_captures[ord];
+    if (cap.m_len == LuaPattern::x_positionCapture)
+    {
+        return TValue::Create<tDouble>(static_cast<double>(cap.m_start - ms.m_srcBegin + 1));
+    }
+    return TValue::Create<tString>(vm->CreateStringObjectFromRawString(cap.m_start, static_cast<uint32_t>(cap.m_len)).As());
+}
+
+// Write the captures of a successful match to 'out' and return the number of values written.
+// If the pattern has no captures, the whole match is written if 'wholeMatchIfNoCaptures' is true.
+//
+static size_t WARN_UNUSED WritePatternCaptures(VM* vm, LuaPattern::MatchState& ms, const char* matchStart, const char* matchEnd, bool wholeMatchIfNoCaptures, TValue* out /*out*/)
+{
+    size_t num = (ms.m_level == 0 && wholeMatchIfNoCaptures) ? 1 : ms.m_level;
+    for (size_t i = 0; i < num; i++)
+    {
+        out[i] = GetPatternCaptureValue(vm, ms, i, matchStart, matchEnd);
+    }
+    return num;
 }
 
 // string.find -- https://www.lua.org/manual/5.1/manual.html#pdf-string.find
@@ -163,7 +290,74 @@ DEEGEN_DEFINE_LIB_FUNC(string_dump)
 //
 DEEGEN_DEFINE_LIB_FUNC(string_find)
 {
-    ThrowError("Library function 'string.find' is not implemented yet!");
+    size_t numArgs = GetNumArgs();
+    if (unlikely(numArgs < 2))
+    {
+        ThrowError(numArgs == 0 ? "bad argument #1 to 'find' (string expected, got no value)" : "bad argument #2 to 'find' (string expected, got no value)");
+    }
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    TValue* sb = GetStackBase();
+    HeapString* subject = TryConvertPatternFunctionArgToString(vm, sb);
+    if (unlikely(subject == nullptr))
+    {
+        ThrowError("bad argument #1 to 'find' (string expected)");
+    }
+    HeapString* patternStr = TryConvertPatternFunctionArgToString(vm, sb + 1);
+    if (unlikely(patternStr == nullptr))
+    {
+        ThrowError("bad argument #2 to 'find' (string expected)");
+    }
+
+    size_t init;
+    if (unlikely(!TryGetPatternSearchStartOffset(sb, numArgs, subject->m_length, init /*out*/)))
+    {
+        ThrowError("bad argument #3 to 'find' (number expected)");
+    }
+
+    const char* s = reinterpret_cast<const char*>(subject->m_string);
+    size_t len = subject->m_length;
+
+    const char* p = reinterpret_cast<const char*>(patternStr->m_string);
+    size_t patternLen = patternStr->m_length;
+    if ((numArgs >= 4 && sb[3].IsTruthy()) || !LuaPattern::HasSpecialCharacters(p, patternLen))
+    {
+        // Plain find, the pattern is not compiled at all (it may not even be a valid pattern)
+        //
+        const char* pos = reinterpret_cast<const char*>(memmem(s + init, len - init, p, patternLen));
+        if (pos == nullptr)
+        {
+            Return(TValue::Create<tNil>());
+        }
+        Return(TValue::Create<tDouble>(static_cast<double>(pos - s + 1)), TValue::Create<tDouble>(static_cast<double>(pos - s) + static_cast<double>(patternLen)));
+    }
+
+    const char* errMsg;
+    LuaPattern* pattern = GetCompiledLuaPattern(vm, patternStr, true /*handleAnchor*/, errMsg /*out*/);
+    if (unlikely(pattern == nullptr))
+    {
+        ThrowError(errMsg);
+    }
+
+    LuaPattern::MatchState ms(s, s + len);
+    const char* matchStart;
+    const char* matchEnd;
+    LuaPattern::MatchResult res = pattern->Find(ms, s + init, matchStart /*out*/, matchEnd /*out*/);
+    if (res == LuaPattern::MatchResult::NotMatched)
+    {
+        Return(TValue::Create<tNil>());
+    }
+    if (unlikely(res == LuaPattern::MatchResult::TooComplex))
+    {
+        ThrowError("pattern too complex");
+    }
+
+    // The captures are created before the subject string in slot 0 is overwritten
+    //
+    size_t numCaptures = WritePatternCaptures(vm, ms, matchStart, matchEnd, false /*wholeMatchIfNoCaptures*/, sb + 2 /*out*/);
+    sb[0] = TValue::Create<tDouble>(static_cast<double>(matchStart - s + 1));
+    sb[1] = TValue::Create<tDouble>(static_cast<double>(matchEnd - s));
+    ReturnValueRange(sb, numCaptures + 2);
 }
 
 // string.format -- https://www.lua.org/manual/5.1/manual.html#pdf-string.format
@@ -246,7 +440,560 @@ DEEGEN_DEFINE_LIB_FUNC(string_format)
 //
 DEEGEN_DEFINE_LIB_FUNC(string_gmatch)
 {
-    ThrowError("Library function 'string.gmatch' is not implemented yet!");
+    size_t numArgs = GetNumArgs();
+    if (unlikely(numArgs < 2))
+    {
+        ThrowError(numArgs == 0 ? "bad argument #1 to 'gmatch' (string expected, got no value)" : "bad argument #2 to 'gmatch' (string expected, got no value)");
+    }
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    TValue* sb = GetStackBase();
+    if (unlikely(TryConvertPatternFunctionArgToString(vm, sb) == nullptr))
+    {
+        ThrowError("bad argument #1 to 'gmatch' (string expected)");
+    }
+    HeapString* patternStr = TryConvertPatternFunctionArgToString(vm, sb + 1);
+    if (unlikely(patternStr == nullptr))
+    {
+        ThrowError("bad argument #2 to 'gmatch' (string expected)");
+    }
+
+    // Compile the pattern now, so a malformed pattern is reported here instead of in the middle of the loop
+    //
+    const char* errMsg;
+    if (unlikely(GetCompiledLuaPattern(vm, patternStr, false /*handleAnchor*/, errMsg /*out*/) == nullptr))
+    {
+        ThrowError(errMsg);
+    }
+
+    HeapPtr<FunctionObject> iter = FunctionObject::CreateCFunc(vm, vm->GetLibFnProto<VM::LibFnProto::StringGmatchIter>(), 3 /*numUpvalues*/).As();
+    TCSet(iter->m_upvalues[0], sb[0]);
+    TCSet(iter->m_upvalues[1], sb[1]);
+    TCSet(iter->m_upvalues[2], TValue::Create<tDouble>(0));
+    Return(TValue::Create<tFunction>(iter));
+}
+
+// The iterator returned by string.gmatch
+// Upvalue 0 is the subject string, upvalue 1 is the pattern string, and upvalue 2 is the offset where the next match is attempted.
+//
+DEEGEN_DEFINE_LIB_FUNC(string_gmatch_iter)
+{
+    HeapPtr<FunctionObject> func = GetStackFrameHeader()->m_func;
+    assert(func->m_numUpvalues == 3);
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    HeapString* subject = TranslateToRawPointer(vm, TCGet(func->m_upvalues[0]).As<tString>());
+    HeapString* patternStr = TranslateToRawPointer(vm, TCGet(func->m_upvalues[1]).As<tString>());
+    size_t offset = static_cast<size_t>(TCGet(func->m_upvalues[2]).As<tDouble>());
+
+    // After an empty match at the end of the subject, the offset is past the end
+    //
+    size_t len = subject->m_length;
+    if (offset > len)
+    {
+        Return(TValue::Create<tNil>());
+    }
+
+    const char* errMsg;
+    LuaPattern* pattern = GetCompiledLuaPattern(vm, patternStr, false /*handleAnchor*/, errMsg /*out*/);
+    if (unlikely(pattern == nullptr))
+    {
+        ThrowError(errMsg);
+    }
+
+    const char* s = reinterpret_cast<const char*>(subject->m_string);
+    LuaPattern::MatchState ms(s, s + len);
+    const char* matchStart;
+    const char* matchEnd;
+    LuaPattern::MatchResult res = pattern->Find(ms, s + offset, matchStart /*out*/, matchEnd /*out*/);
+    if (res == LuaPattern::MatchResult::NotMatched)
+    {
+        TCSet(func->m_upvalues[2], TValue::Create<tDouble>(static_cast<double>(len + 1)));
+        Return(TValue::Create<tNil>());
+    }
+    if (unlikely(res == LuaPattern::MatchResult::TooComplex))
+    {
+        ThrowError("pattern too complex");
+    }
+
+    // An empty match must not be found again at the same position
+    //
+    size_t newOffset = static_cast<size_t>(matchEnd - s);
+    if (matchEnd == matchStart)
+    {
+        newOffset++;
+    }
+    TCSet(func->m_upvalues[2], TValue::Create<tDouble>(static_cast<double>(newOffset)));
+
+    TValue* sb = GetStackBase();
+    ReturnValueRange(sb, WritePatternCaptures(vm, ms, matchStart, matchEnd, true /*wholeMatchIfNoCaptures*/, sb /*out*/));
+}
+
+static void AppendToStringStream(SimpleTempStringStream& ss, const char* data, size_t len)
+{
+    char* buf = ss.Reserve(len);
+    memcpy(buf, data, len);
+    ss.Update(buf + len);
+}
+
+// string.gsub is implemented as a state machine, so that it can call the replacement function (or an '__index' function of
+// the replacement table) with MakeInPlaceCall, and resume in the continuation after the call returns.
+//
+// The result is built in a SimpleTempStringStream. The stream cannot live across a call, so before each call the text built
+// so far is saved as a string piece in the pieces table, and the pieces are concatenated in one pass at the end.
+// So a string replacement (or a table replacement that needs no call) builds the whole result in one pass with no pieces at all.
+//
+// The physical stack is arranged as follows:
+// Slot 0: the subject string
+// Slot 1: the pattern string
+// Slot 2: the replacement (a string, a table or a function; a number is converted to a string)
+// Slot 3: the max number of substitutions (double)
+// Slot 4: the offset in the subject where the next match is attempted (double)
+// Slot 5: the number of matches so far (double)
+// Slot 6: the pieces table, or nil if no piece has been saved yet
+// Slot 7: the number of pieces (double)
+// Slot 8, 9: the range of the match being replaced by the pending call (double)
+// Slot 10: the call frame of the pending call
+//
+struct GsubStateMachine
+{
+    static constexpr size_t x_slotSubject = 0;
+    static constexpr size_t x_slotPattern = 1;
+    static constexpr size_t x_slotRepl = 2;
+    static constexpr size_t x_slotMaxMatches = 3;
+    static constexpr size_t x_slotSrcOffset = 4;
+    static constexpr size_t x_slotNumMatches = 5;
+    static constexpr size_t x_slotPieces = 6;
+    static constexpr size_t x_slotNumPieces = 7;
+    static constexpr size_t x_slotMatchStart = 8;
+    static constexpr size_t x_slotMatchEnd = 9;
+    static constexpr size_t x_slotCallFrame = 10;
+
+    enum class Action
+    {
+        // The result string and the number of matches are in slot 0 and 1
+        //
+        Finish,
+        // The call frame is set up with 'm_numCallArgs' arguments
+        //
+        Call,
+        // Throw 'm_error'
+        //
+        Error
+    };
+
+    struct Result
+    {
+        Action m_action;
+        size_t m_numCallArgs;
+        TValue m_error;
+    };
+
+    // Run the substitution loop from the state in the stack. If 'callResult' is not nullptr, the pending call has returned
+    // with that value, which replaces the pending match.
+    //
+    static Result WARN_UNUSED Run(VM* vm, TValue* sb, TValue* callResult)
+    {
+        SimpleTempStringStream ss;
+        Result res = RunImpl(vm, sb, ss, callResult);
+        ss.Destroy();
+        return res;
+    }
+
+private:
+    static Result WARN_UNUSED MakeError(const char* msg)
+    {
+        return { .m_action = Action::Error, .m_numCallArgs = 0, .m_error = MakeErrorMessage(msg) };
+    }
+
+    // Same as 'add_s' in Lua 5.1
+    //
+    static bool WARN_UNUSED AppendStringReplacement(VM* vm, SimpleTempStringStream& ss, HeapString* repl, LuaPattern::MatchState& ms, const char* matchStart, const char* matchEnd)
+    {
+        // The string is NUL-terminated, so a '%' at the end appends a '\0', same as Lua 5.1
+        //
+        const char* r = reinterpret_cast<const char*>(repl->m_string);
+        const char* rEnd = r + repl->m_length;
+        while (r < rEnd)
+        {
+            const char* esc = reinterpret_cast<const char*>(memchr(r, '%', static_cast<size_t>(rEnd - r)));
+            if (esc == nullptr)
+            {
+                AppendToStringStream(ss, r, static_cast<size_t>(rEnd - r));
+                break;
+            }
+            AppendToStringStream(ss, r, static_cast<size_t>(esc - r));
+            char c = esc[1];
+            r = esc + 2;
+            if (!isdigit(static_cast<unsigned char>(c)))
+            {
+                AppendToStringStream(ss, &c, 1);
+            }
+            else if (c == '0')
+            {
+                AppendToStringStream(ss, matchStart, static_cast<size_t>(matchEnd - matchStart));
+            }
+            else
+            {
+                size_t ord = static_cast<size_t>(c - '1');
+                if (ord >= ms.m_level && !(ord == 0 && ms.m_level == 0))
+                {
+                    return false;
+                }
+                TValue cap = GetPatternCaptureValue(vm, ms, ord, matchStart, matchEnd);
+                if (cap.Is<tDouble>())
+                {
+                    char buf[x_default_tostring_buffersize_double];
+                    char* bufEnd = StringifyDoubleUsingDefaultLuaFormattingOptions(buf, cap.As<tDouble>());
+                    AppendToStringStream(ss, buf, static_cast<size_t>(bufEnd - buf));
+                }
+                else
+                {
+                    HeapString* capStr = TranslateToRawPointer(vm, cap.As<tString>());
+                    AppendToStringStream(ss, reinterpret_cast<const char*>(capStr->m_string), capStr->m_length);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Append the value returned by the replacement function or table: false or nil keeps the original match.
+    // Return false if the value is not a string or a number.
+    //
+    static bool WARN_UNUSED AppendReplacementValue(VM* vm, SimpleTempStringStream& ss, TValue value, const char* matchStart, const char* matchEnd)
+    {
+        if (!value.IsTruthy())
+        {
+            AppendToStringStream(ss, matchStart, static_cast<size_t>(matchEnd - matchStart));
+            return true;
+        }
+        if (value.Is<tString>())
+        {
+            HeapString* str = TranslateToRawPointer(vm, value.As<tString>());
+            AppendToStringStream(ss, reinterpret_cast<const char*>(str->m_string), str->m_length);
+            return true;
+        }
+        char buf[std::max(x_default_tostring_buffersize_double, x_default_tostring_buffersize_int)];
+        char* bufEnd;
+        if (value.Is<tDouble>())
+        {
+            bufEnd = StringifyDoubleUsingDefaultLuaFormattingOptions(buf, value.As<tDouble>());
+        }
+        else if (value.Is<tInt32>())
+        {
+            bufEnd = StringifyInt32UsingDefaultLuaFormattingOptions(buf, value.As<tInt32>());
+        }
+        else
+        {
+            return false;
+        }
+        AppendToStringStream(ss, buf, static_cast<size_t>(bufEnd - buf));
+        return true;
+    }
+
+    static Result WARN_UNUSED MakeInvalidReplacementValueError(TValue value)
+    {
+        // Only values that are truthy but neither strings nor numbers can get here
+        //
+        const char* typeName;
+        if (value.Is<tBool>())
+        {
+            typeName = "boolean";
+        }
+        else
+        {
+            assert(value.IsPointer());
+            switch (TranslateToRawPointer(value.AsPointer<UserHeapGcObjectHeader>().As())->m_type)
+            {
+            case HeapEntityType::Table: typeName = "table"; break;
+            case HeapEntityType::Function: typeName = "function"; break;
+            case HeapEntityType::Thread: typeName = "thread"; break;
+            default: typeName = "userdata"; break;
+            }   /*switch*/
+        }
+        char msg[100];
+        snprintf(msg, 100, "invalid replacement value (a %s)", typeName);
+        return MakeError(msg);
+    }
+
+    // Look up 'key' in the replacement table, following the '__index' chain as long as it consists of tables.
+    // Return false if an '__index' that is not a table is reached, in which case 'result' is the '__index' and 'base' is
+    // the table it belongs to, and the lookup must be finished by calling it.
+    //
+    static bool WARN_UNUSED TryLookupReplacementTable(HeapPtr<TableObject> tab, TValue key, TValue& result /*out*/, TValue& base /*out*/)
+    {
+        while (true)
+        {
+            TValue val;
+            if (key.Is<tDouble>())
+            {
+                GetByIntegerIndexICInfo icInfo;
+                TableObject::PrepareGetByIntegerIndex(tab, icInfo /*out*/);
+                val = TableObject::GetByDoubleVal(tab, key.As<tDouble>(), icInfo);
+            }
+            else
+            {
+                assert(key.Is<tString>());
+                GetByIdICInfo icInfo;
+                TableObject::PrepareGetById(tab, UserHeapPointer<void> { key.As<tHeapEntity>() }, icInfo /*out*/);
+                val = TableObject::GetById(tab, key.As<tHeapEntity>(), icInfo);
+            }
+            if (!val.Is<tNil>())
+            {
+                result = val;
+                return true;
+            }
+
+            TableObject::GetMetatableResult gmr = TableObject::GetMetatable(tab);
+            if (gmr.m_result.m_value == 0)
+            {
+                result = val;
+                return true;
+            }
+            HeapPtr<TableObject> metatable = gmr.m_result.As<TableObject>();
+            if (TableObject::TryQuicklyRuleOutMetamethod(metatable, LuaMetamethodKind::Index))
+            {
+                result = val;
+                return true;
+            }
+            TValue metamethod = GetMetamethodFromMetatable(metatable, LuaMetamethodKind::Index);
+            if (metamethod.Is<tNil>())
+            {
+                result = val;
+                return true;
+            }
+            if (!metamethod.Is<tTable>())
+            {
+                result = metamethod;
+                base = TValue::Create<tTable>(tab);
+                return false;
+            }
+            tab = metamethod.As<tTable>();
+        }
+    }
+
+    // Save the text built so far as a piece, since the stream does not survive the call
+    //
+    static void SavePiece(VM* vm, TValue* sb, SimpleTempStringStream& ss)
+    {
+        if (ss.Len() == 0)
+        {
+            return;
+        }
+        if (sb[x_slotPieces].Is<tNil>())
+        {
+            sb[x_slotPieces] = TValue::Create<tTable>(TableObject::CreateEmptyTableObject(vm, 0U /*inlineCap*/, 4 /*initialButterfly*/));
+        }
+        HeapPtr<TableObject> pieces = sb[x_slotPieces].As<tTable>();
+        int64_t ord = static_cast<int64_t>(sb[x_slotNumPieces].As<tDouble>()) + 1;
+        TValue piece = TValue::Create<tString>(vm->CreateStringObjectFromRawString(ss.Begin(), static_cast<uint32_t>(ss.Len())).As());
+        TableObject::RawPutByValIntegerIndex(pieces, ord, piece);
+        sb[x_slotNumPieces] = TValue::Create<tDouble>(static_cast<double>(ord));
+        ss.Clear();
+    }
+
+    // Set up the call frame to call 'callee' with 'numArgs' arguments already in place, resolving the '__call' metamethod if needed
+    //
+    static Result WARN_UNUSED PrepareCall(TValue* callFrame, TValue callee, size_t numArgs)
+    {
+        if (likely(callee.Is<tFunction>()))
+        {
+            callFrame[0] = callee;
+            return { .m_action = Action::Call, .m_numCallArgs = numArgs, .m_error = TValue() };
+        }
+        HeapPtr<FunctionObject> callTarget = GetCallTargetViaMetatable(callee);
+        if (unlikely(callTarget == nullptr))
+        {
+            return { .m_action = Action::Error, .m_numCallArgs = 0, .m_error = MakeErrorMessageForUnableToCall(callee) };
+        }
+        TValue* args = callFrame + x_numSlotsForStackFrameHeader;
+        memmove(args + 1, args, sizeof(TValue) * numArgs);
+        args[0] = callee;
+        callFrame[0] = TValue::Create<tFunction>(callTarget);
+        return { .m_action = Action::Call, .m_numCallArgs = numArgs + 1, .m_error = TValue() };
+    }
+
+    static Result WARN_UNUSED RunImpl(VM* vm, TValue* sb, SimpleTempStringStream& ss, TValue* callResult)
+    {
+        HeapString* subject = TranslateToRawPointer(vm, sb[x_slotSubject].As<tString>());
+        const char* s = reinterpret_cast<const char*>(subject->m_string);
+        const char* end = s + subject->m_length;
+        double maxMatches = sb[x_slotMaxMatches].As<tDouble>();
+        double numMatches = sb[x_slotNumMatches].As<tDouble>();
+        const char* src = s + static_cast<size_t>(sb[x_slotSrcOffset].As<tDouble>());
+        TValue repl = sb[x_slotRepl];
+
+        // The pattern is looked up again every time, as the replacement function may have evicted it from the cache
+        //
+        const char* errMsg;
+        LuaPattern* pattern = GetCompiledLuaPattern(vm, TranslateToRawPointer(vm, sb[x_slotPattern].As<tString>()), true /*handleAnchor*/, errMsg /*out*/);
+        if (unlikely(pattern == nullptr))
+        {
+            return MakeError(errMsg);
+        }
+        bool isAnchored = pattern->IsAnchored();
+        LuaPattern::MatchState ms(s, end);
+
+        // Same as the loop in 'str_gsub' in Lua 5.1, except that for an unanchored pattern, the positions where the pattern
+        // does not match are skipped in one step by LuaPattern::Find
+        //
+        bool isResumingFromCall = (callResult != nullptr);
+        while (true)
+        {
+            const char* matchEnd = nullptr;
+            if (isResumingFromCall)
+            {
+                isResumingFromCall = false;
+                src = s + static_cast<size_t>(sb[x_slotMatchStart].As<tDouble>());
+                matchEnd = s + static_cast<size_t>(sb[x_slotMatchEnd].As<tDouble>());
+                if (unlikely(!AppendReplacementValue(vm, ss, *callResult, src, matchEnd)))
+                {
+                    return MakeInvalidReplacementValueError(*callResult);
+                }
+            }
+            else
+            {
+                if (!(numMatches < maxMatches))
+                {
+                    break;
+                }
+                LuaPattern::MatchResult res;
+                if (isAnchored)
+                {
+                    res = pattern->MatchAt(ms, src, matchEnd /*out*/);
+                }
+                else
+                {
+                    const char* matchStart;
+                    res = pattern->Find(ms, src, matchStart /*out*/, matchEnd /*out*/);
+                    if (res == LuaPattern::MatchResult::NotMatched)
+                    {
+                        break;
+                    }
+                    if (res == LuaPattern::MatchResult::Matched)
+                    {
+                        AppendToStringStream(ss, src, static_cast<size_t>(matchStart - src));
+                        src = matchStart;
+                    }
+                }
+                if (unlikely(res == LuaPattern::MatchResult::TooComplex))
+                {
+                    return MakeError("pattern too complex");
+                }
+
+                if (res == LuaPattern::MatchResult::Matched)
+                {
+                    numMatches++;
+                    TValue value;
+                    TValue callee;
+                    TValue* callFrame = sb + x_slotCallFrame;
+                    TValue* args = callFrame + x_numSlotsForStackFrameHeader;
+                    size_t numArgs;
+                    if (repl.Is<tString>())
+                    {
+                        if (unlikely(!AppendStringReplacement(vm, ss, TranslateToRawPointer(vm, repl.As<tString>()), ms, src, matchEnd)))
+                        {
+                            return MakeError("invalid capture index");
+                        }
+                        goto advance;
+                    }
+                    else if (repl.Is<tTable>())
+                    {
+                        TValue key = GetPatternCaptureValue(vm, ms, 0 /*ord*/, src, matchEnd);
+                        TValue base;
+                        if (TryLookupReplacementTable(repl.As<tTable>(), key, value /*out*/, base /*out*/))
+                        {
+                            if (unlikely(!AppendReplacementValue(vm, ss, value, src, matchEnd)))
+                            {
+                                return MakeInvalidReplacementValueError(value);
+                            }
+                            goto advance;
+                        }
+                        callee = value;
+                        args[0] = base;
+                        args[1] = key;
+                        numArgs = 2;
+                    }
+                    else
+                    {
+                        assert(repl.Is<tFunction>());
+                        callee = repl;
+                        numArgs = WritePatternCaptures(vm, ms, src, matchEnd, true /*wholeMatchIfNoCaptures*/, args /*out*/);
+                    }
+
+                    SavePiece(vm, sb, ss);
+                    sb[x_slotSrcOffset] = TValue::Create<tDouble>(static_cast<double>(src - s));
+                    sb[x_slotNumMatches] = TValue::Create<tDouble>(numMatches);
+                    sb[x_slotMatchStart] = TValue::Create<tDouble>(static_cast<double>(src - s));
+                    sb[x_slotMatchEnd] = TValue::Create<tDouble>(static_cast<double>(matchEnd - s));
+                    return PrepareCall(callFrame, callee, numArgs);
+                }
+                matchEnd = nullptr;
+            }
+
+advance:
+            if (matchEnd != nullptr && matchEnd > src)
+            {
+                src = matchEnd;
+            }
+            else if (src < end)
+            {
+                AppendToStringStream(ss, src, 1);
+                src++;
+            }
+            else
+            {
+                break;
+            }
+            if (isAnchored)
+            {
+                break;
+            }
+        }
+
+        AppendToStringStream(ss, src, static_cast<size_t>(end - src));
+
+        HeapPtr<HeapString> result;
+        if (sb[x_slotPieces].Is<tNil>())
+        {
+            result = vm->CreateStringObjectFromRawString(ss.Begin(), static_cast<uint32_t>(ss.Len())).As();
+        }
+        else
+        {
+            HeapPtr<TableObject> pieces = sb[x_slotPieces].As<tTable>();
+            size_t numPieces = static_cast<size_t>(sb[x_slotNumPieces].As<tDouble>());
+            std::vector<std::pair<const void*, size_t>> parts;
+            parts.reserve(numPieces + 1);
+            GetByIntegerIndexICInfo icInfo;
+            TableObject::PrepareGetByIntegerIndex(pieces, icInfo /*out*/);
+            for (size_t i = 1; i <= numPieces; i++)
+            {
+                HeapString* piece = TranslateToRawPointer(vm, TableObject::GetByIntegerIndex(pieces, static_cast<int64_t>(i), icInfo).As<tString>());
+                parts.push_back(std::make_pair(static_cast<const void*>(piece->m_string), static_cast<size_t>(piece->m_length)));
+            }
+            parts.push_back(std::make_pair(static_cast<const void*>(ss.Begin()), ss.Len()));
+            result = vm->CreateStringObjectFromConcatenation(parts.data(), parts.size()).As();
+        }
+        sb[0] = TValue::Create<tString>(result);
+        sb[1] = TValue::Create<tDouble>(numMatches);
+        return { .m_action = Action::Finish, .m_numCallArgs = 0, .m_error = TValue() };
+    }
+};
+
+DEEGEN_DEFINE_LIB_FUNC_CONTINUATION(string_gsub_continuation)
+{
+    TValue callResult = (GetNumReturnValues() > 0) ? GetReturnValuesBegin()[0] : TValue::Create<tNil>();
+    TValue* sb = GetStackBase();
+    GsubStateMachine::Result res = GsubStateMachine::Run(VM::GetActiveVMForCurrentThread(), sb, &callResult);
+    if (res.m_action == GsubStateMachine::Action::Finish)
+    {
+        ReturnValueRange(sb, 2);
+    }
+    if (res.m_action == GsubStateMachine::Action::Error)
+    {
+        ThrowError(res.m_error);
+    }
+    TValue* callFrame = sb + GsubStateMachine::x_slotCallFrame;
+    MakeInPlaceCall(callFrame + x_numSlotsForStackFrameHeader, res.m_numCallArgs, DEEGEN_LIB_FUNC_RETURN_CONTINUATION(string_gsub_continuation));
 }
 
 // string.gsub -- https://www.lua.org/manual/5.1/manual.html#pdf-string.gsub
@@ -294,7 +1041,61 @@ DEEGEN_DEFINE_LIB_FUNC(string_gmatch)
 //
 DEEGEN_DEFINE_LIB_FUNC(string_gsub)
 {
-    ThrowError("Library function 'string.gsub' is not implemented yet!");
+    size_t numArgs = GetNumArgs();
+    if (unlikely(numArgs < 3))
+    {
+        if (numArgs == 2)
+        {
+            ThrowError("bad argument #3 to 'gsub' (string/function/table expected)");
+        }
+        ThrowError(numArgs == 0 ? "bad argument #1 to 'gsub' (string expected, got no value)" : "bad argument #2 to 'gsub' (string expected, got no value)");
+    }
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    TValue* sb = GetStackBase();
+    HeapString* subject = TryConvertPatternFunctionArgToString(vm, sb + GsubStateMachine::x_slotSubject);
+    if (unlikely(subject == nullptr))
+    {
+        ThrowError("bad argument #1 to 'gsub' (string expected)");
+    }
+    if (unlikely(TryConvertPatternFunctionArgToString(vm, sb + GsubStateMachine::x_slotPattern) == nullptr))
+    {
+        ThrowError("bad argument #2 to 'gsub' (string expected)");
+    }
+    TValue repl = sb[GsubStateMachine::x_slotRepl];
+    if (!repl.Is<tTable>() && !repl.Is<tFunction>() && unlikely(TryConvertPatternFunctionArgToString(vm, sb + GsubStateMachine::x_slotRepl) == nullptr))
+    {
+        ThrowError("bad argument #3 to 'gsub' (string/function/table expected)");
+    }
+
+    int64_t maxMatches = static_cast<int64_t>(subject->m_length) + 1;
+    if (numArgs >= 4 && !sb[3].Is<tNil>())
+    {
+        auto [success, val] = LuaLib_ToNumber(sb[3]);
+        if (unlikely(!success))
+        {
+            ThrowError("bad argument #4 to 'gsub' (number expected)");
+        }
+        maxMatches = static_cast<int64_t>(val);
+    }
+
+    sb[GsubStateMachine::x_slotMaxMatches] = TValue::Create<tDouble>(static_cast<double>(maxMatches));
+    sb[GsubStateMachine::x_slotSrcOffset] = TValue::Create<tDouble>(0);
+    sb[GsubStateMachine::x_slotNumMatches] = TValue::Create<tDouble>(0);
+    sb[GsubStateMachine::x_slotPieces] = TValue::Create<tNil>();
+    sb[GsubStateMachine::x_slotNumPieces] = TValue::Create<tDouble>(0);
+
+    GsubStateMachine::Result res = GsubStateMachine::Run(vm, sb, nullptr /*callResult*/);
+    if (likely(res.m_action == GsubStateMachine::Action::Finish))
+    {
+        ReturnValueRange(sb, 2);
+    }
+    if (res.m_action == GsubStateMachine::Action::Error)
+    {
+        ThrowError(res.m_error);
+    }
+    TValue* callFrame = sb + GsubStateMachine::x_slotCallFrame;
+    MakeInPlaceCall(callFrame + x_numSlotsForStackFrameHeader, res.m_numCallArgs, DEEGEN_LIB_FUNC_RETURN_CONTINUATION(string_gsub_continuation));
 }
 
 // string.len -- https://www.lua.org/manual/5.1/manual.html#pdf-string.len
@@ -490,7 +1291,56 @@ DEEGEN_DEFINE_LIB_FUNC(string_lower)
 //
 DEEGEN_DEFINE_LIB_FUNC(string_match)
 {
-    ThrowError("Library function 'string.match' is not implemented yet!");
+    size_t numArgs = GetNumArgs();
+    if (unlikely(numArgs < 2))
+    {
+        ThrowError(numArgs == 0 ? "bad argument #1 to 'match' (string expected, got no value)" : "bad argument #2 to 'match' (string expected, got no value)");
+    }
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    TValue* sb = GetStackBase();
+    HeapString* subject = TryConvertPatternFunctionArgToString(vm, sb);
+    if (unlikely(subject == nullptr))
+    {
+        ThrowError("bad argument #1 to 'match' (string expected)");
+    }
+    HeapString* patternStr = TryConvertPatternFunctionArgToString(vm, sb + 1);
+    if (unlikely(patternStr == nullptr))
+    {
+        ThrowError("bad argument #2 to 'match' (string expected)");
+    }
+
+    size_t init;
+    if (unlikely(!TryGetPatternSearchStartOffset(sb, numArgs, subject->m_length, init /*out*/)))
+    {
+        ThrowError("bad argument #3 to 'match' (number expected)");
+    }
+
+    const char* errMsg;
+    LuaPattern* pattern = GetCompiledLuaPattern(vm, patternStr, true /*handleAnchor*/, errMsg /*out*/);
+    if (unlikely(pattern == nullptr))
+    {
+        ThrowError(errMsg);
+    }
+
+    const char* s = reinterpret_cast<const char*>(subject->m_string);
+    LuaPattern::MatchState ms(s, s + subject->m_length);
+    const char* matchStart;
+    const char* matchEnd;
+    LuaPattern::MatchResult res = pattern->Find(ms, s + init, matchStart /*out*/, matchEnd /*out*/);
+    if (res == LuaPattern::MatchResult::NotMatched)
+    {
+        Return(TValue::Create<tNil>());
+    }
+    if (unlikely(res == LuaPattern::MatchResult::TooComplex))
+    {
+        ThrowError("pattern too complex");
+    }
+
+    // The captures are written past the subject string in slot 0, so it stays alive while they are created
+    //
+    size_t numCaptures = WritePatternCaptures(vm, ms, matchStart, matchEnd, true /*wholeMatchIfNoCaptures*/, sb + 2 /*out*/);
+    ReturnValueRange(sb + 2, numCaptures);
 }
 
 // string.rep -- https://www.lua.org/manual/5.1/manual.html#pdf-string.rep
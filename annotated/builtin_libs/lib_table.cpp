@@ -2,6 +2,22 @@
 #include "lualib_tonumber_util.h"
 #include "runtime_utils.h"
 #include "simple_string_stream.h"
+#include "array_sort.h"
+
+// Convert a numeric index argument to int64_t, truncating towards zero.
+// Returns false if the value is NaN, infinite or out of the int64_t range, where the cast would be undefined behavior
+//
+static bool WARN_UNUSED LuaLibTableTryConvertIndexToInt64(double val, int64_t& result /*out*/)
+{
+    // Written so that NaN fails the check
+    //
+    if (unlikely(!(val >= -9223372036854775808.0 && val < 9223372036854775808.0)))
+    {
+        return false;
+    }
+    result = static_cast<int64_t>(val);
+    return true;
+}
 
 // table.concat -- https://www.lua.org/manual/5.1/manual.html#pdf-table.concat
 //
@@ -71,7 +87,10 @@ DEEGEN_DEFINE_LIB_FUNC(table_concat)
         {
             ThrowError("bad argument #3 to 'concat' (number expected)");
         }
-        start = static_cast<int64_t>(val);
+        if (unlikely(!LuaLibTableTryConvertIndexToInt64(val, start /*out*/)))
+        {
+            ThrowError("bad argument #3 to 'concat' (number has no integer representation)");
+        }
     }
 
     int64_t end;
@@ -86,7 +105,10 @@ DEEGEN_DEFINE_LIB_FUNC(table_concat)
         {
             ThrowError("bad argument #4 to 'concat' (number expected)");
         }
-        end = static_cast<int64_t>(val);
+        if (unlikely(!LuaLibTableTryConvertIndexToInt64(val, end /*out*/)))
+        {
+            ThrowError("bad argument #4 to 'concat' (number has no integer representation)");
+        }
     }
 
     if (start > end)
@@ -257,6 +279,44 @@ DEEGEN_DEFINE_LIB_FUNC(table_concat)
     Return(TValue::Create<tString>(result));
 }
 
+// Raw get of an integer index, used by the generic paths of table.insert and table.remove
+// A put may change the array type of the table, so the IC info has to be prepared for every get
+//
+static TValue LuaLibTableRawGetByIntegerIndex(HeapPtr<TableObject> tab, int64_t idx)
+{
+    GetByIntegerIndexICInfo info;
+    TableObject::PrepareGetByIntegerIndex(tab, info /*out*/);
+    return TableObject::GetByIntegerIndex(tab, idx, info);
+}
+
+// Whether 'value' can be stored into a continuous array part of type 'arrType' without changing its array kind,
+// in which case the array is still continuous after the elements are shifted by a memmove and 'value' is stored
+//
+static bool WARN_UNUSED LuaLibTableValueFitsInContinuousArray(ArrayType arrType, TValue value)
+{
+    assert(arrType.IsContinuous());
+    switch (arrType.ArrayKind())
+    {
+    case ArrayType::Kind::Int32:
+    {
+        return value.Is<tInt32>();
+    }
+    case ArrayType::Kind::Double:
+    {
+        return value.Is<tDouble>();
+    }
+    case ArrayType::Kind::Any:
+    {
+        return !value.Is<tNil>();
+    }
+    case ArrayType::Kind::NoButterflyArrayPart:
+    {
+        assert(false);
+        __builtin_unreachable();
+    }
+    }   /*switch*/
+}
+
 // table.insert -- https://www.lua.org/manual/5.1/manual.html#pdf-table.insert
 //
 // table.insert (table, [pos,] value)
@@ -264,9 +324,94 @@ DEEGEN_DEFINE_LIB_FUNC(table_concat)
 // The default value for pos is n+1, where n is the length of the table (see §2.5.5), so that a call table.insert(t,x)
 // inserts x at the end of table t.
 //
+// Same as PUC Lua, all the reads and writes are raw, so the metatable of the table is irrelevant.
+//
 DEEGEN_DEFINE_LIB_FUNC(table_insert)
 {
-    ThrowError("Library function 'table.insert' is not implemented yet!");
+    size_t numArgs = GetNumArgs();
+    if (unlikely(numArgs == 0))
+    {
+        ThrowError("bad argument #1 to 'insert' (table expected, got no value)");
+    }
+    if (unlikely(!GetArg(0).Is<tTable>()))
+    {
+        ThrowError("bad argument #1 to 'insert' (table expected)");
+    }
+    HeapPtr<TableObject> tab = GetArg(0).As<tTable>();
+
+    int64_t end = static_cast<int64_t>(TableObject::GetTableLengthWithLuaSemantics(tab)) + 1;
+    if (numArgs == 2)
+    {
+        // Append to the end, which is just a put
+        //
+        TableObject::RawPutByValIntegerIndex(tab, end, GetArg(1));
+        Return();
+    }
+
+    if (unlikely(numArgs != 3))
+    {
+        ThrowError("wrong number of arguments to 'insert'");
+    }
+
+    int64_t pos;
+    {
+        auto [success, val] = LuaLib_ToNumber(GetArg(1));
+        if (unlikely(!success))
+        {
+            ThrowError("bad argument #2 to 'insert' (number expected)");
+        }
+        if (unlikely(!LuaLibTableTryConvertIndexToInt64(val, pos /*out*/)))
+        {
+            ThrowError("bad argument #2 to 'insert' (number has no integer representation)");
+        }
+    }
+    TValue value = GetArg(2);
+
+    // Fast path: the array is continuous and the insert position is within the array,
+    // so we can open the space with one memmove
+    //
+    ArrayType arrType = TCGet(tab->m_arrayType);
+    if (arrType.IsContinuous() && 1 <= pos && pos < end && LuaLibTableValueFitsInContinuousArray(arrType, value))
+    {
+        int64_t len = end - 1;
+        assert(tab->m_butterfly->GetHeader()->m_arrayLengthIfContinuous == len);
+
+        // Append a copy of the last element first, which grows the vector storage following ArrayGrowthPolicy if needed
+        //
+        TableObject::RawPutByValIntegerIndex(tab, end, *tab->m_butterfly->UnsafeGetInVectorIndexAddr(len));
+
+        // The append only fails to keep the array continuous if the index is too large for the vector storage
+        // (and goes to the sparse map). In that case the generic path below will finish the job.
+        //
+        if (likely(TCGet(tab->m_arrayType).IsContinuous()))
+        {
+            Butterfly* butterfly = tab->m_butterfly;
+            assert(butterfly->GetHeader()->m_arrayLengthIfContinuous == end);
+            assert(TCGet(tab->m_arrayType).m_asValue == arrType.m_asValue);
+            TValue* addr = butterfly->UnsafeGetInVectorIndexAddr(pos);
+            memmove(addr + 1, addr, sizeof(TValue) * static_cast<size_t>(len - pos));
+            *addr = value;
+
+            // The elements have been moved around in the array part, so the concurrent marker may have missed some of them
+            //
+            if (!arrType.ArrayPartHasNoReference())
+            {
+                WriteBarrier(tab);
+            }
+            Return();
+        }
+    }
+
+    if (pos > end)
+    {
+        end = pos;
+    }
+    for (int64_t i = end; i > pos; i--)
+    {
+        TableObject::RawPutByValIntegerIndex(tab, i, LuaLibTableRawGetByIntegerIndex(tab, i - 1));
+    }
+    TableObject::RawPutByValIntegerIndex(tab, pos, value);
+    Return();
 }
 
 // table.maxn -- https://www.lua.org/manual/5.1/manual.html#pdf-table.maxn
@@ -275,9 +420,61 @@ DEEGEN_DEFINE_LIB_FUNC(table_insert)
 // Returns the largest positive numerical index of the given table, or zero if the table has no positive numerical indices.
 // (To do its job this function does a linear traversal of the whole table.)
 //
+// All numeric keys live in the array part, so only the vector storage and the sparse map need to be inspected.
+//
 DEEGEN_DEFINE_LIB_FUNC(table_maxn)
 {
-    ThrowError("Library function 'table.maxn' is not implemented yet!");
+    if (unlikely(GetNumArgs() == 0))
+    {
+        ThrowError("bad argument #1 to 'maxn' (table expected, got no value)");
+    }
+    if (unlikely(!GetArg(0).Is<tTable>()))
+    {
+        ThrowError("bad argument #1 to 'maxn' (table expected)");
+    }
+    HeapPtr<TableObject> tab = GetArg(0).As<tTable>();
+
+    ArrayType arrType = TCGet(tab->m_arrayType);
+    if (arrType.ArrayKind() == ArrayType::Kind::NoButterflyArrayPart)
+    {
+        Return(TValue::Create<tDouble>(0.0));
+    }
+
+    Butterfly* butterfly = tab->m_butterfly;
+    if (arrType.IsContinuous())
+    {
+        Return(TValue::Create<tDouble>(static_cast<double>(butterfly->GetHeader()->m_arrayLengthIfContinuous)));
+    }
+
+    double result = 0;
+    int64_t idx = static_cast<int64_t>(butterfly->GetHeader()->m_arrayStorageCapacity) + ArrayGrowthPolicy::x_arrayBaseOrd - 1;
+    while (idx >= ArrayGrowthPolicy::x_arrayBaseOrd)
+    {
+        if (!butterfly->UnsafeGetInVectorIndexAddr(idx)->Is<tNil>())
+        {
+            result = static_cast<double>(idx);
+            break;
+        }
+        idx--;
+    }
+
+    if (butterfly->GetHeader()->HasSparseMap())
+    {
+        VM* vm = VM::GetActiveVMForCurrentThread();
+        ArraySparseMap* sparseMap = TranslateToRawPointer(vm, butterfly->GetHeader()->GetSparseMap());
+        TValue* values = sparseMap->GetValues();
+        uint64_t* keys = sparseMap->GetKeys();
+        uint32_t capacity = sparseMap->GetCapacity();
+        for (uint32_t i = 0; i < capacity; i++)
+        {
+            if (!ArraySparseMap::IsEmptyKey(keys[i]) && !values[i].Is<tNil>())
+            {
+                result = std::max(result, ArraySparseMap::GetKeyFromBits(keys[i]));
+            }
+        }
+    }
+
+    Return(TValue::Create<tDouble>(result));
 }
 
 // table.remove -- https://www.lua.org/manual/5.1/manual.html#pdf-table.remove
@@ -287,9 +484,80 @@ DEEGEN_DEFINE_LIB_FUNC(table_maxn)
 // Returns the value of the removed element. The default value for pos is n, where n is the length of the table,
 // so that a call table.remove(t) removes the last element of table t.
 //
+// Same as PUC Lua, all the reads and writes are raw, so the metatable of the table is irrelevant.
+//
 DEEGEN_DEFINE_LIB_FUNC(table_remove)
 {
-    ThrowError("Library function 'table.remove' is not implemented yet!");
+    size_t numArgs = GetNumArgs();
+    if (unlikely(numArgs == 0))
+    {
+        ThrowError("bad argument #1 to 'remove' (table expected, got no value)");
+    }
+    if (unlikely(!GetArg(0).Is<tTable>()))
+    {
+        ThrowError("bad argument #1 to 'remove' (table expected)");
+    }
+    HeapPtr<TableObject> tab = GetArg(0).As<tTable>();
+
+    int64_t end = static_cast<int64_t>(TableObject::GetTableLengthWithLuaSemantics(tab));
+    int64_t pos;
+    if (numArgs < 2 || GetArg(1).Is<tNil>())
+    {
+        pos = end;
+    }
+    else
+    {
+        auto [success, val] = LuaLib_ToNumber(GetArg(1));
+        if (unlikely(!success))
+        {
+            ThrowError("bad argument #2 to 'remove' (number expected)");
+        }
+        if (unlikely(!LuaLibTableTryConvertIndexToInt64(val, pos /*out*/)))
+        {
+            ThrowError("bad argument #2 to 'remove' (number has no integer representation)");
+        }
+    }
+
+    if (!(1 <= pos && pos <= end))
+    {
+        // Nothing to remove
+        //
+        Return();
+    }
+
+    // Fast path: the array is continuous, so we can close the space with one memmove
+    //
+    ArrayType arrType = TCGet(tab->m_arrayType);
+    if (arrType.IsContinuous())
+    {
+        Butterfly* butterfly = tab->m_butterfly;
+        assert(butterfly->GetHeader()->m_arrayLengthIfContinuous == end);
+        TValue* addr = butterfly->UnsafeGetInVectorIndexAddr(pos);
+        TValue result = *addr;
+        memmove(addr, addr + 1, sizeof(TValue) * static_cast<size_t>(end - pos));
+
+        // Removing the last element of a continuous array keeps the array continuous and only changes its length,
+        // so the array type is unchanged (this is what the put slow path would do for the nil write)
+        //
+        *butterfly->UnsafeGetInVectorIndexAddr(end) = TValue::Create<tNil>();
+        butterfly->GetHeader()->m_arrayLengthIfContinuous = static_cast<int32_t>(end - 1);
+
+        // The elements have been moved around in the array part, so the concurrent marker may have missed some of them
+        //
+        if (!arrType.ArrayPartHasNoReference())
+        {
+            WriteBarrier(tab);
+        }
+        Return(result);
+    }
+
+    TValue result = LuaLibTableRawGetByIntegerIndex(tab, pos);
+    for (int64_t i = pos; i < end; i++)
+    {
+        TableObject::RawPutByValIntegerIndex(tab, i, LuaLibTableRawGetByIntegerIndex(tab, i + 1));
+    }
+    TableObject::RawPutByValIntegerIndex(tab, end, TValue::Create<tNil>());
+    Return(result);
 }
 
 // Check that the metatable for string has no __lt metamethod
@@ -322,7 +590,7 @@ static void LuaLibTableSortDoubleContinuousArrayNoMM(TValue* arr, size_t n)
     }
 #endif
     double* arrDbl = reinterpret_cast<double*>(arr);
-    std::sort(arrDbl + 1, arrDbl + n + 1);
+    SortDoubleArray(arrDbl + 1, n);
 }
 
 static void LuaLibTableSortDoubleNonContinuousArrayNoMM(HeapPtr<TableObject> tab, size_t n)
@@ -350,7 +618,7 @@ static void LuaLibTableSortDoubleNonContinuousArrayNoMM(HeapPtr<TableObject> tab
         }
     }
 
-    std::sort(ptr, ptr + n);
+    SortDoubleArray(ptr, n);
 
     for (uint32_t i = 1; i <= n; i++)
     {
@@ -380,7 +648,7 @@ static bool LuaLibTableSortStringComparator(TValue lhs, TValue rhs)
     return cmpRes < 0;
 }
 
-static void LuaLibTableSortStringContinuousArrayNoMM(TValue* arr, size_t n)
+static void LuaLibTableSortStringContinuousArrayNoMM(HeapPtr<TableObject> tab, TValue* arr, size_t n)
 {
 #ifndef NDEBUG
     for (size_t i = 1; i <= n; i++)
@@ -392,6 +660,10 @@ static void LuaLibTableSortStringContinuousArrayNoMM(TValue* arr, size_t n)
     // For string sorting, comparison is the expensive part.
     //
     std::stable_sort(arr + 1, arr + n + 1, LuaLibTableSortStringComparator);
+
+    // The strings have been moved around in the array part, so the concurrent marker may have missed some of them
+    //
+    WriteBarrier(tab);
 }
 
 static void LuaLibTableSortStringNonContinuousArrayNoMM(HeapPtr<TableObject> tab, size_t n)
@@ -450,7 +722,17 @@ struct QuickSortStateMachine
 
     // The pseudo-code of the quicksort we implement (in imperative style) is the following:
     //
+    // function median_of_three(A, lo, hi)
+    //     mid = (hi + lo) / 2
+    //     if A[mid] < A[lo]:
+    //         swap(A[lo], A[mid])
+    //     if A[hi] < A[mid]:
+    //         swap(A[mid], A[hi])
+    //         if A[mid] < A[lo]:
+    //             swap(A[lo], A[mid])
+    //
     // function partition(A, lo, hi)
+    //     median_of_three(A, lo, hi)
     //     pivot_ord = (hi + lo) / 2
     //     pivot = A[pivot_ord]
     //     i = lo
@@ -505,9 +787,13 @@ struct QuickSortStateMachine
     // Slot 5: j
     // Slot 6: 0 if executing the 'while A[i] < pivot' loop,
     //         1 if executing the 'while pivot < A[j]' loop,
-    //         2 if executing the insertion sort loop
+    //         2 if executing the insertion sort loop,
+    //         3, 4, 5 if executing the first, second and third comparison in median_of_three
     // Slot [7, 7 + 2 * h): the <lo, hi> of each item in 's'
     //
+    // Like pdqsort, the pivot is the median of the first, middle and last element, so the partitions stay balanced
+    // on the common patterns of real-world data (sorted, reverse sorted, organ pipe, etc.), where a fixed pivot may not.
+    //
     static constexpr int32_t x_limit_for_ins_sort = 8;
 
     static QuickSortStateMachine WARN_UNUSED Init(TValue* stackBase, HeapPtr<TableObject> tableObj, int32_t n)
@@ -517,17 +803,16 @@ struct QuickSortStateMachine
         TableObject::PrepareGetByIntegerIndex(tableObj, info /*out*/);
         if (n > x_limit_for_ins_sort)
         {
-            TValue pivot = TableObject::GetByIntegerIndex(tableObj, (1 + n) / 2, info);
             stackBase[7] = TValue::Create<tInt32>(1);
             stackBase[8] = TValue::Create<tInt32>(n);
             return QuickSortStateMachine {
                 .sb = stackBase,
                 .tab = tableObj,
-                .pivot = pivot,
+                .pivot = TValue::Create<tNil>(),
                 .h = 1,
                 .i = 1,
                 .j = n,
-                .state = 0,
+                .state = 3,
                 .info = info
             };
         }
@@ -565,7 +850,7 @@ struct QuickSortStateMachine
         assert(stackBase[2].Is<tInt32>() && stackBase[2].As<tInt32>() > 0);
         assert(stackBase[4].Is<tInt32>());
         assert(stackBase[5].Is<tInt32>());
-        assert(stackBase[6].Is<tInt32>() && 0 <= stackBase[6].As<tInt32>() && stackBase[6].As<tInt32>() <= 2);
+        assert(stackBase[6].Is<tInt32>() && 0 <= stackBase[6].As<tInt32>() && stackBase[6].As<tInt32>() <= 5);
         HeapPtr<TableObject> tableObj = stackBase[0].As<tTable>();
         GetByIntegerIndexICInfo info;
         TableObject::PrepareGetByIntegerIndex(tableObj, info /*out*/);
@@ -585,10 +870,10 @@ struct QuickSortStateMachine
     //
     Result WARN_UNUSED InitialAdvance()
     {
-        assert(state == 0 || state == 2);
-        if (state == 0)
+        assert(state == 3 || state == 2);
+        if (state == 3)
         {
-            return FirstLoopCompare();
+            return MedianOfThreeCompare();
         }
         else
         {
@@ -600,6 +885,10 @@ struct QuickSortStateMachine
     //
     Result WARN_UNUSED Advance(bool lessThanComparisonResult)
     {
+        if (state >= 3)
+        {
+            return MedianOfThreeStepFinished(lessThanComparisonResult);
+        }
         if (lessThanComparisonResult)
         {
             if (state == 0)
@@ -679,6 +968,73 @@ private:
         };
     }
 
+    Result MedianOfThreeCompare()
+    {
+        assert(3 <= state && state <= 5);
+        int32_t lo = sb[5 + 2 * h].As<tInt32>();
+        int32_t hi = sb[6 + 2 * h].As<tInt32>();
+        int32_t mid = (lo + hi) / 2;
+        if (state == 4)
+        {
+            return Result {
+                .finish = false,
+                .lhs = TableObject::GetByIntegerIndex(tab, hi, info),
+                .rhs = TableObject::GetByIntegerIndex(tab, mid, info)
+            };
+        }
+        return Result {
+            .finish = false,
+            .lhs = TableObject::GetByIntegerIndex(tab, mid, info),
+            .rhs = TableObject::GetByIntegerIndex(tab, lo, info)
+        };
+    }
+
+    Result MedianOfThreeStepFinished(bool lessThanComparisonResult)
+    {
+        assert(3 <= state && state <= 5);
+        int32_t lo = sb[5 + 2 * h].As<tInt32>();
+        int32_t hi = sb[6 + 2 * h].As<tInt32>();
+        int32_t mid = (lo + hi) / 2;
+        if (state == 3)
+        {
+            if (lessThanComparisonResult)
+            {
+                SwapIndex(lo, mid);
+            }
+            state = 4;
+            return MedianOfThreeCompare();
+        }
+        else if (state == 4)
+        {
+            if (!lessThanComparisonResult)
+            {
+                return StartPartitionLoop(lo, hi);
+            }
+            SwapIndex(mid, hi);
+            state = 5;
+            return MedianOfThreeCompare();
+        }
+        else
+        {
+            assert(state == 5);
+            if (lessThanComparisonResult)
+            {
+                SwapIndex(lo, mid);
+            }
+            return StartPartitionLoop(lo, hi);
+        }
+    }
+
+    Result StartPartitionLoop(int32_t lo, int32_t hi)
+    {
+        i = lo;
+        j = hi;
+        int32_t pivot_ord = (lo + hi) / 2;
+        pivot = TableObject::GetByIntegerIndex(tab, pivot_ord, info);
+        state = 0;
+        return FirstLoopCompare();
+    }
+
     Result FirstPartitionInnerLoopFinished()
     {
         assert(state == 0);
@@ -783,12 +1139,8 @@ private:
         assert(lo < hi);
         if (hi - lo + 1 > x_limit_for_ins_sort)
         {
-            i = lo;
-            j = hi;
-            int32_t pivot_ord = (lo + hi) / 2;
-            pivot = TableObject::GetByIntegerIndex(tab, pivot_ord, info);
-            state = 0;
-            return FirstLoopCompare();
+            state = 3;
+            return MedianOfThreeCompare();
         }
         else
         {
@@ -800,6 +1152,14 @@ private:
         }
     }
 
+    void SwapIndex(int32_t idx1, int32_t idx2)
+    {
+        TValue val1 = TableObject::GetByIntegerIndex(tab, idx1, info);
+        TValue val2 = TableObject::GetByIntegerIndex(tab, idx2, info);
+        PutIndex(idx1, val2);
+        PutIndex(idx2, val1);
+    }
+
     void PutIndex(int32_t idx, TValue val)
     {
         if (unlikely(!TableObject::TryPutByValIntegerIndexFastNoIC(tab, idx, val)))
@@ -1095,7 +1455,8 @@ no_usr_comparator:
         //
         // We implement fastpath for the good case: all values are double, or all values are string (and that
         // no exotic __lt metamethod exists for the double/string type)
-        // In these cases, we can be certain that no metamethod will be called, so we can simply use std::sort
+        // In these cases, we can be certain that no metamethod will be called, so we can simply use std::stable_sort for strings,
+        // and SortDoubleArray (a radix sort, multi-threaded for very large arrays) for doubles
         //
         GetByIntegerIndexICInfo info;
         TableObject::PrepareGetByIntegerIndex(tab, info /*out*/);
@@ -1141,7 +1502,7 @@ no_usr_comparator:
                         goto slowpath;
                     }
                 }
-                LuaLibTableSortStringContinuousArrayNoMM(arr, n);
+                LuaLibTableSortStringContinuousArrayNoMM(tab, arr, n);
                 Return();
             }
             else
@@ -168,11 +168,16 @@ DEEGEN_DEFINE_LIB_FUNC(DeegenInternal_ThrowTValueErrorImpl)
         //
         currentCoro->m_coroutineStatus.SetDead(true);
 
+        // The error object is all we need from the dead coroutine, so its stack can be recycled
+        //
+        currentCoro->ReleaseStack();
+
+        // Both cases below write a few values past the suspend point, so grow the parent's stack if needed.
         // Check if the parent coroutine resumed the current coroutine via coroutine.wrap or coroutine.resume
         // DEVNOTE: this is currently accomplished by a hack that repurposes 'm_numVariadicArguments' of the
         // suspension call frame as a matter of distinguishment. 0 means coroutine.resume and 1 mean coroutine.wrap
         //
-        TValue* dstStackBase = parentCoro->m_suspendPointStackBase;
+        TValue* dstStackBase = parentCoro->EnsureStackSpace(parentCoro->m_suspendPointStackBase, x_numSlotsForStackFrameHeader + x_minNilFillReturnValues /*numSlotsNeeded*/);
         StackFrameHeader* dstHdr = StackFrameHeader::Get(dstStackBase);
         if (dstHdr->m_numVariadicArguments == 0)
         {
@@ -180,8 +185,6 @@ DEEGEN_DEFINE_LIB_FUNC(DeegenInternal_ThrowTValueErrorImpl)
             // We should simply make coroutine.resume return 'false' plus the error object.
             // Note that we also need to pad nils to x_minNilFillReturnValues, as required by our internal call scheme.
             //
-            // TODO: we need to check for stack overflow here once we implement resizable stack
-            //
             dstStackBase[0] = TValue::Create<tBool>(false);
             dstStackBase[1] = errorObject;
             for (size_t i = 2; i < x_minNilFillReturnValues; i++)
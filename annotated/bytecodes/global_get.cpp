@@ -92,6 +92,23 @@ static void NO_RETURN GlobalGetImpl(TValue tvIndex)
         //
         TableObject::PrepareGetByIdForGlobalObject(base, UserHeapPointer<HeapString> { index }, c_info /*out*/);
         bool c_mayHaveMt = c_info.m_mayHaveMetatable;
+        if (c_info.m_icKind == GetByIdICInfo::ICKind::InlinedStorage || c_info.m_icKind == GetByIdICInfo::ICKind::OutlinedStorage)
+        {
+            // Most globals (library functions, module tables, etc) are never written after initialization,
+            // so burn the current value into the IC if it is safe to do so. This may relocate the hidden class of the global object.
+            //
+            TValue value = TableObject::GetById(base, index, c_info);
+            if (!value.Is<tNil>() && TableObject::TryWatchGlobalValueForConstantFolding(base, UserHeapPointer<HeapString> { index }))
+            {
+                uint64_t c_value = value.m_value;
+                return ic->Effect([c_value] {
+                    IcSpecifyCaptureValueRange(c_value, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max());
+                    // The value is not nil, so the metatable doesn't matter
+                    //
+                    return std::make_pair(TValue { c_value }, false /*mayHaveMt*/);
+                });
+            }
+        }
         if (c_info.m_icKind == GetByIdICInfo::ICKind::InlinedStorage)
         {
             int32_t c_slot = c_info.m_slot;
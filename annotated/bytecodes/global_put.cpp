@@ -141,6 +141,7 @@ static void NO_RETURN GlobalPutImpl(TValue tvIndex, TValue valueToPut)
 
     if (likely(!hasMetamethod))
     {
+        WriteBarrier(base);
         Return();
     }
 
@@ -4,18 +4,37 @@
 
 #include "runtime_utils.h"
 
-static void NO_RETURN TableGetByIdMetamethodCallContinuation(TValue /*base*/, TValue /*tvIndex*/)
+// Where the base object of the TableGetById comes from
+//
+// Besides the plain TableGetById (base in a bytecode slot), the parser fuses an upvalue load immediately followed by a
+// TableGetById on the loaded value (e.g., 'math.floor' where 'math' is an upvalue) into one bytecode, which saves one dispatch
+// and one stack slot store/load. Since the slow paths take the bytecode operands first, they are templated on this kind as well.
+//
+enum class TableGetByIdBaseKind
+{
+    BytecodeSlot,
+    MutableUpvalue,
+    ImmutableUpvalue
+};
+
+template<TableGetByIdBaseKind baseKind>
+using TableGetByIdBaseOperandTy = std::conditional_t<baseKind == TableGetByIdBaseKind::BytecodeSlot, TValue, uint16_t>;
+
+template<TableGetByIdBaseKind baseKind>
+static void NO_RETURN TableGetByIdMetamethodCallContinuation(TableGetByIdBaseOperandTy<baseKind> /*bc_base*/, TValue /*tvIndex*/)
 {
     Return(GetReturnValue(0));
 }
 
 // Forward declaration due to mutual recursion
 //
-static void NO_RETURN HandleMetatableSlowPath(TValue /*bc_base*/, TValue /*bc_tviIndex*/, TValue base, TValue metamethod);
+template<TableGetByIdBaseKind baseKind>
+static void NO_RETURN HandleMetatableSlowPath(TableGetByIdBaseOperandTy<baseKind> /*bc_base*/, TValue /*bc_tviIndex*/, TValue base, TValue metamethod);
 
 // At this point, we know that 'rawget(base, index)' is nil and 'base' might have a metatable
 //
-static void NO_RETURN CheckMetatableSlowPath(TValue /*bc_base*/, TValue /*bc_index*/, TValue base)
+template<TableGetByIdBaseKind baseKind>
+static void NO_RETURN CheckMetatableSlowPath(TableGetByIdBaseOperandTy<baseKind> /*bc_base*/, TValue /*bc_index*/, TValue base)
 {
     assert(base.Is<tTable>());
     TableObject::GetMetatableResult gmr = TableObject::GetMetatable(base.As<tTable>());
@@ -27,7 +46,7 @@ static void NO_RETURN CheckMetatableSlowPath(TValue /*bc_base*/, TValue /*bc_ind
             TValue metamethod = GetMetamethodFromMetatable(metatable, LuaMetamethodKind::Index);
             if (!metamethod.Is<tNil>())
             {
-                EnterSlowPath<HandleMetatableSlowPath>(base, metamethod);
+                EnterSlowPath<HandleMetatableSlowPath<baseKind>>(base, metamethod);
             }
         }
     }
@@ -36,7 +55,8 @@ static void NO_RETURN CheckMetatableSlowPath(TValue /*bc_base*/, TValue /*bc_ind
 
 // At this point, we know that 'base' is not a table
 //
-static void NO_RETURN HandleNotTableObjectSlowPath(TValue /*bc_base*/, TValue /*bc_tvIndex*/, TValue base)
+template<TableGetByIdBaseKind baseKind>
+static void NO_RETURN HandleNotTableObjectSlowPath(TableGetByIdBaseOperandTy<baseKind> /*bc_base*/, TValue /*bc_tvIndex*/, TValue base)
 {
     assert(!base.Is<tTable>());
     TValue metamethod = GetMetamethodForValue(base, LuaMetamethodKind::Index);
@@ -44,18 +64,19 @@ static void NO_RETURN HandleNotTableObjectSlowPath(TValue /*bc_base*/, TValue /*
     {
         ThrowError("bad type for TableGetById");
     }
-    EnterSlowPath<HandleMetatableSlowPath>(base, metamethod);
+    EnterSlowPath<HandleMetatableSlowPath<baseKind>>(base, metamethod);
 }
 
 // At this point, we know that 'rawget(base, index)' is nil, and 'base' has a non-nil metamethod which we shall use
 //
-static void NO_RETURN HandleMetatableSlowPath(TValue /*bc_base*/, TValue tvIndex, TValue base, TValue metamethod)
+template<TableGetByIdBaseKind baseKind>
+static void NO_RETURN HandleMetatableSlowPath(TableGetByIdBaseOperandTy<baseKind> /*bc_base*/, TValue tvIndex, TValue base, TValue metamethod)
 {
     // If 'metamethod' is a function, we should invoke the metamethod
     //
     if (likely(metamethod.Is<tFunction>()))
     {
-        MakeCall(metamethod.As<tFunction>(), base, tvIndex, TableGetByIdMetamethodCallContinuation);
+        MakeCall(metamethod.As<tFunction>(), base, tvIndex, TableGetByIdMetamethodCallContinuation<baseKind>);
     }
 
     // Otherwise, we should repeat operation on 'metamethod' (i.e., recurse on metamethod[index])
@@ -64,7 +85,7 @@ static void NO_RETURN HandleMetatableSlowPath(TValue /*bc_base*/, TValue tvIndex
 
     if (unlikely(!base.Is<tTable>()))
     {
-        EnterSlowPath<HandleNotTableObjectSlowPath>(base);
+        EnterSlowPath<HandleNotTableObjectSlowPath<baseKind>>(base);
     }
 
     assert(tvIndex.Is<tString>());
@@ -76,7 +97,7 @@ static void NO_RETURN HandleMetatableSlowPath(TValue /*bc_base*/, TValue tvIndex
     TValue result = TableObject::GetById(tableObj, index, icInfo);
     if (unlikely(icInfo.m_mayHaveMetatable && result.Is<tNil>()))
     {
-        EnterSlowPath<CheckMetatableSlowPath>(base);
+        EnterSlowPath<CheckMetatableSlowPath<baseKind>>(base);
     }
     Return(result);
 }
@@ -88,8 +109,29 @@ enum class TableGetByIdIcResultKind
     NoMetatable         // The base object is a table that is guaranteed to have no metatable
 };
 
-static void NO_RETURN TableGetByIdImpl(TValue base, TValue tvIndex)
+template<TableGetByIdBaseKind baseKind>
+static TValue WARN_UNUSED ALWAYS_INLINE GetTableGetByIdBase(TableGetByIdBaseOperandTy<baseKind> bcBase)
+{
+    if constexpr(baseKind == TableGetByIdBaseKind::BytecodeSlot)
+    {
+        return bcBase;
+    }
+    else if constexpr(baseKind == TableGetByIdBaseKind::MutableUpvalue)
+    {
+        return UpvalueAccessor::GetMutable(bcBase);
+    }
+    else
+    {
+        static_assert(baseKind == TableGetByIdBaseKind::ImmutableUpvalue);
+        return UpvalueAccessor::GetImmutable(bcBase);
+    }
+}
+
+template<TableGetByIdBaseKind baseKind>
+static void NO_RETURN TableGetByIdImpl(TableGetByIdBaseOperandTy<baseKind> bcBase, TValue tvIndex)
 {
+    TValue base = GetTableGetByIdBase<baseKind>(bcBase);
+
     assert(tvIndex.Is<tString>());
     HeapPtr<HeapString> index = tvIndex.As<tString>();
 
@@ -120,8 +162,9 @@ static void NO_RETURN TableGetByIdImpl(TValue base, TValue tvIndex)
             {
             case GetByIdICInfo::ICKind::UncachableDictionary:
             {
-                assert(false && "unimplemented");
-                __builtin_unreachable();
+                // The slot ordinals of an UncacheableDictionary may change, so the result must not be cached
+                //
+                return std::make_pair(TableObject::GetById(heapEntity, UserHeapPointer<void> { index }, c_info), c_resKind);
             }
             case GetByIdICInfo::ICKind::MustBeNil:
             {
@@ -165,7 +208,7 @@ static void NO_RETURN TableGetByIdImpl(TValue base, TValue tvIndex)
         }
         case ResKind::NotTable: [[unlikely]]
         {
-            EnterSlowPath<HandleNotTableObjectSlowPath>(base);
+            EnterSlowPath<HandleNotTableObjectSlowPath<baseKind>>(base);
         }
         case ResKind::MayHaveMetatable:
         {
@@ -173,13 +216,13 @@ static void NO_RETURN TableGetByIdImpl(TValue base, TValue tvIndex)
             {
                 Return(result);
             }
-            EnterSlowPath<CheckMetatableSlowPath>(base);
+            EnterSlowPath<CheckMetatableSlowPath<baseKind>>(base);
         }
         }   /* switch resultKind*/
     }
     else
     {
-        EnterSlowPath<HandleNotTableObjectSlowPath>(base);
+        EnterSlowPath<HandleNotTableObjectSlowPath<baseKind>>(base);
     }
 }
 
@@ -190,10 +233,32 @@ DEEGEN_DEFINE_BYTECODE(TableGetById)
         Constant("index")
     );
     Result(BytecodeValue);
-    Implementation(TableGetByIdImpl);
+    Implementation(TableGetByIdImpl<TableGetByIdBaseKind::BytecodeSlot>);
     Variant(
         Op("index").IsConstant<tString>()
     );
 }
 
+// The fusion of UpvalueGet{Mutable,Immutable} and a TableGetById whose base and output are both the output of the UpvalueGet
+//
+DEEGEN_DEFINE_BYTECODE_TEMPLATE(UpvalueGetThenTableGetByIdOperation, bool isImmutable)
+{
+    Operands(
+        Literal<uint16_t>("ord"),
+        Constant("index")
+    );
+    Result(BytecodeValue);
+    Implementation(TableGetByIdImpl<isImmutable ? TableGetByIdBaseKind::ImmutableUpvalue : TableGetByIdBaseKind::MutableUpvalue>);
+    Variant(
+        Op("index").IsConstant<tString>()
+    );
+}
+
+DEEGEN_DEFINE_BYTECODE_BY_TEMPLATE_INSTANTIATION(UpvalueGetMutableThenTableGetById, UpvalueGetThenTableGetByIdOperation, false /*isImmutable*/);
+DEEGEN_DEFINE_BYTECODE_BY_TEMPLATE_INSTANTIATION(UpvalueGetImmutableThenTableGetById, UpvalueGetThenTableGetByIdOperation, true /*isImmutable*/);
+
+// Parser needs to late-replace between the two bytecodes, same as UpvalueGetMutable and UpvalueGetImmutable
+//
+DEEGEN_ADD_BYTECODE_SAME_LENGTH_CONSTRAINT(UpvalueGetMutableThenTableGetById, UpvalueGetImmutableThenTableGetById);
+
 DEEGEN_END_BYTECODE_DEFINITIONS
@@ -137,10 +137,8 @@ static void NO_RETURN TablePutByIdImpl(TValue base, TValue tvIndex, TValue value
 
             if (unlikely(!c_info.m_isInlineCacheable))
             {
-                // Currently since we don't have UncacheableDictionary, the only case for this is TransitionedToDictionaryMode
+                // Either the table transitions to dictionary mode, or the hidden class is (or has just become) an UncacheableDictionary
                 //
-                assert(c_icKind == PutByIdICInfo::ICKind::TransitionedToDictionaryMode);
-                assert(!c_info.m_propertyExists);
                 if (unlikely(TableObject::PutByIdNeedToCheckMetatable(tableObj, c_info)))
                 {
                     TValue mm = GetNewIndexMetamethodFromTableObject(tableObj);
@@ -149,7 +147,18 @@ static void NO_RETURN TablePutByIdImpl(TValue base, TValue tvIndex, TValue value
                         return std::make_pair(mm, ResKind::HandleMetamethod);
                     }
                 }
-                TableObject::PutByIdTransitionToDictionary(tableObj, index, valueToPut);
+                if (c_icKind == PutByIdICInfo::ICKind::TransitionedToDictionaryMode)
+                {
+                    assert(!c_info.m_propertyExists);
+                    TableObject::PutByIdTransitionToDictionary(tableObj, index, valueToPut);
+                }
+                else
+                {
+                    // The property has been inserted by PreparePutById, so we only need to store the value
+                    //
+                    assert(c_info.m_propertyExists);
+                    PutByIdICHelper::StoreValueIntoTableObject(tableObj, c_icKind, c_slot, valueToPut);
+                }
                 return std::make_pair(TValue(), ResKind::NoMetamethod);
             }
 
@@ -279,6 +288,9 @@ static void NO_RETURN TablePutByIdImpl(TValue base, TValue tvIndex, TValue value
         {
         case ResKind::NoMetamethod: [[likely]]
         {
+            // The write barrier is executed outside the inline cache so that the IC effects stay as simple as possible
+            //
+            WriteBarrier(tableObj);
             Return();
         }
         case ResKind::NotTable: [[unlikely]]
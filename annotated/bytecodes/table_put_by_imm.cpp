@@ -117,9 +117,17 @@ enum class TablePutByImmIcResultKind
     NotTable,           // The base object is not a table
     HandleMetamethod,   // The base object is a table that has the __newindex metamethod, and the metamethod should be called
     NoMetamethod,       // The TablePutByImm has been executed fully
+    NoMetamethodNoWriteBarrier,     // The TablePutByImm has been executed fully, and the value put is not a reference, so no write barrier is needed
     SlowPathPut         // No metamethod needed, but fast path put failed. A slow path put is needed.
 };
 
+// For an Int32 or Double array, the value check guarantees that the value put is not a reference to a heap object
+//
+static constexpr TablePutByImmIcResultKind GetNoMetamethodResultKind(PutByIntegerIndexICInfo::ValueCheckKind valueCheckKind)
+{
+    return PutByIntegerIndexICInfo::ValueCheckImpliesNoReference(valueCheckKind) ? TablePutByImmIcResultKind::NoMetamethodNoWriteBarrier : TablePutByImmIcResultKind::NoMetamethod;
+}
+
 static void NO_RETURN TablePutByImmImpl(TValue base, int16_t index, TValue valueToPut)
 {
     if (likely(base.Is<tHeapEntity>()))
@@ -157,7 +165,7 @@ static void NO_RETURN TablePutByImmImpl(TValue base, int16_t index, TValue value
                         {
                             if (likely(TableObject::TryPutByIntegerIndexFastPath_ContinuousArray(tableObj, index, valueToPut)))
                             {
-                                return std::make_pair(TValue(), ResKind::NoMetamethod);
+                                return std::make_pair(TValue(), GetNoMetamethodResultKind(c_valueCK));
                             }
                         }
                         return std::make_pair(TValue(), ResKind::SlowPathPut);
@@ -173,7 +181,7 @@ static void NO_RETURN TablePutByImmImpl(TValue base, int16_t index, TValue value
                         {
                             if (likely(TableObject::TryPutByIntegerIndexFastPath_InBoundPut(tableObj, index, valueToPut)))
                             {
-                                return std::make_pair(TValue(), ResKind::NoMetamethod);
+                                return std::make_pair(TValue(), GetNoMetamethodResultKind(c_valueCK));
                             }
                         }
                         return std::make_pair(TValue(), ResKind::SlowPathPut);
@@ -208,7 +216,7 @@ static void NO_RETURN TablePutByImmImpl(TValue base, int16_t index, TValue value
                                         butterfly->GetHeader()->m_arrayLengthIfContinuous = 1;
                                         TCSet(tableObj->m_arrayType, c_newArrayType);
                                         TCSet(tableObj->m_hiddenClass, c_newHiddenClass);
-                                        return std::make_pair(TValue(), ResKind::NoMetamethod);
+                                        return std::make_pair(TValue(), GetNoMetamethodResultKind(c_valueCK));
                                     }
                                 }
                             }
@@ -371,6 +379,13 @@ static void NO_RETURN TablePutByImmImpl(TValue base, int16_t index, TValue value
         switch (resKind)
         {
         case ResKind::NoMetamethod: [[likely]]
+        {
+            // The write barrier is executed outside the inline cache so that the IC effects stay as simple as possible
+            //
+            WriteBarrier(tableObj);
+            Return();
+        }
+        case ResKind::NoMetamethodNoWriteBarrier: [[likely]]
         {
             Return();
         }
@@ -344,9 +344,17 @@ enum class TablePutByValIcResultKind
     NotTable,           // The base object is not a table
     HandleMetamethod,   // The base object is a table that has the __newindex metamethod, and the metamethod should be called
     NoMetamethod,       // The TablePutByVal has been executed fully
+    NoMetamethodNoWriteBarrier,     // The TablePutByVal has been executed fully, and the value put is not a reference, so no write barrier is needed
     SlowPathPut         // No metamethod needed, but fast path put failed. A slow path put is needed.
 };
 
+// For an Int32 or Double array, the value check guarantees that the value put is not a reference to a heap object
+//
+static constexpr TablePutByValIcResultKind GetNoMetamethodResultKind(PutByIntegerIndexICInfo::ValueCheckKind valueCheckKind)
+{
+    return PutByIntegerIndexICInfo::ValueCheckImpliesNoReference(valueCheckKind) ? TablePutByValIcResultKind::NoMetamethodNoWriteBarrier : TablePutByValIcResultKind::NoMetamethod;
+}
+
 static void NO_RETURN TablePutByValImpl(TValue base, TValue tvIndex, TValue valueToPut)
 {
     double idxDbl = tvIndex.ViewAsDouble();
@@ -392,7 +400,7 @@ static void NO_RETURN TablePutByValImpl(TValue base, TValue tvIndex, TValue valu
                             {
                                 if (likely(TableObject::TryPutByIntegerIndexFastPath_ContinuousArray(tableObj, index, valueToPut)))
                                 {
-                                    return std::make_pair(TValue(), ResKind::NoMetamethod);
+                                    return std::make_pair(TValue(), GetNoMetamethodResultKind(c_valueCK));
                                 }
                             }
                             return std::make_pair(TValue(), ResKind::SlowPathPut);
@@ -408,7 +416,7 @@ static void NO_RETURN TablePutByValImpl(TValue base, TValue tvIndex, TValue valu
                             {
                                 if (likely(TableObject::TryPutByIntegerIndexFastPath_InBoundPut(tableObj, index, valueToPut)))
                                 {
-                                    return std::make_pair(TValue(), ResKind::NoMetamethod);
+                                    return std::make_pair(TValue(), GetNoMetamethodResultKind(c_valueCK));
                                 }
                             }
                             return std::make_pair(TValue(), ResKind::SlowPathPut);
@@ -438,7 +446,7 @@ static void NO_RETURN TablePutByValImpl(TValue base, TValue tvIndex, TValue valu
                                             butterfly->GetHeader()->m_arrayLengthIfContinuous = 1;
                                             TCSet(tableObj->m_arrayType, c_newArrayType);
                                             TCSet(tableObj->m_hiddenClass, c_newHiddenClass);
-                                            return std::make_pair(TValue(), ResKind::NoMetamethod);
+                                            return std::make_pair(TValue(), GetNoMetamethodResultKind(c_valueCK));
                                         }
                                     }
                                 }
@@ -595,6 +603,13 @@ static void NO_RETURN TablePutByValImpl(TValue base, TValue tvIndex, TValue valu
             switch (resKind)
             {
             case ResKind::NoMetamethod: [[likely]]
+            {
+                // The write barrier is executed outside the inline cache so that the IC effects stay as simple as possible
+                //
+                WriteBarrier(tableObj);
+                Return();
+            }
+            case ResKind::NoMetamethodNoWriteBarrier: [[likely]]
             {
                 Return();
             }
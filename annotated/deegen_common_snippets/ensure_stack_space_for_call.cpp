@@ -0,0 +1,19 @@
+#include "force_release_build.h"
+
+#include "define_deegen_common_snippet.h"
+#include "runtime_utils.h"
+
+// Make sure the stack can hold the stack frame of the callee, growing the stack if needed.
+// Returns the possibly relocated 'paramStart'.
+//
+// This is checked before the stack frame fixup, so conservatively assume that the callee is variadic and
+// all the arguments are moved into the variadic argument area.
+//
+static uint64_t* DeegenSnippet_EnsureStackSpaceForCall(CoroutineRuntimeContext* coroCtx, uint64_t* paramStart, uint64_t numProvidedParams, CodeBlock* calleeCb)
+{
+    size_t numSlotsNeeded = numProvidedParams + x_numSlotsForStackFrameHeader + calleeCb->m_stackFrameNumSlots;
+    TValue* stackBase = reinterpret_cast<TValue*>(paramStart);
+    return reinterpret_cast<uint64_t*>(coroCtx->EnsureStackSpace(stackBase, numSlotsNeeded));
+}
+
+DEFINE_DEEGEN_COMMON_SNIPPET("EnsureStackSpaceForCall", DeegenSnippet_EnsureStackSpaceForCall)
@@ -0,0 +1,24 @@
+#include "force_release_build.h"
+
+#include "define_deegen_common_snippet.h"
+#include "runtime_utils.h"
+
+// Same as GetCalleeEntryPoint, but also records the call target into the profile of the JIT call IC site,
+// for sites that cannot create more IC entries. The profile is only recorded here, the dispatch is unchanged (see JitCallMegamorphicProfile).
+// Only used if x_enable_jit_call_megamorphic_profiling, but always defined since every snippet file must define a snippet.
+//
+static std::pair<HeapPtr<ExecutableCode>, void*> DeegenSnippet_GetCalleeEntryPointForMegamorphicJitCallIcSite(JitCallInlineCacheSite* site, uint64_t target)
+{
+    HeapPtr<FunctionObject> o = reinterpret_cast<HeapPtr<FunctionObject>>(target);
+    SystemHeapPointer<ExecutableCode> ecPtr = TCGet(o->m_executable);
+#ifdef ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
+    site->RecordMegamorphicCallTarget(ecPtr);
+#else
+    std::ignore = site;
+#endif
+    HeapPtr<ExecutableCode> ec = ecPtr.As();
+    void* entrypoint = ec->m_bestEntryPoint;
+    return std::make_pair(ec, entrypoint);
+}
+
+DEFINE_DEEGEN_COMMON_SNIPPET("GetCalleeEntryPointForMegamorphicJitCallIcSite", DeegenSnippet_GetCalleeEntryPointForMegamorphicJitCallIcSite)
@@ -0,0 +1,32 @@
+#include "force_release_build.h"
+
+#include "define_deegen_common_snippet.h"
+#include "runtime_utils.h"
+
+// Used by the interpreter call IC when the call site always passes 'numArgs' arguments.
+// Returns the exact-arity interpreter entry if it is applicable to the callee, otherwise returns 'entryPoint' unchanged.
+//
+static void* DeegenSnippet_GetCalleeExactArityEntryPoint(HeapPtr<ExecutableCode> ec, void* entryPoint, uint64_t numArgs)
+{
+    uint32_t numFixedParams = ec->m_numFixedArguments;
+    if (numFixedParams > x_interpreterMaxSpecializedNumFixedParams)
+    {
+        return entryPoint;
+    }
+    bool takesVarArgs = ec->m_hasVariadicArguments;
+    if (takesVarArgs ? (numArgs != numFixedParams) : (numArgs < numFixedParams))
+    {
+        return entryPoint;
+    }
+    // The callee may be a C function, or may have tiered up. Only swap in the exact-arity entry if the callee
+    // is currently using the corresponding specialized interpreter entry.
+    //
+    auto& entryPair = deegen_interpreter_exact_arity_entry_table[takesVarArgs][numFixedParams];
+    if (entryPoint != reinterpret_cast<void*>(entryPair[0]))
+    {
+        return entryPoint;
+    }
+    return reinterpret_cast<void*>(entryPair[1]);
+}
+
+DEFINE_DEEGEN_COMMON_SNIPPET("GetCalleeExactArityEntryPoint", DeegenSnippet_GetCalleeExactArityEntryPoint)
@@ -10,6 +10,9 @@ static void DeegenSnippet_PutUpvalue(uint64_t* stackBase, size_t upvalueOrd, TVa
     HeapPtr<Upvalue> uv = FunctionObject::GetMutableUpvaluePtr(hdr->m_func, upvalueOrd);
     TValue* ptr = uv->m_ptr;
     *ptr = valueToPut;
+    // If the upvalue is closed, the value is stored in the Upvalue object itself
+    //
+    WriteBarrier(uv);
 }
 
 DEFINE_DEEGEN_COMMON_SNIPPET("PutUpvalue", DeegenSnippet_PutUpvalue)
@@ -0,0 +1,12 @@
+#include "force_release_build.h"
+
+#include "define_deegen_common_snippet.h"
+#include "runtime_utils.h"
+#include "interpreter_opcode_profiler.h"
+
+static void DeegenSnippet_RecordInterpreterQuickeningSlowPathForProfiling(uint8_t* curBytecode)
+{
+    InterpreterOpcodeProfiler::RecordQuickeningSlowPath(UnalignedLoad<uint16_t>(curBytecode));
+}
+
+DEFINE_DEEGEN_COMMON_SNIPPET("RecordInterpreterQuickeningSlowPathForProfiling", DeegenSnippet_RecordInterpreterQuickeningSlowPathForProfiling)
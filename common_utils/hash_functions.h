@@ -78,4 +78,39 @@ StringLengthAndHash WARN_UNUSED HashMultiPieceString(Iterator iterator)
     };
 }
 
+// Hash a string piece by piece
+//
+// Unlike HashMultiPieceString, the hasher may be kept around after computing the hash: hashing a string that extends an
+// already-hashed string then only needs to feed in the extension.
+//
+struct IncrementalStringHasher
+{
+    void Reset()
+    {
+        [[maybe_unused]] XXH_errorcode err = XXH3_64bits_reset(&m_state);
+        assert(err == XXH_OK);
+        m_length = 0;
+    }
+
+    void Update(const void* str, size_t len)
+    {
+        [[maybe_unused]] XXH_errorcode err = XXH3_64bits_update(&m_state, str, len);
+        assert(err == XXH_OK);
+        m_length += len;
+    }
+
+    // Does not change the state, more pieces may still be appended after this
+    //
+    StringLengthAndHash WARN_UNUSED Digest() const
+    {
+        return StringLengthAndHash {
+            .m_length = m_length,
+            .m_hashValue = XXH3_64bits_digest(&m_state)
+        };
+    }
+
+    XXH3_state_t m_state;
+    size_t m_length;
+};
+
 #pragma clang diagnostic pop
@@ -802,6 +802,38 @@ std::pair<llvm::Value* /*newSfBase*/, llvm::Value* /*totalNumArgs*/> WARN_UNUSED
     return std::make_pair(newSfBase, totalNumArgs);
 }
 
+llvm::ConstantInt* WARN_UNUSED AstMakeCall::GetNumArgsIfConstant()
+{
+    using namespace llvm;
+    LLVMContext& ctx = m_origin->getContext();
+
+    // The number of variadic results is only known at runtime
+    //
+    if (m_passVariadicRes)
+    {
+        return nullptr;
+    }
+
+    uint64_t numArgs = 0;
+    for (Arg& arg : m_args)
+    {
+        if (arg.IsArgRange())
+        {
+            ConstantInt* argNum = dyn_cast<ConstantInt>(arg.GetArgNum());
+            if (argNum == nullptr)
+            {
+                return nullptr;
+            }
+            numArgs += argNum->getZExtValue();
+        }
+        else
+        {
+            numArgs++;
+        }
+    }
+    return CreateLLVMConstantInt<uint64_t>(ctx, numArgs);
+}
+
 void AstMakeCall::DoLoweringForInterpreter(InterpreterBytecodeImplCreator* ifi)
 {
     using namespace llvm;
@@ -818,7 +850,7 @@ void AstMakeCall::DoLoweringForInterpreter(InterpreterBytecodeImplCreator* ifi)
     //
     Value* calleeCbHeapPtr = nullptr;
     Value* codePointer = nullptr;
-    DeegenCallIcLogicCreator::EmitForInterpreter(ifi, m_target, calleeCbHeapPtr /*out*/, codePointer /*out*/, m_origin /*insertBefore*/);
+    DeegenCallIcLogicCreator::EmitForInterpreter(ifi, m_target, GetNumArgsIfConstant(), calleeCbHeapPtr /*out*/, codePointer /*out*/, m_origin /*insertBefore*/);
     ReleaseAssert(calleeCbHeapPtr != nullptr);
     ReleaseAssert(codePointer != nullptr);
 
@@ -121,6 +121,10 @@ private:
 
     llvm::Function* WARN_UNUSED GetContinuationDispatchTarget();
 
+    // Returns the total number of arguments passed to the callee if it is a constant, nullptr otherwise
+    //
+    llvm::ConstantInt* WARN_UNUSED GetNumArgsIfConstant();
+
     static AstMakeCall WARN_UNUSED ParseFromApiUse(llvm::CallInst* callInst);
 
     static constexpr const char* x_placeholderPrefix = "__DeegenInternal_AstMakeCallIdentificationFunc_";
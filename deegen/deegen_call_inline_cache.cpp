@@ -33,6 +33,7 @@ void DeegenCallIcLogicCreator::EmitGenericGetCallTargetLogic(DeegenBytecodeImplC
 
 static void EmitInterpreterCallIcCacheMissPopulateIcSlowPath(InterpreterBytecodeImplCreator* ifi,
                                                              llvm::Value* functionObject,
+                                                             llvm::ConstantInt* constantNumArgs,
                                                              llvm::Value*& calleeCbHeapPtr /*out*/,
                                                              llvm::Value*& codePointer /*out*/,
                                                              llvm::Instruction* insertBefore)
@@ -44,6 +45,16 @@ static void EmitInterpreterCallIcCacheMissPopulateIcSlowPath(InterpreterBytecode
     ReleaseAssert(calleeCbHeapPtr != nullptr);
     ReleaseAssert(codePointer != nullptr);
 
+    // If the call site always passes the same number of arguments, the callee's argument fixup logic gives the same result every time,
+    // so we can cache the exact-arity entry of the callee (if applicable) which skips the fixup
+    //
+    if (constantNumArgs != nullptr)
+    {
+        ReleaseAssert(llvm_value_has_type<uint64_t>(constantNumArgs));
+        codePointer = ifi->CallDeegenCommonSnippet("GetCalleeExactArityEntryPoint", { calleeCbHeapPtr, codePointer, constantNumArgs }, insertBefore);
+        ReleaseAssert(llvm_value_has_type<void*>(codePointer));
+    }
+
     InterpreterCallIcMetadata& ic = ifi->GetBytecodeDef()->GetInterpreterCallIc();
 
     Value* cachedIcTvAddr = ic.GetCachedTValue()->EmitGetAddress(ifi->GetModule(), ifi->GetBytecodeMetadataPtr(), insertBefore);
@@ -148,6 +159,7 @@ static bool WARN_UNUSED CheckCanHoistCallIcCheck(llvm::Value* functionObject,
 static void EmitInterpreterCallIcWithHoistedCheck(InterpreterBytecodeImplCreator* ifi,
                                                   llvm::Value* tv,
                                                   llvm::BranchInst* term,
+                                                  llvm::ConstantInt* constantNumArgs,
                                                   llvm::Value*& calleeCbHeapPtr /*out*/,
                                                   llvm::Value*& codePointer /*out*/,
                                                   llvm::Instruction* insertBefore)
@@ -251,7 +263,7 @@ static void EmitInterpreterCallIcWithHoistedCheck(InterpreterBytecodeImplCreator
     Value* icMissCodePtr = nullptr;
     Value* fo64 = ifi->CallDeegenCommonSnippet("GetFuncObjAsU64FromTValue", { tv }, updateIcBBEnd /*insertBefore*/);
     ReleaseAssert(llvm_value_has_type<uint64_t>(fo64));
-    EmitInterpreterCallIcCacheMissPopulateIcSlowPath(ifi, fo64, icMissCalleeCbHeapPtr /*out*/, icMissCodePtr /*out*/, updateIcBBEnd /*insertBefore*/);
+    EmitInterpreterCallIcCacheMissPopulateIcSlowPath(ifi, fo64, constantNumArgs, icMissCalleeCbHeapPtr /*out*/, icMissCodePtr /*out*/, updateIcBBEnd /*insertBefore*/);
     ReleaseAssert(icMissCalleeCbHeapPtr != nullptr);
     ReleaseAssert(icMissCodePtr != nullptr);
 
@@ -381,6 +393,7 @@ static void EmitInterpreterCallIcWithHoistedCheck(InterpreterBytecodeImplCreator
 
 void DeegenCallIcLogicCreator::EmitForInterpreter(InterpreterBytecodeImplCreator* ifi,
                                                   llvm::Value* functionObject,
+                                                  llvm::ConstantInt* constantNumArgs,
                                                   llvm::Value*& calleeCbHeapPtr /*out*/,
                                                   llvm::Value*& codePointer /*out*/,
                                                   llvm::Instruction* insertBefore)
@@ -432,14 +445,14 @@ void DeegenCallIcLogicCreator::EmitForInterpreter(InterpreterBytecodeImplCreator
         {
             ReleaseAssert(tv != nullptr);
             ReleaseAssert(brInst != nullptr);
-            EmitInterpreterCallIcWithHoistedCheck(ifi, tv, brInst, calleeCbHeapPtr /*out*/, codePointer /*out*/, insertBefore);
+            EmitInterpreterCallIcWithHoistedCheck(ifi, tv, brInst, constantNumArgs, calleeCbHeapPtr /*out*/, codePointer /*out*/, insertBefore);
             return;
         }
     }
 
     // When we reach here, we cannot hoist the IC check. So just generate the slow path and update IC
     //
-    EmitInterpreterCallIcCacheMissPopulateIcSlowPath(ifi, functionObject, calleeCbHeapPtr /*out*/, codePointer /*out*/, insertBefore);
+    EmitInterpreterCallIcCacheMissPopulateIcSlowPath(ifi, functionObject, constantNumArgs, calleeCbHeapPtr /*out*/, codePointer /*out*/, insertBefore);
 }
 
 // Emit ASM magic for the CallIC direct-call case (i.e., cache on a fixed FunctionObject)
@@ -2282,6 +2295,7 @@ DeegenCallIcLogicCreator::BaselineJitCodegenResult WARN_UNUSED DeegenCallIcLogic
     }
 
     // If m_numEntries >= x_maxJitCallInlineCacheEntries, don't create more ICs. Just get the result and return.
+    // If x_enable_jit_call_megamorphic_profiling, the call target is also recorded into the megamorphic profile of the site.
     //
     Value* isIcCountReachedMaximum = new ICmpInst(*entryBB, ICmpInst::ICMP_UGE, numExistingICs, CreateLLVMConstantInt<uint8_t>(ctx, x_maxJitCallInlineCacheEntries));
 
@@ -2303,7 +2317,15 @@ DeegenCallIcLogicCreator::BaselineJitCodegenResult WARN_UNUSED DeegenCallIcLogic
         ReleaseAssert(llvm_value_has_type<uint64_t>(targetTv));
         CallInst* targetFnObject = CreateCallToDeegenCommonSnippet(module.get(), "GetFuncObjAsU64FromTValue", { targetTv }, skipIcCreationBB);
         ReleaseAssert(llvm_value_has_type<uint64_t>(targetFnObject));
-        Value* codeBlockAndEntryPoint = CreateCallToDeegenCommonSnippet(module.get(), "GetCalleeEntryPoint", { targetFnObject }, skipIcCreationBB);
+        Value* codeBlockAndEntryPoint;
+        if (x_enable_jit_call_megamorphic_profiling)
+        {
+            codeBlockAndEntryPoint = CreateCallToDeegenCommonSnippet(module.get(), "GetCalleeEntryPointForMegamorphicJitCallIcSite", { icSite, targetFnObject }, skipIcCreationBB);
+        }
+        else
+        {
+            codeBlockAndEntryPoint = CreateCallToDeegenCommonSnippet(module.get(), "GetCalleeEntryPoint", { targetFnObject }, skipIcCreationBB);
+        }
 
         Value* calleeCbHeapPtr = ExtractValueInst::Create(codeBlockAndEntryPoint, { 0 /*idx*/ }, "", skipIcCreationBB);
         Value* codePointer = ExtractValueInst::Create(codeBlockAndEntryPoint, { 1 /*idx*/ }, "", skipIcCreationBB);
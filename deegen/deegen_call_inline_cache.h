@@ -110,10 +110,13 @@ struct DeegenCallIcLogicCreator
         llvm::Instruction* insertBefore);
 
     // Emit logic for interpreter, employing Call IC if possible
+    // 'constantNumArgs' should be the number of arguments passed to the callee if it is a constant, or nullptr otherwise.
+    // If it is provided, the IC may cache the callee's exact-arity entry point that skips the argument fixup.
     //
     static void EmitForInterpreter(
         InterpreterBytecodeImplCreator* ifi,
         llvm::Value* functionObject,
+        llvm::ConstantInt* constantNumArgs,
         llvm::Value*& calleeCbHeapPtr /*out*/,
         llvm::Value*& codePointer /*out*/,
         llvm::Instruction* insertBefore);
@@ -29,6 +29,10 @@ std::string DeegenFunctionEntryLogicCreator::GetFunctionName()
     if (IsNumFixedParamSpecialized())
     {
         name += std::to_string(GetSpecializedNumFixedParam()) + "_params_";
+        if (IsExactArity())
+        {
+            name += "exact_";
+        }
     }
     else
     {
@@ -131,17 +135,51 @@ std::unique_ptr<llvm::Module> WARN_UNUSED DeegenFunctionEntryLogicCreator::Gener
         Value* codePointer = ExtractValueInst::Create(bcbAndCodePointer, { 1 /*idx*/ }, "", entryBB);
         ReleaseAssert(llvm_value_has_type<void*>(codePointer));
 
-        UnreachableInst* dummyInst = new UnreachableInst(ctx, entryBB);
+        // If the baseline JIT code is being compiled in the background, the BaselineCodeBlock is nullptr,
+        // and we should resume executing the current bytecode in the interpreter
+        //
+        BasicBlock* osrEntryBB = BasicBlock::Create(ctx, "", func);
+        BasicBlock* stayInInterpreterBB = BasicBlock::Create(ctx, "", func);
+        {
+            Value* isCompiled = new ICmpInst(*entryBB, ICmpInst::ICMP_NE, bcb, ConstantPointerNull::get(PointerType::getUnqual(ctx)));
+            Function* expectIntrin = Intrinsic::getDeclaration(module.get(), Intrinsic::expect, { Type::getInt1Ty(ctx) });
+            isCompiled = CallInst::Create(expectIntrin, { isCompiled, CreateLLVMConstantInt<bool>(ctx, true) }, "", entryBB);
+            BranchInst::Create(osrEntryBB, stayInInterpreterBB, isCompiled, entryBB);
+        }
 
-        InterpreterFunctionInterface::CreateDispatchToBytecode(
-            codePointer,
-            coroCtx,
-            stackBase,
-            UndefValue::get(llvm_type_of<void*>(ctx)) /*bytecodePtr*/,
-            codeBlock,
-            dummyInst);
+        {
+            UnreachableInst* dummyInst = new UnreachableInst(ctx, osrEntryBB);
 
-        dummyInst->eraseFromParent();
+            InterpreterFunctionInterface::CreateDispatchToBytecode(
+                codePointer,
+                coroCtx,
+                stackBase,
+                UndefValue::get(llvm_type_of<void*>(ctx)) /*bytecodePtr*/,
+                codeBlock,
+                dummyInst);
+
+            dummyInst->eraseFromParent();
+        }
+
+        {
+            UnreachableInst* dummyInst = new UnreachableInst(ctx, stayInInterpreterBB);
+
+            // The tier-up counter has been reset, so the bytecode will not come back here right away
+            //
+            Value* opcode = BytecodeVariantDefinition::DecodeBytecodeOpcode(curBytecode, dummyInst);
+            Value* interpreterFn = GetInterpreterFunctionFromInterpreterOpcode(module.get(), opcode, dummyInst);
+            ReleaseAssert(llvm_value_has_type<void*>(interpreterFn));
+
+            InterpreterFunctionInterface::CreateDispatchToBytecode(
+                interpreterFn,
+                coroCtx,
+                stackBase,
+                curBytecode,
+                codeBlock,
+                dummyInst);
+
+            dummyInst->eraseFromParent();
+        }
     }
 
     RunLLVMOptimizePass(module.get());
@@ -249,6 +287,13 @@ void DeegenFunctionEntryLogicCreator::Run(llvm::LLVMContext& ctx)
     ReleaseAssert(llvm_value_has_type<void*>(calleeCodeBlock));
     calleeCodeBlock->setName("calleeCodeBlock");
 
+    // Grow the stack if it cannot hold the callee's stack frame. This may relocate the stack, so all the
+    // logic below must use the returned stack base.
+    //
+    preFixupStackBase = CreateCallToDeegenCommonSnippet(module.get(), "EnsureStackSpaceForCall", { coroutineCtx, preFixupStackBase, numArgs, calleeCodeBlock }, normalBB);
+    ReleaseAssert(llvm_value_has_type<void*>(preFixupStackBase));
+    preFixupStackBase->setName("preFixupStackBaseAfterStackCheck");
+
     Value* bytecodePtr = nullptr;
     if (m_tier == DeegenEngineTier::Interpreter)
     {
@@ -257,7 +302,14 @@ void DeegenFunctionEntryLogicCreator::Run(llvm::LLVMContext& ctx)
     }
 
     Value* stackBaseAfterFixUp = nullptr;
-    if (!m_acceptVarArgs)
+    if (IsExactArity())
+    {
+        // The caller guarantees that all the fixed params are provided, and that there are no variadic args to set up
+        // (see 'deegen_interpreter_exact_arity_entry_table'), so the stack frame can be used as is.
+        //
+        stackBaseAfterFixUp = preFixupStackBase;
+    }
+    else if (!m_acceptVarArgs)
     {
         if (IsNumFixedParamSpecialized())
         {
@@ -365,7 +417,7 @@ void DeegenFunctionEntryLogicCreator::Run(llvm::LLVMContext& ctx)
         bool shouldPutIntoHotCodeSection;
         if (m_acceptVarArgs)
         {
-            shouldPutIntoHotCodeSection = IsNumFixedParamSpecialized() && GetSpecializedNumFixedParam() <= 2;
+            shouldPutIntoHotCodeSection = IsExactArity() || (IsNumFixedParamSpecialized() && GetSpecializedNumFixedParam() <= 2);
         }
         else
         {
@@ -12,12 +12,18 @@ class DeegenFunctionEntryLogicCreator
 public:
     // numSpecializedFixedParams == -1 means it's not specialized
     //
-    DeegenFunctionEntryLogicCreator(llvm::LLVMContext& ctx, DeegenEngineTier tier, bool acceptVarArgs, size_t numSpecializedFixedParams)
+    // If 'isExactArity' is true, the generated entry assumes that the caller passes exactly 'numSpecializedFixedParams' arguments
+    // (or at least 'numSpecializedFixedParams' arguments if the function does not accept varargs), so no argument fixup is needed.
+    // This is only supported for the interpreter, and requires the number of fixed params to be specialized.
+    //
+    DeegenFunctionEntryLogicCreator(llvm::LLVMContext& ctx, DeegenEngineTier tier, bool acceptVarArgs, size_t numSpecializedFixedParams, bool isExactArity = false)
         : m_generated(false)
         , m_tier(tier)
         , m_acceptVarArgs(acceptVarArgs)
+        , m_isExactArity(isExactArity)
         , m_numSpecializedFixedParams(numSpecializedFixedParams)
     {
+        ReleaseAssert(!m_isExactArity || (m_tier == DeegenEngineTier::Interpreter && IsNumFixedParamSpecialized()));
         Run(ctx);
     }
 
@@ -61,6 +67,7 @@ public:
 
     bool IsNumFixedParamSpecialized() { return m_numSpecializedFixedParams != static_cast<size_t>(-1); }
     size_t GetSpecializedNumFixedParam() { ReleaseAssert(IsNumFixedParamSpecialized()); return m_numSpecializedFixedParams; }
+    bool IsExactArity() { return m_isExactArity; }
 
     static std::unique_ptr<llvm::Module> WARN_UNUSED GenerateInterpreterTierUpOrOsrEntryImplementation(llvm::LLVMContext& ctx, bool isTierUp);
 
@@ -73,6 +80,7 @@ private:
     bool m_generated;
     DeegenEngineTier m_tier;
     bool m_acceptVarArgs;
+    bool m_isExactArity;
     size_t m_numSpecializedFixedParams;
     std::unique_ptr<llvm::Module> m_module;
 
@@ -133,6 +133,21 @@ void InterpreterBytecodeImplCreator::CreateWrapperFunction()
         currentBlock = normalExecutionBB;
     }
 
+    if (x_enable_interpreter_opcode_profiling)
+    {
+        // The Main component and the fused IC effects are the functions in the dispatch table, so they count the opcode executions.
+        // The quickening slow path is entered from the quickened opcode whose fast path check failed.
+        //
+        if (m_processKind == BytecodeIrComponentKind::Main || m_processKind == BytecodeIrComponentKind::FusedInInlineCacheEffect)
+        {
+            CreateCallToDeegenCommonSnippet(m_module.get(), "RecordInterpreterOpcodeForProfiling", { GetCurBytecode() }, currentBlock);
+        }
+        else if (m_processKind == BytecodeIrComponentKind::QuickeningSlowPath)
+        {
+            CreateCallToDeegenCommonSnippet(m_module.get(), "RecordInterpreterQuickeningSlowPathForProfiling", { GetCurBytecode() }, currentBlock);
+        }
+    }
+
     std::unordered_map<uint64_t /*operandOrd*/, uint64_t /*argOrd*/> alreadyDecodedArgs;
     if (m_processKind == BytecodeIrComponentKind::QuickeningSlowPath && m_bytecodeDef->HasQuickeningSlowPath())
     {
@@ -34,3 +34,34 @@ constexpr bool x_allow_interpreter_tier_up_to_baseline_jit = true;
 // For now we simply choose C = 1, yielding a multiplier of 20.
 //
 constexpr size_t x_interpreter_tier_up_threshold_bytecode_length_multiplier = 20;
+
+// When baseline JIT compilation is done in the background, a function that is waiting for its JIT code keeps running in the
+// interpreter, and checks whether the JIT code is ready after executing this many times its bytecode length.
+//
+// The compiler thread needs about the time the interpreter takes to execute 20x the bytecode length (see above),
+// so the function checks a few times during the compilation, and switches to the JIT code soon after it is ready.
+//
+constexpr int64_t x_interpreter_tier_up_background_compilation_poll_interval_bytecode_length_multiplier = 4;
+
+// When this option is true, every opcode handler of the interpreter counts its executions, as well as the executions of
+// each (previous opcode, opcode) pair, and the quickened opcodes also count how often they fall back to the quickening slow path.
+// Since each variant, quickening and fused IC effect of a bytecode is a distinct opcode, the report tells exactly which of them
+// were executed. The report is written as JSON when the VM is destroyed, see runtime/interpreter_opcode_profiler.h.
+//
+// This slows down the interpreter a lot, so it is only enabled by the INTERPRETER_OPCODE_PROFILING build option.
+//
+#ifdef ENABLE_INTERPRETER_OPCODE_PROFILING
+constexpr bool x_enable_interpreter_opcode_profiling = true;
+#else
+constexpr bool x_enable_interpreter_opcode_profiling = false;
+#endif
+
+// When this option is true, a baseline JIT call IC site that cannot create more IC entries records the targets it calls
+// into a JitCallMegamorphicProfile (see runtime_utils.h). Nothing consumes the profile yet, and it costs a slow path
+// call per uncached target and 4 bytes per call IC site, so it is only enabled by the JIT_CALL_MEGAMORPHIC_PROFILING build option.
+//
+#ifdef ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
+constexpr bool x_enable_jit_call_megamorphic_profiling = true;
+#else
+constexpr bool x_enable_jit_call_megamorphic_profiling = false;
+#endif
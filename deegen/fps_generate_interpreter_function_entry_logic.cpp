@@ -3,6 +3,7 @@
 #include "transactional_output_file.h"
 
 #include "deegen_function_entry_logic_creator.h"
+#include "runtime_utils.h"
 #include "llvm/Linker/Linker.h"
 
 namespace {
@@ -14,6 +15,11 @@ using namespace dast;
 constexpr size_t x_specializeThresholdForNonVarargsFunction = 6;
 constexpr size_t x_specializeThresholdForVarargsFunction = 6;
 
+// The exact-arity entry table is indexed by the specialized number of fixed params
+//
+static_assert(x_specializeThresholdForNonVarargsFunction == x_interpreterMaxSpecializedNumFixedParams);
+static_assert(x_specializeThresholdForVarargsFunction == x_interpreterMaxSpecializedNumFixedParams);
+
 struct GeneratorContext
 {
     GeneratorContext()
@@ -46,6 +52,13 @@ struct GeneratorContext
             LinkInModule(ifi.GetInterpreterModule());
         }
 
+        for (size_t i = 0; i <= x_specializeThresholdForNonVarargsFunction; i++)
+        {
+            DeegenFunctionEntryLogicCreator ifi(*context.get(), DeegenEngineTier::Interpreter, false /*takesVarArgs*/, i /*specialziedFixedParams*/, true /*isExactArity*/);
+            novaExactArityNames.push_back(ifi.GetFunctionName());
+            LinkInModule(ifi.GetInterpreterModule());
+        }
+
         {
             DeegenFunctionEntryLogicCreator ifi(*context.get(), DeegenEngineTier::Interpreter, false /*takesVarArgs*/, static_cast<size_t>(-1) /*specialziedFixedParams*/);
             generalNovaName = ifi.GetFunctionName();
@@ -59,6 +72,13 @@ struct GeneratorContext
             LinkInModule(ifi.GetInterpreterModule());
         }
 
+        for (size_t i = 0; i <= x_specializeThresholdForVarargsFunction; i++)
+        {
+            DeegenFunctionEntryLogicCreator ifi(*context.get(), DeegenEngineTier::Interpreter, true /*takesVarArgs*/, i /*specialziedFixedParams*/, true /*isExactArity*/);
+            vaExactArityNames.push_back(ifi.GetFunctionName());
+            LinkInModule(ifi.GetInterpreterModule());
+        }
+
         {
             DeegenFunctionEntryLogicCreator ifi(*context.get(), DeegenEngineTier::Interpreter, true /*takesVarArgs*/, static_cast<size_t>(-1) /*specialziedFixedParams*/);
             generalVaName = ifi.GetFunctionName();
@@ -119,6 +139,37 @@ struct GeneratorContext
         }
         EmitDeclaration(fp, generalVaName);
 
+        for (auto& name : novaExactArityNames)
+        {
+            EmitDeclaration(fp, name);
+        }
+        for (auto& name : vaExactArityNames)
+        {
+            EmitDeclaration(fp, name);
+        }
+
+        // The exact-arity entry table, see comments in runtime_utils.h
+        //
+        ReleaseAssert(novaNames.size() == novaExactArityNames.size());
+        ReleaseAssert(vaNames.size() == vaExactArityNames.size());
+        ReleaseAssert(novaNames.size() == vaNames.size());
+        fprintf(fp, "\nextern \"C\" void (* const deegen_interpreter_exact_arity_entry_table[2][%d][2])();\n", static_cast<int>(novaNames.size()));
+        fprintf(fp, "extern \"C\" {\n");
+        fprintf(fp, "void (* const deegen_interpreter_exact_arity_entry_table[2][%d][2])() = {\n", static_cast<int>(novaNames.size()));
+        for (bool takesVarArgs : { false, true })
+        {
+            std::vector<std::string>& names = (takesVarArgs ? vaNames : novaNames);
+            std::vector<std::string>& exactArityNames = (takesVarArgs ? vaExactArityNames : novaExactArityNames);
+            fprintf(fp, "    {\n");
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                fprintf(fp, "        { %s, %s },\n", names[i].c_str(), exactArityNames[i].c_str());
+            }
+            fprintf(fp, "    },\n");
+        }
+        fprintf(fp, "};\n");
+        fprintf(fp, "}   // extern \"C\"\n");
+
         fprintf(fp, "\nnamespace generated {\n\n");
 
         fprintf(fp, "extern const std::array<void(*)(), %d> x_interpreterEntryFuncListNoVa;\n", static_cast<int>(novaNames.size() + 1));
@@ -159,6 +210,8 @@ struct GeneratorContext
     std::string generalNovaName;
     std::vector<std::string> vaNames;
     std::string generalVaName;
+    std::vector<std::string> novaExactArityNames;
+    std::vector<std::string> vaExactArityNames;
 };
 
 }   // anonymous namespace
@@ -62,6 +62,8 @@ inline cl::opt<std::string> cl_cppOutputFilename2("cpp-output-2", cl::desc("The
 inline cl::opt<std::string> cl_assemblyOutputFilename("asm-output", cl::desc("The output file name for the generated assembly"), cl::value_desc("filename"), cl::init(""), cl::cat(FPSOptions));
 inline cl::opt<std::string> cl_jsonOutputFilename("json-output", cl::desc("The output file name for the generated JSON"), cl::value_desc("filename"), cl::init(""), cl::cat(FPSOptions));
 inline cl::opt<std::string> cl_auditDirPath("audit-dir", cl::desc("The directory for outputting audit information. These are not used for the build, but for human inspection only."), cl::value_desc("path"), cl::init(""), cl::cat(FPSOptions));
+inline cl::opt<std::string> cl_cacheDirPath("cache-dir", cl::desc("The directory for caching intermediate results, so that unchanged inputs are not processed again. Caching is disabled if not specified."), cl::value_desc("path"), cl::init(""), cl::cat(FPSOptions));
+inline cl::opt<unsigned> cl_numThreads("num-threads", cl::desc("The number of worker threads for the commands that support parallel processing. Default is the number of hardware threads. The build rules pass 1, as they already run these commands in parallel."), cl::value_desc("n"), cl::init(0), cl::cat(FPSOptions));
 
 std::vector<std::string> WARN_UNUSED ParseCommaSeparatedFileList(const std::string& commaSeparatedFiles);
 
@@ -123,3 +125,13 @@ std::string WARN_UNUSED FPS_GetAuditFilePathWithTwoPartName(const std::string& d
 // A simple function that returns the file name from the absolute file path
 //
 std::string WARN_UNUSED FPS_GetFileNameFromAbsolutePath(const std::string& filename);
+
+// Given the desired file name in the cache directory, returns the full file path.
+// This also creates the cache directory if it doesn't exist yet.
+//
+std::string WARN_UNUSED FPS_GetCacheFilePath(const std::string& filename);
+
+// Call 'fn(i)' for every i in [0, n), using up to 'cl_numThreads' worker threads.
+// The calls may happen concurrently and in any order, so 'fn' must be thread-safe.
+//
+void FPS_ParallelFor(size_t n, const std::function<void(size_t)>& fn);
@@ -10,16 +10,341 @@
 #include "deegen_interpreter_bytecode_impl_creator.h"
 #include "llvm_identical_function_merger.h"
 #include "deegen_global_bytecode_trait_accessor.h"
+#include "anonymous_file.h"
+#include "check_file_md5.h"
 
 using namespace dast;
 
 constexpr const char* x_baselineJitSlowPathSectionName = "deegen_baseline_jit_slow_path_section";
 constexpr const char* x_baselineJitCodegenFnSectionName = "deegen_baseline_jit_codegen_fn_section";
 
+using json_t = nlohmann::json;  // unfortunately the name 'json' collides with LLVM's json...
+
+namespace {
+
+// The result of processing one bytecode for baseline JIT
+//
+// It holds no LLVM object (the modules are stored in textual form), so it can be produced by a worker thread
+// using its own LLVMContext, and can be saved into the cache directory and reused if the input is unchanged.
+//
+struct BaselineJitBytecodeProcessResult
+{
+    struct AuditFile
+    {
+        std::string m_dirSuffix;
+        std::string m_fileName;
+        std::string m_contents;
+    };
+
+    // The C++ code that populates the dispatch table, the bytecode trait table and the IC trait tables for this bytecode
+    //
+    std::string m_hdrContents;
+    std::string m_originalImplFunctionName;
+    // Base64-encoded modules to be linked into the final module
+    //
+    std::vector<std::string> m_modules;
+    std::vector<std::string> m_functionsOkToMerge;
+    std::vector<std::string> m_fnNamesNeedToBeMadeDsoLocal;
+    std::vector<AuditFile> m_auditFiles;
+
+    json_t WARN_UNUSED SaveToJSON()
+    {
+        json_t j;
+        j["hdr_contents"] = m_hdrContents;
+        j["original_impl_function_name"] = m_originalImplFunctionName;
+        j["modules"] = m_modules;
+        j["functions_ok_to_merge"] = m_functionsOkToMerge;
+        j["functions_need_to_be_made_dso_local"] = m_fnNamesNeedToBeMadeDsoLocal;
+        std::vector<json_t> auditFiles;
+        for (AuditFile& af : m_auditFiles)
+        {
+            json_t a;
+            a["dir_suffix"] = af.m_dirSuffix;
+            a["file_name"] = af.m_fileName;
+            a["contents"] = base64_encode(af.m_contents);
+            auditFiles.push_back(std::move(a));
+        }
+        j["audit_files"] = std::move(auditFiles);
+        return j;
+    }
+
+    static std::vector<std::string> WARN_UNUSED GetStringListFromJSON(json_t& j, const char* prop)
+    {
+        ReleaseAssert(j.count(prop) && j[prop].is_array());
+        std::vector<std::string> res;
+        for (json_t& e : j[prop])
+        {
+            ReleaseAssert(e.is_string());
+            res.push_back(e.get<std::string>());
+        }
+        return res;
+    }
+
+    static BaselineJitBytecodeProcessResult WARN_UNUSED LoadFromJSON(json_t& j)
+    {
+        BaselineJitBytecodeProcessResult r;
+        r.m_hdrContents = JSONCheckedGet<std::string>(j, "hdr_contents");
+        r.m_originalImplFunctionName = JSONCheckedGet<std::string>(j, "original_impl_function_name");
+        r.m_modules = GetStringListFromJSON(j, "modules");
+        r.m_functionsOkToMerge = GetStringListFromJSON(j, "functions_ok_to_merge");
+        r.m_fnNamesNeedToBeMadeDsoLocal = GetStringListFromJSON(j, "functions_need_to_be_made_dso_local");
+        ReleaseAssert(j.count("audit_files") && j["audit_files"].is_array());
+        for (json_t& a : j["audit_files"])
+        {
+            r.m_auditFiles.push_back({
+                .m_dirSuffix = JSONCheckedGet<std::string>(a, "dir_suffix"),
+                .m_fileName = JSONCheckedGet<std::string>(a, "file_name"),
+                .m_contents = base64_decode(JSONCheckedGet<std::string>(a, "contents"))
+            });
+        }
+        return r;
+    }
+};
+
+// Process one bytecode (described by 'curBytecodeInfoJson') for baseline JIT
+// This is thread-safe: all the LLVM work is done in a private LLVMContext
+//
+BaselineJitBytecodeProcessResult WARN_UNUSED ProcessOneBytecodeForBaselineJit(json_t& curBytecodeInfoJson,
+                                                                              const BytecodeOpcodeRawValueMap& byOpMap,
+                                                                              const DeegenGlobalBytecodeTraitAccessor& bcTraitAccessor)
+{
+    using namespace llvm;
+    std::unique_ptr<LLVMContext> llvmCtxHolder = std::make_unique<llvm::LLVMContext>();
+    LLVMContext& ctx = *llvmCtxHolder.get();
+
+    BaselineJitBytecodeProcessResult out;
+
+    AnonymousFile hdrOut;
+    FILE* hdrFp = hdrOut.GetFStream("w");
+
+    BytecodeIrInfo bii(ctx, curBytecodeInfoJson);
+    bii.m_bytecodeDef->ComputeBaselineJitSlowPathDataLayout();
+
+    DeegenProcessBytecodeForBaselineJitResult res = DeegenProcessBytecodeForBaselineJitResult::Create(&bii, bcTraitAccessor);
+
+    out.m_originalImplFunctionName = bii.m_bytecodeDef->m_implFunctionName;
+
+    // Emit C++ code that populates the dispatch table entries
+    //
+    {
+        std::string cgFnName = res.m_baselineJitInfo.m_resultFuncName;
+        ReleaseAssert(cgFnName != "");
+        size_t start = res.m_opcodeRawValue;
+        size_t end = res.m_opcodeRawValue + res.m_opcodeNumFuseIcVariants + 1;
+        ReleaseAssert(start < byOpMap.GetDispatchTableLength() && end <= byOpMap.GetDispatchTableLength());
+
+        size_t bytecodeStructLength = res.m_bytecodeDef->GetBytecodeStructLength();
+
+        fprintf(hdrFp, "extern \"C\" void %s();\n", cgFnName.c_str());
+        fprintf(hdrFp, "namespace {\n\n");
+        fprintf(hdrFp, "template<typename T> struct populate_baseline_jit_dispatch_table_%s {\n", res.m_bytecodeDef->GetBytecodeIdName().c_str());
+        fprintf(hdrFp, "static consteval void run(T* p) {\n");
+        for (size_t k = start; k < end; k++)
+        {
+            fprintf(hdrFp, "p->set(%llu, FOLD_CONSTEXPR(reinterpret_cast<void*>(&%s)));\n",
+                    static_cast<unsigned long long>(k), cgFnName.c_str());
+        }
+        fprintf(hdrFp, "}\n};\n}\n\n");
+
+        fprintf(hdrFp, "namespace {\n\n");
+        fprintf(hdrFp, "template<typename T> struct populate_baseline_jit_bytecode_traits_%s {\n", res.m_bytecodeDef->GetBytecodeIdName().c_str());
+        fprintf(hdrFp, "static consteval void run(T* p) {\n");
+        fprintf(hdrFp, "constexpr BytecodeBaselineJitTraits x_traitValue = BytecodeBaselineJitTraits {\n");
+        ReleaseAssert(res.m_baselineJitInfo.m_fastPathCodeLen <= 65535);
+        fprintf(hdrFp, "    .m_fastPathCodeLen = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_fastPathCodeLen));
+        ReleaseAssert(res.m_baselineJitInfo.m_slowPathCodeLen <= 65535);
+        fprintf(hdrFp, "    .m_slowPathCodeLen = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_slowPathCodeLen));
+        ReleaseAssert(res.m_baselineJitInfo.m_dataSectionCodeLen <= 65535);
+        fprintf(hdrFp, "    .m_dataSectionCodeLen = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_dataSectionCodeLen));
+        ReleaseAssert(res.m_baselineJitInfo.m_dataSectionAlignment <= x_baselineJitMaxPossibleDataSectionAlignment);
+        ReleaseAssert(is_power_of_2(res.m_baselineJitInfo.m_dataSectionAlignment));
+        fprintf(hdrFp, "    .m_dataSectionAlignment = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_dataSectionAlignment));
+        ReleaseAssert(res.m_baselineJitInfo.m_numCondBrLatePatches <= 65535);
+        fprintf(hdrFp, "    .m_numCondBrLatePatches = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_numCondBrLatePatches));
+        ReleaseAssert(res.m_baselineJitInfo.m_slowPathDataLen <= 65535);
+        fprintf(hdrFp, "    .m_slowPathDataLen = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_slowPathDataLen));
+        ReleaseAssert(bytecodeStructLength <= 65535);
+        fprintf(hdrFp, "    .m_bytecodeLength = %llu\n", static_cast<unsigned long long>(bytecodeStructLength));
+        fprintf(hdrFp, "};\n");
+
+        for (size_t k = start; k < end; k++)
+        {
+            fprintf(hdrFp, "p->set(%llu, x_traitValue);\n", static_cast<unsigned long long>(k));
+        }
+        fprintf(hdrFp, "}\n};\n}\n\n");
+    }
+
+    // Emit C++ code that populates the Call IC trait table entries
+    //
+    {
+        using CallIcTraitDesc = DeegenBytecodeBaselineJitInfo::CallIcTraitDesc;
+        std::vector<CallIcTraitDesc> icTraitList = res.m_baselineJitInfo.m_allCallIcTraitDescs;
+        size_t icTraitTableLength = bcTraitAccessor.GetJitCallIcTraitTableLength();
+        for (CallIcTraitDesc& icTrait : icTraitList)
+        {
+            ReleaseAssert(icTrait.m_ordInTraitTable < icTraitTableLength);
+            fprintf(hdrFp, "__attribute__((__section__(\"deegen_call_ic_trait_table_section\"))) constexpr JitCallInlineCacheTraitsHolder<%llu> ",
+                    static_cast<unsigned long long>(icTrait.m_codePtrPatchRecords.size()));
+            fprintf(hdrFp, "x_deegen_jit_call_ic_trait_ord_%llu(\n", static_cast<unsigned long long>(icTrait.m_ordInTraitTable));
+
+            // If one IC has more than 8KB of code, probably something is seriously wrong...
+            //
+            ReleaseAssert(icTrait.m_allocationLength <= x_jit_mem_alloc_stepping_array[x_jit_mem_alloc_total_steppings - 1]);
+            size_t icAllocationLengthStepping = GetJitMemoryAllocatorSteppingFromSmallAllocationSize(icTrait.m_allocationLength);
+            ReleaseAssert(icAllocationLengthStepping < x_jit_mem_alloc_total_steppings);
+            ReleaseAssert(x_jit_mem_alloc_stepping_array[icAllocationLengthStepping] >= icTrait.m_allocationLength);
+            fprintf(hdrFp, "    %llu,\n", static_cast<unsigned long long>(icAllocationLengthStepping));
+            fprintf(hdrFp, "    %s /*isDirectCallMode*/,\n", (icTrait.m_isDirectCall ? "true" : "false"));
+            fprintf(hdrFp, "    std::array<JitCallInlineCacheTraits::PatchRecord, %llu> {", static_cast<unsigned long long>(icTrait.m_codePtrPatchRecords.size()));
+
+            for (size_t i = 0; i < icTrait.m_codePtrPatchRecords.size(); i++)
+            {
+                uint64_t offset = icTrait.m_codePtrPatchRecords[i].first;
+                bool is64 = icTrait.m_codePtrPatchRecords[i].second;
+                ReleaseAssert(offset <= 65535);
+                if (i > 0) { fprintf(hdrFp, ","); }
+                fprintf(hdrFp, "\n        JitCallInlineCacheTraits::PatchRecord {\n");
+                fprintf(hdrFp, "            .m_offset = %llu,\n", static_cast<unsigned long long>(offset));
+                fprintf(hdrFp, "            .m_is64 = %s\n", (is64 ? "true" : "false"));
+                fprintf(hdrFp, "        }");
+            }
+            fprintf(hdrFp, "\n    });\n\n");
+        }
+    }
+
+    // Emit C++ code that populates the allocation length stepping table of generic IC
+    //
+    {
+        using GenericIcTraitDesc = AstInlineCache::BaselineJitFinalLoweringResult::TraitDesc;
+
+        std::vector<GenericIcTraitDesc> icTraitList = res.m_baselineJitInfo.m_allGenericIcTraitDescs;
+        size_t icTraitTableLength = bcTraitAccessor.GetJitGenericIcEffectTraitTableLength();
+        fprintf(hdrFp, "namespace {\n\n");
+        fprintf(hdrFp, "template<typename T> struct populate_baseline_jit_generic_ic_allocation_length_stepping_table_%s {\n", res.m_bytecodeDef->GetBytecodeIdName().c_str());
+        fprintf(hdrFp, "static consteval void run(T* p) {\n");
+        fprintf(hdrFp, "std::ignore = p;\n");
+        for (GenericIcTraitDesc& icTrait : icTraitList)
+        {
+            ReleaseAssert(icTrait.m_ordInTraitTable < icTraitTableLength);
+            // If one IC has more than 8KB of code, probably something is seriously wrong...
+            //
+            ReleaseAssert(icTrait.m_allocationLength <= x_jit_mem_alloc_stepping_array[x_jit_mem_alloc_total_steppings - 1]);
+            size_t icAllocationLengthStepping = GetJitMemoryAllocatorSteppingFromSmallAllocationSize(icTrait.m_allocationLength);
+            ReleaseAssert(icAllocationLengthStepping < x_jit_mem_alloc_total_steppings);
+            ReleaseAssert(x_jit_mem_alloc_stepping_array[icAllocationLengthStepping] >= icTrait.m_allocationLength);
+            fprintf(hdrFp, "p->set(%llu, %llu);\n",
+                    static_cast<unsigned long long>(icTrait.m_ordInTraitTable), static_cast<unsigned long long>(icAllocationLengthStepping));
+        }
+        fprintf(hdrFp, "}\n};\n}\n\n");
+    }
+
+    // Push generated modules to the list of modules to be linked, and also set section
+    //
+    for (auto& m : res.m_aotSlowPaths)
+    {
+        Function* fn = m.m_module->getFunction(m.m_funcName);
+        ReleaseAssert(fn != nullptr);
+        fn->setSection(x_baselineJitSlowPathSectionName);
+        out.m_modules.push_back(base64_encode(DumpLLVMModuleAsString(m.m_module.get())));
+    }
+
+    for (auto& m : res.m_aotSlowPathReturnConts)
+    {
+        Function* fn = m.m_module->getFunction(m.m_funcName);
+        ReleaseAssert(fn != nullptr);
+        fn->setSection(x_baselineJitSlowPathSectionName);
+        // Return continuations are also mergeable if identical
+        //
+        out.m_functionsOkToMerge.push_back(m.m_funcName);
+        out.m_modules.push_back(base64_encode(DumpLLVMModuleAsString(m.m_module.get())));
+    }
+
+    // Compile the main codegen function module to ASM for audit purpose
+    //
+    std::string cgFnAsmForAudit = CompileLLVMModuleToAssemblyFile(res.m_baselineJitInfo.m_cgMod.get(), Reloc::Static, CodeModel::Small);
+
+    // Set up section name for main codegen function
+    //
+    {
+        Function* fn = res.m_baselineJitInfo.m_cgMod->getFunction(res.m_baselineJitInfo.m_resultFuncName);
+        ReleaseAssert(fn != nullptr);
+        fn->setSection(x_baselineJitCodegenFnSectionName);
+    }
+
+    for (Function& fn : *res.m_baselineJitInfo.m_cgMod.get())
+    {
+        out.m_fnNamesNeedToBeMadeDsoLocal.push_back(fn.getName().str());
+    }
+
+    out.m_modules.push_back(base64_encode(DumpLLVMModuleAsString(res.m_baselineJitInfo.m_cgMod.get())));
+
+    // Record the codegen logic audit file
+    //
+    {
+        std::string cgFnAuditFileContents = res.m_baselineJitInfo.m_disasmForAudit + cgFnAsmForAudit;
+        std::string cgFnAuditFileName = res.m_bytecodeDef->GetBytecodeIdName() + ".s";
+
+        out.m_auditFiles.push_back({ "baseline_jit" /*dirSuffix*/, cgFnAuditFileName, cgFnAuditFileContents });
+    }
+
+    // Record the verbose audit files
+    //
+    for (size_t i = 0; i < res.m_baselineJitInfo.m_implModulesForAudit.size(); i++)
+    {
+        Module* m = res.m_baselineJitInfo.m_implModulesForAudit[i].first.get();
+        std::string fnName = res.m_baselineJitInfo.m_implModulesForAudit[i].second;
+        std::string auditFileName = res.m_bytecodeDef->GetBytecodeIdName();
+        if (i > 0)
+        {
+            size_t k = fnName.rfind("_retcont_");
+            ReleaseAssert(k != std::string::npos);
+            auditFileName += fnName.substr(k);
+        }
+        else
+        {
+            ReleaseAssert(fnName.rfind("_retcont_") == std::string::npos);
+        }
+        auditFileName += ".ll";
+        out.m_auditFiles.push_back({ "baseline_jit_verbose" /*dirSuffix*/, auditFileName, DumpLLVMModuleAsString(m) });
+    }
+
+    for (auto& extraAuditFile : res.m_baselineJitInfo.m_extraAuditFiles)
+    {
+        out.m_auditFiles.push_back({ "baseline_jit" /*dirSuffix*/, extraAuditFile.first, extraAuditFile.second });
+    }
+
+    for (auto& verboseAuditFile : res.m_baselineJitInfo.m_extraVerboseAuditFiles)
+    {
+        out.m_auditFiles.push_back({ "baseline_jit_verbose" /*dirSuffix*/, verboseAuditFile.first, verboseAuditFile.second });
+    }
+
+    fclose(hdrFp);
+    out.m_hdrContents = hdrOut.GetFileContents();
+    return out;
+}
+
+// The part of the cache key shared by all bytecodes: the output of a bytecode also depends on the global bytecode tables
+// and on the fps binary itself. For the binary we use its size and modification time, which change whenever it is rebuilt.
+//
+std::string WARN_UNUSED GetBaselineJitCacheKeyCommonPart()
+{
+    struct stat st;
+    if (stat("/proc/self/exe", &st) != 0)
+    {
+        fprintf(stderr, "Failed to access '/proc/self/exe', errno = %d (%s)\n", errno, strerror(errno));
+        abort();
+    }
+    std::string res = "fps binary: " + std::to_string(st.st_size) + " " + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec) + "\n";
+    res += ReadFileContentAsString(cl_bytecodeNameTable) + "\n";
+    res += ReadFileContentAsString(cl_bytecodeTraitTable) + "\n";
+    return res;
+}
+
+}   // anonymous namespace
+
 void FPS_ProcessBytecodeDefinitionForBaselineJit()
 {
     using namespace llvm;
-    using json_t = nlohmann::json;  // unfortunately the name 'json' collides with LLVM's json...
     std::unique_ptr<LLVMContext> llvmCtxHolder = std::make_unique<llvm::LLVMContext>();
     LLVMContext& ctx = *llvmCtxHolder.get();
 
@@ -34,6 +359,87 @@ void FPS_ProcessBytecodeDefinitionForBaselineJit()
     ReleaseAssert(inputJson.count("all-bytecode-info"));
     json_t& bytecodeInfoListJson = inputJson["all-bytecode-info"];
     ReleaseAssert(bytecodeInfoListJson.is_array());
+    size_t numBytecodes = bytecodeInfoListJson.size();
+
+    std::vector<BaselineJitBytecodeProcessResult> results(numBytecodes);
+
+    // If a cache directory is given, look up the result of each bytecode in the cache.
+    // The cache key file of a bytecode holds everything its result depends on, so if the key file is unchanged
+    // (judged by its md5 checksum), the cached result is still valid.
+    //
+    bool useCache = (cl_cacheDirPath != "");
+    std::vector<std::string> cacheKeyFiles;
+    std::vector<std::string> cacheResultFiles;
+    std::vector<size_t> bytecodesToProcess;
+    if (useCache)
+    {
+        std::string keyCommonPart = GetBaselineJitCacheKeyCommonPart();
+        for (size_t bytecodeDefOrd = 0; bytecodeDefOrd < numBytecodes; bytecodeDefOrd++)
+        {
+            std::string fileNamePrefix = FPS_GetCacheFilePath(FPS_GetFileNameFromAbsolutePath(inputFileName) + "." + std::to_string(bytecodeDefOrd));
+            cacheKeyFiles.push_back(fileNamePrefix + ".key");
+            cacheResultFiles.push_back(fileNamePrefix + ".result.json");
+
+            {
+                TransactionalOutputFile keyFile(cacheKeyFiles.back());
+                keyFile.write(keyCommonPart);
+                keyFile.write(bytecodeInfoListJson[bytecodeDefOrd].dump());
+                keyFile.Commit();
+            }
+
+            struct stat st;
+            bool isCached = CheckMd5Match(cacheKeyFiles.back()) && (stat(cacheResultFiles.back().c_str(), &st) == 0);
+            if (isCached)
+            {
+                json_t j = json_t::parse(ReadFileContentAsString(cacheResultFiles.back()));
+                results[bytecodeDefOrd] = BaselineJitBytecodeProcessResult::LoadFromJSON(j);
+            }
+            else
+            {
+                bytecodesToProcess.push_back(bytecodeDefOrd);
+            }
+        }
+    }
+    else
+    {
+        for (size_t bytecodeDefOrd = 0; bytecodeDefOrd < numBytecodes; bytecodeDefOrd++)
+        {
+            bytecodesToProcess.push_back(bytecodeDefOrd);
+        }
+    }
+
+    // The bytecodes are independent of each other, so process them in parallel.
+    // Note that the JSON object must not be modified concurrently, so look up the inputs before starting the workers.
+    //
+    std::vector<json_t*> inputsToProcess;
+    for (size_t bytecodeDefOrd : bytecodesToProcess)
+    {
+        inputsToProcess.push_back(&bytecodeInfoListJson[bytecodeDefOrd]);
+    }
+
+    FPS_ParallelFor(bytecodesToProcess.size(), [&](size_t k)
+    {
+        results[bytecodesToProcess[k]] = ProcessOneBytecodeForBaselineJit(*inputsToProcess[k], byOpMap, bcTraitAccessor);
+    });
+
+    if (useCache)
+    {
+        for (size_t bytecodeDefOrd : bytecodesToProcess)
+        {
+            TransactionalOutputFile resultFile(cacheResultFiles[bytecodeDefOrd]);
+            resultFile.write(results[bytecodeDefOrd].SaveToJSON().dump());
+            resultFile.Commit();
+
+            // Must be done after the result file is written, so the cache is never considered valid with a stale result
+            //
+            UpdateMd5Checksum(cacheKeyFiles[bytecodeDefOrd]);
+        }
+    }
+
+    auto getModuleFromBase64EncodedString = [&](const std::string& str)
+    {
+        return ParseLLVMModuleFromString(ctx, "bytecode_ir_component_module" /*moduleName*/, base64_decode(str));
+    };
 
     std::vector<std::unique_ptr<Module>> moduleToLink;
 
@@ -73,233 +479,35 @@ void FPS_ProcessBytecodeDefinitionForBaselineJit()
     //
     std::vector<std::string> bytecodeOriginalImplFunctionNames;
 
-    for (size_t bytecodeDefOrd = 0; bytecodeDefOrd < bytecodeInfoListJson.size(); bytecodeDefOrd++)
+    // Collect the results in bytecode order, so the output does not depend on the thread scheduling
+    //
+    for (BaselineJitBytecodeProcessResult& res : results)
     {
-        json_t& curBytecodeInfoJson = bytecodeInfoListJson[bytecodeDefOrd];
-
-        BytecodeIrInfo bii(ctx, curBytecodeInfoJson);
-        bii.m_bytecodeDef->ComputeBaselineJitSlowPathDataLayout();
-
-        DeegenProcessBytecodeForBaselineJitResult res = DeegenProcessBytecodeForBaselineJitResult::Create(&bii, bcTraitAccessor);
-
-        bytecodeOriginalImplFunctionNames.push_back(bii.m_bytecodeDef->m_implFunctionName);
-
-        // Emit C++ code that populates the dispatch table entries
-        //
-        {
-            std::string cgFnName = res.m_baselineJitInfo.m_resultFuncName;
-            ReleaseAssert(cgFnName != "");
-            size_t start = res.m_opcodeRawValue;
-            size_t end = res.m_opcodeRawValue + res.m_opcodeNumFuseIcVariants + 1;
-            ReleaseAssert(start < byOpMap.GetDispatchTableLength() && end <= byOpMap.GetDispatchTableLength());
-
-            size_t bytecodeStructLength = res.m_bytecodeDef->GetBytecodeStructLength();
-
-            fprintf(hdrFp, "extern \"C\" void %s();\n", cgFnName.c_str());
-            fprintf(hdrFp, "namespace {\n\n");
-            fprintf(hdrFp, "template<typename T> struct populate_baseline_jit_dispatch_table_%s {\n", res.m_bytecodeDef->GetBytecodeIdName().c_str());
-            fprintf(hdrFp, "static consteval void run(T* p) {\n");
-            for (size_t k = start; k < end; k++)
-            {
-                fprintf(hdrFp, "p->set(%llu, FOLD_CONSTEXPR(reinterpret_cast<void*>(&%s)));\n",
-                        static_cast<unsigned long long>(k), cgFnName.c_str());
-            }
-            fprintf(hdrFp, "}\n};\n}\n\n");
-
-            fprintf(hdrFp, "namespace {\n\n");
-            fprintf(hdrFp, "template<typename T> struct populate_baseline_jit_bytecode_traits_%s {\n", res.m_bytecodeDef->GetBytecodeIdName().c_str());
-            fprintf(hdrFp, "static consteval void run(T* p) {\n");
-            fprintf(hdrFp, "constexpr BytecodeBaselineJitTraits x_traitValue = BytecodeBaselineJitTraits {\n");
-            ReleaseAssert(res.m_baselineJitInfo.m_fastPathCodeLen <= 65535);
-            fprintf(hdrFp, "    .m_fastPathCodeLen = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_fastPathCodeLen));
-            ReleaseAssert(res.m_baselineJitInfo.m_slowPathCodeLen <= 65535);
-            fprintf(hdrFp, "    .m_slowPathCodeLen = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_slowPathCodeLen));
-            ReleaseAssert(res.m_baselineJitInfo.m_dataSectionCodeLen <= 65535);
-            fprintf(hdrFp, "    .m_dataSectionCodeLen = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_dataSectionCodeLen));
-            ReleaseAssert(res.m_baselineJitInfo.m_dataSectionAlignment <= x_baselineJitMaxPossibleDataSectionAlignment);
-            ReleaseAssert(is_power_of_2(res.m_baselineJitInfo.m_dataSectionAlignment));
-            fprintf(hdrFp, "    .m_dataSectionAlignment = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_dataSectionAlignment));
-            ReleaseAssert(res.m_baselineJitInfo.m_numCondBrLatePatches <= 65535);
-            fprintf(hdrFp, "    .m_numCondBrLatePatches = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_numCondBrLatePatches));
-            ReleaseAssert(res.m_baselineJitInfo.m_slowPathDataLen <= 65535);
-            fprintf(hdrFp, "    .m_slowPathDataLen = %llu,\n", static_cast<unsigned long long>(res.m_baselineJitInfo.m_slowPathDataLen));
-            ReleaseAssert(bytecodeStructLength <= 65535);
-            fprintf(hdrFp, "    .m_bytecodeLength = %llu\n", static_cast<unsigned long long>(bytecodeStructLength));
-            fprintf(hdrFp, "};\n");
-
-            for (size_t k = start; k < end; k++)
-            {
-                fprintf(hdrFp, "p->set(%llu, x_traitValue);\n", static_cast<unsigned long long>(k));
-            }
-            fprintf(hdrFp, "}\n};\n}\n\n");
-        }
-
-        // Emit C++ code that populates the Call IC trait table entries
-        //
-        {
-            using CallIcTraitDesc = DeegenBytecodeBaselineJitInfo::CallIcTraitDesc;
-            std::vector<CallIcTraitDesc> icTraitList = res.m_baselineJitInfo.m_allCallIcTraitDescs;
-            size_t icTraitTableLength = bcTraitAccessor.GetJitCallIcTraitTableLength();
-            for (CallIcTraitDesc& icTrait : icTraitList)
-            {
-                ReleaseAssert(icTrait.m_ordInTraitTable < icTraitTableLength);
-                fprintf(hdrFp, "__attribute__((__section__(\"deegen_call_ic_trait_table_section\"))) constexpr JitCallInlineCacheTraitsHolder<%llu> ",
-                        static_cast<unsigned long long>(icTrait.m_codePtrPatchRecords.size()));
-                fprintf(hdrFp, "x_deegen_jit_call_ic_trait_ord_%llu(\n", static_cast<unsigned long long>(icTrait.m_ordInTraitTable));
-
-                // If one IC has more than 8KB of code, probably something is seriously wrong...
-                //
-                ReleaseAssert(icTrait.m_allocationLength <= x_jit_mem_alloc_stepping_array[x_jit_mem_alloc_total_steppings - 1]);
-                size_t icAllocationLengthStepping = GetJitMemoryAllocatorSteppingFromSmallAllocationSize(icTrait.m_allocationLength);
-                ReleaseAssert(icAllocationLengthStepping < x_jit_mem_alloc_total_steppings);
-                ReleaseAssert(x_jit_mem_alloc_stepping_array[icAllocationLengthStepping] >= icTrait.m_allocationLength);
-                fprintf(hdrFp, "    %llu,\n", static_cast<unsigned long long>(icAllocationLengthStepping));
-                fprintf(hdrFp, "    %s /*isDirectCallMode*/,\n", (icTrait.m_isDirectCall ? "true" : "false"));
-                fprintf(hdrFp, "    std::array<JitCallInlineCacheTraits::PatchRecord, %llu> {", static_cast<unsigned long long>(icTrait.m_codePtrPatchRecords.size()));
-
-                for (size_t i = 0; i < icTrait.m_codePtrPatchRecords.size(); i++)
-                {
-                    uint64_t offset = icTrait.m_codePtrPatchRecords[i].first;
-                    bool is64 = icTrait.m_codePtrPatchRecords[i].second;
-                    ReleaseAssert(offset <= 65535);
-                    if (i > 0) { fprintf(hdrFp, ","); }
-                    fprintf(hdrFp, "\n        JitCallInlineCacheTraits::PatchRecord {\n");
-                    fprintf(hdrFp, "            .m_offset = %llu,\n", static_cast<unsigned long long>(offset));
-                    fprintf(hdrFp, "            .m_is64 = %s\n", (is64 ? "true" : "false"));
-                    fprintf(hdrFp, "        }");
-                }
-                fprintf(hdrFp, "\n    });\n\n");
-            }
-        }
-
-        // Emit C++ code that populates the allocation length stepping table of generic IC
-        //
+        hdrOutput.write(res.m_hdrContents);
+        bytecodeOriginalImplFunctionNames.push_back(res.m_originalImplFunctionName);
+        for (const std::string& m : res.m_modules)
         {
-            using GenericIcTraitDesc = AstInlineCache::BaselineJitFinalLoweringResult::TraitDesc;
-
-            std::vector<GenericIcTraitDesc> icTraitList = res.m_baselineJitInfo.m_allGenericIcTraitDescs;
-            size_t icTraitTableLength = bcTraitAccessor.GetJitGenericIcEffectTraitTableLength();
-            fprintf(hdrFp, "namespace {\n\n");
-            fprintf(hdrFp, "template<typename T> struct populate_baseline_jit_generic_ic_allocation_length_stepping_table_%s {\n", res.m_bytecodeDef->GetBytecodeIdName().c_str());
-            fprintf(hdrFp, "static consteval void run(T* p) {\n");
-            fprintf(hdrFp, "std::ignore = p;\n");
-            for (GenericIcTraitDesc& icTrait : icTraitList)
-            {
-                ReleaseAssert(icTrait.m_ordInTraitTable < icTraitTableLength);
-                // If one IC has more than 8KB of code, probably something is seriously wrong...
-                //
-                ReleaseAssert(icTrait.m_allocationLength <= x_jit_mem_alloc_stepping_array[x_jit_mem_alloc_total_steppings - 1]);
-                size_t icAllocationLengthStepping = GetJitMemoryAllocatorSteppingFromSmallAllocationSize(icTrait.m_allocationLength);
-                ReleaseAssert(icAllocationLengthStepping < x_jit_mem_alloc_total_steppings);
-                ReleaseAssert(x_jit_mem_alloc_stepping_array[icAllocationLengthStepping] >= icTrait.m_allocationLength);
-                fprintf(hdrFp, "p->set(%llu, %llu);\n",
-                        static_cast<unsigned long long>(icTrait.m_ordInTraitTable), static_cast<unsigned long long>(icAllocationLengthStepping));
-            }
-            fprintf(hdrFp, "}\n};\n}\n\n");
+            moduleToLink.push_back(getModuleFromBase64EncodedString(m));
         }
-
-        // Push generated modules to the list of modules to be linked, and also set section
-        //
-        for (auto& m : res.m_aotSlowPaths)
+        for (const std::string& fnName : res.m_functionsOkToMerge)
         {
-            Function* fn = m.m_module->getFunction(m.m_funcName);
-            ReleaseAssert(fn != nullptr);
-            fn->setSection(x_baselineJitSlowPathSectionName);
-            moduleToLink.push_back(std::move(m.m_module));
+            listOfFunctionsOkToMerge.push_back(fnName);
         }
-
-        for (auto& m : res.m_aotSlowPathReturnConts)
+        for (const std::string& fnName : res.m_fnNamesNeedToBeMadeDsoLocal)
         {
-            Function* fn = m.m_module->getFunction(m.m_funcName);
-            ReleaseAssert(fn != nullptr);
-            fn->setSection(x_baselineJitSlowPathSectionName);
-            // Return continuations are also mergeable if identical
-            //
-            listOfFunctionsOkToMerge.push_back(m.m_funcName);
-            moduleToLink.push_back(std::move(m.m_module));
+            fnNamesNeedToBeMadeDsoLocal.insert(fnName);
         }
-
-        // Compile the main codegen function module to ASM for audit purpose
-        //
-        std::string cgFnAsmForAudit = CompileLLVMModuleToAssemblyFile(res.m_baselineJitInfo.m_cgMod.get(), Reloc::Static, CodeModel::Small);
-
-        // Set up section name for main codegen function
-        //
+        for (BaselineJitBytecodeProcessResult::AuditFile& af : res.m_auditFiles)
         {
-            Function* fn = res.m_baselineJitInfo.m_cgMod->getFunction(res.m_baselineJitInfo.m_resultFuncName);
-            ReleaseAssert(fn != nullptr);
-            fn->setSection(x_baselineJitCodegenFnSectionName);
-        }
-
-        for (Function& fn : *res.m_baselineJitInfo.m_cgMod.get())
-        {
-            fnNamesNeedToBeMadeDsoLocal.insert(fn.getName().str());
-        }
-
-        moduleToLink.push_back(std::move(res.m_baselineJitInfo.m_cgMod));
-
-        // Write the codegen logic audit file
-        //
-        {
-            std::string cgFnAuditFileContents = res.m_baselineJitInfo.m_disasmForAudit + cgFnAsmForAudit;
-            std::string cgFnAuditFileName = res.m_bytecodeDef->GetBytecodeIdName() + ".s";
-
-            std::string auditFilePath = FPS_GetAuditFilePathWithTwoPartName("baseline_jit" /*dirSuffix*/, cgFnAuditFileName);
+            std::string auditFilePath = FPS_GetAuditFilePathWithTwoPartName(af.m_dirSuffix, af.m_fileName);
             TransactionalOutputFile auditFile(auditFilePath);
-            auditFile.write(cgFnAuditFileContents);
-            auditFile.Commit();
-        }
-
-        // Write the verbose audit files
-        //
-        for (size_t i = 0; i < res.m_baselineJitInfo.m_implModulesForAudit.size(); i++)
-        {
-            Module* m = res.m_baselineJitInfo.m_implModulesForAudit[i].first.get();
-            std::string fnName = res.m_baselineJitInfo.m_implModulesForAudit[i].second;
-            std::string auditFileName = res.m_bytecodeDef->GetBytecodeIdName();
-            if (i > 0)
-            {
-                size_t k = fnName.rfind("_retcont_");
-                ReleaseAssert(k != std::string::npos);
-                auditFileName += fnName.substr(k);
-            }
-            else
-            {
-                ReleaseAssert(fnName.rfind("_retcont_") == std::string::npos);
-            }
-            auditFileName += ".ll";
-            std::string auditFileContents = DumpLLVMModuleAsString(m);
-
-            std::string auditFilePath = FPS_GetAuditFilePathWithTwoPartName("baseline_jit_verbose" /*dirSuffix*/, auditFileName);
-            TransactionalOutputFile auditFile(auditFilePath);
-            auditFile.write(auditFileContents);
-            auditFile.Commit();
-        }
-
-        for (auto& extraAuditFile : res.m_baselineJitInfo.m_extraAuditFiles)
-        {
-            std::string auditFilePath = FPS_GetAuditFilePathWithTwoPartName("baseline_jit" /*dirSuffix*/, extraAuditFile.first);
-            TransactionalOutputFile auditFile(auditFilePath);
-            auditFile.write(extraAuditFile.second);
-            auditFile.Commit();
-        }
-
-        for (auto& verboseAuditFile : res.m_baselineJitInfo.m_extraVerboseAuditFiles)
-        {
-            std::string auditFilePath = FPS_GetAuditFilePathWithTwoPartName("baseline_jit_verbose" /*dirSuffix*/, verboseAuditFile.first);
-            TransactionalOutputFile auditFile(auditFilePath);
-            auditFile.write(verboseAuditFile.second);
+            auditFile.write(af.m_contents);
             auditFile.Commit();
         }
     }
 
     // Parse the origin module and each additional module generated from the interpreter lowering stage
     //
-    auto getModuleFromBase64EncodedString = [&](const std::string& str)
-    {
-        return ParseLLVMModuleFromString(ctx, "bytecode_ir_component_module" /*moduleName*/, base64_decode(str));
-    };
-
     std::unique_ptr<Module> module = getModuleFromBase64EncodedString(JSONCheckedGet<std::string>(inputJson, "reference_module"));
 
     ReleaseAssert(inputJson.count("bytecode_module_list"));
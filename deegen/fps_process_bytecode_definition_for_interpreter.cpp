@@ -207,6 +207,45 @@ void FPS_GenerateBytecodeBuilderAPIHeader()
         }
     }
 
+    fprintf(cppOutFile.fp(), "        for (size_t i = 0; i < %u; i++) {\n", SafeIntegerCast<unsigned int>(totalSize));
+    fprintf(cppOutFile.fp(), "            ReleaseAssert(r[i] != nullptr);\n");
+    fprintf(cppOutFile.fp(), "        }\n");
+    fprintf(cppOutFile.fp(), "        return r;\n");
+    fprintf(cppOutFile.fp(), "    }\n");
+
+    // Also generate the opcode names in the same order as the dispatch table, used by the interpreter opcode profiler
+    //
+    fprintf(cppOutFile.fp(), "    static constexpr auto getNames() {\n");
+    fprintf(cppOutFile.fp(), "        std::array<const char*, %u> r;\n", SafeIntegerCast<unsigned int>(totalSize));
+    fprintf(cppOutFile.fp(), "        for (size_t i = 0; i < %u; i++) {\n", SafeIntegerCast<unsigned int>(totalSize));
+    fprintf(cppOutFile.fp(), "            r[i] = nullptr;\n");
+    fprintf(cppOutFile.fp(), "        }\n");
+
+    for (json& j : jlist)
+    {
+        size_t len = j["class-names"].size();
+        for (size_t i = 0; i < len; i++)
+        {
+            std::string className = j["class-names"][i].get<std::string>();
+            auto& arr = j["cdecl-names"][i];
+            std::vector<std::string> lis;
+            for (auto& x : arr)
+            {
+                std::string val = x.get<std::string>();
+                ReleaseAssert(val.starts_with("__deegen_interpreter_op_"));
+                lis.push_back(val.substr(strlen("__deegen_interpreter_op_")));
+            }
+
+            fprintf(cppOutFile.fp(), "        {\n");
+            fprintf(cppOutFile.fp(), "            constexpr size_t base = BytecodeBuilder::GetBytecodeOpcodeBase<%s<BytecodeBuilderImpl>>();\n", className.c_str());
+            for (size_t k = 0; k < lis.size(); k++)
+            {
+                fprintf(cppOutFile.fp(), "            r[base + %d] = \"%s\";\n", static_cast<int>(k), lis[k].c_str());
+            }
+            fprintf(cppOutFile.fp(), "        }\n");
+        }
+    }
+
     fprintf(cppOutFile.fp(), "        for (size_t i = 0; i < %u; i++) {\n", SafeIntegerCast<unsigned int>(totalSize));
     fprintf(cppOutFile.fp(), "            ReleaseAssert(r[i] != nullptr);\n");
     fprintf(cppOutFile.fp(), "        }\n");
@@ -240,6 +279,16 @@ void FPS_GenerateBytecodeBuilderAPIHeader()
     }
     fprintf(cppOutFile.fp(), "\n};\n");
 
+    fprintf(cppOutFile.fp(), "\n");
+    fprintf(cppOutFile.fp(), "constexpr std::array<const char*, %u> x_tmpOpcodeNameTable = DeegenBytecodeBuilder::DeegenInterpreterDispatchTableBuilder::getNames();\n", SafeIntegerCast<unsigned int>(totalSize));
+    fprintf(cppOutFile.fp(), "extern \"C\" const char* const deegen_interpreter_opcode_name_table[%u];\n", SafeIntegerCast<unsigned int>(totalSize));
+    fprintf(cppOutFile.fp(), "extern \"C\" const char* const deegen_interpreter_opcode_name_table[%u] = {\n", SafeIntegerCast<unsigned int>(totalSize));
+    for (size_t i = 0; i < totalSize; i++)
+    {
+        fprintf(cppOutFile.fp(), "    x_tmpOpcodeNameTable[%u]%s\n", SafeIntegerCast<unsigned int>(i), (i + 1 < totalSize ? "," : ""));
+    }
+    fprintf(cppOutFile.fp(), "};\n");
+
     fprintf(cppOutFile.fp(), "#pragma clang diagnostic pop\n");
 
     // This is even more hacky.. We want to generate the list of bytecodes in the same order as the dispatching array.
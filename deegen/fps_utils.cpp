@@ -6,6 +6,8 @@
 #include "json_utils.h"
 #include "deegen_global_bytecode_trait_accessor.h"
 
+#include <atomic>
+
 void FPS_EmitHeaderFileCommonHeader(FILE* fp)
 {
     fprintf(fp, "// Generated, do not edit!\n//\n\n#pragma once\n\n");
@@ -55,7 +57,7 @@ static void CreateDirIfNeeded(const std::string& dirPath)
         int err = errno;
         if (err != EEXIST)
         {
-            fprintf(stderr, "Failed to create audit file directory '%s', error = %d (%s)\n",
+            fprintf(stderr, "Failed to create directory '%s', error = %d (%s)\n",
                     dirPath.c_str(), err, strerror(err));
             abort();
         }
@@ -98,6 +100,62 @@ std::string WARN_UNUSED FPS_GetFileNameFromAbsolutePath(const std::string& filen
     return filename.substr(k + 1);
 }
 
+std::string WARN_UNUSED FPS_GetCacheFilePath(const std::string& filename)
+{
+    std::string cacheDirPath = cl_cacheDirPath;
+    ReleaseAssert(cacheDirPath != "");
+    if (cacheDirPath.ends_with("/"))
+    {
+        cacheDirPath = cacheDirPath.substr(0, cacheDirPath.length() - 1);
+    }
+    ReleaseAssert(cacheDirPath != "");
+    CreateDirIfNeeded(cacheDirPath);
+    return cacheDirPath + "/" + filename;
+}
+
+void FPS_ParallelFor(size_t n, const std::function<void(size_t)>& fn)
+{
+    size_t numThreads = cl_numThreads;
+    if (numThreads == 0)
+    {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    numThreads = std::min(numThreads, n);
+
+    if (numThreads <= 1)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    // Each worker repeatedly grabs the next unprocessed index, so a few expensive tasks do not hold up the others
+    //
+    std::atomic<size_t> nextTask { 0 };
+    std::vector<std::thread> workers;
+    for (size_t k = 0; k < numThreads; k++)
+    {
+        workers.push_back(std::thread([&]() {
+            while (true)
+            {
+                size_t i = nextTask.fetch_add(1, std::memory_order_relaxed);
+                if (i >= n)
+                {
+                    break;
+                }
+                fn(i);
+            }
+        }));
+    }
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
 namespace dast {
 
 BytecodeOpcodeRawValueMap WARN_UNUSED BytecodeOpcodeRawValueMap::ParseFromCommandLineArgs()
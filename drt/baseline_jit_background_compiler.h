@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+#include "concurrent_queue.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+class VM;
+class CodeBlock;
+struct BaselineJitCompilationTask;
+
+// Compiles CodeBlocks to baseline JIT code on a dedicated compiler thread, so that tiering up does not pause
+// the execution thread (which matters for scripts that load and warm up thousands of functions at startup).
+//
+// The work is split into three steps:
+// 1. On the execution thread, the bytecode stream is snapshotted (the interpreter may still quicken the live stream),
+//    the code size is computed from the snapshot, and the JIT memory and the BaselineCodeBlock are allocated.
+//    This is a single pass over the bytecode, and keeps the JIT memory allocator single-threaded.
+// 2. On the compiler thread, the code is emitted and all the branches are patched.
+// 3. On the execution thread, at the next tier-up check of any CodeBlock, the BaselineCodeBlock is attached to
+//    its CodeBlock and the CodeBlock's best entry point (and all call inline caches) is updated to the JIT code.
+//
+// Only the execution thread may call the public functions.
+//
+class BaselineJitBackgroundCompiler
+{
+    MAKE_NONCOPYABLE(BaselineJitBackgroundCompiler);
+    MAKE_NONMOVABLE(BaselineJitBackgroundCompiler);
+
+public:
+    BaselineJitBackgroundCompiler(VM* vm);
+
+    // Unfinished compilations are abandoned (the CodeBlocks stay in the interpreter)
+    //
+    ~BaselineJitBackgroundCompiler();
+
+    // Enqueue 'cb' for compilation. Return false if 'cb' is already enqueued.
+    //
+    bool Enqueue(CodeBlock* cb);
+
+    bool IsEnqueued(CodeBlock* cb) { return m_enqueuedCodeBlocks.count(cb) > 0; }
+
+    size_t GetNumEnqueuedCodeBlocks() { return m_enqueuedCodeBlocks.size(); }
+
+    // Attach the finished compilations to their CodeBlocks
+    //
+    void PublishFinishedCompilations();
+
+    // Wait until every enqueued CodeBlock is compiled, and attach them to their CodeBlocks
+    //
+    void WaitForAllCompilations();
+
+private:
+    void CompilerThreadMain();
+
+    VM* m_vm;
+
+    // CodeBlocks that are enqueued but not published yet (execution thread only)
+    //
+    std::unordered_set<CodeBlock*> m_enqueuedCodeBlocks;
+
+    ConcurrentQueue<BaselineJitCompilationTask*> m_pendingTasks;
+    ConcurrentQueue<BaselineJitCompilationTask*> m_finishedTasks;
+
+    // Protects the counters below, which are only used for the threads to sleep and wake up
+    //
+    std::mutex m_lock;
+    std::condition_variable m_condVar;
+    size_t m_numPendingTasks;
+    size_t m_numFinishedTasks;
+    bool m_compilerThreadShouldExit;
+
+    std::thread m_compilerThread;
+};
@@ -1,6 +1,9 @@
 #include "baseline_jit_codegen_helper.h"
 #include "runtime_utils.h"
 #include "bytecode_builder.h"
+#include "baseline_jit_background_compiler.h"
+#include "persistent_hot_function_cache.h"
+#include "deegen_options.h"
 
 // These tables are generated by Deegen
 //
@@ -52,14 +55,57 @@ static BaselineJitFunctionEntryLogicTraits WARN_UNUSED ALWAYS_INLINE GetBaseline
 
 using BytecodeOpcodeTy = DeegenBytecodeBuilder::BytecodeBuilder::BytecodeOpcodeTy;
 
-BaselineCodeBlock* NO_INLINE deegen_baseline_jit_do_codegen(CodeBlock* cb)
+// The codegen may overwrite at most this many bytes after each section
+//
+constexpr size_t x_maxBytesCodegenFnMayOverwrite = 7;
+
+// A baseline JIT compilation in progress, see BaselineJitBackgroundCompiler
+//
+struct BaselineJitCompilationTask
+{
+    CodeBlock* m_codeBlock;
+    BaselineCodeBlock* m_baselineCodeBlock;
+    // The bytecode stream to compile from. This is either the CodeBlock's own bytecode stream,
+    // or a snapshot of it owned by this task (when compiling on the compiler thread)
+    //
+    uint8_t* m_bytecodeStream;
+    uint8_t* m_bytecodeSnapshot;
+    BaselineJitFunctionEntryLogicTraits m_fnPrologueInfo;
+    uint8_t* m_dataSecPtr;
+    uint8_t* m_fastPathSecPtr;
+    uint8_t* m_slowPathSecPtr;
+    size_t m_fastPathCodeLen;
+    size_t m_slowPathCodeLen;
+    size_t m_dataSectionCodeLen;
+    size_t m_numLateCondBrPatches;
+    size_t m_slowPathDataStreamLen;
+    size_t m_numBytecodes;
+};
+
+// Compute the code size and allocate the JIT memory and the BaselineCodeBlock. Execution thread only.
+//
+static BaselineJitCompilationTask* WARN_UNUSED PrepareBaselineJitCompilation(CodeBlock* cb, bool snapshotBytecode)
 {
     // Each CodeBlock should be codegen'ed only once.
     // Be extra careful to catch such bugs, as these will not show up as correctness issues but cause silent performance regressions.
     //
     ReleaseAssert(cb->m_baselineCodeBlock == nullptr);
 
-    uint8_t* bytecodeStream = cb->GetBytecodeStream();
+    BaselineJitCompilationTask* task = new BaselineJitCompilationTask();
+    task->m_codeBlock = cb;
+    task->m_bytecodeSnapshot = nullptr;
+    task->m_bytecodeStream = cb->GetBytecodeStream();
+    if (snapshotBytecode)
+    {
+        // The interpreter may keep quickening the bytecode while the compiler thread is working on it,
+        // and the compiler must see the same opcodes in the size computation pass and in the codegen pass
+        //
+        task->m_bytecodeSnapshot = new uint8_t[cb->m_bytecodeLength];
+        memcpy(task->m_bytecodeSnapshot, cb->GetBytecodeStream(), cb->m_bytecodeLength);
+        task->m_bytecodeStream = task->m_bytecodeSnapshot;
+    }
+
+    uint8_t* bytecodeStream = task->m_bytecodeStream;
     uint8_t* bytecodeStreamEnd = bytecodeStream + cb->m_bytecodeLength - DeegenBytecodeBuilder::BytecodeBuilder::x_numExtraPaddingAtEnd;
 
     // Get the function entry logic trait based on the function prototype
@@ -103,7 +149,6 @@ BaselineCodeBlock* NO_INLINE deegen_baseline_jit_do_codegen(CodeBlock* cb)
     //     [ Data Section ] [ Fast Path ] [ Slow Path ]
     // Note that however, the codegen may overwrite at most 7 more bytes after each section, so allocation must account for that.
     //
-    constexpr size_t x_maxBytesCodegenFnMayOverwrite = 7;
     size_t fastPathSectionOffset = dataSectionCodeLen;
     if (dataSectionCodeLen > 0)
     {
@@ -130,7 +175,6 @@ BaselineCodeBlock* NO_INLINE deegen_baseline_jit_do_codegen(CodeBlock* cb)
     // TODO: right now the data section is also marked executable because we just use one mmap for simplicity..
     //
     VM* vm = VM::GetActiveVMForCurrentThread();
-    vm->IncrementNumTotalBaselineJitCompilations();
     JitMemoryAllocator* jitAlloc = vm->GetJITMemoryAlloc();
     void* regionVoidPtr = jitAlloc->AllocateGivenSize(totalJitRegionSize);
     assert(regionVoidPtr != nullptr);
@@ -144,17 +188,49 @@ BaselineCodeBlock* NO_INLINE deegen_baseline_jit_do_codegen(CodeBlock* cb)
     uint8_t* fastPathSecPtr = dataSecPtr + fastPathSectionOffset;
     uint8_t* slowPathSecPtr = dataSecPtr + slowPathSectionOffset;
 
-    uint8_t* fastPathSecTrueEnd = fastPathSecPtr + fastPathCodeLen;
-    uint8_t* slowPathSecTrueEnd = slowPathSecPtr + slowPathCodeLen;
-
-    // Set up the BaselineCodeBlock
+    // Set up the BaselineCodeBlock. It is attached to the CodeBlock only when the compilation is published.
     //
-    BaselineCodeBlock* bcb = BaselineCodeBlock::Create(cb,
-                                                       SafeIntegerCast<uint32_t>(numBytecodes),
-                                                       SafeIntegerCast<uint32_t>(slowPathDataStreamLen),
-                                                       fastPathSecPtr /*jitCodeEntry*/,
-                                                       dataSecPtr /*jitRegionStart*/,
-                                                       SafeIntegerCast<uint32_t>(totalJitRegionSize));
+    task->m_baselineCodeBlock = BaselineCodeBlock::Create(cb,
+                                                          SafeIntegerCast<uint32_t>(numBytecodes),
+                                                          SafeIntegerCast<uint32_t>(slowPathDataStreamLen),
+                                                          fastPathSecPtr /*jitCodeEntry*/,
+                                                          dataSecPtr /*jitRegionStart*/,
+                                                          SafeIntegerCast<uint32_t>(totalJitRegionSize));
+
+    task->m_fnPrologueInfo = fnPrologueInfo;
+    task->m_dataSecPtr = dataSecPtr;
+    task->m_fastPathSecPtr = fastPathSecPtr;
+    task->m_slowPathSecPtr = slowPathSecPtr;
+    task->m_fastPathCodeLen = fastPathCodeLen;
+    task->m_slowPathCodeLen = slowPathCodeLen;
+    task->m_dataSectionCodeLen = dataSectionCodeLen;
+    task->m_numLateCondBrPatches = numLateCondBrPatches;
+    task->m_slowPathDataStreamLen = slowPathDataStreamLen;
+    task->m_numBytecodes = numBytecodes;
+    return task;
+}
+
+// Emit the JIT code. May run on any thread: it only touches memory owned by the task, and reads the CodeBlock's immutable fields.
+//
+static void RunBaselineJitCompilation(BaselineJitCompilationTask* task)
+{
+    CodeBlock* cb = task->m_codeBlock;
+    BaselineCodeBlock* bcb = task->m_baselineCodeBlock;
+    BaselineJitFunctionEntryLogicTraits fnPrologueInfo = task->m_fnPrologueInfo;
+
+    uint8_t* bytecodeStream = task->m_bytecodeStream;
+    [[maybe_unused]] uint8_t* bytecodeStreamEnd = bytecodeStream + cb->m_bytecodeLength - DeegenBytecodeBuilder::BytecodeBuilder::x_numExtraPaddingAtEnd;
+
+    uint8_t* dataSecPtr = task->m_dataSecPtr;
+    uint8_t* fastPathSecPtr = task->m_fastPathSecPtr;
+    uint8_t* slowPathSecPtr = task->m_slowPathSecPtr;
+
+    uint8_t* fastPathSecTrueEnd = fastPathSecPtr + task->m_fastPathCodeLen;
+    uint8_t* slowPathSecTrueEnd = slowPathSecPtr + task->m_slowPathCodeLen;
+
+    size_t numLateCondBrPatches = task->m_numLateCondBrPatches;
+    [[maybe_unused]] size_t slowPathDataStreamLen = task->m_slowPathDataStreamLen;
+    [[maybe_unused]] size_t numBytecodes = task->m_numBytecodes;
 
     BaselineCodeBlock::SlowPathDataAndBytecodeOffset* slowPathDataIndexArray = bcb->m_sbIndex;
     uint8_t* slowPathDataStreamStart = bcb->GetSlowPathDataStreamStart();
@@ -200,7 +276,7 @@ BaselineCodeBlock* NO_INLINE deegen_baseline_jit_do_codegen(CodeBlock* cb)
         //
         assert(ctl.m_actualJitFastPathEnd == fastPathSecTrueEnd);
         assert(ctl.m_actualJitSlowPathEnd == slowPathSecTrueEnd);
-        assert(ctl.m_actualJitDataSecEnd == dataSecPtr + dataSectionCodeLen);
+        assert(ctl.m_actualJitDataSecEnd == dataSecPtr + task->m_dataSectionCodeLen);
         assert(ctl.m_actualCondBrPatchesArrayEnd == condBrLatePatchList + numLateCondBrPatches);
         assert(ctl.m_actualSlowPathDataEnd == slowPathDataStreamStart + slowPathDataStreamLen);
         assert(ctl.m_actualSlowPathDataIndexArrayEnd == slowPathDataIndexArray + numBytecodes);
@@ -209,6 +285,22 @@ BaselineCodeBlock* NO_INLINE deegen_baseline_jit_do_codegen(CodeBlock* cb)
         assert(ctl.m_actualBytecodeStreamEnd == bytecodeStreamEnd);
     }
 
+    // The codegen records the lower 32 bits of the bytecode pointers it sees.
+    // If we compiled from a snapshot, relocate them to the CodeBlock's bytecode stream.
+    //
+    if (bytecodeStream != cb->GetBytecodeStream())
+    {
+        uint32_t diff = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(cb->GetBytecodeStream())) - static_cast<uint32_t>(reinterpret_cast<uintptr_t>(bytecodeStream));
+        for (size_t i = 0; i < bcb->m_numBytecodes; i++)
+        {
+            bcb->m_sbIndex[i].m_bytecodePtr32 += diff;
+        }
+        for (size_t i = 0; i < numLateCondBrPatches; i++)
+        {
+            condBrLatePatchList[i].m_dstBytecodePtrLow32bits += diff;
+        }
+    }
+
     // Sanity check that the SlowPathDataIndex array makes sense
     //
 #ifndef NDEBUG
@@ -298,15 +390,149 @@ BaselineCodeBlock* NO_INLINE deegen_baseline_jit_do_codegen(CodeBlock* cb)
         populateCodeGap(fastPathSecTrueEnd);
         populateCodeGap(slowPathSecTrueEnd);
     }
+}
+
+// Attach the BaselineCodeBlock to the CodeBlock and switch the CodeBlock to the JIT code. Execution thread only.
+//
+static BaselineCodeBlock* PublishBaselineJitCompilation(BaselineJitCompilationTask* task)
+{
+    CodeBlock* cb = task->m_codeBlock;
+    BaselineCodeBlock* bcb = task->m_baselineCodeBlock;
+
+    TestAssert(cb->m_baselineCodeBlock == nullptr);
+    cb->m_baselineCodeBlock = bcb;
+    VM::GetActiveVMForCurrentThread()->IncrementNumTotalBaselineJitCompilations();
 
     // Update best entry point from interpreter code to baseline JIT code
     //
     assert(cb->m_bestEntryPoint == cb->m_owner->GetInterpreterEntryPoint());
     cb->UpdateBestEntryPoint(bcb->m_jitCodeEntry);
     assert(cb->m_bestEntryPoint == bcb->m_jitCodeEntry);
+
+    delete [] task->m_bytecodeSnapshot;
+    delete task;
     return bcb;
 }
 
+BaselineCodeBlock* NO_INLINE deegen_baseline_jit_do_codegen(CodeBlock* cb)
+{
+    BaselineJitCompilationTask* task = PrepareBaselineJitCompilation(cb, false /*snapshotBytecode*/);
+    RunBaselineJitCompilation(task);
+    return PublishBaselineJitCompilation(task);
+}
+
+BaselineJitBackgroundCompiler::BaselineJitBackgroundCompiler(VM* vm)
+    : m_vm(vm)
+    , m_numPendingTasks(0)
+    , m_numFinishedTasks(0)
+    , m_compilerThreadShouldExit(false)
+{
+    m_compilerThread = std::thread([this]() { CompilerThreadMain(); });
+}
+
+BaselineJitBackgroundCompiler::~BaselineJitBackgroundCompiler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_compilerThreadShouldExit = true;
+    }
+    m_condVar.notify_all();
+    m_compilerThread.join();
+
+    // The JIT memory of the abandoned compilations is released together with the VM's JIT memory allocator
+    //
+    auto dropTasks = [&](ConcurrentQueue<BaselineJitCompilationTask*>& queue)
+    {
+        BaselineJitCompilationTask* task;
+        while (queue.try_dequeue(task))
+        {
+            delete [] reinterpret_cast<uint64_t*>(task->m_baselineCodeBlock);
+            delete [] task->m_bytecodeSnapshot;
+            delete task;
+        }
+    };
+    dropTasks(m_pendingTasks);
+    dropTasks(m_finishedTasks);
+}
+
+bool BaselineJitBackgroundCompiler::Enqueue(CodeBlock* cb)
+{
+    assert(IsExecutionThread());
+    if (cb->m_baselineCodeBlock != nullptr || m_enqueuedCodeBlocks.count(cb))
+    {
+        return false;
+    }
+    m_enqueuedCodeBlocks.insert(cb);
+    BaselineJitCompilationTask* task = PrepareBaselineJitCompilation(cb, true /*snapshotBytecode*/);
+    m_pendingTasks.enqueue(task);
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_numPendingTasks++;
+    }
+    m_condVar.notify_all();
+    return true;
+}
+
+void BaselineJitBackgroundCompiler::PublishFinishedCompilations()
+{
+    assert(IsExecutionThread());
+    BaselineJitCompilationTask* task;
+    while (m_finishedTasks.try_dequeue(task))
+    {
+        CodeBlock* cb = task->m_codeBlock;
+        assert(m_enqueuedCodeBlocks.count(cb));
+        m_enqueuedCodeBlocks.erase(cb);
+        std::ignore = PublishBaselineJitCompilation(task);
+    }
+}
+
+void BaselineJitBackgroundCompiler::WaitForAllCompilations()
+{
+    assert(IsExecutionThread());
+    while (true)
+    {
+        PublishFinishedCompilations();
+        if (m_enqueuedCodeBlocks.empty())
+        {
+            break;
+        }
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_condVar.wait(lock, [&]() { return m_numFinishedTasks > 0; });
+        m_numFinishedTasks = 0;
+    }
+}
+
+void BaselineJitBackgroundCompiler::CompilerThreadMain()
+{
+    t_threadKind = CompilerThread;
+    m_vm->SetUpSegmentationRegister();
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_condVar.wait(lock, [&]() { return m_numPendingTasks > 0 || m_compilerThreadShouldExit; });
+            if (m_compilerThreadShouldExit)
+            {
+                return;
+            }
+            m_numPendingTasks--;
+        }
+
+        BaselineJitCompilationTask* task;
+        bool success = m_pendingTasks.try_dequeue(task);
+        ReleaseAssert(success);
+        RunBaselineJitCompilation(task);
+        m_finishedTasks.enqueue(task);
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_numFinishedTasks++;
+        }
+        m_condVar.notify_all();
+    }
+}
+
 JitGenericInlineCacheEntry* WARN_UNUSED JitGenericInlineCacheEntry::Create(VM* vm,
                                                                            SpdsPtr<JitGenericInlineCacheEntry> nextNode,
                                                                            uint16_t icTraitKind)
@@ -331,10 +557,61 @@ void* WARN_UNUSED JitGenericInlineCacheSite::Insert(uint16_t traitKind)
     return entry->m_jitAddr;
 }
 
+// Remember that 'cb' got hot, so that on the next run it is compiled as soon as it is loaded
+//
+static void RecordHotFunctionInPersistentCache(CodeBlock* cb)
+{
+    PersistentHotFunctionCache* cache = VM::GetActiveVMForCurrentThread()->GetPersistentHotFunctionCache();
+    if (cache != nullptr)
+    {
+        cache->RecordHotFunction(PersistentHotFunctionCache::ComputeKey(cb->m_owner));
+    }
+}
+
+// If background compilation is enabled, enqueue 'cb' for compilation (if not already) and publish the finished compilations.
+// Return true if 'cb' should keep running in the interpreter for now.
+//
+static bool WARN_UNUSED ShouldStayInInterpreterForBackgroundCompilation(CodeBlock* cb)
+{
+    if (cb->m_baselineCodeBlock != nullptr)
+    {
+        return false;
+    }
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    if (!vm->IsBackgroundBaselineJitCompilationEnabled())
+    {
+        return false;
+    }
+    BaselineJitBackgroundCompiler* compiler = vm->GetBaselineJitBackgroundCompiler();
+    std::ignore = compiler->Enqueue(cb);
+    compiler->PublishFinishedCompilations();
+    if (cb->m_baselineCodeBlock != nullptr)
+    {
+        return false;
+    }
+    // Check again after the function has run for a while in the interpreter
+    //
+    cb->m_interpreterTierUpCounter = x_interpreter_tier_up_background_compilation_poll_interval_bytecode_length_multiplier * static_cast<int64_t>(cb->m_bytecodeLength);
+    return true;
+}
+
 BaselineCodeBlockAndEntryPoint NO_INLINE WARN_UNUSED deegen_prepare_tier_up_into_baseline_jit(HeapPtr<CodeBlock> cbHeapPtr)
 {
     CodeBlock* cb = TranslateToRawPointer(cbHeapPtr);
-    BaselineCodeBlock* bcb = deegen_baseline_jit_do_codegen(cb);
+    RecordHotFunctionInPersistentCache(cb);
+    if (ShouldStayInInterpreterForBackgroundCompilation(cb))
+    {
+        return {
+            .baselineCodeBlock = nullptr,
+            .entryPoint = cb->m_owner->GetInterpreterEntryPoint()
+        };
+    }
+
+    BaselineCodeBlock* bcb = cb->m_baselineCodeBlock;
+    if (bcb == nullptr)
+    {
+        bcb = deegen_baseline_jit_do_codegen(cb);
+    }
     return {
         .baselineCodeBlock = bcb,
         .entryPoint = bcb->m_jitCodeEntry
@@ -343,6 +620,17 @@ BaselineCodeBlockAndEntryPoint NO_INLINE WARN_UNUSED deegen_prepare_tier_up_into
 
 BaselineCodeBlockAndEntryPoint NO_INLINE WARN_UNUSED deegen_prepare_osr_entry_into_baseline_jit(CodeBlock* cb, void* curBytecode)
 {
+    RecordHotFunctionInPersistentCache(cb);
+    if (ShouldStayInInterpreterForBackgroundCompilation(cb))
+    {
+        // The caller resumes interpreting 'curBytecode'
+        //
+        return {
+            .baselineCodeBlock = nullptr,
+            .entryPoint = nullptr
+        };
+    }
+
     BaselineCodeBlock* bcb;
     if (cb->m_baselineCodeBlock != nullptr)
     {
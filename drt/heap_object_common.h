@@ -109,10 +109,17 @@ PP_FOR_EACH(macro, HEAP_OBJECT_INFO_LIST)
 template<typename T>
 constexpr bool TypeMayLiveInUserHeap = TypeMayLiveInUserHeapImpl<T>::value;
 
+// White: the cell has not been marked (for a cell allocated after the last collection, this means it is young)
+// Black: the cell has been marked (survived the last collection, so it is old)
+// Remembered: an old cell that has been written to since the last collection, and is recorded in the remembered set
+//
+// The write barrier slow path is only taken for Black cells, so every state other than Black must compare greater than it.
+//
 enum class GcCellState: uint8_t
 {
     Black = 0,
-    White = 1
+    White = 1,
+    Remembered = 2
 };
 static constexpr GcCellState x_defaultCellState = GcCellState::White;
 
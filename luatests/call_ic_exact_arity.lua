@@ -0,0 +1,46 @@
+-- A call site passing a constant number of arguments may cache the callee's exact-arity entry, which skips
+-- the argument fixup. Check that calls stay correct when the callee of a call site changes its arity or varargs-ness,
+-- and when the callee tiers up while being cached
+
+local function f0() return "f0" end
+local function f1(a) return a end
+local function f2(a, b) return b end
+local function f3(a, b, c) return c end
+local function fva(a, ...) return select('#', ...) end
+local function fva2(a, b, ...) return (a or 0) + (b or 0) + select('#', ...) end
+
+local fns = { f0, f1, f2, f3, fva, fva2 }
+
+local function callWithTwo(f)
+	local r = f(10, 20)
+	return r
+end
+
+local function tailCallWithTwo(f)
+	return f(10, 20)
+end
+
+local function callWithNone(f)
+	local r = f()
+	return r
+end
+
+for round = 1, 3 do
+	for i = 1, #fns do
+		print(i, callWithTwo(fns[i]), tailCallWithTwo(fns[i]), callWithNone(fns[i]))
+	end
+end
+
+local function add3(a, b, c) return a + (b or 0) + (c or 0) end
+local s = 0
+for i = 1, 20000 do
+	s = s + add3(i, 1) + add3(i, 1, 2) + add3(i, 1, 2, 3)
+end
+print(s)
+
+local function cnt(a, ...) return select('#', ...) + a end
+local t = 0
+for i = 1, 20000 do
+	t = t + cnt(1) + cnt(1, 2) + cnt(1, 2, 3)
+end
+print(t)
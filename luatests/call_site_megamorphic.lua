@@ -0,0 +1,33 @@
+-- A call site that sees more distinct targets than the JIT call IC can cache calls the extra targets through the
+-- IC miss slow path (and records them into its megamorphic profile if enabled). The calls must still reach the right targets
+
+local function f1(x) return x + 1 end
+local function f2(x) return x * 2 end
+local function f3(x) return x - 3 end
+local function f4(x) return x * x end
+local function f5(x) return -x end
+local function f6(x) return x % 7 end
+local function f7(x) return x + 100 end
+local function f8(x) return 1 end
+
+local fns = { f1, f2, f3, f4, f5, f6, f7, f8, math.abs, math.floor }
+
+local s = 0
+for i = 1, 1000 do
+	s = s + fns[(i % #fns) + 1](i)
+end
+print(s)
+
+local cnt = {}
+for i = 1, #fns do
+	cnt[i] = 0
+end
+for i = 1, 100 do
+	local k = (i * 7) % #fns + 1
+	if fns[k](k) == fns[k](k) then
+		cnt[k] = cnt[k] + 1
+	end
+end
+for i = 1, #fns do
+	print(i, cnt[i])
+end
@@ -0,0 +1,73 @@
+-- Creates and finishes lots of coroutines, so that the stacks of dead coroutines are recycled
+--
+local function gen(n)
+  return coroutine.wrap(function()
+    for i = 1, n do coroutine.yield(i) end
+  end)
+end
+
+local total = 0
+for k = 1, 2000 do
+  for v in gen(k % 7) do total = total + v end
+end
+print(total)
+
+-- Closures that capture locals of a coroutine must still see the values after the coroutine is dead
+--
+local getters = {}
+for k = 1, 200 do
+  local co = coroutine.create(function(x)
+    local captured = x * 2
+    local function get() return captured end
+    local function set(v) captured = v end
+    coroutine.yield(get)
+    return get, set
+  end)
+  local _, g0 = coroutine.resume(co, k)
+  local _, g, s = coroutine.resume(co)
+  assert(g0 == g)
+  assert(coroutine.status(co) == "dead")
+  s(g() + 1)
+  getters[k] = g
+end
+-- Create more coroutines that reuse the recycled stacks, overwriting them
+--
+for k = 1, 200 do
+  local co = coroutine.wrap(function() local a, b, c = k, k, k; coroutine.yield(a + b + c) end)
+  co()
+end
+local sum = 0
+for k = 1, 200 do
+  assert(getters[k]() == k * 2 + 1)
+  sum = sum + getters[k]()
+end
+print(sum)
+
+-- Coroutines that die by an error also give their stacks back
+--
+local numErrors = 0
+for k = 1, 500 do
+  local co = coroutine.create(function(x)
+    coroutine.yield(x)
+    error("boom " .. x)
+  end)
+  coroutine.resume(co, k)
+  local ok, msg = coroutine.resume(co)
+  assert(not ok and coroutine.status(co) == "dead")
+  if string.find(msg, "boom " .. k, 1, true) then numErrors = numErrors + 1 end
+end
+print(numErrors)
+
+local ok, msg = pcall(function()
+  local f = coroutine.wrap(function() error("wrapped") end)
+  f()
+end)
+print(ok, string.find(msg, "wrapped", 1, true) ~= nil)
+
+-- A fresh coroutine on a recycled stack starts with a clean state
+--
+local co = coroutine.wrap(function(...)
+  local a, b, c, d
+  coroutine.yield(select('#', ...), a, b, c, d)
+end)
+print(co(1, 2, 3))
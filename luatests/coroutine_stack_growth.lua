@@ -0,0 +1,54 @@
+-- The stack of a coroutine starts small and is relocated when it grows,
+-- while suspended frames and open upvalues point into it
+
+local function sum(n)
+	if n == 0 then return 0 end
+	return n + sum(n - 1)
+end
+
+local co = coroutine.create(function(n)
+	local counter = 0
+	local function bump() counter = counter + 1 end
+	local function rec(k)
+		bump()
+		if k == 0 then
+			coroutine.yield(counter)
+			return 0
+		end
+		return 1 + rec(k - 1)
+	end
+	local depth = rec(n)
+	return depth, counter, sum(n)
+end)
+
+print(coroutine.resume(co, 20000))
+print(coroutine.resume(co))
+print(coroutine.status(co))
+
+-- Growing the stack of a suspended coroutine to pass lots of values to it
+--
+local t = {}
+for i = 1, 3000 do t[i] = i end
+
+local co2 = coroutine.wrap(function(...)
+	local n = select('#', ...)
+	while true do
+		local a, b = ...
+		n = select('#', coroutine.yield(n, a, b))
+	end
+end)
+print(co2(unpack(t)))
+print(co2(unpack(t, 1, 2000)))
+print(co2(sum(100)))
+
+-- Lots of coroutines, each of which only uses a small stack
+--
+local cos = {}
+for i = 1, 1000 do
+	cos[i] = coroutine.wrap(function(x)
+		while true do x = coroutine.yield(x + i) end
+	end)
+end
+local total = 0
+for i = 1, 1000 do total = total + cos[i](i) end
+print(total)
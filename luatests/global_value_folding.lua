@@ -0,0 +1,91 @@
+-- The values of global variables may be folded into the code that reads them,
+-- so overwriting a global (in any way) must be seen by all its readers
+
+function f(x)
+	return x + 1
+end
+
+local function callF(n)
+	local s = 0
+	for i = 1, n do
+		s = s + f(i)
+	end
+	return s
+end
+
+print(callF(1000))
+
+function f(x)
+	return x * 2
+end
+print(callF(1000))
+
+-- Overwrite the global in the loop that reads it
+--
+function g(x)
+	return 1
+end
+local function h(x)
+	return 2
+end
+local s = 0
+for i = 1, 1000 do
+	s = s + g(i)
+	if i == 500 then
+		g = h
+	end
+end
+print(s)
+
+-- Writes through _G and rawset
+--
+counter = 10
+local function readCounter()
+	return counter
+end
+local t = 0
+for i = 1, 300 do
+	t = t + readCounter()
+	if i == 100 then
+		_G.counter = 20
+	elseif i == 200 then
+		rawset(_G, "counter", 30)
+	end
+end
+print(t)
+
+-- A global that is written all the time
+--
+total = 0
+for i = 1, 1000 do
+	total = total + i
+end
+print(total)
+
+-- Replace a library table
+--
+local function useMath(n)
+	local r = 0
+	for i = 1, n do
+		r = r + math.floor(i / 2)
+	end
+	return r
+end
+print(useMath(10))
+local oldMath = math
+math = { floor = function(x) return -1 end }
+print(useMath(10))
+math = oldMath
+print(useMath(10))
+
+-- Set a global to nil and back
+--
+someGlobal = 'a'
+local function readSomeGlobal()
+	return someGlobal
+end
+print(readSomeGlobal(), readSomeGlobal())
+someGlobal = nil
+print(readSomeGlobal())
+someGlobal = 'b'
+print(readSomeGlobal())
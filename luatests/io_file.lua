@@ -0,0 +1,73 @@
+local name = "luatests/io_file_input.txt"
+
+print(io.type(io.stdout), io.type(42), io.type(nil))
+print(tostring(io.stdout):sub(1, 6))
+
+-- io.lines closes the file at EOF
+local n = 0
+for line in io.lines(name) do
+	n = n + 1
+	print(n, "[" .. line .. "]")
+end
+
+-- formats
+local f = assert(io.open(name, "r"))
+print(io.type(f))
+print(f:read(5), f:read(0), f:read("*l"))
+print(f:read("*n", "*n", "*n"))
+print(f:read("*l"))
+print(f:read("*l"))
+print(f:read(4))
+print(f:read("*a"))
+print(f:read("*a"), f:read("*l"), f:read(1), f:read(0))
+print(f:seek("set", 6), f:read(5))
+print(f:seek("cur"), f:seek("end"))
+print(f:close())
+print(io.type(f), tostring(f))
+print(pcall(f.read, f))
+
+-- file:lines does not close the file
+f = assert(io.open(name))
+local cnt = 0
+for line in f:lines() do
+	cnt = cnt + #line
+end
+print(cnt, io.type(f))
+f:close()
+
+-- write, then read back through the same handle
+local t = io.tmpfile()
+print(t:write("abc", 12, "\n", 1.5, "\n"))
+print(t:seek("set"))
+print(t:read("*a"))
+t:seek("set", 0)
+for i = 1, 1000 do
+	t:write(i, "\n")
+end
+t:seek("set")
+local sum = 0
+for line in t:lines() do
+	sum = sum + tonumber(line)
+end
+print(sum)
+t:seek("set")
+local s = t:read("*a")
+print(#s, s:sub(1, 6) == "1\n2\n3\n")
+t:close()
+
+-- errors
+print(io.open("luatests/this_file_does_not_exist.txt") == nil)
+print(pcall(io.open, name, "rw"))
+print(pcall(io.lines, "luatests/this_file_does_not_exist.txt") == false)
+f = io.open(name)
+print(pcall(f.read, f, "*x"))
+f:close()
+print(io.close(io.stdout))
+
+-- the default output
+print(io.output() == io.stdout, io.input() == io.stdin)
+io.write("written ", 1, " ", 2.5, "\n")
+print(io.write("") == true)
+
+-- stdout and stderr are seekable when they are redirected to a regular file
+print(io.stdout:seek("cur") > 0, type(io.stderr:seek("cur")))
@@ -0,0 +1,47 @@
+local function add(a, b)
+	return a + b
+end
+
+local s = string.dump(add)
+print(type(s), string.sub(s, 1, 1) == "\27")
+
+local add2 = loadstring(s)
+print(type(add2), add2 == add)
+print(add2(1, 2), add2(1.5, 2.25))
+
+-- The snapshot may also be loaded piece by piece
+--
+local parts = { string.sub(s, 1, 5), string.sub(s, 6) }
+local i = 0
+local add3 = load(function() i = i + 1; return parts[i] end)
+print(add3(10, 20))
+
+-- Nested closures, string constants and template tables survive the round trip
+--
+local function make()
+	local t = { x = 1, y = "str", [true] = false, 10, 20, 30, [0.5] = "half", [-1] = "neg" }
+	local function counter(step)
+		local n = 0
+		return function()
+			n = n + step
+			return n, t.y
+		end
+	end
+	local c = counter(3)
+	c()
+	return c(), t.x, t[true], t[1], t[2], t[3], t[0.5], t[-1]
+end
+
+local make2 = loadstring(string.dump(make))
+print(make())
+print(make2())
+
+-- Functions with upvalues and C functions cannot be dumped
+--
+local up = 1
+local function getUp() return up end
+print((pcall(string.dump, getUp)))
+print((pcall(string.dump, print)))
+print((pcall(string.dump, 123)))
+
+print(loadstring("\27garbage"))
@@ -0,0 +1,89 @@
+-- string.find
+--
+print(string.find("hello world", "wor"))
+print(string.find("hello world", "o", 6))
+print(string.find("hello world", "l+"))
+print(string.find("hello world", "xyz"))
+print(string.find("a.b.c", ".", 1, true))
+print(string.find("a+b", "+", 1, true))
+print(string.find("hello", "(l)(l)"))
+print(string.find("hello", "()ll()"))
+print(string.find("hello", "^h"))
+print(string.find("hello", "^e"))
+print(string.find("hello", "o$"))
+print(string.find("hello", "", 10))
+print(string.find("hello", "l", -2))
+print(("x = 10, y = 20"):find("(%a+) = (%d+)", 5))
+
+-- string.match
+--
+print(string.match("key=value", "(%w+)=(%w+)"))
+print(string.match("  trim me  ", "^%s*(.-)%s*$"))
+print(string.match("2024-01-15", "(%d+)-(%d+)-(%d+)"))
+print("[" .. string.match("hello", ".-") .. "]")
+print(string.match("hello", "xyz"))
+print(string.match("THE (quick) fox", "%((%a+)%)"))
+print(string.match("f(a(b)c)d", "%b()"))
+print(string.match("THE (quick) fox", "%f[%a]%a+", 5))
+print(string.match("abcabc", "(abc)%1"))
+print(string.match("abcabd", "(abc)%1"))
+print(string.match("hello123", "%a+(%d*)"))
+print(string.match("[test]", "[%[](.-)[%]]"))
+print(string.match("a-b", "[a-]+"))
+print(string.match("x]y", "[]x]+"))
+print(string.match("hello world", "%s(.*)"))
+print(string.match("  42  ", "%d+") + 1)
+print(string.match(12345, "3(%d)"))
+print(string.match("abc", "()b()"))
+print(string.match("aaa", "a-b"))
+print(string.match("aaab", "a-b"))
+print(string.match("hello", "l?lo"))
+print(string.match("caaat", "ca*t"), string.match("ct", "ca*t"), string.match("cat", "ca+t"), string.match("ct", "ca+t"))
+
+-- string.gmatch
+--
+for w in string.gmatch("one two  three", "%a+") do io.write(w, ";") end
+print()
+for k, v in string.gmatch("a=1, b=2, c=3", "(%w+)=(%w+)") do io.write(k, "->", v, ";") end
+print()
+local n = 0
+for _ in string.gmatch("abc", "") do n = n + 1 end
+print(n)
+for p in string.gmatch("^a^b", "^.") do io.write(p, ";") end
+print()
+for a in string.gmatch("abc", "()") do io.write(a, ";") end
+print()
+
+-- string.gsub
+--
+print(string.gsub("hello world", "o", "0"))
+print(string.gsub("hello world", "(%w+)", "<%1>"))
+print(string.gsub("hello world", "%w+", "%0 %0", 1))
+print(string.gsub("hello world from Lua", "(%w+)%s*(%w+)", "%2 %1"))
+print(string.gsub("abc", "", "-"))
+print(string.gsub("hello", "^h", "H"))
+print(string.gsub("hello", "^x", "H"))
+print(string.gsub("abc", "%w", "%%"))
+print(string.gsub("$name-$version.tar.gz", "%$(%w+)", {name="lua", version="5.1"}))
+print(string.gsub("$name $missing", "%$(%w+)", {name="lua"}))
+print(string.gsub("4+5 = $return 4+5$", "%$(.-)%$", function(s) return loadstring(s)() end))
+print(string.gsub("abc", "%w", function(c) return c:upper() .. "." end))
+print(string.gsub("abc", "%w", function(c) if c == "b" then return false end return 1 end))
+print(string.gsub("hello world", "o", "0", 0))
+print(string.gsub(12345, 3, 9))
+print(string.gsub("a b", "%a", setmetatable({}, {__index = function(t, k) return k:rep(2) end})))
+print(string.gsub("x y", "%a", setmetatable({}, {__index = {x = "X"}})))
+local r, cnt = string.gsub(string.rep("ab", 1000), "a", function() return "xyz" end)
+print(#r, cnt, r:sub(1, 8))
+
+-- Errors
+--
+print(pcall(string.find, "abc", "%"))
+print(pcall(string.find, "abc", "[a"))
+print(pcall(string.find, "abc", "(a"))
+print(pcall(string.match, "abc", "a)"))
+print(pcall(string.find, "abc", "%1"))
+print(pcall(string.gsub, "abc", "(a)", "%2"))
+print(pcall(string.gsub, "abc", "a", true))
+print(pcall(string.gsub, "abc", "a", function() return {} end))
+print(pcall(string.gmatch, "abc", "%f"))
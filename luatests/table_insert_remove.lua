@@ -0,0 +1,159 @@
+-- table.insert, table.remove and table.maxn
+
+local function dump(t, n)
+	local s = ''
+	for i = 1, n do
+		s = s .. ' ' .. tostring(t[i])
+	end
+	return s
+end
+
+local t = { 'a', 'b', 'c' }
+table.insert(t, 'd')
+table.insert(t, 1, 'x')
+table.insert(t, 3, 'y')
+table.insert(t, 7, 'z')
+print(#t, dump(t, #t))
+print(table.remove(t, 1))
+print(table.remove(t))
+print(table.remove(t, 3))
+print(#t, dump(t, 5))
+print(table.remove(t, 5))
+print(table.remove(t, 0))
+print(#t, dump(t, 4))
+
+local d = {}
+for i = 1, 10 do
+	d[i] = i * 1.5
+end
+table.insert(d, 1, 100)
+table.insert(d, 5, 0.25)
+print(#d, dump(d, #d))
+table.insert(d, 2, 'str')
+print(#d, dump(d, #d))
+print(table.remove(d, 2), #d)
+while #d > 0 do
+	table.remove(d, 1)
+end
+print(#d, table.remove(d))
+
+local u = { 1, 2, 3 }
+table.insert(u, 2, nil)
+print(dump(u, 4))
+
+local e = {}
+table.insert(e, 5, 'five')
+print(e[5], table.maxn(e))
+
+print(table.maxn({}))
+print(table.maxn({ 1, 2, 3 }))
+local m = {}
+m[7] = 1
+m[3] = 1
+m[2.5] = 1
+m.x = 1
+print(table.maxn(m))
+m[7] = nil
+print(table.maxn(m))
+local m2 = {}
+m2[10.5] = true
+m2[-3] = true
+print(table.maxn(m2))
+local m3 = {}
+m3[-1] = 1
+print(table.maxn(m3))
+local m4 = { 1, 2, 3 }
+m4[1000000] = 'far'
+m4[2.5] = 'x'
+print(table.maxn(m4))
+
+print((pcall(table.insert, t, 1, 2, 3)))
+print((pcall(table.insert, t)))
+print((pcall(table.insert, nil, 1)))
+print((pcall(table.remove, 1)))
+print((pcall(table.maxn, 'x')))
+
+-- Positions that are NaN, infinite or out of the integer range are rejected
+--
+local inf = 1 / 0
+local nan = 0 / 0
+for _, v in ipairs({ nan, inf, -inf, 1e300, -1e300, 2 ^ 63 }) do
+	print(pcall(table.insert, { 1, 2 }, v, 'x'))
+	print(pcall(table.remove, { 1, 2 }, v))
+	print(pcall(table.concat, { 'a', 'b' }, ',', v))
+	print(pcall(table.concat, { 'a', 'b' }, ',', 1, v))
+end
+print(table.concat({ 'a', 'b', 'c' }, ',', 1.5, 3.9))
+print(table.remove({ 'a', 'b' }, 2.7))
+
+-- Queue and stack usage against a reference implementation that shifts elements by hand
+--
+local seed = 1
+local function rand(n)
+	seed = (seed * 1103515245 + 12345) % 2147483648
+	return seed % n
+end
+
+local q = {}
+local r = {}
+local rn = 0
+for iter = 1, 20000 do
+	local op = rand(4)
+	if op <= 1 or rn == 0 then
+		local v
+		local kind = rand(3)
+		if kind == 0 then
+			v = iter
+		elseif kind == 1 then
+			v = iter + 0.5
+		else
+			v = 'v' .. iter
+		end
+		local pos = rand(rn + 1) + 1
+		if rand(2) == 0 and pos == rn + 1 then
+			table.insert(q, v)
+		else
+			table.insert(q, pos, v)
+		end
+		for i = rn, pos, -1 do
+			r[i + 1] = r[i]
+		end
+		r[pos] = v
+		rn = rn + 1
+	else
+		local pos = rand(rn) + 1
+		local got
+		if rand(2) == 0 then
+			pos = rn
+			got = table.remove(q)
+		else
+			got = table.remove(q, pos)
+		end
+		assert(got == r[pos])
+		for i = pos, rn - 1 do
+			r[i] = r[i + 1]
+		end
+		r[rn] = nil
+		rn = rn - 1
+	end
+	assert(#q == rn)
+end
+for i = 1, rn + 1 do
+	assert(q[i] == r[i])
+end
+print('check ok')
+
+-- A queue of doubles that is consumed from the front
+--
+local dq = {}
+for i = 1, 3000 do
+	table.insert(dq, i + 0.5)
+end
+local sum = 0
+for i = 1, 1000 do
+	sum = sum + table.remove(dq, 1)
+	table.insert(dq, 1, i)
+	sum = sum - table.remove(dq, 1)
+	sum = sum + table.remove(dq, 1)
+end
+print(sum, #dq, dq[1], dq[#dq])
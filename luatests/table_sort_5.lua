@@ -0,0 +1,66 @@
+-- Sorting large arrays of numbers (radix sort and parallel sort), and comparator sorts on inputs with patterns
+
+function check_sorted(a, n, cnt, lt)
+	for i = 1, n-1 do
+		assert(not lt(a[i+1], a[i]))
+	end
+	for i = 1, n do
+		assert(cnt[a[i]] ~= nil)
+		cnt[a[i]] = cnt[a[i]] - 1
+	end
+	for k,v in pairs(cnt) do
+		assert(v == 0)
+	end
+end
+
+function make_array(n, gen, continuous)
+	local a = {}
+	local cnt = {}
+	local first, last, step = 1, n, 1
+	if not continuous then
+		first, last, step = n, 1, -1
+	end
+	for i = first, last, step do
+		local v = gen(i)
+		a[i] = v
+		cnt[v] = (cnt[v] or 0) + 1
+	end
+	return a, cnt
+end
+
+local function lt(x, y) return x < y end
+local function gt(x, y) return x > y end
+
+local seed = 12345
+local function rand()
+	seed = (seed * 1103515245 + 12345) % 2147483648
+	return seed
+end
+
+local gens = {
+	function(i) return rand() / 1000 - 1000000 end,
+	function(i) return rand() % 100 - 50 end,
+	function(i) return i end,
+	function(i) return -i end,
+	function(i) if i % 2 == 0 then return i else return 1000000 - i end end,
+}
+
+for _, n in ipairs({ 3000, 300000 }) do
+	for gi, gen in ipairs(gens) do
+		for _, continuous in ipairs({ true, false }) do
+			local a, cnt = make_array(n, gen, continuous)
+			table.sort(a)
+			check_sorted(a, n, cnt, lt)
+			print('check ok')
+		end
+	end
+end
+
+for _, n in ipairs({ 2000 }) do
+	for gi, gen in ipairs(gens) do
+		local a, cnt = make_array(n, gen, true)
+		table.sort(a, gt)
+		check_sorted(a, n, cnt, gt)
+		print('check ok')
+	end
+end
@@ -0,0 +1,58 @@
+-- An upvalue load followed by a field access on it (e.g., 'm.floor' where 'm' is an upvalue) is fused into one bytecode,
+-- which must behave the same as the two bytecodes
+
+local m = { floor = math.floor }
+
+local function sumOfFloors(n)
+	local s = 0
+	for i = 1, n do
+		s = s + m.floor(i / 3)
+	end
+	return s
+end
+
+print(sumOfFloors(100))
+
+local cfg = { name = "a" }
+
+local function getName()
+	return cfg.name
+end
+
+print(getName())
+cfg = { name = "b" }
+print(getName())
+cfg = setmetatable({}, { __index = function(t, k) return k .. "!" end })
+print(getName())
+cfg = setmetatable({}, { __index = { name = "c" } })
+print(getName())
+
+local cnt = 0
+for i = 1, 100 do
+	if getName() == "c" then
+		cnt = cnt + 1
+	end
+end
+print(cnt)
+
+cfg = "hello"
+print(getName())
+cfg = nil
+print((pcall(getName)))
+
+local str = "abc"
+
+local function getLen()
+	return str.len
+end
+
+print(getLen() == string.len)
+
+local a = nil
+local b = { x = 5 }
+
+local function getX()
+	return (a or b).x
+end
+
+print(getX())
@@ -0,0 +1,375 @@
+#include "array_sort.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// Below this size, std::sort is faster than the radix sort, whose cost is dominated by the fixed number of passes
+//
+constexpr size_t x_radixSortThreshold = 1024;
+
+// At or above this size, the array is sorted by multiple threads
+//
+constexpr size_t x_parallelSortThreshold = 1 << 18;
+
+// The number of threads used for a parallel sort, must be a power of 2
+//
+constexpr size_t x_maxParallelSortThreads = 4;
+static_assert(is_power_of_2(x_maxParallelSortThreads));
+
+// The GC thread and the baseline JIT compiler thread may be busy while the execution thread sorts,
+// so the sort does not count on their cores
+//
+constexpr size_t x_numRuntimeBackgroundThreads = 2;
+
+constexpr uint32_t x_radixBits = 8;
+constexpr uint32_t x_radixBuckets = 1U << x_radixBits;
+constexpr uint32_t x_radixPasses = 64 / x_radixBits;
+
+// Map the bit pattern of a double to an unsigned integer with the same order as the double:
+// flip all bits of a negative number (so that larger magnitude becomes smaller), and only the sign bit of a non-negative number
+//
+uint64_t WARN_UNUSED ALWAYS_INLINE DoubleToOrderedBits(double value)
+{
+    uint64_t bits = cxx2a_bit_cast<uint64_t>(value);
+    uint64_t mask = static_cast<uint64_t>(static_cast<int64_t>(bits) >> 63) | (1ULL << 63);
+    return bits ^ mask;
+}
+
+double WARN_UNUSED ALWAYS_INLINE OrderedBitsToDouble(uint64_t orderedBits)
+{
+    uint64_t mask = ((orderedBits >> 63) - 1) | (1ULL << 63);
+    return cxx2a_bit_cast<double>(orderedBits ^ mask);
+}
+
+// Sort 'keys' using 'buf' (of the same length) as the scratch buffer. The result is in 'keys'.
+//
+void RadixSortOrderedBits(uint64_t* keys, uint64_t* buf, size_t n)
+{
+    assert(n > 0 && n <= std::numeric_limits<uint32_t>::max());
+
+    uint32_t counts[x_radixPasses][x_radixBuckets];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t key = keys[i];
+        for (uint32_t pass = 0; pass < x_radixPasses; pass++)
+        {
+            counts[pass][(key >> (pass * x_radixBits)) & (x_radixBuckets - 1)]++;
+        }
+    }
+
+    uint64_t* src = keys;
+    uint64_t* dst = buf;
+    for (uint32_t pass = 0; pass < x_radixPasses; pass++)
+    {
+        uint32_t shift = pass * x_radixBits;
+        uint32_t* count = counts[pass];
+
+        // All keys have the same digit in this pass, so this pass would not change anything
+        //
+        if (count[(src[0] >> shift) & (x_radixBuckets - 1)] == n)
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < x_radixBuckets; digit++)
+        {
+            uint32_t cnt = count[digit];
+            count[digit] = offset;
+            offset += cnt;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            uint64_t key = src[i];
+            dst[count[(key >> shift) & (x_radixBuckets - 1)]++] = key;
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != keys)
+    {
+        memcpy(keys, src, sizeof(uint64_t) * n);
+    }
+}
+
+// Merge the sorted ranges [a, a + na) and [b, b + nb) into 'out'
+//
+void MergeOrderedBits(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out)
+{
+    std::merge(a, a + na, b, b + nb, out);
+}
+
+// The worker threads of the parallel sort, created on first use and shared by every sort in the process,
+// so a sort does not pay for creating and joining threads
+//
+class SortWorkerPool
+{
+    MAKE_NONCOPYABLE(SortWorkerPool);
+    MAKE_NONMOVABLE(SortWorkerPool);
+
+public:
+    static SortWorkerPool* WARN_UNUSED Get()
+    {
+        static SortWorkerPool pool;
+        return &pool;
+    }
+
+    // Run task(0), ..., task(numTasks - 1) in parallel, task(0) in the calling thread.
+    // If the pool is in use by another thread (e.g., another VM is sorting), the tasks are run one by one in the calling thread.
+    //
+    void RunInParallel(size_t numTasks, const std::function<void(size_t)>& task)
+    {
+        assert(1 <= numTasks && numTasks <= x_maxParallelSortThreads);
+        std::unique_lock<std::mutex> runLock(m_runLock, std::try_to_lock);
+        if (!runLock.owns_lock())
+        {
+            for (size_t k = 0; k < numTasks; k++)
+            {
+                task(k);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_task = &task;
+            m_numTasks = numTasks;
+            m_numWorkersRunning = x_maxParallelSortThreads - 1;
+            m_generation++;
+        }
+        m_condVar.notify_all();
+
+        task(0);
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_doneCondVar.wait(lock, [&]() { return m_numWorkersRunning == 0; });
+        m_task = nullptr;
+    }
+
+private:
+    SortWorkerPool()
+        : m_task(nullptr)
+        , m_numTasks(0)
+        , m_numWorkersRunning(0)
+        , m_generation(0)
+        , m_workersShouldExit(false)
+    {
+        for (size_t k = 1; k < x_maxParallelSortThreads; k++)
+        {
+            m_workers[k] = std::thread([this, k]() { WorkerMain(k); });
+        }
+    }
+
+    ~SortWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_workersShouldExit = true;
+        }
+        m_condVar.notify_all();
+        for (size_t k = 1; k < x_maxParallelSortThreads; k++)
+        {
+            m_workers[k].join();
+        }
+    }
+
+    // Worker 'k' runs task(k) of every round that has more than 'k' tasks
+    //
+    void WorkerMain(size_t k)
+    {
+        uint64_t lastGeneration = 0;
+        while (true)
+        {
+            const std::function<void(size_t)>* task;
+            size_t numTasks;
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_condVar.wait(lock, [&]() { return m_workersShouldExit || m_generation != lastGeneration; });
+                if (m_workersShouldExit)
+                {
+                    return;
+                }
+                lastGeneration = m_generation;
+                task = m_task;
+                numTasks = m_numTasks;
+            }
+
+            if (k < numTasks)
+            {
+                (*task)(k);
+            }
+
+            bool isLast;
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                assert(m_numWorkersRunning > 0);
+                m_numWorkersRunning--;
+                isLast = (m_numWorkersRunning == 0);
+            }
+            if (isLast)
+            {
+                m_doneCondVar.notify_one();
+            }
+        }
+    }
+
+    // Held by the thread running a parallel sort
+    //
+    std::mutex m_runLock;
+
+    // Protects the fields below
+    //
+    std::mutex m_lock;
+    std::condition_variable m_condVar;
+    std::condition_variable m_doneCondVar;
+    const std::function<void(size_t)>* m_task;
+    size_t m_numTasks;
+    size_t m_numWorkersRunning;
+    uint64_t m_generation;
+    bool m_workersShouldExit;
+
+    // m_workers[0] is unused, task 0 is run by the calling thread
+    //
+    std::thread m_workers[x_maxParallelSortThreads];
+};
+
+// Merge the sorted ranges [a, a + na) and [b, b + nb), and convert the result back to doubles in 'out', using two threads:
+// one thread produces the smallest half of the output by merging from the front,
+// the other produces the largest half by merging from the back.
+//
+// The two halves are always consistent: elements that compare equal have the same bit pattern, so it doesn't matter which range they come from.
+//
+void ParallelMergeIntoDoubles(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, double* out)
+{
+    size_t n = na + nb;
+    size_t frontCount = n / 2;
+
+    SortWorkerPool::Get()->RunInParallel(2 /*numTasks*/, [&](size_t taskOrd) {
+        if (taskOrd == 0)
+        {
+            size_t i = 0, j = 0;
+            for (size_t k = 0; k < frontCount; k++)
+            {
+                if (j == nb || (i < na && a[i] <= b[j]))
+                {
+                    out[k] = OrderedBitsToDouble(a[i]);
+                    i++;
+                }
+                else
+                {
+                    out[k] = OrderedBitsToDouble(b[j]);
+                    j++;
+                }
+            }
+        }
+        else
+        {
+            size_t i = na, j = nb;
+            for (size_t k = n; k > frontCount; k--)
+            {
+                if (i == 0 || (j > 0 && b[j - 1] >= a[i - 1]))
+                {
+                    out[k - 1] = OrderedBitsToDouble(b[j - 1]);
+                    j--;
+                }
+                else
+                {
+                    out[k - 1] = OrderedBitsToDouble(a[i - 1]);
+                    i--;
+                }
+            }
+        }
+    });
+}
+
+size_t WARN_UNUSED GetNumThreadsForSort(size_t n)
+{
+    if (n < x_parallelSortThreshold)
+    {
+        return 1;
+    }
+    static const size_t numAvailableThreads = []() -> size_t {
+        size_t numHardwareThreads = std::thread::hardware_concurrency();
+        return numHardwareThreads > x_numRuntimeBackgroundThreads ? numHardwareThreads - x_numRuntimeBackgroundThreads : 1;
+    }();
+    size_t numThreads = x_maxParallelSortThreads;
+    while (numThreads > 1 && numThreads > numAvailableThreads)
+    {
+        numThreads /= 2;
+    }
+    return numThreads;
+}
+
+}   // anonymous namespace
+
+void SortDoubleArray(double* arr, size_t n)
+{
+    if (n < x_radixSortThreshold)
+    {
+        std::sort(arr, arr + n);
+        return;
+    }
+
+    std::unique_ptr<uint64_t[]> storage(new uint64_t[n * 2]);
+    uint64_t* keys = storage.get();
+    uint64_t* buf = keys + n;
+    for (size_t i = 0; i < n; i++)
+    {
+        keys[i] = DoubleToOrderedBits(arr[i]);
+    }
+
+    size_t numThreads = GetNumThreadsForSort(n);
+    if (numThreads == 1)
+    {
+        RadixSortOrderedBits(keys, buf, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            arr[i] = OrderedBitsToDouble(keys[i]);
+        }
+        return;
+    }
+
+    // Split the array into 'numThreads' chunks, and radix sort each chunk in its own thread
+    //
+    assert(is_power_of_2(numThreads) && numThreads <= x_maxParallelSortThreads);
+    size_t bounds[x_maxParallelSortThreads + 1];
+    for (size_t k = 0; k <= numThreads; k++)
+    {
+        bounds[k] = n * k / numThreads;
+    }
+
+    SortWorkerPool* pool = SortWorkerPool::Get();
+    pool->RunInParallel(numThreads, [&](size_t k) {
+        RadixSortOrderedBits(keys + bounds[k], buf + bounds[k], bounds[k + 1] - bounds[k]);
+    });
+
+    // Merge adjacent pairs of chunks, in parallel, until two chunks are left
+    //
+    size_t numChunks = numThreads;
+    while (numChunks > 2)
+    {
+        pool->RunInParallel(numChunks / 2, [&](size_t k) {
+            size_t lo = bounds[2 * k];
+            size_t mid = bounds[2 * k + 1];
+            size_t hi = bounds[2 * k + 2];
+            MergeOrderedBits(keys + lo, mid - lo, keys + mid, hi - mid, buf + lo);
+        });
+        std::swap(keys, buf);
+        numChunks /= 2;
+        for (size_t k = 0; k <= numChunks; k++)
+        {
+            bounds[k] = bounds[2 * k];
+        }
+    }
+
+    // The final merge writes the doubles back into the array
+    //
+    assert(numChunks == 2 && bounds[0] == 0 && bounds[2] == n);
+    ParallelMergeIntoDoubles(keys, bounds[1], keys + bounds[1], n - bounds[1], arr);
+}
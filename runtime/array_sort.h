@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common_utils.h"
+
+// Sort 'n' doubles in ascending order, as if by std::sort with operator '<'.
+//
+// Small arrays are sorted by std::sort. Larger arrays are radix-sorted (LSD, one byte per pass) on the bit pattern of the
+// doubles mapped to order-preserving unsigned integers, so the sort does no comparison at all, and passes where all elements
+// have the same byte (which is common, e.g., for numbers of similar magnitude) are skipped.
+// Very large arrays are split into chunks that are radix-sorted and then merged by a pool of worker threads shared by all sorts.
+//
+// Same as std::sort, the relative order of -0 and 0 is unspecified, and if the array contains NaN, the order is unspecified
+// (but the result is still a permutation of the input).
+//
+void SortDoubleArray(double* arr, size_t n);
@@ -74,6 +74,19 @@ struct ArrayType
     constexpr Kind ArrayKind() { return BFM_arrayKind::Get(m_asValue); }
     constexpr void SetArrayKind(Kind v) { return BFM_arrayKind::Set(m_asValue, v); }
 
+    // Whether the array part can only contain Int32, Double or nil, i.e., no reference to a heap object
+    //
+    // Since a double TValue is just the raw IEEE-754 bit pattern, the vector storage of a Double array is already an unboxed double array.
+    // The first write of a value of another type simply changes the kind to Any, no conversion of the storage is needed.
+    // On the other hand, since the array part holds no references, a store of a value that passed the kind check needs no write barrier,
+    // and the GC doesn't need to scan the array part.
+    //
+    constexpr bool ArrayPartHasNoReference()
+    {
+        Kind kind = ArrayKind();
+        return kind == Kind::Int32 || kind == Kind::Double;
+    }
+
     // bit 2: bool m_hasSparseMap
     //   Whether there is a sparse map
     //
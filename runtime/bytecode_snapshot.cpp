@@ -0,0 +1,672 @@
+#include "bytecode_snapshot.h"
+#include "runtime_utils.h"
+#include "gc.h"
+
+namespace BytecodeSnapshot
+{
+
+namespace {
+
+struct UcbHeader
+{
+    uint32_t m_parentOrd;
+    uint32_t m_numFixedArguments;
+    uint32_t m_numUpvalues;
+    uint32_t m_stackFrameNumSlots;
+    uint32_t m_bytecodeLength;
+    uint32_t m_bytecodeMetadataLength;
+    uint32_t m_cstTableLength;
+    uint32_t m_hasVariadicArguments;
+};
+
+constexpr uint32_t x_noParent = static_cast<uint32_t>(-1);
+
+struct UpvalueRecord
+{
+    uint32_t m_slot;
+    uint8_t m_isParentLocal;
+    uint8_t m_isImmutable;
+    uint16_t m_reserved;
+};
+
+enum class ConstantKind : uint8_t
+{
+    // A number, boolean, nil, or any other non-pointer value, stored as the raw TValue
+    //
+    Raw,
+    // A string, stored as [ uint32_t length ] [ content ]
+    //
+    String,
+    // An UnlinkedCodeBlock created by the NewClosure bytecode, stored as the uint32_t ordinal in the snapshot
+    //
+    Function,
+    // A template table of the TableDup bytecode, stored as [ TableHeader ] [ named properties ] [ indexed entries ]
+    //
+    Table
+};
+
+struct TableHeader
+{
+    uint32_t m_inlineCapacity;
+    uint32_t m_numNamedProperties;
+    uint32_t m_hasButterfly;
+    uint32_t m_arrayStorageCapacity;
+    uint32_t m_numIndexedEntries;
+};
+
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(std::string& out) : m_out(out) { }
+
+    void Write(const void* data, size_t len)
+    {
+        m_out.append(reinterpret_cast<const char*>(data), len);
+    }
+
+    template<typename T>
+    void Write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Write(&value, sizeof(T));
+    }
+
+    // Only strings and non-pointer values are supported
+    //
+    bool WARN_UNUSED WriteValue(TValue tv)
+    {
+        if (tv.Is<tString>())
+        {
+            HeapString* s = TranslateToRawPointer(tv.As<tString>());
+            Write(ConstantKind::String);
+            Write(s->m_length);
+            Write(s->m_string, s->m_length);
+            return true;
+        }
+        if (tv.Is<tHeapEntity>())
+        {
+            return false;
+        }
+        Write(ConstantKind::Raw);
+        Write(tv.m_value);
+        return true;
+    }
+
+    bool WARN_UNUSED WriteTemplateTable(HeapPtr<TableObject> tab)
+    {
+        // The template tables are only populated by the parser, so they have no metatable and their hidden class is a Structure
+        // unless they have a huge number of named properties
+        //
+        if (TCGet(tab->m_hiddenClass).As<SystemHeapGcObjectHeader>()->m_type != HeapEntityType::Structure)
+        {
+            return false;
+        }
+        HeapPtr<Structure> structure = TCGet(tab->m_hiddenClass).As<Structure>();
+        if (structure->m_metatable != 0)
+        {
+            return false;
+        }
+
+        // The indexed entries are collected by the iterator, which reports the named properties first
+        //
+        std::vector<TableObjectIterator::KeyValuePair> indexedEntries;
+        {
+            TableObjectIterator iter;
+            while (true)
+            {
+                TableObjectIterator::KeyValuePair kv = iter.Advance(tab);
+                if (kv.m_key.IsNil())
+                {
+                    break;
+                }
+                if (kv.m_key.IsDouble())
+                {
+                    indexedEntries.push_back(kv);
+                }
+            }
+        }
+
+        Butterfly* butterfly = tab->m_butterfly;
+        TableHeader header {
+            .m_inlineCapacity = structure->m_inlineNamedStorageCapacity,
+            .m_numNamedProperties = structure->m_numSlots,
+            .m_hasButterfly = (butterfly != nullptr),
+            .m_arrayStorageCapacity = (butterfly != nullptr ? static_cast<uint32_t>(butterfly->GetHeader()->m_arrayStorageCapacity) : 0),
+            .m_numIndexedEntries = static_cast<uint32_t>(indexedEntries.size())
+        };
+        Write(header);
+
+        // Named properties are written in slot order, including the ones holding nil (the parser creates them to reserve
+        // the slot for a non-constant value), so the rebuilt table gets the same Structure
+        //
+        for (uint32_t slot = 0; slot < structure->m_numSlots; slot++)
+        {
+            UserHeapPointer<void> key = Structure::GetKeyForSlotOrdinal(structure, static_cast<uint8_t>(slot));
+            TValue tvKey;
+            if (key == VM_GetSpecialKeyForBoolean(false).As<void>())
+            {
+                tvKey = TValue::CreateFalse();
+            }
+            else if (key == VM_GetSpecialKeyForBoolean(true).As<void>())
+            {
+                tvKey = TValue::CreateTrue();
+            }
+            else
+            {
+                tvKey = TValue::CreatePointer(key);
+            }
+            TValue value = TableObject::GetValueForSlot(tab, slot, structure->m_inlineNamedStorageCapacity);
+            if (!WriteValue(tvKey) || !WriteValue(value))
+            {
+                return false;
+            }
+        }
+
+        for (TableObjectIterator::KeyValuePair& kv : indexedEntries)
+        {
+            Write(kv.m_key.AsDouble());
+            if (!WriteValue(kv.m_value))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::string& m_out;
+};
+
+class SnapshotReader
+{
+public:
+    SnapshotReader(const char* data, size_t length)
+        : m_cur(data), m_end(data + length)
+    { }
+
+    // Return nullptr if there are not enough bytes left
+    //
+    const char* WARN_UNUSED Skip(size_t len)
+    {
+        if (static_cast<size_t>(m_end - m_cur) < len)
+        {
+            return nullptr;
+        }
+        const char* res = m_cur;
+        m_cur += len;
+        return res;
+    }
+
+    template<typename T>
+    bool WARN_UNUSED Read(T& value /*out*/)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const char* src = Skip(sizeof(T));
+        if (src == nullptr)
+        {
+            return false;
+        }
+        memcpy(&value, src, sizeof(T));
+        return true;
+    }
+
+    bool WARN_UNUSED ReadValue(VM* vm, TValue& value /*out*/)
+    {
+        ConstantKind kind;
+        if (!Read(kind))
+        {
+            return false;
+        }
+        return ReadValuePayload(vm, kind, value /*out*/);
+    }
+
+    bool WARN_UNUSED ReadValuePayload(VM* vm, ConstantKind kind, TValue& value /*out*/)
+    {
+        if (kind == ConstantKind::Raw)
+        {
+            return Read(value.m_value);
+        }
+        if (kind == ConstantKind::String)
+        {
+            uint32_t len;
+            if (!Read(len))
+            {
+                return false;
+            }
+            const char* s = Skip(len);
+            if (s == nullptr)
+            {
+                return false;
+            }
+            value = TValue::Create<tString>(vm->CreateStringObjectFromRawString(s, len).As());
+            return true;
+        }
+        return false;
+    }
+
+    // Replay the insertions done by the parser (see expr_table in lj_parse.cpp), and check that we get the same table shape
+    //
+    bool WARN_UNUSED ReadTemplateTable(VM* vm, TValue& value /*out*/)
+    {
+        TableHeader header;
+        if (!Read(header))
+        {
+            return false;
+        }
+        if (header.m_numNamedProperties > header.m_inlineCapacity || header.m_inlineCapacity > Structure::x_maxNumSlots)
+        {
+            return false;
+        }
+
+        HeapPtr<TableObject> tab = TableObject::CreateEmptyTableObject(vm, header.m_inlineCapacity, header.m_arrayStorageCapacity);
+        for (uint32_t i = 0; i < header.m_numNamedProperties; i++)
+        {
+            TValue key, val;
+            if (!ReadValue(vm, key /*out*/) || !ReadValue(vm, val /*out*/))
+            {
+                return false;
+            }
+            UserHeapPointer<void> propKey;
+            if (key.Is<tString>())
+            {
+                propKey = UserHeapPointer<void> { key.As<tHeapEntity>() };
+            }
+            else if (key.Is<tBool>())
+            {
+                propKey = VM_GetSpecialKeyForBoolean(key.As<tBool>()).As<void>();
+            }
+            else
+            {
+                return false;
+            }
+            PutByIdICInfo icInfo;
+            TableObject::PreparePutById(tab, propKey, icInfo /*out*/);
+            TableObject::PutById(tab, propKey.As(), val, icInfo);
+        }
+
+        // Non-integer keys are inserted before the integer keys, which are inserted in ascending order
+        //
+        std::vector<std::pair<int32_t, uint64_t /*tv*/>> integerKeyEntries;
+        for (uint32_t i = 0; i < header.m_numIndexedEntries; i++)
+        {
+            double key;
+            TValue val;
+            if (!Read(key) || !ReadValue(vm, val /*out*/) || IsNaN(key))
+            {
+                return false;
+            }
+            int32_t i32 = static_cast<int32_t>(key);
+            if (static_cast<double>(i32) == key)
+            {
+                integerKeyEntries.push_back(std::make_pair(i32, val.m_value));
+            }
+            else
+            {
+                TableObject::RawPutByValDoubleIndex(tab, key, val);
+            }
+        }
+        std::sort(integerKeyEntries.begin(), integerKeyEntries.end());
+        for (auto& it : integerKeyEntries)
+        {
+            TValue val; val.m_value = it.second;
+            TableObject::RawPutByValIntegerIndex(tab, it.first, val);
+        }
+
+        if (TCGet(tab->m_hiddenClass).As<SystemHeapGcObjectHeader>()->m_type != HeapEntityType::Structure)
+        {
+            return false;
+        }
+        HeapPtr<Structure> structure = TCGet(tab->m_hiddenClass).As<Structure>();
+        if (structure->m_inlineNamedStorageCapacity != header.m_inlineCapacity ||
+            structure->m_numSlots != header.m_numNamedProperties ||
+            (tab->m_butterfly != nullptr) != static_cast<bool>(header.m_hasButterfly))
+        {
+            return false;
+        }
+        if (tab->m_butterfly != nullptr && static_cast<uint32_t>(tab->m_butterfly->GetHeader()->m_arrayStorageCapacity) != header.m_arrayStorageCapacity)
+        {
+            return false;
+        }
+
+        value = TValue::Create<tTable>(tab);
+        return true;
+    }
+
+private:
+    const char* m_cur;
+    const char* m_end;
+};
+
+ParseResult WARN_UNUSED MakeLoadError(VM* vm, const char* reason)
+{
+    char buf[200];
+    snprintf(buf, 200, "bad bytecode snapshot (%s)", reason);
+    return {
+        .m_scriptModule = nullptr,
+        .errMsg = TValue::Create<tString>(vm->CreateStringObjectFromRawCString(buf))
+    };
+}
+
+}   // anonymous namespace
+
+bool WARN_UNUSED Dump(UnlinkedCodeBlock* root, std::string& out /*out*/)
+{
+    if (root->m_numUpvalues > 0)
+    {
+        return false;
+    }
+
+    // Collect the functions nested in 'root', in pre-order, so the root gets ordinal 0
+    //
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    std::unordered_map<UnlinkedCodeBlock*, std::vector<UnlinkedCodeBlock*>> children;
+    for (UnlinkedCodeBlock* ucb : vm->GetUserHeapGarbageCollector()->GetUnlinkedCodeBlocks())
+    {
+        if (ucb->m_parent != nullptr)
+        {
+            children[ucb->m_parent].push_back(ucb);
+        }
+    }
+
+    std::vector<UnlinkedCodeBlock*> ucbs;
+    std::unordered_map<UnlinkedCodeBlock*, uint32_t> ucbOrd;
+    {
+        std::vector<UnlinkedCodeBlock*> worklist { root };
+        while (!worklist.empty())
+        {
+            UnlinkedCodeBlock* ucb = worklist.back();
+            worklist.pop_back();
+            ucbOrd[ucb] = static_cast<uint32_t>(ucbs.size());
+            ucbs.push_back(ucb);
+            auto it = children.find(ucb);
+            if (it != children.end())
+            {
+                worklist.insert(worklist.end(), it->second.rbegin(), it->second.rend());
+            }
+        }
+    }
+
+    out.clear();
+    SnapshotWriter w(out);
+    Header header {
+        .m_magic = x_magic,
+        .m_version = x_version,
+        .m_numBytecodeMetadataKinds = static_cast<uint32_t>(x_num_bytecode_metadata_struct_kinds_),
+        .m_numUnlinkedCodeBlocks = static_cast<uint32_t>(ucbs.size()),
+        .m_reserved = 0
+    };
+    w.Write(header);
+
+    for (UnlinkedCodeBlock* ucb : ucbs)
+    {
+        assert(ucb->m_bytecodeBuilder == nullptr);
+        UcbHeader uh {
+            .m_parentOrd = (ucb == root ? x_noParent : ucbOrd[ucb->m_parent]),
+            .m_numFixedArguments = ucb->m_numFixedArguments,
+            .m_numUpvalues = ucb->m_numUpvalues,
+            .m_stackFrameNumSlots = ucb->m_stackFrameNumSlots,
+            .m_bytecodeLength = ucb->m_bytecodeLength,
+            .m_bytecodeMetadataLength = ucb->m_bytecodeMetadataLength,
+            .m_cstTableLength = ucb->m_cstTableLength,
+            .m_hasVariadicArguments = ucb->m_hasVariadicArguments
+        };
+        w.Write(uh);
+
+        for (uint32_t i = 0; i < ucb->m_numUpvalues; i++)
+        {
+            UpvalueMetadata& uv = ucb->m_upvalueInfo[i];
+            w.Write(UpvalueRecord {
+                .m_slot = uv.m_slot,
+                .m_isParentLocal = uv.m_isParentLocal,
+                .m_isImmutable = uv.m_isImmutable,
+                .m_reserved = 0
+            });
+        }
+
+        w.Write(ucb->m_bytecodeMetadataUseCounts, sizeof(uint16_t) * x_num_bytecode_metadata_struct_kinds_);
+        w.Write(ucb->m_bytecode, ucb->m_bytecodeLength);
+
+        // The NewClosure bytecode keeps the raw UnlinkedCodeBlock pointer of the child function in the constant table,
+        // which cannot be told apart from a double by value, so we recognize it by comparing against the children
+        //
+        for (uint32_t i = 0; i < ucb->m_cstTableLength; i++)
+        {
+            uint64_t raw = ucb->m_cstTable[i];
+            UnlinkedCodeBlock* maybeChild = reinterpret_cast<UnlinkedCodeBlock*>(raw);
+            auto it = ucbOrd.find(maybeChild);
+            if (it != ucbOrd.end() && maybeChild->m_parent == ucb)
+            {
+                w.Write(ConstantKind::Function);
+                w.Write(it->second);
+                continue;
+            }
+
+            TValue tv(raw);
+            if (tv.Is<tTable>())
+            {
+                w.Write(ConstantKind::Table);
+                if (!w.WriteTemplateTable(tv.As<tTable>()))
+                {
+                    return false;
+                }
+                continue;
+            }
+            if (!w.WriteValue(tv))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool WARN_UNUSED IsSnapshot(const char* data, size_t length)
+{
+    return length > 0 && data[0] == x_signatureByte;
+}
+
+ParseResult WARN_UNUSED Load(CoroutineRuntimeContext* ctx, const char* data, size_t length, bool dataOutlivesVM)
+{
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    // The half-built constant tables hold heap objects that the garbage collector does not know about yet
+    //
+    DeferGC deferGC(vm);
+
+    SnapshotReader r(data, length);
+    Header header;
+    if (!r.Read(header) || header.m_magic != x_magic)
+    {
+        return MakeLoadError(vm, "bad header");
+    }
+    if (header.m_version != x_version || header.m_numBytecodeMetadataKinds != x_num_bytecode_metadata_struct_kinds_)
+    {
+        return MakeLoadError(vm, "version mismatch");
+    }
+    if (header.m_numUnlinkedCodeBlocks == 0 || header.m_numUnlinkedCodeBlocks > length / sizeof(UcbHeader))
+    {
+        return MakeLoadError(vm, "bad function count");
+    }
+
+    // All the UnlinkedCodeBlocks are created upfront, so the constant tables can reference any of them
+    //
+    HeapPtr<TableObject> globalObject = ctx->m_globalObject.As();
+    std::vector<UnlinkedCodeBlock*> ucbs;
+    std::vector<std::pair<uint32_t /*parentOrd*/, uint32_t /*childOrd*/>> childFunctionRefs;
+    for (uint32_t i = 0; i < header.m_numUnlinkedCodeBlocks; i++)
+    {
+        UnlinkedCodeBlock* ucb = UnlinkedCodeBlock::Create(vm, globalObject);
+        ucb->m_bytecode = nullptr;
+        ucb->m_upvalueInfo = nullptr;
+        ucb->m_cstTable = nullptr;
+        ucb->m_bytecodeLength = 0;
+        ucb->m_cstTableLength = 0;
+        ucb->m_numUpvalues = 0;
+        ucb->m_bytecodeMetadataLength = 0;
+        ucb->m_bytecodeBuilder = nullptr;
+        ucbs.push_back(ucb);
+    }
+
+    for (uint32_t ord = 0; ord < header.m_numUnlinkedCodeBlocks; ord++)
+    {
+        UnlinkedCodeBlock* ucb = ucbs[ord];
+        UcbHeader uh;
+        if (!r.Read(uh))
+        {
+            return MakeLoadError(vm, "truncated");
+        }
+        // The parent must come before the child in pre-order, and the root must not have upvalues
+        //
+        if ((ord == 0) != (uh.m_parentOrd == x_noParent) || (ord > 0 && uh.m_parentOrd >= ord) || (ord == 0 && uh.m_numUpvalues > 0))
+        {
+            return MakeLoadError(vm, "bad function tree");
+        }
+        if (uh.m_numUpvalues > std::numeric_limits<uint8_t>::max() || uh.m_cstTableLength >= 0x7fff || uh.m_bytecodeMetadataLength % 8 != 0)
+        {
+            return MakeLoadError(vm, "bad function header");
+        }
+
+        ucb->m_parent = (ord == 0) ? nullptr : ucbs[uh.m_parentOrd];
+        ucb->m_numFixedArguments = uh.m_numFixedArguments;
+        ucb->m_hasVariadicArguments = static_cast<bool>(uh.m_hasVariadicArguments);
+        ucb->m_stackFrameNumSlots = uh.m_stackFrameNumSlots;
+        ucb->m_bytecodeMetadataLength = uh.m_bytecodeMetadataLength;
+
+        ucb->m_upvalueInfo = new UpvalueMetadata[uh.m_numUpvalues];
+        ucb->m_numUpvalues = uh.m_numUpvalues;
+        for (uint32_t i = 0; i < uh.m_numUpvalues; i++)
+        {
+            UpvalueRecord rec;
+            if (!r.Read(rec))
+            {
+                return MakeLoadError(vm, "truncated");
+            }
+            UpvalueMetadata& uv = ucb->m_upvalueInfo[i];
+            DEBUG_ONLY(uv.m_immutabilityFieldFinalized = true;)
+            uv.m_isParentLocal = static_cast<bool>(rec.m_isParentLocal);
+            uv.m_isImmutable = static_cast<bool>(rec.m_isImmutable);
+            uv.m_slot = rec.m_slot;
+        }
+
+        const char* useCounts = r.Skip(sizeof(uint16_t) * x_num_bytecode_metadata_struct_kinds_);
+        const char* bytecode = r.Skip(uh.m_bytecodeLength);
+        if (useCounts == nullptr || bytecode == nullptr)
+        {
+            return MakeLoadError(vm, "truncated");
+        }
+        memcpy(ucb->m_bytecodeMetadataUseCounts, useCounts, sizeof(uint16_t) * x_num_bytecode_metadata_struct_kinds_);
+        if (dataOutlivesVM)
+        {
+            ucb->m_bytecode = reinterpret_cast<uint8_t*>(const_cast<char*>(bytecode));
+        }
+        else
+        {
+            ucb->m_bytecode = new uint8_t[uh.m_bytecodeLength];
+            memcpy(ucb->m_bytecode, bytecode, uh.m_bytecodeLength);
+        }
+        ucb->m_bytecodeLength = uh.m_bytecodeLength;
+
+        uint64_t* cstTable = new uint64_t[uh.m_cstTableLength]();
+        ucb->m_cstTable = cstTable;
+        ucb->m_cstTableLength = uh.m_cstTableLength;
+        for (uint32_t i = 0; i < uh.m_cstTableLength; i++)
+        {
+            ConstantKind kind;
+            if (!r.Read(kind))
+            {
+                return MakeLoadError(vm, "truncated");
+            }
+            if (kind == ConstantKind::Function)
+            {
+                uint32_t childOrd;
+                if (!r.Read(childOrd) || childOrd <= ord || childOrd >= header.m_numUnlinkedCodeBlocks)
+                {
+                    return MakeLoadError(vm, "bad function constant");
+                }
+                cstTable[i] = reinterpret_cast<uint64_t>(ucbs[childOrd]);
+                childFunctionRefs.push_back(std::make_pair(ord, childOrd));
+            }
+            else if (kind == ConstantKind::Table)
+            {
+                TValue tv;
+                if (!r.ReadTemplateTable(vm, tv /*out*/))
+                {
+                    return MakeLoadError(vm, "bad template table");
+                }
+                cstTable[i] = tv.m_value;
+            }
+            else
+            {
+                TValue tv;
+                if (!r.ReadValuePayload(vm, kind, tv /*out*/))
+                {
+                    return MakeLoadError(vm, "bad constant");
+                }
+                cstTable[i] = tv.m_value;
+            }
+        }
+
+        ucb->m_uvFixUpCompleted = (ord > 0);
+    }
+
+    // A function may only create closures of its direct children, otherwise the upvalue metadata makes no sense
+    //
+    for (auto& it : childFunctionRefs)
+    {
+        if (ucbs[it.second]->m_parent != ucbs[it.first])
+        {
+            return MakeLoadError(vm, "bad function constant");
+        }
+    }
+
+    // Same as the tail of ParseLuaScript: the root goes last in the module, and the CodeBlocks are created for the default global object
+    //
+    UnlinkedCodeBlock* chunkFn = ucbs[0];
+    std::unique_ptr<ScriptModule> module = std::make_unique<ScriptModule>();
+    module->m_unlinkedCodeBlocks.assign(ucbs.begin() + 1, ucbs.end());
+    module->m_unlinkedCodeBlocks.push_back(chunkFn);
+    module->m_defaultGlobalObject = ctx->m_globalObject;
+    for (UnlinkedCodeBlock* ucb : module->m_unlinkedCodeBlocks)
+    {
+        assert(ucb->m_defaultCodeBlock == nullptr);
+        ucb->m_defaultCodeBlock = CodeBlock::Create(vm, ucb, ctx->m_globalObject);
+    }
+    chunkFn->m_uvFixUpCompleted = true;
+    assert(chunkFn->m_numUpvalues == 0);
+    UserHeapPointer<FunctionObject> entryPointFunc = FunctionObject::Create(vm, chunkFn->GetCodeBlock(ctx->m_globalObject));
+    module->m_defaultEntryPoint = entryPointFunc;
+    vm->GetUserHeapGarbageCollector()->AddPermanentRoot(TValue::CreatePointer(entryPointFunc));
+    return {
+        .m_scriptModule = std::move(module),
+        .errMsg = TValue::Create<tNil>()
+    };
+}
+
+ParseResult WARN_UNUSED LoadFromFile(CoroutineRuntimeContext* ctx, const char* fileName)
+{
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    int fd = open(fileName, O_RDONLY);
+    if (fd == -1)
+    {
+        return MakeLoadError(vm, "cannot open file");
+    }
+    Auto(close(fd));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        return MakeLoadError(vm, "cannot read file");
+    }
+    size_t fileSize = static_cast<size_t>(st.st_size);
+
+    void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0 /*offset*/);
+    if (mapped == MAP_FAILED)
+    {
+        return MakeLoadError(vm, "cannot map file");
+    }
+
+    // Note that the mapping is kept even if the load fails, since the UnlinkedCodeBlocks created so far may point into it
+    //
+    return Load(ctx, reinterpret_cast<const char*>(mapped), fileSize, true /*dataOutlivesVM*/);
+}
+
+}   // namespace BytecodeSnapshot
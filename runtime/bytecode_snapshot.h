@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common_utils.h"
+#include "lj_parser_wrapper.h"
+
+class UnlinkedCodeBlock;
+
+// A compact binary serialization of parsed Lua functions, so a script bundle can be loaded without running the Lua parser.
+//
+// A snapshot contains one function (the root) and all the functions nested in it. For each function it records the
+// final bytecode, the constant table, the upvalue metadata and the bytecode metadata use counts, which is everything
+// needed to create the CodeBlocks. Child functions are referenced by their ordinal in the snapshot, string constants by
+// their content, and the template tables of the TableDup bytecode are recorded as the sequence of insertions that
+// rebuilds a table with the exact same shape (which the TableDup bytecode relies on).
+//
+// The bytecode is stored as-is, so a snapshot is only valid for the exact same build of the VM, similar to LuaJIT's
+// bytecode dump. Like in LuaJIT, the bytecode is trusted, so loading untrusted snapshots is unsafe.
+//
+// When a snapshot file is loaded, the file is mmap'ed, and the bytecode of the UnlinkedCodeBlocks points directly into
+// the mapping instead of being copied.
+//
+// File format:
+//     [ Header ] [ UnlinkedCodeBlock #0 (the root) ] [ UnlinkedCodeBlock #1 ] ...
+// where each UnlinkedCodeBlock is
+//     [ UcbHeader ] [ UpvalueRecord * m_numUpvalues ] [ uint16_t bytecode metadata use counts ] [ bytecode ] [ constants ]
+//
+namespace BytecodeSnapshot
+{
+
+struct Header
+{
+    uint64_t m_magic;
+    uint32_t m_version;
+    uint32_t m_numBytecodeMetadataKinds;
+    uint32_t m_numUnlinkedCodeBlocks;
+    uint32_t m_reserved;
+};
+static_assert(sizeof(Header) == 24);
+
+// "\x1bLJRBC1", the leading ESC character is never valid in Lua source code, so a snapshot can always be told apart from source
+//
+constexpr uint64_t x_magic = 0x00314342524A4C1BULL;
+constexpr char x_signatureByte = '\x1b';
+
+// Bump this when the format changes
+//
+constexpr uint32_t x_version = 1;
+
+// Return false if the function cannot be dumped: if it has upvalues, or if its constant table holds something
+// we do not know how to serialize (e.g. a template table that has turned into a dictionary)
+//
+bool WARN_UNUSED Dump(UnlinkedCodeBlock* root, std::string& out /*out*/);
+
+bool WARN_UNUSED IsSnapshot(const char* data, size_t length);
+
+// Load a snapshot and link it to the global object of 'ctx', just like ParseLuaScript does for source code.
+// If 'dataOutlivesVM' is true, the UnlinkedCodeBlocks reference the bytecode in 'data' directly.
+//
+ParseResult WARN_UNUSED Load(CoroutineRuntimeContext* ctx, const char* data, size_t length, bool dataOutlivesVM);
+
+// The file is mmap'ed and never unmapped, since the UnlinkedCodeBlocks are never freed either
+//
+ParseResult WARN_UNUSED LoadFromFile(CoroutineRuntimeContext* ctx, const char* fileName);
+
+}   // namespace BytecodeSnapshot
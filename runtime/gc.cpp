@@ -0,0 +1,1559 @@
+#include "gc.h"
+#include "runtime_utils.h"
+#include "lua_file.h"
+#include "lua_pattern.h"
+
+#include <pthread.h>
+
+namespace {
+
+int64_t WARN_UNUSED GranuleOrdinalToUserHeapOffset(uint64_t ord)
+{
+    return static_cast<int64_t>(ord * 8) - static_cast<int64_t>(VM::x_vmBaseOffset);
+}
+
+// Return the capacity of the inline named storage and the butterfly named storage of a table object
+// Return false if the object has no valid hidden class (which may happen if the object is being initialized)
+//
+bool WARN_UNUSED GetTableObjectNamedStorageCapacity(VM* vm, TableObject* obj, uint32_t& inlineCapacity /*out*/, uint32_t& butterflyNamedCapacity /*out*/)
+{
+    SystemHeapPointer<void> hc = obj->m_hiddenClass;
+    if (hc.m_value == 0)
+    {
+        return false;
+    }
+    HeapEntityType ty = TranslateToRawPointer(vm, hc.As<SystemHeapGcObjectHeader>())->m_type;
+    if (likely(ty == HeapEntityType::Structure))
+    {
+        Structure* structure = TranslateToRawPointer(vm, hc.As<Structure>());
+        inlineCapacity = structure->m_inlineNamedStorageCapacity;
+        butterflyNamedCapacity = structure->m_butterflyNamedStorageCapacity;
+        return true;
+    }
+    else
+    {
+        // UncacheableDictionary has the same layout as CacheableDictionary
+        //
+        assert(ty == HeapEntityType::CacheableDictionary || ty == HeapEntityType::UncacheableDictionary);
+        CacheableDictionary* dict = TranslateToRawPointer(vm, hc.As<CacheableDictionary>());
+        inlineCapacity = dict->m_inlineNamedStorageCapacity;
+        butterflyNamedCapacity = dict->m_butterflyNamedStorageCapacity;
+        return true;
+    }
+}
+
+uint64_t* WARN_UNUSED GetButterflyAllocationStart(Butterfly* butterfly, uint32_t butterflyNamedCapacity)
+{
+    return reinterpret_cast<uint64_t*>(butterfly) - (butterflyNamedCapacity + static_cast<uint32_t>(1 - ArrayGrowthPolicy::x_arrayBaseOrd));
+}
+
+// Return an address that is below all the native stack frames of our caller
+//
+uintptr_t NO_INLINE WARN_UNUSED GetApproximateNativeStackPointer()
+{
+    volatile uint64_t marker = 0;
+    return reinterpret_cast<uintptr_t>(&marker);
+}
+
+uintptr_t WARN_UNUSED GetNativeStackHighAddress()
+{
+    static thread_local uintptr_t t_stackHigh = 0;
+    if (unlikely(t_stackHigh == 0))
+    {
+        pthread_attr_t attr;
+        int r = pthread_getattr_np(pthread_self(), &attr);
+        ReleaseAssert(r == 0 && "pthread_getattr_np failed");
+        void* stackAddr;
+        size_t stackSize;
+        r = pthread_attr_getstack(&attr, &stackAddr, &stackSize);
+        ReleaseAssert(r == 0 && "pthread_attr_getstack failed");
+        pthread_attr_destroy(&attr);
+        t_stackHigh = reinterpret_cast<uintptr_t>(stackAddr) + stackSize;
+    }
+    return t_stackHigh;
+}
+
+}   // anonymous namespace
+
+void WriteBarrierSlowPath(void* obj, uint8_t* cellState)
+{
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    int64_t offset = static_cast<int64_t>(reinterpret_cast<uintptr_t>(obj) - reinterpret_cast<uintptr_t>(vm));
+    if (offset >= 0)
+    {
+        // System heap objects are not collected (they are always scanned as roots), so nothing needs to be remembered
+        //
+        return;
+    }
+
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+    if (gc->m_isMarkingConcurrently)
+    {
+        // The GC thread makes a cell Black, fences, then scans the cell. Since the barrier is executed after the store,
+        // fencing here guarantees that either we observe Black (and re-grey the cell), or the GC thread observes our store.
+        //
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (__atomic_load_n(cellState, __ATOMIC_RELAXED) != static_cast<uint8_t>(GcCellState::Black))
+        {
+            return;
+        }
+    }
+
+    assert(*cellState == static_cast<uint8_t>(GcCellState::Black));
+    __atomic_store_n(cellState, static_cast<uint8_t>(GcCellState::Remembered), __ATOMIC_RELAXED);
+    gc->RememberCell(offset);
+}
+
+UserHeapGarbageCollector::UserHeapGarbageCollector(VM* vm)
+    : m_vm(vm)
+    , m_vmBase(reinterpret_cast<uintptr_t>(vm))
+    , m_cellStartBitmap(nullptr)
+    , m_userHeapMappedLimit(x_userHeapTop)
+    , m_userHeapLowestCell(x_userHeapTop)
+    , m_bytesAllocatedSinceLastCollection(0)
+    , m_liveBytesAfterLastCollection(0)
+    , m_liveBytesAfterLastFullCollection(0)
+    , m_edenBudgetBytes(x_minEdenBudgetBytes)
+    , m_liveBytesFromLastSweep(0)
+    , m_numEdenCollections(0)
+    , m_numFullCollections(0)
+    , m_luaPause(200)
+    , m_luaStepMultiplier(200)
+    , m_deferralDepth(0)
+    , m_isCollecting(false)
+    , m_isAutomaticCollectionEnabled(true)
+    , m_isConcurrentMarkingEnabled(true)
+    , m_isMarkingConcurrently(false)
+    , m_concurrentCollectionKind(CollectionKind::Eden)
+    , m_bytesAllocatedAtCycleStart(0)
+    , m_concurrentPhase(ConcurrentPhase::Idle)
+    , m_gcThreadShouldExit(false)
+{
+    assert(vm->m_userHeapPtrLimit == x_userHeapTop && vm->m_userHeapCurPtr == x_userHeapTop);
+
+    // One bit for each 8-byte granule. The pages are only populated on demand, so this costs nothing for a small heap
+    //
+    constexpr size_t x_bitmapLengthBytes = VM::x_vmUserHeapSize / 8 / 8;
+    void* bitmap = mmap(nullptr, x_bitmapLengthBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    VM_FAIL_WITH_ERRNO_IF(bitmap == MAP_FAILED,
+                          "Failed to reserve address range of length %llu", static_cast<unsigned long long>(x_bitmapLengthBytes));
+    m_cellStartBitmap = reinterpret_cast<uint64_t*>(bitmap);
+    vm->m_userHeapCellStartBitmap = m_cellStartBitmap;
+    for (size_t i = 0; i < internal::x_numUserHeapSizeClasses; i++)
+    {
+        m_sizeClassFreeLists[i] = 0;
+    }
+    InstallSizeClassFreeLists();
+    vm->m_writeBarrierThreshold = x_writeBarrierThresholdNormal;
+}
+
+UserHeapGarbageCollector::~UserHeapGarbageCollector()
+{
+    // The GC thread exits after finishing its current phase. The cycle is abandoned since the heap is going away.
+    //
+    if (m_gcThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_gcThreadLock);
+            m_gcThreadShouldExit = true;
+        }
+        m_gcThreadCondVar.notify_all();
+        m_gcThread.join();
+    }
+    for (void* ptr : m_arraysToDeleteAfterMarking)
+    {
+        ::operator delete[](ptr);
+    }
+    for (auto& [stackBegin, numStackSlots] : m_stacksToFreeAfterMarking)
+    {
+        CoroutineRuntimeContext::FreeStack(stackBegin, numStackSlots);
+    }
+
+    // Note that we do not run finalizers for the cells that are still alive: the whole user heap is going away with the VM
+    //
+    constexpr size_t x_bitmapLengthBytes = VM::x_vmUserHeapSize / 8 / 8;
+    int r = munmap(m_cellStartBitmap, x_bitmapLengthBytes);
+    LOG_WARNING_WITH_ERRNO_IF(r != 0, "Cannot unmap user heap cell start bitmap");
+    m_vm->m_userHeapCellStartBitmap = nullptr;
+}
+
+bool WARN_UNUSED UserHeapGarbageCollector::IsCellStart(int64_t offset)
+{
+    return IsInUserHeapRange(offset) && offset >= m_userHeapLowestCell && TestCellStartBit(offset);
+}
+
+int64_t WARN_UNUSED UserHeapGarbageCollector::FindNextCellStart(int64_t offset, int64_t limit)
+{
+    assert(offset < limit && limit <= x_userHeapTop);
+    uint64_t ord = VM::GetUserHeapGranuleOrdinal(offset) + 1;
+    // Note that 'limit' may be x_userHeapTop, which has no granule ordinal
+    //
+    uint64_t endOrd = static_cast<uint64_t>(limit + static_cast<int64_t>(VM::x_vmBaseOffset)) / 8;
+    while (ord < endOrd)
+    {
+        uint64_t wordIdx = ord / 64;
+        uint64_t word = m_cellStartBitmap[wordIdx] >> (ord % 64);
+        if (word != 0)
+        {
+            uint64_t resultOrd = ord + static_cast<uint64_t>(__builtin_ctzll(word));
+            return resultOrd < endOrd ? GranuleOrdinalToUserHeapOffset(resultOrd) : limit;
+        }
+        ord = (wordIdx + 1) * 64;
+    }
+    return limit;
+}
+
+int64_t WARN_UNUSED UserHeapGarbageCollector::FindCellContaining(int64_t offset)
+{
+    assert(offset % 8 == 0);
+    if (offset < m_userHeapLowestCell || offset >= x_userHeapTop)
+    {
+        return 0;
+    }
+
+    uint64_t ord = VM::GetUserHeapGranuleOrdinal(offset);
+    uint64_t lowestOrd = VM::GetUserHeapGranuleOrdinal(m_userHeapLowestCell);
+    uint64_t wordIdx = ord / 64;
+    uint64_t bitInWord = ord % 64;
+    uint64_t mask = (bitInWord == 63) ? ~static_cast<uint64_t>(0) : ((static_cast<uint64_t>(1) << (bitInWord + 1)) - 1);
+    uint64_t word = m_cellStartBitmap[wordIdx] & mask;
+    while (word == 0)
+    {
+        // m_userHeapLowestCell is always a cell start, so we will never go past it
+        //
+        assert(wordIdx > lowestOrd / 64);
+        wordIdx--;
+        word = m_cellStartBitmap[wordIdx];
+    }
+    uint64_t cellOrd = wordIdx * 64 + 63 - static_cast<uint64_t>(__builtin_clzll(word));
+    assert(lowestOrd <= cellOrd && cellOrd <= ord);
+    std::ignore = lowestOrd;
+    return GranuleOrdinalToUserHeapOffset(cellOrd);
+}
+
+template<typename Func>
+void UserHeapGarbageCollector::ForEachCellInRange(int64_t begin, int64_t end, const Func& func)
+{
+    int64_t cur = begin;
+    while (cur < end)
+    {
+        assert(TestCellStartBit(cur));
+        int64_t next = FindNextCellStart(cur, end);
+        assert(next > cur);
+        func(cur, static_cast<uint64_t>(next - cur));
+        cur = next;
+    }
+}
+
+void UserHeapGarbageCollector::FormatFreeChunk(int64_t offset, uint64_t size)
+{
+    assert(TestCellStartBit(offset));
+    assert(size >= 8 && size % 8 == 0);
+    UserHeapGcObjectHeader* hdr = reinterpret_cast<UserHeapGcObjectHeader*>(RawCell(offset));
+    hdr->m_hiddenClass = 0;
+    hdr->m_type = HeapEntityType::X_END_OF_ENUM;
+    hdr->m_cellState = GcCellState::White;
+    hdr->m_opaque = 0;
+    hdr->m_arrayType = 0;
+}
+
+void UserHeapGarbageCollector::AddToFreeList(int64_t offset, uint64_t size)
+{
+    if (size >= x_minFreeListChunkSize)
+    {
+        size_t bucket = static_cast<size_t>(63 - __builtin_clzll(size));
+        assert(bucket < x_numFreeListBuckets);
+        m_freeLists[bucket].push_back({ .m_offset = offset, .m_size = size });
+    }
+}
+
+void UserHeapGarbageCollector::AddToSizeClassFreeLists(int64_t offset, uint64_t size)
+{
+    assert(TestCellStartBit(offset));
+    assert(size >= 8 && size % 8 == 0 && size <= x_maxSizeClassCarvingChunkSize);
+    int64_t cur = offset;
+    uint64_t remaining = size;
+    while (remaining >= internal::x_userHeapSizeClassSlots[0] * 8)
+    {
+        // Every size up to 8 slots is a size class. Otherwise, take the largest size class that leaves room for
+        // at least one more cell, since a leftover 8-byte cell cannot be put on any free list.
+        //
+        uint32_t slots;
+        if (remaining <= 64)
+        {
+            slots = static_cast<uint32_t>(remaining / 8);
+        }
+        else
+        {
+            slots = static_cast<uint32_t>(remaining / 8) - internal::x_userHeapSizeClassSlots[0];
+        }
+        size_t sizeClass = internal::x_userHeapSizeClassForSlots[slots];
+        if (internal::x_userHeapSizeClassSlots[sizeClass] > slots)
+        {
+            sizeClass--;
+        }
+        uint64_t cellSize = static_cast<uint64_t>(internal::x_userHeapSizeClassSlots[sizeClass]) * 8;
+        assert(cellSize <= remaining);
+
+        SetCellStartBit(cur);
+        FormatFreeChunk(cur, cellSize);
+        UnalignedStore<int64_t>(RawCell(cur) + VM::x_userHeapFreeCellNextOffset, m_sizeClassFreeLists[sizeClass]);
+        m_sizeClassFreeLists[sizeClass] = cur;
+
+        cur += static_cast<int64_t>(cellSize);
+        remaining -= cellSize;
+    }
+    if (remaining > 0)
+    {
+        assert(remaining == 8);
+        SetCellStartBit(cur);
+        FormatFreeChunk(cur, remaining);
+    }
+}
+
+void UserHeapGarbageCollector::InstallSizeClassFreeLists()
+{
+    assert(!IsConcurrentCycleInProgress());
+    for (size_t i = 0; i < internal::x_numUserHeapSizeClasses; i++)
+    {
+        m_vm->m_userHeapSizeClassFreeList[i] = m_sizeClassFreeLists[i];
+        m_sizeClassFreeLists[i] = 0;
+    }
+}
+
+void UserHeapGarbageCollector::RetireCurrentAllocationRegion()
+{
+    VM* vm = m_vm;
+    assert(vm->m_userHeapPtrLimit <= vm->m_userHeapCurPtr);
+    if (vm->m_userHeapCurPtr > vm->m_userHeapPtrLimit)
+    {
+        // The allocator guarantees that no cell start bit is set inside the unused part of the region
+        //
+        int64_t offset = vm->m_userHeapPtrLimit;
+        uint64_t size = static_cast<uint64_t>(vm->m_userHeapCurPtr - vm->m_userHeapPtrLimit);
+        SetCellStartBit(offset);
+        FormatFreeChunk(offset, size);
+        if (IsConcurrentCycleInProgress())
+        {
+            // The GC thread may be sweeping and rebuilding the free lists
+            //
+            m_freeChunksRetiredDuringCycle.push_back({ .m_offset = offset, .m_size = size });
+        }
+        else
+        {
+            AddToFreeList(offset, size);
+        }
+    }
+    vm->m_userHeapPtrLimit = m_userHeapMappedLimit;
+    vm->m_userHeapCurPtr = m_userHeapMappedLimit;
+}
+
+bool WARN_UNUSED UserHeapGarbageCollector::TryTakeRegionFromFreeList(uint32_t length)
+{
+    assert(length > 0 && length % 8 == 0);
+    // Every chunk in bucket 'b' has size at least 2^b, so starting from ceil(log2(length)) any chunk will do
+    //
+    size_t firstBucket = (length == 1) ? 0 : static_cast<size_t>(64 - __builtin_clzll(static_cast<uint64_t>(length) - 1));
+    for (size_t bucket = firstBucket; bucket < x_numFreeListBuckets; bucket++)
+    {
+        std::vector<FreeChunk>& freeList = m_freeLists[bucket];
+        if (freeList.empty())
+        {
+            continue;
+        }
+
+        FreeChunk chunk = freeList.back();
+        freeList.pop_back();
+        assert(chunk.m_size >= length);
+
+        RetireCurrentAllocationRegion();
+
+        // Take the region from the high end of the chunk, so the remainder keeps its header and cell start bit
+        //
+        uint64_t regionSize = std::max(static_cast<uint64_t>(length), static_cast<uint64_t>(x_allocationRegionSize));
+        int64_t regionEnd = chunk.m_offset + static_cast<int64_t>(chunk.m_size);
+        int64_t regionBegin;
+        if (chunk.m_size >= regionSize + x_minFreeListChunkSize)
+        {
+            regionBegin = regionEnd - static_cast<int64_t>(regionSize);
+            uint64_t remainderSize = static_cast<uint64_t>(regionBegin - chunk.m_offset);
+            FormatFreeChunk(chunk.m_offset, remainderSize);
+            AddToFreeList(chunk.m_offset, remainderSize);
+        }
+        else
+        {
+            regionBegin = chunk.m_offset;
+            ClearCellStartBit(regionBegin);
+        }
+
+        memset(RawCell(regionBegin), 0, static_cast<size_t>(regionEnd - regionBegin));
+
+        m_vm->m_userHeapPtrLimit = regionBegin;
+        m_vm->m_userHeapCurPtr = regionEnd;
+        m_bytesAllocatedSinceLastCollection += static_cast<size_t>(regionEnd - regionBegin);
+        return true;
+    }
+    return false;
+}
+
+void UserHeapGarbageCollector::GrowIntoWilderness(uint32_t length)
+{
+    VM* vm = m_vm;
+    if (vm->m_userHeapPtrLimit != m_userHeapMappedLimit)
+    {
+        // The current region is not adjacent to the unmapped part of the heap, so it cannot be extended
+        //
+        RetireCurrentAllocationRegion();
+    }
+    assert(vm->m_userHeapPtrLimit == m_userHeapMappedLimit);
+
+    int64_t newCurPtr = vm->m_userHeapCurPtr - static_cast<int64_t>(length);
+    VM_FAIL_IF(newCurPtr < x_userHeapLowest,
+               "Resource limit exceeded: user heap overflowed %dGB memory limit.", static_cast<int>(VM::x_vmUserHeapSize >> 30));
+
+    constexpr size_t x_allocationSize = 65536;
+    // TODO: consider allocating smaller sizes on the first few allocations
+    //
+    int64_t newHeapLimit = newCurPtr & (~static_cast<int64_t>(x_allocationSize - 1));
+    assert(newHeapLimit <= newCurPtr && newHeapLimit % static_cast<int64_t>(VM::x_pageSize) == 0 && newHeapLimit < m_userHeapMappedLimit);
+    size_t lengthToAllocate = static_cast<size_t>(m_userHeapMappedLimit - newHeapLimit);
+    assert(lengthToAllocate % VM::x_pageSize == 0);
+
+    uintptr_t allocAddr = m_vmBase + static_cast<uint64_t>(newHeapLimit);
+    void* r = mmap(reinterpret_cast<void*>(allocAddr), lengthToAllocate, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE | MAP_FIXED, -1, 0);
+    VM_FAIL_WITH_ERRNO_IF(r == MAP_FAILED,
+                          "Out of Memory: Allocation of length %llu failed", static_cast<unsigned long long>(lengthToAllocate));
+    assert(r == reinterpret_cast<void*>(allocAddr));
+
+    m_userHeapMappedLimit = newHeapLimit;
+    vm->m_userHeapPtrLimit = newHeapLimit;
+    m_bytesAllocatedSinceLastCollection += lengthToAllocate;
+}
+
+UserHeapGarbageCollector::CollectionKind WARN_UNUSED UserHeapGarbageCollector::DecideCollectionKind()
+{
+    size_t fullCollectionThreshold = std::max(x_minFullCollectionThresholdBytes, m_liveBytesAfterLastFullCollection * x_fullCollectionGrowthFactor);
+    if (GetHeapSizeBytes() > fullCollectionThreshold)
+    {
+        return CollectionKind::Full;
+    }
+    return CollectionKind::Eden;
+}
+
+void UserHeapGarbageCollector::AllocationSlowPath(uint32_t length)
+{
+    assert(IsExecutionThread());
+    assert(!m_isCollecting);
+    VM* vm = m_vm;
+    assert(vm->m_userHeapCurPtr < vm->m_userHeapPtrLimit);
+
+    // Undo the bump done by the fast path, so the current region is consistent if we need to collect
+    //
+    vm->m_userHeapCurPtr += static_cast<int64_t>(length);
+    assert(vm->m_userHeapPtrLimit <= vm->m_userHeapCurPtr);
+
+    // This is the safepoint where the execution thread does its part of a concurrent cycle.
+    // While collection is deferred, we must not finish marking, as some pointers are not visible to the collector.
+    //
+    if (IsConcurrentCycleInProgress() && m_deferralDepth == 0)
+    {
+        std::ignore = AdvanceConcurrentCycle();
+
+        // If the execution thread allocates faster than the GC thread can collect, wait for the cycle to complete
+        //
+        if (IsConcurrentCycleInProgress() && m_bytesAllocatedSinceLastCollection - m_bytesAllocatedAtCycleStart >= m_edenBudgetBytes)
+        {
+            CompleteConcurrentCycle();
+        }
+    }
+
+    if (!IsConcurrentCycleInProgress() && m_bytesAllocatedSinceLastCollection >= m_edenBudgetBytes && m_isAutomaticCollectionEnabled && m_deferralDepth == 0)
+    {
+        CollectionKind kind = DecideCollectionKind();
+        if (m_isConcurrentMarkingEnabled)
+        {
+            StartConcurrentCycle(kind);
+        }
+        else
+        {
+            Collect(kind);
+        }
+    }
+
+    // During a concurrent cycle, free chunks are off limits (see comments in gc.h)
+    //
+    if (IsConcurrentCycleInProgress() || !TryTakeRegionFromFreeList(length))
+    {
+        GrowIntoWilderness(length);
+    }
+
+    vm->m_userHeapCurPtr -= static_cast<int64_t>(length);
+    assert(vm->m_userHeapPtrLimit <= vm->m_userHeapCurPtr);
+}
+
+void UserHeapGarbageCollector::UpdateStatisticsAfterCollection(CollectionKind kind, size_t liveBytes, size_t bytesAllocatedDuringCollection)
+{
+    m_liveBytesAfterLastCollection = liveBytes;
+    m_bytesAllocatedSinceLastCollection = bytesAllocatedDuringCollection;
+    m_edenBudgetBytes = std::max(x_minEdenBudgetBytes, liveBytes / 2);
+    if (kind == CollectionKind::Full)
+    {
+        m_liveBytesAfterLastFullCollection = liveBytes;
+        m_numFullCollections++;
+    }
+    else
+    {
+        m_numEdenCollections++;
+    }
+}
+
+void UserHeapGarbageCollector::Collect(CollectionKind kind)
+{
+    assert(IsExecutionThread());
+    assert(m_deferralDepth == 0 && !m_isCollecting);
+
+    if (IsConcurrentCycleInProgress())
+    {
+        CompleteConcurrentCycle();
+    }
+
+    m_isCollecting = true;
+
+    // After this, every byte in [m_userHeapMappedLimit, x_userHeapTop) belongs to some cell, so the heap is walkable
+    //
+    RetireCurrentAllocationRegion();
+    m_userHeapLowestCell = m_userHeapMappedLimit;
+
+    if (kind == CollectionKind::Full)
+    {
+        m_rememberedSet.clear();
+        ResetAllCellsToWhite();
+    }
+
+    MarkRoots(kind);
+    DrainMarkStack();
+    CloseOpenUpvaluesOfDeadCoroutines();
+    SweepWeakReferences();
+    UnregisterDeadCoroutines();
+    Sweep();
+    InstallSizeClassFreeLists();
+
+    UpdateStatisticsAfterCollection(kind, m_liveBytesFromLastSweep, 0 /*bytesAllocatedDuringCollection*/);
+
+    assert(m_markStack.empty() && m_rememberedSet.empty());
+    m_isCollecting = false;
+}
+
+void UserHeapGarbageCollector::SetConcurrentPhase(ConcurrentPhase phase)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_gcThreadLock);
+        m_concurrentPhase.store(phase, std::memory_order_release);
+    }
+    m_gcThreadCondVar.notify_all();
+}
+
+void UserHeapGarbageCollector::WaitUntilConcurrentPhaseChanges(ConcurrentPhase phase)
+{
+    std::unique_lock<std::mutex> lock(m_gcThreadLock);
+    m_gcThreadCondVar.wait(lock, [&]() { return m_concurrentPhase.load(std::memory_order_acquire) != phase; });
+}
+
+void UserHeapGarbageCollector::StartConcurrentCycle(CollectionKind kind)
+{
+    assert(IsExecutionThread());
+    assert(!IsConcurrentCycleInProgress() && m_deferralDepth == 0 && !m_isCollecting);
+
+    if (!m_gcThread.joinable())
+    {
+        m_gcThread = std::thread([this]() { GCThreadMain(); });
+    }
+
+    // From now on, the execution thread only allocates below m_userHeapLowestCell
+    //
+    RetireCurrentAllocationRegion();
+    m_userHeapLowestCell = m_userHeapMappedLimit;
+    for (size_t i = 0; i < internal::x_numUserHeapSizeClasses; i++)
+    {
+        m_vm->m_userHeapSizeClassFreeList[i] = 0;
+    }
+
+    m_concurrentCollectionKind = kind;
+    m_bytesAllocatedAtCycleStart = m_bytesAllocatedSinceLastCollection;
+    m_isMarkingConcurrently = true;
+    m_vm->m_writeBarrierThreshold = x_writeBarrierThresholdDuringMarking;
+
+    if (kind == CollectionKind::Full)
+    {
+        // The GC thread will reset every cell to White, after which the remembered set is meaningless
+        //
+        m_rememberedSet.clear();
+        SetConcurrentPhase(ConcurrentPhase::Resetting);
+    }
+    else
+    {
+        MarkRootsForConcurrentCycle();
+    }
+}
+
+bool WARN_UNUSED UserHeapGarbageCollector::AdvanceConcurrentCycle()
+{
+    assert(IsExecutionThread() && m_deferralDepth == 0);
+    switch (m_concurrentPhase.load(std::memory_order_acquire))
+    {
+    case ConcurrentPhase::Idle:
+    {
+        return true;
+    }
+    case ConcurrentPhase::Resetting:
+    case ConcurrentPhase::Sweeping:
+    {
+        return false;
+    }
+    case ConcurrentPhase::WaitingForRoots:
+    {
+        MarkRootsForConcurrentCycle();
+        return true;
+    }
+    case ConcurrentPhase::Marking:
+    {
+        // Hand the cells re-greyed by the write barrier to the GC thread
+        //
+        if (!m_rememberedSet.empty())
+        {
+            std::lock_guard<std::mutex> lock(m_gcThreadLock);
+            if (m_concurrentPhase.load(std::memory_order_relaxed) == ConcurrentPhase::Marking)
+            {
+                m_greyCellsFromExecutionThread.insert(m_greyCellsFromExecutionThread.end(), m_rememberedSet.begin(), m_rememberedSet.end());
+                m_rememberedSet.clear();
+            }
+        }
+        m_gcThreadCondVar.notify_all();
+        return false;
+    }
+    case ConcurrentPhase::WaitingForFinalPause:
+    {
+        FinishConcurrentMarking();
+        return true;
+    }
+    case ConcurrentPhase::SweepDone:
+    {
+        FinishConcurrentCycle();
+        return true;
+    }
+    }   /*switch*/
+    __builtin_unreachable();
+}
+
+void UserHeapGarbageCollector::CompleteConcurrentCycle()
+{
+    assert(IsExecutionThread() && m_deferralDepth == 0);
+    while (IsConcurrentCycleInProgress())
+    {
+        ConcurrentPhase phase = m_concurrentPhase.load(std::memory_order_acquire);
+        if (!AdvanceConcurrentCycle())
+        {
+            WaitUntilConcurrentPhaseChanges(phase);
+        }
+    }
+}
+
+void UserHeapGarbageCollector::MarkRootsForConcurrentCycle()
+{
+    assert(m_markStack.empty());
+    m_isCollecting = true;
+
+    MarkVMRoots();
+    ScanNativeStack();
+    MarkCoroutineRoots(m_concurrentCollectionKind == CollectionKind::Eden /*rescanOldCoroutines*/);
+    ProcessRememberedSet();
+    MarkSystemObjectRoots();
+
+    m_isCollecting = false;
+    SetConcurrentPhase(ConcurrentPhase::Marking);
+}
+
+void UserHeapGarbageCollector::FinishConcurrentMarking()
+{
+    assert(m_isMarkingConcurrently);
+    m_isCollecting = true;
+
+    // Make the cells allocated during the cycle walkable
+    //
+    RetireCurrentAllocationRegion();
+
+    m_rememberedSet.insert(m_rememberedSet.end(), m_greyCellsFromExecutionThread.begin(), m_greyCellsFromExecutionThread.end());
+    m_greyCellsFromExecutionThread.clear();
+
+    // Everything that is written without a write barrier must be rescanned
+    //
+    MarkVMRoots();
+    ScanNativeStack();
+    MarkCoroutineRoots(true /*rescanOldCoroutines*/);
+    ProcessRememberedSet();
+    MarkSystemObjectRoots();
+
+    // The cells allocated during the cycle are not collected by this cycle, but they may hold the only reference to
+    // an older cell (the execution thread does not execute a write barrier when initializing a new cell)
+    //
+    ForEachCellInRange(m_userHeapMappedLimit, m_userHeapLowestCell, [&](int64_t cellOffset, uint64_t /*size*/) ALWAYS_INLINE {
+        uint8_t* cell = RawCell(cellOffset);
+        if (!IsFreeCell(cell))
+        {
+            VisitCell(cell);
+        }
+    });
+
+    DrainMarkStack();
+    CloseOpenUpvaluesOfDeadCoroutines();
+    SweepWeakReferences();
+    UnregisterDeadCoroutines();
+
+    for (void* ptr : m_arraysToDeleteAfterMarking)
+    {
+        ::operator delete[](ptr);
+    }
+    m_arraysToDeleteAfterMarking.clear();
+    for (auto& [stackBegin, numStackSlots] : m_stacksToFreeAfterMarking)
+    {
+        CoroutineRuntimeContext::FreeStack(stackBegin, numStackSlots);
+    }
+    m_stacksToFreeAfterMarking.clear();
+
+    m_isMarkingConcurrently = false;
+    m_vm->m_writeBarrierThreshold = x_writeBarrierThresholdNormal;
+
+    assert(m_markStack.empty() && m_rememberedSet.empty());
+    m_isCollecting = false;
+    SetConcurrentPhase(ConcurrentPhase::Sweeping);
+}
+
+void UserHeapGarbageCollector::FinishConcurrentCycle()
+{
+    for (FreeChunk& chunk : m_freeChunksRetiredDuringCycle)
+    {
+        AddToFreeList(chunk.m_offset, chunk.m_size);
+    }
+    m_freeChunksRetiredDuringCycle.clear();
+
+    UpdateStatisticsAfterCollection(m_concurrentCollectionKind, m_liveBytesFromLastSweep, m_bytesAllocatedSinceLastCollection - m_bytesAllocatedAtCycleStart);
+    SetConcurrentPhase(ConcurrentPhase::Idle);
+    InstallSizeClassFreeLists();
+}
+
+void UserHeapGarbageCollector::GCThreadMain()
+{
+    t_threadKind = GCThread;
+    m_vm->SetUpSegmentationRegister();
+
+    std::unique_lock<std::mutex> lock(m_gcThreadLock);
+    while (true)
+    {
+        m_gcThreadCondVar.wait(lock, [&]() {
+            ConcurrentPhase phase = m_concurrentPhase.load(std::memory_order_relaxed);
+            return m_gcThreadShouldExit || phase == ConcurrentPhase::Resetting || phase == ConcurrentPhase::Marking || phase == ConcurrentPhase::Sweeping;
+        });
+        if (m_gcThreadShouldExit)
+        {
+            break;
+        }
+
+        switch (m_concurrentPhase.load(std::memory_order_relaxed))
+        {
+        case ConcurrentPhase::Resetting:
+        {
+            lock.unlock();
+            ResetAllCellsToWhite();
+            lock.lock();
+            m_concurrentPhase.store(ConcurrentPhase::WaitingForRoots, std::memory_order_release);
+            break;
+        }
+        case ConcurrentPhase::Marking:
+        {
+            while (!m_gcThreadShouldExit)
+            {
+                std::vector<int64_t> greyCells;
+                greyCells.swap(m_greyCellsFromExecutionThread);
+                if (greyCells.empty() && m_markStack.empty())
+                {
+                    m_concurrentPhase.store(ConcurrentPhase::WaitingForFinalPause, std::memory_order_release);
+                    break;
+                }
+                lock.unlock();
+                for (int64_t cellOffset : greyCells)
+                {
+                    // The cell may have been reset to White if it was remembered while the GC thread was resetting
+                    //
+                    uint8_t* cell = RawCell(cellOffset);
+                    if (GetCellState(cell) == GcCellState::Remembered)
+                    {
+                        SetCellState(cell, GcCellState::Black);
+                        m_markStack.push_back(cellOffset);
+                    }
+                }
+                GCThreadDrainMarkStack();
+                lock.lock();
+            }
+            break;
+        }
+        case ConcurrentPhase::Sweeping:
+        {
+            lock.unlock();
+            Sweep();
+            lock.lock();
+            m_concurrentPhase.store(ConcurrentPhase::SweepDone, std::memory_order_release);
+            break;
+        }
+        default:
+        {
+            ReleaseAssert(false);
+        }
+        }   /*switch*/
+        m_gcThreadCondVar.notify_all();
+    }
+}
+
+void UserHeapGarbageCollector::GCThreadDrainMarkStack()
+{
+    assert(IsGCThread());
+    int64_t batch[x_concurrentMarkingBatchSize];
+    while (!m_markStack.empty())
+    {
+        size_t batchSize = 0;
+        while (batchSize < x_concurrentMarkingBatchSize && !m_markStack.empty())
+        {
+            batch[batchSize] = m_markStack.back();
+            m_markStack.pop_back();
+            batchSize++;
+        }
+
+        // Every cell in the batch was made Black before it was pushed. This pairs with the fence in the write barrier slow path.
+        //
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        for (size_t i = 0; i < batchSize; i++)
+        {
+            VisitCell(RawCell(batch[i]));
+        }
+    }
+}
+
+void UserHeapGarbageCollector::MarkCellKnownValid(int64_t cellOffset)
+{
+    assert(TestCellStartBit(cellOffset));
+    uint8_t* cell = RawCell(cellOffset);
+    if (IsFreeCell(cell) || GetCellState(cell) != GcCellState::White)
+    {
+        return;
+    }
+    SetCellState(cell, GcCellState::Black);
+    m_markStack.push_back(cellOffset);
+}
+
+void UserHeapGarbageCollector::ConservativelyMarkWord(uint64_t word)
+{
+    // A pointer into the user heap is either a HeapPtr (or TValue), which is the negative offset from the VM base,
+    // or a raw pointer
+    //
+    int64_t offset = static_cast<int64_t>(word);
+    if (!(x_userHeapLowest <= offset && offset < x_userHeapTop))
+    {
+        offset = static_cast<int64_t>(word - m_vmBase);
+        if (!(x_userHeapLowest <= offset && offset < x_userHeapTop))
+        {
+            return;
+        }
+    }
+    if (offset < m_userHeapLowestCell)
+    {
+        return;
+    }
+
+    // Interior pointers keep the whole cell alive
+    //
+    int64_t cellOffset = FindCellContaining(offset & ~static_cast<int64_t>(7));
+    if (cellOffset != 0)
+    {
+        MarkCellKnownValid(cellOffset);
+    }
+}
+
+void UserHeapGarbageCollector::ConservativelyScanRange(const void* begin, const void* end)
+{
+    assert(reinterpret_cast<uintptr_t>(begin) % 8 == 0 && reinterpret_cast<uintptr_t>(end) % 8 == 0);
+    const uint64_t* cur = reinterpret_cast<const uint64_t*>(begin);
+    const uint64_t* endPtr = reinterpret_cast<const uint64_t*>(end);
+    while (cur < endPtr)
+    {
+        ConservativelyMarkWord(*cur);
+        cur++;
+    }
+}
+
+void UserHeapGarbageCollector::ConservativelyScanRangeUnaligned(const void* begin, const void* end)
+{
+    const uint8_t* cur = reinterpret_cast<const uint8_t*>(begin);
+    const uint8_t* endPtr = reinterpret_cast<const uint8_t*>(end);
+    while (cur + sizeof(uint64_t) <= endPtr)
+    {
+        ConservativelyMarkWord(UnalignedLoad<uint64_t>(cur));
+        cur++;
+    }
+}
+
+void UserHeapGarbageCollector::ScanNativeStack()
+{
+    // Force all callee-saved registers to be spilled onto the stack, so that the pointers that only live in
+    // registers of our callers are also scanned
+    //
+    __builtin_unwind_init();
+
+    uintptr_t low = GetApproximateNativeStackPointer() & ~static_cast<uintptr_t>(7);
+    uintptr_t high = GetNativeStackHighAddress() & ~static_cast<uintptr_t>(7);
+    assert(low < high);
+    ConservativelyScanRange(reinterpret_cast<void*>(low), reinterpret_cast<void*>(high));
+}
+
+void UserHeapGarbageCollector::MarkRoots(CollectionKind kind)
+{
+    MarkVMRoots();
+    ScanNativeStack();
+    // In an Eden collection, the stacks of all old coroutines must be rescanned, since stack writes have no write barrier
+    //
+    MarkCoroutineRoots(kind == CollectionKind::Eden /*rescanOldCoroutines*/);
+    if (kind == CollectionKind::Eden)
+    {
+        ProcessRememberedSet();
+    }
+    MarkSystemObjectRoots();
+}
+
+void UserHeapGarbageCollector::MarkVMRoots()
+{
+    VM* vm = m_vm;
+
+    // The objects directly referenced by the VM
+    //
+    MarkHeapPointer(vm->m_specialKeyForMetatableSlot.m_value);
+    for (UserHeapPointer<HeapString> key : vm->m_specialKeyForBooleanIndex)
+    {
+        MarkHeapPointer(key.m_value);
+    }
+    ConservativelyMarkWord(reinterpret_cast<uint64_t>(vm->m_rootCoroutine));
+    for (UserHeapPointer<HeapString> name : vm->m_stringNameForMetatableKind)
+    {
+        MarkHeapPointer(name.m_value);
+    }
+    for (TValue fn : vm->m_vmLibFunctionObjects)
+    {
+        MarkTValue(fn);
+    }
+    MarkHeapPointer(vm->m_metatableForNil.m_value);
+    MarkHeapPointer(vm->m_metatableForBoolean.m_value);
+    MarkHeapPointer(vm->m_metatableForNumber.m_value);
+    MarkHeapPointer(vm->m_metatableForString.m_value);
+    MarkHeapPointer(vm->m_metatableForFunction.m_value);
+    MarkHeapPointer(vm->m_metatableForCoroutine.m_value);
+    MarkHeapPointer(vm->m_metatableForFile.m_value);
+    MarkHeapPointer(vm->m_ioDefaultInput.m_value);
+    MarkHeapPointer(vm->m_ioDefaultOutput.m_value);
+    MarkHeapPointer(reinterpret_cast<int64_t>(vm->m_emptyString));
+    MarkHeapPointer(vm->m_toStringString.m_value);
+    MarkHeapPointer(vm->m_stringNameForToStringMetamethod.m_value);
+
+    for (TValue value : m_permanentRoots)
+    {
+        MarkTValue(value);
+    }
+}
+
+void UserHeapGarbageCollector::MarkCoroutineRoots(bool rescanOldCoroutines)
+{
+    // The coroutines that are running or waiting for a coroutine they resumed are always alive
+    //
+    for (CoroutineRuntimeContext* coro : m_coroutines)
+    {
+        uint8_t* cell = reinterpret_cast<uint8_t*>(coro);
+        int64_t cellOffset = static_cast<int64_t>(reinterpret_cast<uintptr_t>(cell) - m_vmBase);
+        if (cellOffset < m_userHeapLowestCell)
+        {
+            // Allocated during the current concurrent cycle, will be visited together with the other new cells
+            //
+            continue;
+        }
+        if (GetCellState(cell) != GcCellState::White)
+        {
+            if (rescanOldCoroutines)
+            {
+                VisitCoroutine(coro);
+            }
+        }
+        else if (!coro->m_coroutineStatus.IsDead() && !coro->m_coroutineStatus.IsResumable())
+        {
+            MarkCellKnownValid(cellOffset);
+        }
+    }
+}
+
+void UserHeapGarbageCollector::ProcessRememberedSet()
+{
+    for (int64_t cellOffset : m_rememberedSet)
+    {
+        // In a Full concurrent cycle, a remembered cell may have been reset to White by the GC thread.
+        // It will be visited if it turns out to be reachable.
+        //
+        uint8_t* cell = RawCell(cellOffset);
+        if (GetCellState(cell) == GcCellState::Remembered)
+        {
+            SetCellState(cell, GcCellState::Black);
+            m_markStack.push_back(cellOffset);
+        }
+    }
+    m_rememberedSet.clear();
+}
+
+void UserHeapGarbageCollector::MarkSystemObjectRoots()
+{
+    for (SystemHeapPointer<void> obj : m_systemHeapObjects)
+    {
+        VisitSystemHeapObject(obj);
+    }
+    for (UnlinkedCodeBlock* ucb : m_unlinkedCodeBlocks)
+    {
+        VisitUnlinkedCodeBlock(ucb);
+    }
+    for (CodeBlock* cb : m_codeBlocks)
+    {
+        VisitCodeBlock(cb);
+    }
+    for (JitCallInlineCacheEntry* entry : m_directCallJitIcEntries)
+    {
+        MarkGeneralHeapPointer(entry->m_entity);
+    }
+}
+
+void UserHeapGarbageCollector::DrainMarkStack()
+{
+    while (!m_markStack.empty())
+    {
+        int64_t cellOffset = m_markStack.back();
+        m_markStack.pop_back();
+        VisitCell(RawCell(cellOffset));
+    }
+}
+
+void UserHeapGarbageCollector::VisitCell(uint8_t* cell)
+{
+    switch (GetCellType(cell))
+    {
+    case HeapEntityType::Function:
+    {
+        FunctionObject* func = reinterpret_cast<FunctionObject*>(cell);
+        for (uint32_t i = 0; i < func->m_numUpvalues; i++)
+        {
+            MarkTValue(func->m_upvalues[i]);
+        }
+        break;
+    }
+    case HeapEntityType::Thread:
+    {
+        VisitCoroutine(reinterpret_cast<CoroutineRuntimeContext*>(cell));
+        break;
+    }
+    case HeapEntityType::Table:
+    {
+        VisitTableObject(reinterpret_cast<TableObject*>(cell));
+        break;
+    }
+    case HeapEntityType::ArraySparseMap:
+    {
+        VisitArraySparseMap(reinterpret_cast<ArraySparseMap*>(cell));
+        break;
+    }
+    case HeapEntityType::Upvalue:
+    {
+        Upvalue* uv = reinterpret_cast<Upvalue*>(cell);
+        if (uv->m_isClosed)
+        {
+            MarkTValue(uv->m_tv);
+        }
+        // For an open upvalue, the value lives in the stack of its coroutine, which is scanned as part of the coroutine
+        //
+        MarkHeapPointer(uv->m_prev.m_value);
+        break;
+    }
+    case HeapEntityType::Userdata:
+    {
+        MarkHeapPointer(reinterpret_cast<HeapCDataObject*>(cell)->m_metatable.m_value);
+        break;
+    }
+    default:
+    {
+        // Strings have no outgoing references
+        //
+        break;
+    }
+    }   /*switch*/
+}
+
+void UserHeapGarbageCollector::VisitTableObject(TableObject* obj)
+{
+    uint32_t inlineCapacity, butterflyNamedCapacity;
+    if (!GetTableObjectNamedStorageCapacity(m_vm, obj, inlineCapacity /*out*/, butterflyNamedCapacity /*out*/))
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < inlineCapacity; i++)
+    {
+        MarkTValue(obj->m_inlineStorage[i]);
+    }
+
+    // The array part of an Int32 or Double array holds no references (see ArrayType::ArrayPartHasNoReference).
+    // Like the hidden class, the array type must be read before the butterfly: the execution thread always stores the value
+    // before switching the array type to Any and executing the write barrier, so a stale array type is caught by the write barrier.
+    //
+    bool arrayPartHasNoReference = obj->m_arrayType.ArrayPartHasNoReference();
+
+    // When the GC thread is visiting the table concurrently, the hidden class must be read before the butterfly:
+    // the execution thread always installs a larger butterfly before switching to a hidden class with a larger capacity,
+    // so the capacity we use never exceeds that of the butterfly we read. Any update we miss is caught by the write barrier.
+    //
+    std::atomic_thread_fence(std::memory_order_acquire);
+    Butterfly* butterfly = obj->m_butterfly;
+    if (butterfly == nullptr)
+    {
+        return;
+    }
+
+    ButterflyHeader* hdr = butterfly->GetHeader();
+    TValue* namedStorageBegin = reinterpret_cast<TValue*>(GetButterflyAllocationStart(butterfly, butterflyNamedCapacity));
+    TValue* namedStorageEnd = reinterpret_cast<TValue*>(hdr);
+    for (TValue* cur = namedStorageBegin; cur < namedStorageEnd; cur++)
+    {
+        MarkTValue(*cur);
+    }
+
+    if (!arrayPartHasNoReference)
+    {
+        TValue* arrayStorageBegin = reinterpret_cast<TValue*>(butterfly) + ArrayGrowthPolicy::x_arrayBaseOrd;
+        TValue* arrayStorageEnd = arrayStorageBegin + hdr->m_arrayStorageCapacity;
+        for (TValue* cur = arrayStorageBegin; cur < arrayStorageEnd; cur++)
+        {
+            MarkTValue(*cur);
+        }
+    }
+
+    if (hdr->HasSparseMap())
+    {
+        ArraySparseMap* sparseMap = TranslateToRawPointer(m_vm, hdr->GetSparseMap());
+        // The sparse map is owned by this table, so it's always visited together with the table
+        // (this also makes it unnecessary for writes into the sparse map to execute a write barrier on the sparse map)
+        //
+        uint8_t* sparseMapCell = reinterpret_cast<uint8_t*>(sparseMap);
+        int64_t sparseMapOffset = static_cast<int64_t>(reinterpret_cast<uintptr_t>(sparseMapCell) - m_vmBase);
+        if (sparseMapOffset >= m_userHeapLowestCell && GetCellState(sparseMapCell) == GcCellState::White)
+        {
+            SetCellState(sparseMapCell, GcCellState::Black);
+        }
+        VisitArraySparseMap(sparseMap);
+    }
+}
+
+void UserHeapGarbageCollector::VisitArraySparseMap(ArraySparseMap* map)
+{
+    // The mask must be read before the storage (see ArraySparseMap::Rebuild)
+    //
+    uint32_t hashMask = map->m_hashMask;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t* storage = map->m_storage;
+    if (storage == nullptr)
+    {
+        return;
+    }
+    // The values are stored before the keys, and an empty slot always has nil value, so no need to look at the keys
+    //
+    TValue* values = reinterpret_cast<TValue*>(storage);
+    for (uint32_t i = 0; i <= hashMask; i++)
+    {
+        MarkTValue(values[i]);
+    }
+}
+
+void UserHeapGarbageCollector::FreeStackMaybeInUseByMarker(TValue* stackBegin, uint32_t numStackSlots)
+{
+    assert(IsExecutionThread());
+    if (unlikely(m_isMarkingConcurrently))
+    {
+        m_stacksToFreeAfterMarking.push_back(std::make_pair(stackBegin, numStackSlots));
+    }
+    else
+    {
+        CoroutineRuntimeContext::FreeStack(stackBegin, numStackSlots);
+    }
+}
+
+void UserHeapGarbageCollector::VisitCoroutine(CoroutineRuntimeContext* coro)
+{
+    MarkHeapPointer(coro->m_upvalueList.m_value);
+    MarkHeapPointer(coro->m_globalObject.m_value);
+    if (coro->m_parent != nullptr)
+    {
+        ConservativelyMarkWord(reinterpret_cast<uint64_t>(coro->m_parent));
+    }
+    // The stack contains not only TValues, but also stack frame headers, so scan it conservatively
+    //
+    // The slot count must be read before the stack pointer (see CoroutineRuntimeContext::GrowStack)
+    //
+    uint32_t numStackSlots = coro->m_numStackSlots;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    TValue* stackBegin = coro->m_stackBegin;
+    if (stackBegin != nullptr)
+    {
+        ConservativelyScanRange(stackBegin, stackBegin + numStackSlots);
+    }
+}
+
+void UserHeapGarbageCollector::VisitSystemHeapObject(SystemHeapPointer<void> obj)
+{
+    HeapEntityType ty = TranslateToRawPointer(m_vm, obj.As<SystemHeapGcObjectHeader>())->m_type;
+    if (ty == HeapEntityType::Structure)
+    {
+        Structure* structure = TranslateToRawPointer(m_vm, obj.As<Structure>());
+        StructureIterator iter(structure);
+        while (iter.HasMore())
+        {
+            MarkGeneralHeapPointer(iter.GetCurrentKey());
+            iter.Advance();
+        }
+        if (structure->m_metatable < 0)
+        {
+            MarkGeneralHeapPointer(GeneralHeapPointer<void> { structure->m_metatable });
+        }
+    }
+    else
+    {
+        assert(ty == HeapEntityType::CacheableDictionary || ty == HeapEntityType::UncacheableDictionary);
+        CacheableDictionary* dict = TranslateToRawPointer(m_vm, obj.As<CacheableDictionary>());
+        // The hash table is stolen when the dictionary is relocated or transitions to UncacheableDictionary
+        //
+        if (dict->m_hashTable != nullptr)
+        {
+            for (uint32_t i = 0; i <= dict->m_hashTableMask; i++)
+            {
+                MarkGeneralHeapPointer(dict->m_hashTable[i].m_key);
+            }
+        }
+        MarkHeapPointer(dict->m_metatable.m_value);
+    }
+}
+
+void UserHeapGarbageCollector::VisitUnlinkedCodeBlock(UnlinkedCodeBlock* ucb)
+{
+    MarkHeapPointer(ucb->m_defaultGlobalObject.m_value);
+    if (ucb->m_cstTable != nullptr)
+    {
+        ConservativelyScanRange(ucb->m_cstTable, ucb->m_cstTable + ucb->m_cstTableLength);
+    }
+}
+
+void UserHeapGarbageCollector::VisitCodeBlock(CodeBlock* cb)
+{
+    MarkHeapPointer(cb->m_globalObject.m_value);
+
+    // The constant table sits right before the CodeBlock
+    //
+    uint64_t* cstTableEnd = reinterpret_cast<uint64_t*>(cb);
+    ConservativelyScanRange(cstTableEnd - cb->m_owner->m_cstTableLength, cstTableEnd);
+
+    // The bytecode metadata contains inline caches that may hold heap pointers.
+    // Some metadata structs are not 8-byte aligned, so the scan must be done at every byte offset.
+    //
+    uint8_t* begin = cb->m_bytecode;
+    uint8_t* end = begin + RoundUpToMultipleOf<8>(cb->m_bytecodeLength) + cb->m_bytecodeMetadataLength;
+    ConservativelyScanRangeUnaligned(begin, end);
+}
+
+bool WARN_UNUSED UserHeapGarbageCollector::IsDeadCoroutine(CoroutineRuntimeContext* coro)
+{
+    uint8_t* cell = reinterpret_cast<uint8_t*>(coro);
+    return IsCellDead(cell);
+}
+
+void UserHeapGarbageCollector::CloseOpenUpvaluesOfDeadCoroutines()
+{
+    // The values of live open upvalues of a dead coroutine are still reachable, and marking them may in turn
+    // resurrect some coroutine, so iterate until a fixpoint is reached before closing anything
+    //
+    while (true)
+    {
+        for (CoroutineRuntimeContext* coro : m_coroutines)
+        {
+            if (!IsDeadCoroutine(coro))
+            {
+                continue;
+            }
+            UserHeapPointer<Upvalue> cur = coro->m_upvalueList;
+            while (cur.m_value != 0)
+            {
+                Upvalue* uv = TranslateToRawPointer(m_vm, cur.As());
+                assert(!uv->m_isClosed);
+                if (!IsCellDead(reinterpret_cast<uint8_t*>(uv)))
+                {
+                    MarkTValue(*uv->m_ptr);
+                }
+                cur = uv->m_prev;
+            }
+        }
+        if (m_markStack.empty())
+        {
+            break;
+        }
+        DrainMarkStack();
+    }
+
+    for (CoroutineRuntimeContext* coro : m_coroutines)
+    {
+        if (!IsDeadCoroutine(coro))
+        {
+            continue;
+        }
+        UserHeapPointer<Upvalue> cur = coro->m_upvalueList;
+        while (cur.m_value != 0)
+        {
+            Upvalue* uv = TranslateToRawPointer(m_vm, cur.As());
+            cur = uv->m_prev;
+            if (!IsCellDead(reinterpret_cast<uint8_t*>(uv)))
+            {
+                uv->Close();
+            }
+        }
+        coro->m_upvalueList.m_value = 0;
+    }
+}
+
+void UserHeapGarbageCollector::UnregisterDeadCoroutines()
+{
+    // Dead coroutines are about to be finalized
+    //
+    std::erase_if(m_coroutines, [&](CoroutineRuntimeContext* coro) {
+        return IsDeadCoroutine(coro);
+    });
+}
+
+void UserHeapGarbageCollector::ResetAllCellsToWhite()
+{
+    ForEachCellInRange(m_userHeapLowestCell, x_userHeapTop, [&](int64_t cellOffset, uint64_t /*size*/) ALWAYS_INLINE {
+        uint8_t* cell = RawCell(cellOffset);
+        if (!IsFreeCell(cell))
+        {
+            SetCellState(cell, GcCellState::White);
+        }
+    });
+}
+
+void UserHeapGarbageCollector::SweepWeakReferences()
+{
+    // The global string table does not keep strings alive
+    //
+    VM* vm = m_vm;
+    auto isDeadString = [&](VM::StringHtEntry entry) ALWAYS_INLINE {
+        int64_t cellOffset = static_cast<int64_t>(entry.m_ptr.m_value) << 3;
+        assert(TestCellStartBit(cellOffset));
+        return IsCellDead(RawCell(cellOffset));
+    };
+
+    // If an incremental resize is in progress, finish it now, since we have to look at every entry anyway.
+    // The dead strings that have not been migrated yet are simply dropped.
+    //
+    if (vm->IsStringConserHashTableMigrationInProgress())
+    {
+        VM::StringHtEntry* oldHt = vm->m_oldHashTable;
+        for (uint32_t i = vm->m_hashTableMigrationCursor; i <= vm->m_oldHashTableSizeMask; i++)
+        {
+            if (oldHt[i].IsNonExistent())
+            {
+                continue;
+            }
+            if (isDeadString(oldHt[i]))
+            {
+                assert(vm->m_elementCount > 0);
+                vm->m_elementCount--;
+            }
+            else
+            {
+                VM::InsertIntoStringHtForResize(vm->m_hashTable, vm->m_hashTableSizeMask, oldHt[i]);
+            }
+        }
+        delete [] oldHt;
+        vm->m_oldHashTable = nullptr;
+    }
+
+    VM::StringHtEntry* ht = vm->m_hashTable;
+    uint32_t i = 0;
+    while (i <= vm->m_hashTableSizeMask)
+    {
+        if (!ht[i].IsNonExistent() && isDeadString(ht[i]))
+        {
+            // Deleting shifts the following entries back by one slot, so slot i must be examined again
+            //
+            VM::DeleteFromStringHt(ht, vm->m_hashTableSizeMask, i);
+            assert(vm->m_elementCount > 0);
+            vm->m_elementCount--;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    // Nor the hash state kept for appending to the last long concatenation result
+    //
+    if (vm->m_concatHashResumeString != nullptr)
+    {
+        int64_t cellOffset = static_cast<int64_t>(reinterpret_cast<uintptr_t>(vm->m_concatHashResumeString) - m_vmBase);
+        if (IsCellDead(RawCell(cellOffset)))
+        {
+            vm->m_concatHashResumeString = nullptr;
+        }
+    }
+
+    // Neither does the compiled pattern cache. The low bit of the key is not part of the string address.
+    //
+    std::erase_if(vm->m_compiledLuaPatternCache, [&](const std::pair<const uintptr_t, LuaPattern*>& entry) {
+        int64_t cellOffset = static_cast<int64_t>((entry.first & ~static_cast<uintptr_t>(1)) - m_vmBase);
+        if (IsCellDead(RawCell(cellOffset)))
+        {
+            delete entry.second;
+            return true;
+        }
+        return false;
+    });
+
+    // Nor the megamorphic property cache. The cached structures live in the system heap and are never freed,
+    // but a dead property name must not be matched by a new string allocated at the same address.
+    //
+    vm->GetMegamorphicPropertyCache()->RemoveEntriesWithDeadPropertyName([&](int64_t propertyName) ALWAYS_INLINE {
+        return IsCellDead(RawCell(propertyName));
+    });
+}
+
+void UserHeapGarbageCollector::FinalizeDeadCell(uint8_t* cell)
+{
+    switch (GetCellType(cell))
+    {
+    case HeapEntityType::Table:
+    {
+        TableObject* obj = reinterpret_cast<TableObject*>(cell);
+        uint32_t inlineCapacity, butterflyNamedCapacity;
+        if (obj->m_butterfly != nullptr && GetTableObjectNamedStorageCapacity(m_vm, obj, inlineCapacity /*out*/, butterflyNamedCapacity /*out*/))
+        {
+            delete [] GetButterflyAllocationStart(obj->m_butterfly, butterflyNamedCapacity);
+        }
+        break;
+    }
+    case HeapEntityType::ArraySparseMap:
+    {
+        ArraySparseMap* map = reinterpret_cast<ArraySparseMap*>(cell);
+        delete [] map->m_storage;
+        break;
+    }
+    case HeapEntityType::Thread:
+    {
+        CoroutineRuntimeContext* coro = reinterpret_cast<CoroutineRuntimeContext*>(cell);
+        if (coro->m_stackBegin != nullptr)
+        {
+            CoroutineRuntimeContext::FreeStack(coro->m_stackBegin, coro->m_numStackSlots);
+        }
+        break;
+    }
+    case HeapEntityType::Userdata:
+    {
+        // This may run on the GC thread, which is fine since closing a file does not touch the VM
+        //
+        HeapCDataObject* obj = reinterpret_cast<HeapCDataObject*>(cell);
+        if (obj->m_kind == HeapCDataObject::Kind::LuaFile)
+        {
+            delete reinterpret_cast<LuaFile*>(obj->m_payload);
+        }
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }   /*switch*/
+}
+
+void UserHeapGarbageCollector::Sweep()
+{
+    for (std::vector<FreeChunk>& freeList : m_freeLists)
+    {
+        freeList.clear();
+    }
+    for (size_t i = 0; i < internal::x_numUserHeapSizeClasses; i++)
+    {
+        m_sizeClassFreeLists[i] = 0;
+    }
+
+    size_t liveBytes = 0;
+    int64_t freeRunStart = 0;
+    auto flushFreeRun = [&](int64_t freeRunEnd) ALWAYS_INLINE {
+        if (freeRunStart == 0)
+        {
+            return;
+        }
+        uint64_t size = static_cast<uint64_t>(freeRunEnd - freeRunStart);
+        if (size <= x_maxSizeClassCarvingChunkSize)
+        {
+            AddToSizeClassFreeLists(freeRunStart, size);
+            freeRunStart = 0;
+            return;
+        }
+        FormatFreeChunk(freeRunStart, size);
+        AddToFreeList(freeRunStart, size);
+        if (size >= x_minDecommitChunkSize)
+        {
+            // Return the pages to the OS. The pages will read as zero if they are reused later.
+            //
+            uintptr_t decommitBegin = RoundUpToMultipleOf<VM::x_pageSize>(reinterpret_cast<uintptr_t>(RawCell(freeRunStart)) + sizeof(UserHeapGcObjectHeader));
+            uintptr_t decommitEnd = reinterpret_cast<uintptr_t>(RawCell(freeRunEnd)) / VM::x_pageSize * VM::x_pageSize;
+            if (decommitBegin < decommitEnd)
+            {
+                int r = madvise(reinterpret_cast<void*>(decommitBegin), decommitEnd - decommitBegin, MADV_DONTNEED);
+                LOG_WARNING_WITH_ERRNO_IF(r != 0, "Failed to decommit free user heap pages");
+            }
+        }
+        freeRunStart = 0;
+    };
+
+    // When sweeping concurrently, the execution thread may turn live cells Remembered, but it never touches dead cells
+    //
+    ForEachCellInRange(m_userHeapLowestCell, x_userHeapTop, [&](int64_t cellOffset, uint64_t size) ALWAYS_INLINE {
+        uint8_t* cell = RawCell(cellOffset);
+        bool isFree = IsFreeCell(cell);
+        if (!isFree && GetCellState(cell) != GcCellState::White)
+        {
+            flushFreeRun(cellOffset);
+            liveBytes += size;
+            return;
+        }
+        if (!isFree)
+        {
+            FinalizeDeadCell(cell);
+        }
+        // Coalesce with the preceding dead cells
+        //
+        if (freeRunStart == 0)
+        {
+            freeRunStart = cellOffset;
+        }
+        else
+        {
+            ClearCellStartBit(cellOffset);
+        }
+    });
+    flushFreeRun(x_userHeapTop);
+
+    m_liveBytesFromLastSweep = liveBytes;
+}
@@ -0,0 +1,542 @@
+#pragma once
+
+#include "common_utils.h"
+#include "memory_ptr.h"
+#include "vm.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class TableObject;
+class ArraySparseMap;
+class CoroutineRuntimeContext;
+class UnlinkedCodeBlock;
+class CodeBlock;
+class JitCallInlineCacheEntry;
+
+// The garbage collector for the user heap.
+//
+// This is a non-moving mark-sweep collector with a sticky-mark-bit young generation (similar to JSC's Eden collection):
+//
+// 1. Every user heap cell carries a GcCellState byte. A newly allocated cell is White (young).
+//    A cell that survived a collection is Black (old).
+//
+// 2. An Eden collection only marks White cells, and treats every Black cell as live. Therefore it must know every
+//    old cell that may point to a young cell. This is what the write barrier is for: writing into a Black cell takes
+//    the barrier slow path, which turns the cell Remembered (so future writes take the fast path) and records it in
+//    the remembered set. An Eden collection scans the remembered set in addition to the roots.
+//
+// 3. A Full collection first resets every live cell to White, then marks everything reachable from the roots.
+//
+// The sweeper frees every cell that is still White after marking, coalesces adjacent dead cells into free chunks,
+// and returns the pages of large free chunks to the OS. Small free chunks are split into cells of the allocator's
+// size classes and put on per-size-class free lists, from which VM::AllocFromUserHeap reuses them without searching.
+//
+// Since cells never move, and since the interpreter and the C++ runtime freely keep heap pointers in native stack
+// frames and CPU registers, the native stack and all coroutine stacks are scanned conservatively. To make conservative
+// scanning (and heap walking in general) possible, the VM maintains a bitmap with one bit per 8-byte granule of the
+// user heap that records where each cell starts. The size of a cell is the distance to the next cell start.
+//
+// The system heap is not collected. All Structures, CacheableDictionaries, UnlinkedCodeBlocks and CodeBlocks are
+// registered with the collector and are treated as roots (they are also where most cached pointers into the user heap
+// live, e.g., property keys and inline cache entries).
+//
+// Collections triggered by allocation are normally concurrent: marking runs on a dedicated GC thread while the
+// execution thread keeps running. A concurrent cycle goes through the following phases:
+//
+// 1. Resetting (Full collection only): the GC thread resets every old cell to White.
+// 2. WaitingForRoots / Marking: at its next safepoint, the execution thread marks the roots in a short pause.
+//    The GC thread then traces the heap concurrently. Meanwhile, the write barrier threshold is raised so that
+//    every barrier takes the slow path, which fences and re-greys Black cells written by the execution thread
+//    (they are handed to the GC thread at safepoints).
+// 3. WaitingForFinalPause: when the GC thread runs out of work, the execution thread rescans everything that is
+//    mutated without a write barrier (stacks, VM roots, system heap objects) and traces the cells allocated since
+//    the cycle started, then finishes marking and processes weak references. This pause is proportional to the
+//    stack sizes and to the amount of allocation during the cycle, not to the heap size.
+// 4. Sweeping / SweepDone: the GC thread sweeps, and the execution thread adopts the free lists at a safepoint.
+//
+// During a concurrent cycle the execution thread never reuses free chunks or free cells: it only allocates below the
+// lowest cell that existed when the cycle started. Such cells are never swept by the cycle, and the GC thread never
+// looks at the part of the heap (and of the cell start bitmap) the execution thread is allocating into.
+//
+// The only safepoint of the execution thread is the allocation slow path. Allocation during a cycle is throttled:
+// if the execution thread allocates too much before the cycle finishes, it waits for the cycle to complete.
+//
+// Only the execution thread may allocate from the user heap or start a collection.
+//
+class UserHeapGarbageCollector
+{
+    MAKE_NONCOPYABLE(UserHeapGarbageCollector);
+    MAKE_NONMOVABLE(UserHeapGarbageCollector);
+
+public:
+    enum class CollectionKind : uint8_t
+    {
+        Eden,
+        Full
+    };
+
+    UserHeapGarbageCollector(VM* vm);
+    ~UserHeapGarbageCollector();
+
+    // The number of bytes granted to the allocator since the last collection after which a collection is triggered,
+    // unless the heap is larger (in which case the budget scales with the live heap size).
+    //
+    static constexpr size_t x_minEdenBudgetBytes = 64ULL << 20;
+
+    // A Full collection is performed if the heap has grown beyond this many bytes and
+    // beyond x_fullCollectionGrowthFactor times the live size after the last Full collection.
+    //
+    static constexpr size_t x_minFullCollectionThresholdBytes = 128ULL << 20;
+    static constexpr size_t x_fullCollectionGrowthFactor = 2;
+
+    // The allocator takes memory from a free chunk in pieces of at most this size, so that
+    // the cost of zero-filling the memory is proportional to what is actually used
+    //
+    static constexpr size_t x_allocationRegionSize = 65536;
+
+    // Free chunks smaller than this are not put on the free list (they are reclaimed by coalescing on the next sweep)
+    //
+    static constexpr size_t x_minFreeListChunkSize = 64;
+
+    // Free chunks at least this large have their interior pages returned to the OS
+    //
+    static constexpr size_t x_minDecommitChunkSize = 262144;
+
+    // Free chunks are bucketed by floor(log2(size))
+    //
+    static constexpr size_t x_numFreeListBuckets = 40;
+
+    // Free chunks of at most this size are carved into cells of the size classes and put on the size class free lists
+    //
+    static constexpr size_t x_maxSizeClassCarvingChunkSize = internal::x_userHeapMaxSizeClassSlots * 8;
+
+    // Called by VM::AllocFromUserHeap when the current allocation region is exhausted.
+    // Upon return, the current allocation region [m_userHeapPtrLimit, m_userHeapCurPtr) has at least 'length' bytes,
+    // and 'length' has been subtracted from m_userHeapCurPtr.
+    //
+    void AllocationSlowPath(uint32_t length);
+
+    // Perform a stop-the-world collection immediately. Must not be called while collection is deferred.
+    // If a concurrent cycle is in progress, it is completed first.
+    //
+    void Collect(CollectionKind kind);
+
+    // Wait for the concurrent cycle in progress (if any) to complete
+    //
+    void CompleteConcurrentCycle();
+
+    // If disabled, collections triggered by allocation are stop-the-world
+    //
+    void SetConcurrentMarkingEnabled(bool value) { m_isConcurrentMarkingEnabled = value; }
+    bool IsConcurrentMarkingEnabled() { return m_isConcurrentMarkingEnabled; }
+
+    bool IsConcurrentCycleInProgress() { return m_concurrentPhase.load(std::memory_order_acquire) != ConcurrentPhase::Idle; }
+
+    // Automatic collection can be disabled by the user (collectgarbage("stop"))
+    //
+    void SetAutomaticCollectionEnabled(bool value) { m_isAutomaticCollectionEnabled = value; }
+    bool IsAutomaticCollectionEnabled() { return m_isAutomaticCollectionEnabled; }
+
+    bool IsCollectionDeferred() { return m_deferralDepth > 0; }
+    bool IsCollecting() { return m_isCollecting; }
+
+    // The number of bytes of the user heap currently in use (live cells after the last collection,
+    // plus everything handed out to the allocator since then)
+    //
+    size_t GetHeapSizeBytes() { return m_liveBytesAfterLastCollection + m_bytesAllocatedSinceLastCollection; }
+
+    size_t GetNumEdenCollections() { return m_numEdenCollections; }
+    size_t GetNumFullCollections() { return m_numFullCollections; }
+
+    // The values set by collectgarbage("setpause") and collectgarbage("setstepmul").
+    // They are only recorded for compatibility: our collector is not incremental and has its own heuristics.
+    //
+    double GetLuaPause() { return m_luaPause; }
+    void SetLuaPause(double value) { m_luaPause = value; }
+    double GetLuaStepMultiplier() { return m_luaStepMultiplier; }
+    void SetLuaStepMultiplier(double value) { m_luaStepMultiplier = value; }
+
+    // Called by the write barrier slow path when a Black user heap cell is written to
+    //
+    void RememberCell(int64_t cellOffset)
+    {
+        assert(IsExecutionThread() && !m_isCollecting);
+        m_rememberedSet.push_back(cellOffset);
+    }
+
+    // Free an array (a butterfly or a hash table owned by a user heap cell) that the GC thread may be reading.
+    // During concurrent marking, the memory is only freed after marking completes.
+    //
+    template<typename T>
+    void DeleteArrayMaybeInUseByMarker(T* ptr)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "the deferred free does not run destructors");
+        assert(IsExecutionThread());
+        if (unlikely(m_isMarkingConcurrently))
+        {
+            m_arraysToDeleteAfterMarking.push_back(ptr);
+        }
+        else
+        {
+            delete [] ptr;
+        }
+    }
+
+    // Same as above, but for a coroutine stack (see CoroutineRuntimeContext::GrowStack)
+    //
+    void FreeStackMaybeInUseByMarker(TValue* stackBegin, uint32_t numStackSlots);
+
+    // Registration of system heap objects and other C++-side objects that hold references into the user heap
+    //
+    void RegisterSystemHeapObject(SystemHeapPointer<void> obj) { m_systemHeapObjects.push_back(obj); }
+    void RegisterUnlinkedCodeBlock(UnlinkedCodeBlock* ucb) { m_unlinkedCodeBlocks.push_back(ucb); }
+    void RegisterCodeBlock(CodeBlock* cb) { m_codeBlocks.push_back(cb); }
+    void RegisterCoroutine(CoroutineRuntimeContext* coro) { m_coroutines.push_back(coro); }
+
+    const std::vector<UnlinkedCodeBlock*>& GetUnlinkedCodeBlocks() { return m_unlinkedCodeBlocks; }
+    void RegisterDirectCallJitIcEntry(JitCallInlineCacheEntry* entry) { m_directCallJitIcEntries.insert(entry); }
+    void UnregisterDirectCallJitIcEntry(JitCallInlineCacheEntry* entry) { m_directCallJitIcEntries.erase(entry); }
+
+    // The value is kept alive for the lifetime of the VM
+    //
+    void AddPermanentRoot(TValue value) { m_permanentRoots.push_back(value); }
+
+    // Return true if 'offset' is the start of a (live or dead, but not free) cell in the user heap
+    // Only meaningful during a collection (outside a collection the current allocation region is not formatted)
+    //
+    bool WARN_UNUSED IsCellStart(int64_t offset);
+
+private:
+    friend class DeferGC;
+    friend void WriteBarrierSlowPath(void* obj, uint8_t* cellState);
+
+    struct FreeChunk
+    {
+        int64_t m_offset;
+        uint64_t m_size;
+    };
+
+    enum class ConcurrentPhase : uint8_t
+    {
+        Idle,
+        Resetting,
+        WaitingForRoots,
+        Marking,
+        WaitingForFinalPause,
+        Sweeping,
+        SweepDone
+    };
+
+    static constexpr uint8_t x_writeBarrierThresholdNormal = static_cast<uint8_t>(GcCellState::Black);
+    static constexpr uint8_t x_writeBarrierThresholdDuringMarking = static_cast<uint8_t>(GcCellState::White);
+
+    // The GC thread publishes marking work to the execution thread in batches, with one fence for each batch
+    //
+    static constexpr size_t x_concurrentMarkingBatchSize = 64;
+
+    static HeapEntityType ALWAYS_INLINE GetCellType(uint8_t* cell)
+    {
+        return reinterpret_cast<UserHeapGcObjectHeader*>(cell)->m_type;
+    }
+
+    static GcCellState ALWAYS_INLINE GetCellState(uint8_t* cell)
+    {
+        return reinterpret_cast<UserHeapGcObjectHeader*>(cell)->m_cellState;
+    }
+
+    static void ALWAYS_INLINE SetCellState(uint8_t* cell, GcCellState value)
+    {
+        reinterpret_cast<UserHeapGcObjectHeader*>(cell)->m_cellState = value;
+    }
+
+    // Free chunks are marked by an invalid HeapEntityType in the cell header
+    //
+    static bool ALWAYS_INLINE IsFreeCell(uint8_t* cell)
+    {
+        return GetCellType(cell) == HeapEntityType::X_END_OF_ENUM;
+    }
+
+    uint8_t* ALWAYS_INLINE RawCell(int64_t offset)
+    {
+        return reinterpret_cast<uint8_t*>(m_vmBase + static_cast<uint64_t>(offset));
+    }
+
+    static bool ALWAYS_INLINE IsInUserHeapRange(int64_t offset)
+    {
+        return x_userHeapLowest <= offset && offset < x_userHeapTop && offset % 8 == 0;
+    }
+
+    bool ALWAYS_INLINE TestCellStartBit(int64_t offset)
+    {
+        uint64_t ord = VM::GetUserHeapGranuleOrdinal(offset);
+        return (m_cellStartBitmap[ord / 64] & (static_cast<uint64_t>(1) << (ord % 64))) != 0;
+    }
+
+    void ALWAYS_INLINE SetCellStartBit(int64_t offset)
+    {
+        uint64_t ord = VM::GetUserHeapGranuleOrdinal(offset);
+        m_cellStartBitmap[ord / 64] |= static_cast<uint64_t>(1) << (ord % 64);
+    }
+
+    void ALWAYS_INLINE ClearCellStartBit(int64_t offset)
+    {
+        uint64_t ord = VM::GetUserHeapGranuleOrdinal(offset);
+        m_cellStartBitmap[ord / 64] &= ~(static_cast<uint64_t>(1) << (ord % 64));
+    }
+
+    // Return the start of the next cell after 'offset' (or 'limit' if none before 'limit')
+    //
+    int64_t WARN_UNUSED FindNextCellStart(int64_t offset, int64_t limit);
+
+    // Return the start of the cell containing 'offset', or 0 if 'offset' is not inside a cell
+    //
+    int64_t WARN_UNUSED FindCellContaining(int64_t offset);
+
+    // Iterate every cell in [begin, end). 'begin' must be a cell start, and 'end' must be a cell start or x_userHeapTop
+    //
+    template<typename Func>
+    void ForEachCellInRange(int64_t begin, int64_t end, const Func& func);
+
+    // Turn the unused part of the current allocation region into a free cell, so the heap is walkable
+    //
+    void RetireCurrentAllocationRegion();
+
+    void FormatFreeChunk(int64_t offset, uint64_t size);
+    void AddToFreeList(int64_t offset, uint64_t size);
+    // Split a small free chunk into free cells of the size classes, and put them on m_sizeClassFreeLists
+    //
+    void AddToSizeClassFreeLists(int64_t offset, uint64_t size);
+    // Hand the size class free lists built by the last sweep to the allocator
+    //
+    void InstallSizeClassFreeLists();
+    bool WARN_UNUSED TryTakeRegionFromFreeList(uint32_t length);
+    void GrowIntoWilderness(uint32_t length);
+
+    CollectionKind WARN_UNUSED DecideCollectionKind();
+    void UpdateStatisticsAfterCollection(CollectionKind kind, size_t liveBytes, size_t bytesAllocatedDuringCollection);
+
+    // Concurrent cycle
+    //
+    void StartConcurrentCycle(CollectionKind kind);
+    // Perform the execution thread's part of the current phase, if any. Return false if the GC thread is working.
+    //
+    bool WARN_UNUSED AdvanceConcurrentCycle();
+    void MarkRootsForConcurrentCycle();
+    void FinishConcurrentMarking();
+    void FinishConcurrentCycle();
+    void SetConcurrentPhase(ConcurrentPhase phase);
+    void WaitUntilConcurrentPhaseChanges(ConcurrentPhase phase);
+    void GCThreadMain();
+    void GCThreadDrainMarkStack();
+
+    // Marking
+    //
+    void MarkCellKnownValid(int64_t cellOffset);
+    void MarkHeapPointer(int64_t offset)
+    {
+        if (likely(IsInUserHeapRange(offset) && offset >= m_userHeapLowestCell && TestCellStartBit(offset)))
+        {
+            MarkCellKnownValid(offset);
+        }
+    }
+    void MarkTValue(TValue tv)
+    {
+        if (tv.IsPointer())
+        {
+            MarkHeapPointer(static_cast<int64_t>(tv.m_value));
+        }
+    }
+    void MarkGeneralHeapPointer(GeneralHeapPointer<void> p)
+    {
+        if (p.m_value < 0)
+        {
+            MarkHeapPointer(static_cast<int64_t>(p.m_value) << 3);
+        }
+    }
+    void ConservativelyMarkWord(uint64_t word);
+    void ConservativelyScanRange(const void* begin, const void* end);
+    void ConservativelyScanRangeUnaligned(const void* begin, const void* end);
+    void ScanNativeStack();
+
+    void MarkRoots(CollectionKind kind);
+    void MarkVMRoots();
+    void MarkCoroutineRoots(bool rescanOldCoroutines);
+    void MarkSystemObjectRoots();
+    void ProcessRememberedSet();
+    void DrainMarkStack();
+    void VisitCell(uint8_t* cell);
+    void VisitTableObject(TableObject* obj);
+    void VisitArraySparseMap(ArraySparseMap* map);
+    void VisitCoroutine(CoroutineRuntimeContext* coro);
+    void VisitSystemHeapObject(SystemHeapPointer<void> obj);
+    void VisitUnlinkedCodeBlock(UnlinkedCodeBlock* ucb);
+    void VisitCodeBlock(CodeBlock* cb);
+
+    // After marking, a cell is dead if it is White and was not allocated during the current concurrent cycle
+    //
+    bool ALWAYS_INLINE IsCellDead(uint8_t* cell)
+    {
+        int64_t cellOffset = static_cast<int64_t>(reinterpret_cast<uintptr_t>(cell) - m_vmBase);
+        return cellOffset >= m_userHeapLowestCell && GetCellState(cell) == GcCellState::White;
+    }
+    bool WARN_UNUSED IsDeadCoroutine(CoroutineRuntimeContext* coro);
+
+    // Open upvalues pointing into the stack of a dead coroutine must be closed before the stack is unmapped
+    //
+    void CloseOpenUpvaluesOfDeadCoroutines();
+    void UnregisterDeadCoroutines();
+
+    // Sweeping
+    //
+    void ResetAllCellsToWhite();
+    void SweepWeakReferences();
+    void Sweep();
+    void FinalizeDeadCell(uint8_t* cell);
+
+    static constexpr int64_t x_userHeapLowest = -static_cast<int64_t>(VM::x_vmBaseOffset);
+    static constexpr int64_t x_userHeapTop = -static_cast<int64_t>(VM::x_vmBaseOffset - VM::x_vmUserHeapSize);
+
+    VM* m_vm;
+    uintptr_t m_vmBase;
+    uint64_t* m_cellStartBitmap;
+
+    // The lowest mapped address in the user heap. Everything in [m_userHeapMappedLimit, x_userHeapTop) is mapped.
+    //
+    int64_t m_userHeapMappedLimit;
+
+    // The lowest cell start at the time of the current collection.
+    // Cells below it are allocated during a concurrent cycle: they are not marked, not swept, and not pointed to by free chunks.
+    //
+    int64_t m_userHeapLowestCell;
+
+    std::vector<FreeChunk> m_freeLists[x_numFreeListBuckets];
+
+    // The size class free lists being built by the sweeper, see VM::m_userHeapSizeClassFreeList
+    //
+    int64_t m_sizeClassFreeLists[internal::x_numUserHeapSizeClasses];
+
+    // Free chunks created by the execution thread during a concurrent cycle, added to the free lists when the cycle completes
+    //
+    std::vector<FreeChunk> m_freeChunksRetiredDuringCycle;
+
+    size_t m_bytesAllocatedSinceLastCollection;
+    size_t m_liveBytesAfterLastCollection;
+    size_t m_liveBytesAfterLastFullCollection;
+    size_t m_edenBudgetBytes;
+
+    // The number of bytes in live cells found by the last sweep
+    //
+    size_t m_liveBytesFromLastSweep;
+
+    size_t m_numEdenCollections;
+    size_t m_numFullCollections;
+
+    double m_luaPause;
+    double m_luaStepMultiplier;
+
+    uint32_t m_deferralDepth;
+    bool m_isCollecting;
+    bool m_isAutomaticCollectionEnabled;
+    bool m_isConcurrentMarkingEnabled;
+
+    // True from the root marking pause to the end of the final pause of a concurrent cycle (execution thread only)
+    //
+    bool m_isMarkingConcurrently;
+
+    CollectionKind m_concurrentCollectionKind;
+    size_t m_bytesAllocatedAtCycleStart;
+
+    std::vector<int64_t> m_rememberedSet;
+
+    // Owned by the GC thread during the Marking phase, and by the execution thread otherwise
+    //
+    std::vector<int64_t> m_markStack;
+
+    // Arrays freed by the execution thread during concurrent marking, actually freed in the final pause
+    //
+    std::vector<void*> m_arraysToDeleteAfterMarking;
+    std::vector<std::pair<TValue*, uint32_t /*numStackSlots*/>> m_stacksToFreeAfterMarking;
+
+    // State shared with the GC thread, protected by m_gcThreadLock
+    //
+    std::mutex m_gcThreadLock;
+    std::condition_variable m_gcThreadCondVar;
+    std::atomic<ConcurrentPhase> m_concurrentPhase;
+    std::vector<int64_t> m_greyCellsFromExecutionThread;
+    bool m_gcThreadShouldExit;
+    std::thread m_gcThread;
+
+    std::vector<SystemHeapPointer<void>> m_systemHeapObjects;
+    std::vector<UnlinkedCodeBlock*> m_unlinkedCodeBlocks;
+    std::vector<CodeBlock*> m_codeBlocks;
+    std::vector<CoroutineRuntimeContext*> m_coroutines;
+    std::unordered_set<JitCallInlineCacheEntry*> m_directCallJitIcEntries;
+    std::vector<TValue> m_permanentRoots;
+};
+
+// While a DeferGC object is alive, allocation never triggers a collection.
+// This is required when user heap pointers are only held in places the collector does not know about
+// (for example, the parser's C++ data structures).
+//
+class DeferGC
+{
+    MAKE_NONCOPYABLE(DeferGC);
+    MAKE_NONMOVABLE(DeferGC);
+
+public:
+    DeferGC(VM* vm)
+        : m_gc(vm->GetUserHeapGarbageCollector())
+    {
+        m_gc->m_deferralDepth++;
+    }
+
+    ~DeferGC()
+    {
+        assert(m_gc->m_deferralDepth > 0);
+        m_gc->m_deferralDepth--;
+    }
+
+private:
+    UserHeapGarbageCollector* m_gc;
+};
+
+// Records 'obj' (whose GcCellState is at 'cellState') in the remembered set of the garbage collector
+//
+void WriteBarrierSlowPath(void* obj, uint8_t* cellState);
+
+template<size_t cellStateOffset, typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, uint8_t>>>
+void NO_INLINE WriteBarrierSlowPathEnter(T ptr)
+{
+    uint8_t* raw = TranslateToRawPointer(ptr);
+    WriteBarrierSlowPath(raw, raw + cellStateOffset);
+}
+
+template void NO_INLINE WriteBarrierSlowPathEnter<offsetof_member_v<&UserHeapGcObjectHeader::m_cellState>, uint8_t*, void>(uint8_t* ptr);
+template void NO_INLINE WriteBarrierSlowPathEnter<offsetof_member_v<&UserHeapGcObjectHeader::m_cellState>, HeapPtr<uint8_t>, void>(HeapPtr<uint8_t> ptr);
+template void NO_INLINE WriteBarrierSlowPathEnter<offsetof_member_v<&SystemHeapGcObjectHeader::m_cellState>, uint8_t*, void>(uint8_t* ptr);
+template void NO_INLINE WriteBarrierSlowPathEnter<offsetof_member_v<&SystemHeapGcObjectHeader::m_cellState>, HeapPtr<uint8_t>, void>(HeapPtr<uint8_t> ptr);
+
+template<size_t cellStateOffset, typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, uint8_t>>>
+void ALWAYS_INLINE WriteBarrierImpl(T ptr)
+{
+    uint8_t cellState = ptr[cellStateOffset];
+    if (likely(cellState > VM::GetWriteBarrierThreshold()))
+    {
+        return;
+    }
+    WriteBarrierSlowPathEnter<cellStateOffset>(ptr);
+}
+
+template<typename T>
+void WriteBarrier(T ptr)
+{
+    static_assert(std::is_pointer_v<T>);
+    using RawType = std::remove_pointer_t<remove_heap_ptr_t<T>>;
+    static_assert(std::is_same_v<value_type_of_member_object_pointer_t<decltype(&RawType::m_cellState)>, GcCellState>);
+    constexpr size_t x_offset = offsetof_member_v<&RawType::m_cellState>;
+    static_assert(x_offset == offsetof_member_v<&UserHeapGcObjectHeader::m_cellState> || x_offset == offsetof_member_v<&SystemHeapGcObjectHeader::m_cellState>);
+    WriteBarrierImpl<x_offset>(ReinterpretCastPreservingAddressSpace<uint8_t*>(ptr));
+}
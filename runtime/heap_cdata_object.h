@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common_utils.h"
+#include "memory_ptr.h"
+#include "vm.h"
+
+// A Lua full userdata
+//
+// There is no C API to create userdata, so all userdata are created by the builtin libraries. Each userdata records the kind of
+// its payload, so the GC knows how to release the payload when the userdata is collected (see FinalizeDeadCell).
+// The metatable is set when the userdata is created, and may only be changed by debug.setmetatable (which does the write barrier).
+//
+class alignas(8) HeapCDataObject final : public UserHeapGcObjectHeader
+{
+public:
+    static constexpr uint32_t x_hiddenClassForHeapCDataObject = 0x28;
+
+    enum class Kind : uint8_t
+    {
+        // The payload is a LuaFile (a file handle of the io library)
+        //
+        LuaFile
+    };
+
+    static HeapCDataObject* WARN_UNUSED Create(VM* vm, Kind kind, UserHeapPointer<void> metatable, void* payload)
+    {
+        HeapPtr<HeapCDataObject> hp = vm->AllocFromUserHeap(sizeof(HeapCDataObject)).AsNoAssert<HeapCDataObject>();
+        HeapCDataObject* r = TranslateToRawPointer(vm, hp);
+        UserHeapGcObjectHeader::Populate(r);
+        r->m_hiddenClass = x_hiddenClassForHeapCDataObject;
+        r->m_opaque = 0;
+        // Must not look like a coroutine to CoroutineStatus, which lives in this field
+        //
+        r->m_arrayType = 0;
+        r->m_kind = kind;
+        r->m_metatable = metatable;
+        r->m_payload = payload;
+        return r;
+    }
+
+    Kind m_kind;
+    UserHeapPointer<void> m_metatable;
+    void* m_payload;
+};
+static_assert(sizeof(HeapCDataObject) == 32);
@@ -1,6 +1,7 @@
 #include "runtime_utils.h"
 #include "api_define_lib_function.h"
 #include "lj_parser_wrapper.h"
+#include "lua_file.h"
 #include <numbers>
 
 #define LUA_LIB_BASE_FUNCTION_LIST      \
@@ -71,6 +72,16 @@
   , type                                \
   , write                               \
 
+// The methods of file handles, other than 'close' which is io.close
+//
+#define LUA_LIB_IO_FILE_FUNCTION_LIST   \
+    flush                               \
+  , lines                               \
+  , read                                \
+  , seek                                \
+  , setvbuf                             \
+  , write                               \
+
 #define LUA_LIB_MATH_FUNCTION_LIST      \
     abs                                 \
   , acos                                \
@@ -148,6 +159,7 @@ PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (base), (LUA_LIB_BASE_FUNCTION_LIST))
 PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (coroutine), (LUA_LIB_COROUTINE_FUNCTION_LIST))
 PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (debug), (LUA_LIB_DEBUG_FUNCTION_LIST))
 PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (io), (LUA_LIB_IO_FUNCTION_LIST))
+PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (io_file), (LUA_LIB_IO_FILE_FUNCTION_LIST))
 PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (math), (LUA_LIB_MATH_FUNCTION_LIST))
 PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (os), (LUA_LIB_OS_FUNCTION_LIST))
 PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (package), (LUA_LIB_PACKAGE_FUNCTION_LIST))
@@ -163,6 +175,7 @@ PP_FOR_EACH_CARTESIAN_PRODUCT(macro, (table), (LUA_LIB_TABLE_FUNCTION_LIST))
 [[maybe_unused]] constexpr uint32_t x_num_functions_in_lib_coroutine = 0 PP_FOR_EACH(macro, LUA_LIB_COROUTINE_FUNCTION_LIST);
 [[maybe_unused]] constexpr uint32_t x_num_functions_in_lib_debug = 0 PP_FOR_EACH(macro, LUA_LIB_DEBUG_FUNCTION_LIST);
 [[maybe_unused]] constexpr uint32_t x_num_functions_in_lib_io = 0 PP_FOR_EACH(macro, LUA_LIB_IO_FUNCTION_LIST);
+[[maybe_unused]] constexpr uint32_t x_num_functions_in_lib_io_file = 0 PP_FOR_EACH(macro, LUA_LIB_IO_FILE_FUNCTION_LIST);
 [[maybe_unused]] constexpr uint32_t x_num_functions_in_lib_math = 0 PP_FOR_EACH(macro, LUA_LIB_MATH_FUNCTION_LIST);
 [[maybe_unused]] constexpr uint32_t x_num_functions_in_lib_os = 0 PP_FOR_EACH(macro, LUA_LIB_OS_FUNCTION_LIST);
 [[maybe_unused]] constexpr uint32_t x_num_functions_in_lib_package = 0 PP_FOR_EACH(macro, LUA_LIB_PACKAGE_FUNCTION_LIST);
@@ -214,6 +227,8 @@ struct CreateGlobalObjectHelper
 DEEGEN_FORWARD_DECLARE_LIB_FUNC(coroutine_wrap_call);
 DEEGEN_FORWARD_DECLARE_LIB_FUNC(base_ipairs_iterator);
 DEEGEN_FORWARD_DECLARE_LIB_FUNC(io_lines_iter);
+DEEGEN_FORWARD_DECLARE_LIB_FUNC(io_file_tostring);
+DEEGEN_FORWARD_DECLARE_LIB_FUNC(string_gmatch_iter);
 
 #define INSERT_LIBFN(libName, fnName)                                               \
     [[maybe_unused]] HeapPtr<FunctionObject> libfn_ ## libName ##_ ## fnName =      \
@@ -264,11 +279,43 @@ UserHeapPointer<TableObject> CreateGlobalObject(VM* vm)
 
     // Initialize io library
     // The io library has 3 non-function fields: stdin, stdout, stderr
-    // TODO: we need to implement these fields.
     //
     HeapPtr<TableObject> libobj_io = h.InsertObject(globalObject, "io", x_num_functions_in_lib_io + 3);
     PP_FOR_EACH_CARTESIAN_PRODUCT(INSERT_LIBFN, (io), (LUA_LIB_IO_FUNCTION_LIST))
 
+    vm->InitializeLibFnProto<VM::LibFnProto::IoLinesIter>(ExecutableCode::CreateCFunction(vm, DEEGEN_CODE_POINTER_FOR_LIB_FUNC(io_lines_iter)));
+
+    // All file handles share one metatable, whose __index is the table of file methods
+    // As in Lua, file:close is the same function as io.close
+    //
+    {
+        HeapPtr<TableObject> libobj_io_file = TableObject::CreateEmptyTableObject(vm, x_num_functions_in_lib_io_file + 1 /*inlineCapacity*/, 0 /*initialButterflyArrayPartCapacity*/);
+        h.InsertField(libobj_io_file, "close", TValue::Create<tFunction>(libfn_io_close));
+        PP_FOR_EACH_CARTESIAN_PRODUCT(INSERT_LIBFN, (io_file), (LUA_LIB_IO_FILE_FUNCTION_LIST))
+
+        HeapPtr<TableObject> file_metatable = TableObject::CreateEmptyTableObject(vm, 2 /*inlineCapacity*/, 0 /*initialButterflyArrayPartCapacity*/);
+        h.InsertField(file_metatable, "__index", TValue::Create<tTable>(libobj_io_file));
+        h.InsertCFunc(file_metatable, "__tostring", DEEGEN_CODE_POINTER_FOR_LIB_FUNC(io_file_tostring));
+        vm->m_metatableForFile = file_metatable;
+    }
+
+    {
+        HeapPtr<HeapCDataObject> file_stdin = CreateLuaFileObject(vm, LuaFile::CreateForStandardStream(LuaFile::Kind::Stdin));
+        HeapPtr<HeapCDataObject> file_stdout = CreateLuaFileObject(vm, LuaFile::CreateForStandardStream(LuaFile::Kind::Stdout));
+        HeapPtr<HeapCDataObject> file_stderr = CreateLuaFileObject(vm, LuaFile::CreateForStandardStream(LuaFile::Kind::Stderr));
+        h.InsertField(libobj_io, "stdin", TValue::Create<tUserdata>(file_stdin));
+        h.InsertField(libobj_io, "stdout", TValue::Create<tUserdata>(file_stdout));
+        h.InsertField(libobj_io, "stderr", TValue::Create<tUserdata>(file_stderr));
+        vm->m_ioDefaultInput = file_stdin;
+        vm->m_ioDefaultOutput = file_stdout;
+
+        HeapPtr<FunctionObject> stdinChunkReader = FunctionObject::CreateCFunc(vm, vm->GetLibFnProto<VM::LibFnProto::IoLinesIter>(), 3 /*numUpvalues*/).As();
+        TCSet(stdinChunkReader->m_upvalues[0], TValue::Create<tUserdata>(file_stdin));
+        TCSet(stdinChunkReader->m_upvalues[1], TValue::Create<tBool>(false) /*closeAtEof*/);
+        TCSet(stdinChunkReader->m_upvalues[2], TValue::Create<tBool>(true) /*keepNewline*/);
+        vm->InitializeLibFn<VM::LibFn::IoStdinChunkReader>(TValue::Create<tFunction>(stdinChunkReader));
+    }
+
     // Initialize math library
     // The math library has 2 non-function fields: huge and pi
     // Additionally, it has 1 field for compatibility: math.mod = math.fmod
@@ -298,16 +345,18 @@ UserHeapPointer<TableObject> CreateGlobalObject(VM* vm)
 
     // Initialize string library
     // The string library has no non-function fields
-    // Additionally, it has 1 field for compatibility: string.gfind = string.find
+    // Additionally, it has 1 field for compatibility: string.gfind = string.gmatch
     //
     constexpr bool x_enable_lua_compat_string_gfind = true;
     HeapPtr<TableObject> libobj_string = h.InsertObject(globalObject, "string", x_num_functions_in_lib_string + (x_enable_lua_compat_string_gfind ? 1 : 0));
     PP_FOR_EACH_CARTESIAN_PRODUCT(INSERT_LIBFN, (string), (LUA_LIB_STRING_FUNCTION_LIST))
     if (x_enable_lua_compat_string_gfind)
     {
-        h.InsertField(libobj_string, "gfind", TValue::Create<tFunction>(libfn_string_find));
+        h.InsertField(libobj_string, "gfind", TValue::Create<tFunction>(libfn_string_gmatch));
     }
 
+    vm->InitializeLibFnProto<VM::LibFnProto::StringGmatchIter>(ExecutableCode::CreateCFunction(vm, DEEGEN_CODE_POINTER_FOR_LIB_FUNC(string_gmatch_iter)));
+
     // According to Lua standard, we need to set a metatable for strings where the __index field points to the string table,
     // so that string functions can be used in object-oriented style, e.g., string.byte(s, i) can be written as s:byte(i).
     //
@@ -323,7 +372,6 @@ UserHeapPointer<TableObject> CreateGlobalObject(VM* vm)
     //
     HeapPtr<TableObject> libobj_table = h.InsertObject(globalObject, "table", x_num_functions_in_lib_table);
     PP_FOR_EACH_CARTESIAN_PRODUCT(INSERT_LIBFN, (table), (LUA_LIB_TABLE_FUNCTION_LIST))
-    vm->InitializeLibFn<VM::LibFn::IoLinesIter>(TValue::Create<tFunction>(h.CreateCFunc(DEEGEN_CODE_POINTER_FOR_LIB_FUNC(io_lines_iter))));
 
     return globalObject;
 }
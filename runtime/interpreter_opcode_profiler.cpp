@@ -0,0 +1,137 @@
+#include "interpreter_opcode_profiler.h"
+#include "drt/bytecode_builder.h"
+
+// Generated by Deegen, in the same order as the interpreter dispatch table
+//
+extern "C" const char* const deegen_interpreter_opcode_name_table[];
+
+namespace {
+
+constexpr size_t x_numOpcodes = DeegenBytecodeBuilder::BytecodeBuilder::GetTotalBytecodeKinds();
+
+// Used as the previous opcode of the first executed opcode
+//
+constexpr size_t x_noPrevOpcode = x_numOpcodes;
+
+uint64_t g_opcodeCount[x_numOpcodes];
+uint64_t g_quickeningSlowPathCount[x_numOpcodes];
+
+// g_pairCount[prev * x_numOpcodes + cur], allocated on the first use since it is large
+// The pages are lazily zero-filled by the OS, so only the rows actually used take memory
+//
+uint64_t* g_pairCount = nullptr;
+size_t g_prevOpcode = x_noPrevOpcode;
+
+}   // anonymous namespace
+
+void InterpreterOpcodeProfiler::RecordOpcode(uint16_t opcode)
+{
+    assert(opcode < x_numOpcodes);
+    if (unlikely(g_pairCount == nullptr))
+    {
+        g_pairCount = reinterpret_cast<uint64_t*>(calloc((x_numOpcodes + 1) * x_numOpcodes, sizeof(uint64_t)));
+        VM_FAIL_IF(g_pairCount == nullptr, "Failed to allocate the opcode pair counters");
+    }
+    g_opcodeCount[opcode]++;
+    g_pairCount[g_prevOpcode * x_numOpcodes + opcode]++;
+    g_prevOpcode = opcode;
+}
+
+void InterpreterOpcodeProfiler::RecordQuickeningSlowPath(uint16_t opcode)
+{
+    assert(opcode < x_numOpcodes);
+    g_quickeningSlowPathCount[opcode]++;
+}
+
+void InterpreterOpcodeProfiler::WriteReport(FILE* fp)
+{
+    auto getName = [](size_t opcode) -> const char*
+    {
+        if (opcode == x_noPrevOpcode)
+        {
+            return "(start)";
+        }
+        assert(opcode < x_numOpcodes);
+        return deegen_interpreter_opcode_name_table[opcode];
+    };
+
+    uint64_t totalCount = 0;
+    std::vector<size_t> opcodes;
+    for (size_t i = 0; i < x_numOpcodes; i++)
+    {
+        if (g_opcodeCount[i] > 0 || g_quickeningSlowPathCount[i] > 0)
+        {
+            opcodes.push_back(i);
+        }
+        totalCount += g_opcodeCount[i];
+    }
+    std::stable_sort(opcodes.begin(), opcodes.end(), [](size_t lhs, size_t rhs) { return g_opcodeCount[lhs] > g_opcodeCount[rhs]; });
+
+    std::vector<std::pair<size_t /*prev*/, size_t /*cur*/>> pairs;
+    if (g_pairCount != nullptr)
+    {
+        for (size_t prev = 0; prev <= x_numOpcodes; prev++)
+        {
+            for (size_t cur = 0; cur < x_numOpcodes; cur++)
+            {
+                if (g_pairCount[prev * x_numOpcodes + cur] > 0)
+                {
+                    pairs.push_back(std::make_pair(prev, cur));
+                }
+            }
+        }
+    }
+    auto getPairCount = [](const std::pair<size_t, size_t>& p) -> uint64_t { return g_pairCount[p.first * x_numOpcodes + p.second]; };
+    std::stable_sort(pairs.begin(), pairs.end(), [&](const auto& lhs, const auto& rhs) { return getPairCount(lhs) > getPairCount(rhs); });
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"total_count\": %llu,\n", static_cast<unsigned long long>(totalCount));
+    fprintf(fp, "  \"opcodes\": [");
+    for (size_t i = 0; i < opcodes.size(); i++)
+    {
+        size_t opcode = opcodes[i];
+        fprintf(fp, "%s\n    { \"name\": \"%s\", \"count\": %llu, \"quickening_slow_path_count\": %llu }",
+                (i > 0 ? "," : ""), getName(opcode),
+                static_cast<unsigned long long>(g_opcodeCount[opcode]),
+                static_cast<unsigned long long>(g_quickeningSlowPathCount[opcode]));
+    }
+    fprintf(fp, "%s],\n", (opcodes.empty() ? "" : "\n  "));
+    fprintf(fp, "  \"pairs\": [");
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        fprintf(fp, "%s\n    { \"prev\": \"%s\", \"next\": \"%s\", \"count\": %llu }",
+                (i > 0 ? "," : ""), getName(pairs[i].first), getName(pairs[i].second),
+                static_cast<unsigned long long>(getPairCount(pairs[i])));
+    }
+    fprintf(fp, "%s]\n", (pairs.empty() ? "" : "\n  "));
+    fprintf(fp, "}\n");
+}
+
+void InterpreterOpcodeProfiler::WriteReportToFileAndReset()
+{
+    const char* path = getenv("LJR_OPCODE_PROFILE_FILE");
+    if (path == nullptr || path[0] == '\0')
+    {
+        path = x_defaultReportFile;
+    }
+    FILE* fp = fopen(path, "w");
+    if (fp == nullptr)
+    {
+        LOG_WARNING_WITH_ERRNO("Failed to open opcode profile report file '%s'", path);
+    }
+    else
+    {
+        WriteReport(fp);
+        fclose(fp);
+    }
+    Reset();
+}
+
+void InterpreterOpcodeProfiler::Reset()
+{
+    memset(g_opcodeCount, 0, sizeof(g_opcodeCount));
+    memset(g_quickeningSlowPathCount, 0, sizeof(g_quickeningSlowPathCount));
+    free(g_pairCount);
+    g_pairCount = nullptr;
+    g_prevOpcode = x_noPrevOpcode;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common_utils.h"
+
+// Execution counters of the interpreter opcodes, only collected if the interpreter is built with
+// x_enable_interpreter_opcode_profiling (the INTERPRETER_OPCODE_PROFILING build option), see deegen_options.h
+//
+// Every handler in the interpreter dispatch table counts as a distinct opcode, so bytecode variants, quickenings from
+// EnableHotColdSplitting and fused IC effects are all counted separately. The following are collected:
+// (1) The number of times each opcode is executed.
+// (2) The number of times each pair of opcodes is executed back-to-back, in dynamic execution order
+//     (so the pair may cross a call or return).
+// (3) For quickened opcodes, the number of times the quickening slow path is taken.
+//
+// Note that only the interpreter is instrumented: once a function tiers up to the baseline JIT, it is no longer counted.
+// The counters are not thread-safe, which is fine since only the execution thread runs the interpreter.
+//
+struct InterpreterOpcodeProfiler
+{
+    // Called by the interpreter at the start of each opcode handler
+    //
+    static void NO_INLINE RecordOpcode(uint16_t opcode);
+
+    // Called by the interpreter at the start of each quickening slow path
+    //
+    static void NO_INLINE RecordQuickeningSlowPath(uint16_t opcode);
+
+    // Write the report as JSON to 'fp'. The opcodes and the pairs are sorted by execution count, and those never executed are omitted.
+    //
+    static void WriteReport(FILE* fp);
+
+    // Write the report to the file specified by environment variable LJR_OPCODE_PROFILE_FILE (or x_defaultReportFile if not set),
+    // then reset all counters. This is called when the VM is destroyed.
+    //
+    static void WriteReportToFileAndReset();
+
+    static void Reset();
+
+    static constexpr const char* x_defaultReportFile = "ljr_opcode_profile.json";
+};
@@ -1,5 +1,6 @@
 #include "runtime_utils.h"
 #include "api_define_lib_function.h"
+#include "gc.h"
 
 #include "bytecode_builder.h"
 #include "json_utils.h"
@@ -138,6 +139,10 @@ std::unique_ptr<ScriptModule> WARN_UNUSED ScriptModule::LegacyParseScriptFromJSO
 {
     using namespace DeegenBytecodeBuilder;
 
+    // The constants are held in C++ data structures until the code blocks are created
+    //
+    DeferGC deferGC(vm);
+
     json module = json::parse(content);
     TestAssert(module.is_object());
     TestAssert(module.count("ChunkName") && module["ChunkName"].is_string());
@@ -1972,6 +1977,7 @@ std::unique_ptr<ScriptModule> WARN_UNUSED ScriptModule::LegacyParseScriptFromJSO
     TestAssert(chunkFn->m_numUpvalues == 0);
     UserHeapPointer<FunctionObject> entryPointFunc = FunctionObject::Create(vm, chunkFn->GetCodeBlock(globalObject));
     r->m_defaultEntryPoint = entryPointFunc;
+    vm->GetUserHeapGarbageCollector()->AddPermanentRoot(TValue::CreatePointer(entryPointFunc));
 
     return smHolder;
 }
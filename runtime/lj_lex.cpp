@@ -74,9 +74,11 @@
 #include "lj_strfmt_details.h"
 
 #include "lj_parser_wrapper.h"
+#include "bytecode_snapshot.h"
 #include "lj_parse_details.h"
 
 #include "vm.h"
+#include "gc.h"
 
 #define TKSTR1(name) +1
 #define TKSTR2(name, sym) +1
@@ -672,10 +674,13 @@ void lj_lex_init(VM* vm)
     {
         HeapPtr<HeapString> s = vm->CreateStringObjectFromRawCString(tokennames[i]);
         HeapString::SetReservedWord(s, i /*reservedWordOrd*/);
+        // The reserved word ordinal is stored in the string object, so it must never be collected
+        //
+        vm->GetUserHeapGarbageCollector()->AddPermanentRoot(TValue::CreatePointer(s));
     }
 }
 
-ParseResult WARN_UNUSED ParseLuaScript(CoroutineRuntimeContext* coroCtx, lua_Reader rd, void* ud)
+static ParseResult WARN_UNUSED ParseLuaSourceCode(CoroutineRuntimeContext* coroCtx, lua_Reader rd, void* ud)
 {
     SimpleTempStringStream ss;
     LexState ls;
@@ -685,6 +690,10 @@ ParseResult WARN_UNUSED ParseLuaScript(CoroutineRuntimeContext* coroCtx, lua_Rea
     ls.mode = nullptr;
     ls.sb = &ss;
 
+    // The parser keeps heap objects in its own data structures that the garbage collector does not know about
+    //
+    DeferGC deferGC(VM::GetActiveVMForCurrentThread());
+
     if (!setjmp(ls.longjmp_buf))
     {
         VM* vm = VM::GetActiveVMForCurrentThread();
@@ -707,6 +716,7 @@ ParseResult WARN_UNUSED ParseLuaScript(CoroutineRuntimeContext* coroCtx, lua_Rea
         assert(chunkFn->m_numUpvalues == 0);
         UserHeapPointer<FunctionObject> entryPointFunc = FunctionObject::Create(vm, chunkFn->GetCodeBlock(coroCtx->m_globalObject));
         module->m_defaultEntryPoint = entryPointFunc;
+        vm->GetUserHeapGarbageCollector()->AddPermanentRoot(TValue::CreatePointer(entryPointFunc));
         return {
             .m_scriptModule = std::move(module),
             .errMsg = TValue::Create<tNil>()
@@ -787,6 +797,62 @@ ParseResult WARN_UNUSED ParseLuaScript(CoroutineRuntimeContext* coroCtx, lua_Rea
     }
 }
 
+// Hands out the first piece of the input that has been read ahead, then the rest of the input from the underlying reader
+//
+struct LuaPeekedReaderState
+{
+    lua_Reader m_reader;
+    void* m_readerState;
+    const char* m_firstPiece;
+    size_t m_firstPieceLength;
+    bool m_firstPieceProvided;
+};
+
+static const char* Parser_LuaPeekedReader(CoroutineRuntimeContext* ctx, void* stateVoid, size_t* size /*out*/)
+{
+    LuaPeekedReaderState* state = reinterpret_cast<LuaPeekedReaderState*>(stateVoid);
+    if (!state->m_firstPieceProvided)
+    {
+        state->m_firstPieceProvided = true;
+        *size = state->m_firstPieceLength;
+        return state->m_firstPiece;
+    }
+    return state->m_reader(ctx, state->m_readerState, size);
+}
+
+ParseResult WARN_UNUSED ParseLuaScript(CoroutineRuntimeContext* coroCtx, lua_Reader rd, void* ud)
+{
+    // Peek at the first piece of the input to tell a precompiled bytecode snapshot from source code
+    //
+    size_t firstPieceLength = 0;
+    const char* firstPiece = rd(coroCtx, ud, &firstPieceLength);
+    if (firstPiece != nullptr && BytecodeSnapshot::IsSnapshot(firstPiece, firstPieceLength))
+    {
+        // The reader may reuse its buffer, so the pieces must be copied out
+        //
+        std::string data(firstPiece, firstPieceLength);
+        while (true)
+        {
+            size_t len = 0;
+            const char* piece = rd(coroCtx, ud, &len);
+            if (piece == nullptr || len == 0)
+            {
+                break;
+            }
+            data.append(piece, len);
+        }
+        return BytecodeSnapshot::Load(coroCtx, data.data(), data.length(), false /*dataOutlivesVM*/);
+    }
+
+    LuaPeekedReaderState state;
+    state.m_reader = rd;
+    state.m_readerState = ud;
+    state.m_firstPiece = firstPiece;
+    state.m_firstPieceLength = firstPieceLength;
+    state.m_firstPieceProvided = false;
+    return ParseLuaSourceCode(coroCtx, Parser_LuaPeekedReader, &state);
+}
+
 struct LuaSimpleStringReaderState
 {
     const char* m_data;
@@ -909,6 +975,19 @@ ParseResult WARN_UNUSED ParseLuaScriptFromFile(CoroutineRuntimeContext* ctx, con
         };
     }
 
+    // A precompiled bytecode snapshot is mmap'ed instead, so the bytecode does not need to be copied
+    //
+    int firstChar = fgetc(fp);
+    if (firstChar == static_cast<unsigned char>(BytecodeSnapshot::x_signatureByte))
+    {
+        fclose(fp);
+        return BytecodeSnapshot::LoadFromFile(ctx, fileName);
+    }
+    if (firstChar != EOF)
+    {
+        ungetc(firstChar, fp);
+    }
+
     LuaSimpleFileReaderState state;
     state.fp = fp;
     ParseResult res = ParseLuaScript(ctx, Parser_LuaSimpleFileReader, &state);
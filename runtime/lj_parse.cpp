@@ -1977,6 +1977,22 @@ static void fs_fixup_uv2(FuncState *fs, UnlinkedCodeBlock* ucb)
     }
 }
 
+/* Check if bytecode op has a jump target. */
+static bool bcopisjump(BCOp op)
+{
+    switch (op) {
+    case BC_UCLO: case BC_UCLO_LH:
+    case BC_ISNEXT:
+    case BC_FORI: case BC_JFORI: case BC_FORL: case BC_IFORL:
+    case BC_ITERL: case BC_IITERL:
+    case BC_LOOP: case BC_ILOOP:
+    case BC_REP_LH: case BC_JMP: case BC_JMP_LH:
+        return true;
+    default:
+        return false;
+    }
+}
+
 /* Fixup bytecode for prototype. */
 static void fs_fixup_bc(FuncState *fs, UnlinkedCodeBlock* ucb, BytecodeBuilder& bw, MSize n)
 {
@@ -2049,6 +2065,29 @@ static void fs_fixup_bc(FuncState *fs, UnlinkedCodeBlock* ucb, BytecodeBuilder&
         return static_cast<size_t>(jumpBytecodeOrdinal);
     };
 
+    // Bytecodes that are the target of some jump, which must not be fused into the bytecode before it
+    //
+    std::vector<bool> isJumpTarget(n, false);
+    for (size_t i = 1; i < n; i++)
+    {
+        BCIns ins = base[i].inst;
+        if (bcopisjump(static_cast<BCOp>(bc_op(ins))))
+        {
+            int64_t target = static_cast<int64_t>(i) + bc_j(ins) + 1;
+            if (target >= 0 && target < static_cast<int64_t>(n))
+            {
+                isJumpTarget[static_cast<size_t>(target)] = true;
+            }
+        }
+    }
+
+    // Check if the bytecode after the current one can be fused into the current one
+    //
+    auto canFuseNextBytecode = [&]() WARN_UNUSED -> bool
+    {
+        return bcOrd + 1 < n && !isJumpTarget[bcOrd + 1];
+    };
+
     bytecodeLocation.push_back(static_cast<size_t>(-1));
 
     for (bcOrd = 1; bcOrd < n; bcOrd++)
@@ -2780,6 +2819,26 @@ static void fs_fixup_bc(FuncState *fs, UnlinkedCodeBlock* ucb, BytecodeBuilder&
         case BC_UGET:
         {
             ucb->m_parserUVGetFixupList->push_back(static_cast<uint32_t>(bw.GetCurLength()));
+
+            // 'UGET A, D; TGETS A, A, str' (e.g., 'math.floor' where 'math' is an upvalue) is fused into one bytecode.
+            // The upvalue is only written to slot A to be immediately overwritten, so it doesn't need to be stored at all.
+            //
+            if (canFuseNextBytecode())
+            {
+                BCIns nextIns = base[bcOrd + 1].inst;
+                if (bc_op(nextIns) == BC_TGETS && bc_a(nextIns) == bc_a(ins) && bc_b(nextIns) == bc_a(ins))
+                {
+                    bw.CreateUpvalueGetMutableThenTableGetById({
+                        .ord = SafeIntegerCast<uint16_t>(bc_d(ins)),
+                        .index = bc_cst(nextIns),
+                        .output = Local { bc_a(ins) }
+                    });
+                    bcOrd++;
+                    bytecodeLocation.push_back(static_cast<size_t>(-1));
+                    break;
+                }
+            }
+
             bw.CreateUpvalueGetMutable({
                 .ord = SafeIntegerCast<uint16_t>(bc_d(ins)),
                 .output = Local { bc_a(ins) }
@@ -4505,10 +4564,24 @@ UnlinkedCodeBlock* lj_parse(LexState *ls)
         BytecodeBuilder& bw = *u->m_bytecodeBuilder;
 
         // Rewrite all UGET on immutable upvalue to ImmutableUpvalueGet (required for correctness!)
+        // The same applies to the UGET fused with a TableGetById
         //
         assert(u->m_parserUVGetFixupList != nullptr);
         for (uint32_t offset : *u->m_parserUVGetFixupList)
         {
+            if (bw.GetBytecodeKind(offset) == BCKind::UpvalueGetMutableThenTableGetById)
+            {
+                auto ops = bw.DecodeUpvalueGetMutableThenTableGetById(offset);
+                uint16_t ord = ops.ord.m_value;
+                assert(ord < u->m_numUpvalues);
+                assert(u->m_upvalueInfo[ord].m_immutabilityFieldFinalized);
+                if (u->m_upvalueInfo[ord].m_isImmutable)
+                {
+                    bw.ReplaceBytecode<BCKind::UpvalueGetImmutableThenTableGetById>(offset, { .ord = ord, .index = ops.index, .output = ops.output });
+                }
+                continue;
+            }
+
             assert(bw.GetBytecodeKind(offset) == BCKind::UpvalueGetMutable);
             auto ops = bw.DecodeUpvalueGetMutable(offset);
             uint16_t ord = ops.ord.m_value;
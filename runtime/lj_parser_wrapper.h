@@ -12,6 +12,9 @@ struct ParseResult
 using lua_Reader = const char*(*)(CoroutineRuntimeContext*, void*, size_t*);
 
 void lj_lex_init(VM* vm);
+
+// All the functions below also accept a precompiled bytecode snapshot (see bytecode_snapshot.h) in place of the source code
+//
 ParseResult WARN_UNUSED ParseLuaScript(CoroutineRuntimeContext* ctx, lua_Reader rd, void* ud);
 
 // Parse Lua script from the specified string
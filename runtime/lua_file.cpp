@@ -0,0 +1,526 @@
+#include "lua_file.h"
+#include "lj_strscan.h"
+
+static bool WARN_UNUSED IsRegularFile(FILE* fp)
+{
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0)
+    {
+        return false;
+    }
+    return S_ISREG(st.st_mode);
+}
+
+LuaFile::LuaFile(Kind kind, FILE* fp)
+    : m_kind(kind)
+    , m_isClosed(false)
+    , m_isRegularFile(false)
+    , m_lastOperation(LastOperation::None)
+    , m_fp(fp)
+    , m_buf(nullptr)
+    , m_bufCapacity(0)
+    , m_bufStart(0)
+    , m_bufEnd(0)
+{
+    // The stdout and stderr of the VM can be redirected at any time, so they are checked on each seek instead (see Seek)
+    //
+    if (kind == Kind::Stdin)
+    {
+        m_isRegularFile = IsRegularFile(stdin);
+    }
+    else if (!IsStandardStream())
+    {
+        m_isRegularFile = IsRegularFile(fp);
+    }
+}
+
+LuaFile::~LuaFile()
+{
+    if (!m_isClosed && !IsStandardStream())
+    {
+        std::ignore = Close();
+    }
+    delete [] m_buf;
+}
+
+LuaFile* WARN_UNUSED LuaFile::CreateForStandardStream(Kind kind)
+{
+    assert(kind == Kind::Stdin || kind == Kind::Stdout || kind == Kind::Stderr);
+    return new LuaFile(kind, nullptr /*fp*/);
+}
+
+LuaFile* WARN_UNUSED LuaFile::Open(const char* fileName, const char* mode)
+{
+    FILE* fp = fopen(fileName, mode);
+    if (fp == nullptr)
+    {
+        return nullptr;
+    }
+    return new LuaFile(Kind::File, fp);
+}
+
+LuaFile* WARN_UNUSED LuaFile::OpenProcess(const char* command, const char* mode)
+{
+    FILE* fp = popen(command, mode);
+    if (fp == nullptr)
+    {
+        return nullptr;
+    }
+    return new LuaFile(Kind::Pipe, fp);
+}
+
+LuaFile* WARN_UNUSED LuaFile::OpenTemporaryFile()
+{
+    FILE* fp = tmpfile();
+    if (fp == nullptr)
+    {
+        return nullptr;
+    }
+    return new LuaFile(Kind::File, fp);
+}
+
+FILE* LuaFile::GetFILE()
+{
+    assert(!m_isClosed);
+    switch (m_kind)
+    {
+    case Kind::Stdin:
+    {
+        return stdin;
+    }
+    case Kind::Stdout:
+    {
+        return VM::GetActiveVMForCurrentThread()->GetStdout();
+    }
+    case Kind::Stderr:
+    {
+        return VM::GetActiveVMForCurrentThread()->GetStderr();
+    }
+    case Kind::File:
+    case Kind::Pipe:
+    {
+        return m_fp;
+    }
+    }   /*switch*/
+    __builtin_unreachable();
+}
+
+bool WARN_UNUSED LuaFile::Close()
+{
+    assert(!m_isClosed && !IsStandardStream());
+    m_isClosed = true;
+    delete [] m_buf;
+    m_buf = nullptr;
+    m_bufCapacity = 0;
+    m_bufStart = 0;
+    m_bufEnd = 0;
+    if (m_kind == Kind::Pipe)
+    {
+        return pclose(m_fp) != -1;
+    }
+    return fclose(m_fp) == 0;
+}
+
+void LuaFile::PrepareForRead()
+{
+    if (m_lastOperation == LastOperation::Write)
+    {
+        std::ignore = fflush(GetFILE());
+    }
+    m_lastOperation = LastOperation::Read;
+    if (m_buf == nullptr)
+    {
+        m_buf = new char[x_initialBufferSize];
+        m_bufCapacity = x_initialBufferSize;
+    }
+}
+
+void LuaFile::PrepareForWrite()
+{
+    if (m_lastOperation == LastOperation::Read)
+    {
+        DiscardReadBuffer();
+    }
+    m_lastOperation = LastOperation::Write;
+}
+
+void LuaFile::DiscardReadBuffer()
+{
+    // The unconsumed data of a pipe cannot be given back, it is lost, same as in C
+    //
+    if (m_isRegularFile)
+    {
+        std::ignore = fseek(GetFILE(), -static_cast<long>(GetNumBufferedBytes()), SEEK_CUR);
+    }
+    m_bufStart = 0;
+    m_bufEnd = 0;
+}
+
+void LuaFile::EnsureBufferSpace(size_t numBytes)
+{
+    assert(m_buf != nullptr);
+    if (m_bufCapacity - m_bufEnd >= numBytes)
+    {
+        return;
+    }
+    size_t numBuffered = GetNumBufferedBytes();
+    if (m_bufCapacity - numBuffered >= numBytes)
+    {
+        memmove(m_buf, m_buf + m_bufStart, numBuffered);
+    }
+    else
+    {
+        size_t newCapacity = std::max(m_bufCapacity * 2, numBuffered + numBytes);
+        char* newBuf = new char[newCapacity];
+        memcpy(newBuf, m_buf + m_bufStart, numBuffered);
+        delete [] m_buf;
+        m_buf = newBuf;
+        m_bufCapacity = newCapacity;
+    }
+    m_bufStart = 0;
+    m_bufEnd = numBuffered;
+}
+
+bool WARN_UNUSED LuaFile::FillBuffer()
+{
+    EnsureBufferSpace(x_minReadSize);
+    size_t numToRead = m_bufCapacity - m_bufEnd;
+    FILE* fp = GetFILE();
+    size_t numRead;
+    if (m_isRegularFile)
+    {
+        numRead = fread(m_buf + m_bufEnd, 1, numToRead, fp);
+    }
+    else
+    {
+        ssize_t r;
+        do
+        {
+            r = read(fileno(fp), m_buf + m_bufEnd, numToRead);
+        }
+        while (r == -1 && errno == EINTR);
+        numRead = (r > 0) ? static_cast<size_t>(r) : 0;
+    }
+    m_bufEnd += numRead;
+    return numRead > 0;
+}
+
+UserHeapPointer<HeapString> WARN_UNUSED LuaFile::ConsumeBufferAsString(VM* vm, size_t len)
+{
+    assert(len <= GetNumBufferedBytes());
+    assert(len <= x_maxStringLength);
+    UserHeapPointer<HeapString> res = vm->CreateStringObjectFromRawString(m_buf + m_bufStart, static_cast<uint32_t>(len));
+    m_bufStart += len;
+    return res;
+}
+
+bool WARN_UNUSED LuaFile::ReadLine(VM* vm, bool keepNewline, UserHeapPointer<HeapString>& result /*out*/)
+{
+    PrepareForRead();
+    // The number of unconsumed bytes known to not contain a newline
+    // (the buffer may be moved by FillBuffer, so this must be relative to m_bufStart)
+    //
+    size_t numScanned = 0;
+    while (true)
+    {
+        char* scanStart = m_buf + m_bufStart + numScanned;
+        char* newline = reinterpret_cast<char*>(memchr(scanStart, '\n', GetNumBufferedBytes() - numScanned));
+        if (newline != nullptr)
+        {
+            size_t lineLen = static_cast<size_t>(newline - (m_buf + m_bufStart));
+            if (unlikely((keepNewline ? lineLen + 1 : lineLen) > x_maxStringLength))
+            {
+                errno = EFBIG;
+                return false;
+            }
+            result = ConsumeBufferAsString(vm, keepNewline ? lineLen + 1 : lineLen);
+            if (!keepNewline)
+            {
+                m_bufStart++;
+            }
+            return true;
+        }
+        numScanned = GetNumBufferedBytes();
+        if (unlikely(numScanned > x_maxStringLength))
+        {
+            errno = EFBIG;
+            return false;
+        }
+        if (!FillBuffer())
+        {
+            // The last line does not end with a newline
+            //
+            if (numScanned == 0)
+            {
+                errno = 0;
+                return false;
+            }
+            result = ConsumeBufferAsString(vm, numScanned);
+            return true;
+        }
+    }
+}
+
+bool WARN_UNUSED LuaFile::ReadChars(VM* vm, size_t numChars, UserHeapPointer<HeapString>& result /*out*/)
+{
+    assert(numChars > 0);
+    PrepareForRead();
+    // Do not buffer more than one byte past the longest possible string, so a huge count fails without exhausting memory
+    //
+    size_t numToBuffer = std::min(numChars, x_maxStringLength + 1);
+    while (GetNumBufferedBytes() < numToBuffer)
+    {
+        if (!FillBuffer())
+        {
+            break;
+        }
+    }
+    size_t len = std::min(numChars, GetNumBufferedBytes());
+    if (unlikely(len > x_maxStringLength))
+    {
+        errno = EFBIG;
+        return false;
+    }
+    if (len == 0)
+    {
+        errno = 0;
+        return false;
+    }
+    result = ConsumeBufferAsString(vm, len);
+    return true;
+}
+
+bool WARN_UNUSED LuaFile::TestEof()
+{
+    PrepareForRead();
+    return GetNumBufferedBytes() > 0 || FillBuffer();
+}
+
+bool WARN_UNUSED LuaFile::ReadNumber(double& result /*out*/)
+{
+    PrepareForRead();
+
+    auto peek = [&]() -> int
+    {
+        if (GetNumBufferedBytes() == 0 && !FillBuffer())
+        {
+            return -1;
+        }
+        return static_cast<unsigned char>(m_buf[m_bufStart]);
+    };
+
+    while (true)
+    {
+        int c = peek();
+        if (c == -1)
+        {
+            return false;
+        }
+        if (!(c == ' ' || (c >= '\t' && c <= '\r')))
+        {
+            break;
+        }
+        m_bufStart++;
+    }
+
+    // Consume the longest prefix that looks like a number, the same way as Lua 5.3 does, then let the parser decide if it is valid
+    //
+    constexpr size_t x_maxNumberLength = 200;
+    char buf[x_maxNumberLength + 1];
+    size_t len = 0;
+
+    auto accept = [&](const char* set) -> bool
+    {
+        int c = peek();
+        if (c == -1 || c == 0 || strchr(set, c) == nullptr || len >= x_maxNumberLength)
+        {
+            return false;
+        }
+        buf[len++] = static_cast<char>(c);
+        m_bufStart++;
+        return true;
+    };
+
+    auto acceptDigits = [&](bool isHex) -> size_t
+    {
+        size_t count = 0;
+        while (accept(isHex ? "0123456789abcdefABCDEF" : "0123456789"))
+        {
+            count++;
+        }
+        return count;
+    };
+
+    std::ignore = accept("+-");
+    size_t numDigits = 0;
+    bool isHex = false;
+    if (accept("0"))
+    {
+        if (accept("xX"))
+        {
+            isHex = true;
+        }
+        else
+        {
+            numDigits = 1;
+        }
+    }
+    numDigits += acceptDigits(isHex);
+    if (accept("."))
+    {
+        numDigits += acceptDigits(isHex);
+    }
+    if (numDigits > 0 && accept(isHex ? "pP" : "eE"))
+    {
+        std::ignore = accept("+-");
+        std::ignore = acceptDigits(false /*isHex*/);
+    }
+    buf[len] = '\0';
+
+    StrScanResult ssr = TryConvertStringToDoubleWithLuaSemantics(buf, len);
+    if (ssr.fmt != StrScanFmt::STRSCAN_NUM)
+    {
+        return false;
+    }
+    result = ssr.d;
+    return true;
+}
+
+bool WARN_UNUSED LuaFile::ReadAll(VM* vm, UserHeapPointer<HeapString>& result /*out*/)
+{
+    PrepareForRead();
+
+    if (m_isRegularFile)
+    {
+        FILE* fp = GetFILE();
+        struct stat st;
+        long pos = ftell(fp);
+        if (fstat(fileno(fp), &st) == 0 && pos >= 0 && st.st_size > pos)
+        {
+            size_t numRemaining = static_cast<size_t>(st.st_size - pos);
+            size_t numBuffered = GetNumBufferedBytes();
+            if (numBuffered + numRemaining > x_maxStringLength)
+            {
+                errno = EFBIG;
+                return false;
+            }
+
+            if (numRemaining >= x_mmapThresholdForReadAll)
+            {
+                // Create the string directly from the page cache, instead of reading the file into the buffer first
+                //
+                size_t mapOffset = static_cast<size_t>(pos) & ~(VM::x_pageSize - 1);
+                size_t mapLength = static_cast<size_t>(st.st_size) - mapOffset;
+                void* map = mmap(nullptr, mapLength, PROT_READ, MAP_PRIVATE, fileno(fp), static_cast<off_t>(mapOffset));
+                if (map != MAP_FAILED)
+                {
+                    std::ignore = madvise(map, mapLength, MADV_SEQUENTIAL);
+                    std::pair<const void*, size_t> chunks[2] = {
+                        std::make_pair(m_buf + m_bufStart, numBuffered),
+                        std::make_pair(reinterpret_cast<char*>(map) + (static_cast<size_t>(pos) - mapOffset), numRemaining)
+                    };
+                    result = vm->CreateStringObjectFromConcatenation(chunks, 2 /*len*/);
+                    munmap(map, mapLength);
+                    m_bufStart = 0;
+                    m_bufEnd = 0;
+                    std::ignore = fseek(fp, st.st_size, SEEK_SET);
+                    return true;
+                }
+            }
+
+            // Size the buffer so the whole file is read in one go, and the read that sees the end of file does not grow the buffer
+            //
+            EnsureBufferSpace(numRemaining + x_minReadSize);
+        }
+    }
+
+    while (FillBuffer()) { }
+
+    if (GetNumBufferedBytes() > x_maxStringLength)
+    {
+        m_bufStart = m_bufEnd;
+        errno = EFBIG;
+        return false;
+    }
+    result = ConsumeBufferAsString(vm, GetNumBufferedBytes());
+
+    // Do not hold on to a huge buffer after reading a big file
+    //
+    if (m_bufCapacity > x_initialBufferSize)
+    {
+        delete [] m_buf;
+        m_buf = new char[x_initialBufferSize];
+        m_bufCapacity = x_initialBufferSize;
+        m_bufStart = 0;
+        m_bufEnd = 0;
+    }
+    return true;
+}
+
+bool WARN_UNUSED LuaFile::Write(const void* data, size_t len)
+{
+    PrepareForWrite();
+    return fwrite(data, 1, len, GetFILE()) == len;
+}
+
+bool WARN_UNUSED LuaFile::Flush()
+{
+    return fflush(GetFILE()) == 0;
+}
+
+bool WARN_UNUSED LuaFile::Seek(int whence, int64_t offset, int64_t& newPosition /*out*/)
+{
+    // stdout and stderr are seekable if they are redirected to a regular file. They are never read, so only Seek cares.
+    //
+    if (m_kind == Kind::Stdout || m_kind == Kind::Stderr)
+    {
+        m_isRegularFile = IsRegularFile(GetFILE());
+    }
+    if (!m_isRegularFile)
+    {
+        errno = ESPIPE;
+        return false;
+    }
+    if (m_lastOperation == LastOperation::Read)
+    {
+        DiscardReadBuffer();
+    }
+    m_lastOperation = LastOperation::None;
+    FILE* fp = GetFILE();
+    if (fseeko(fp, static_cast<off_t>(offset), whence) != 0)
+    {
+        return false;
+    }
+    off_t pos = ftello(fp);
+    if (pos < 0)
+    {
+        return false;
+    }
+    newPosition = static_cast<int64_t>(pos);
+    return true;
+}
+
+bool WARN_UNUSED LuaFile::SetVBuf(int mode, size_t size)
+{
+    return setvbuf(GetFILE(), nullptr, mode, size) == 0;
+}
+
+HeapPtr<HeapCDataObject> WARN_UNUSED CreateLuaFileObject(VM* vm, LuaFile* file)
+{
+    HeapCDataObject* obj = HeapCDataObject::Create(vm, HeapCDataObject::Kind::LuaFile, vm->m_metatableForFile, file);
+    return TranslateToHeapPtr(obj);
+}
+
+LuaFile* WARN_UNUSED TryGetLuaFile(TValue tv)
+{
+    if (!tv.Is<tUserdata>())
+    {
+        return nullptr;
+    }
+    HeapCDataObject* obj = TranslateToRawPointer(tv.As<tUserdata>());
+    if (obj->m_kind != HeapCDataObject::Kind::LuaFile)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<LuaFile*>(obj->m_payload);
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "common_utils.h"
+#include "memory_ptr.h"
+#include "vm.h"
+#include "heap_cdata_object.h"
+
+// A file handle of the io library, the payload of a HeapCDataObject of kind LuaFile
+//
+// The file is read in big chunks into an internal buffer, so lines and strings are created straight from the buffer with no
+// intermediate copy, and the newline search (memchr) runs over the whole buffer at once instead of character by character.
+// Regular files are read with fread (which reads large requests directly into our buffer), so stdio keeps track of the file
+// position. Other files (pipes and terminals) are read with read(2), which, unlike fread, returns as soon as some data is
+// available, so reading a line from an interactive stdin does not block until the buffer is full.
+// Writing goes through the FILE, so output is still buffered by stdio as usual.
+//
+// Switching from reading to writing or seeking rewinds the file by the amount of unconsumed data and discards the buffer,
+// and switching from writing to reading flushes the FILE first, similar to what the C standard requires for update streams.
+//
+// The standard streams do not own their FILE: stdout and stderr resolve to the VM's (possibly redirected) stdout and stderr
+// every time they are used, and they cannot be closed.
+//
+class LuaFile
+{
+    MAKE_NONCOPYABLE(LuaFile);
+    MAKE_NONMOVABLE(LuaFile);
+
+public:
+    enum class Kind : uint8_t
+    {
+        Stdin,
+        Stdout,
+        Stderr,
+        // Opened by fopen or tmpfile
+        //
+        File,
+        // Opened by popen
+        //
+        Pipe
+    };
+
+    static LuaFile* WARN_UNUSED CreateForStandardStream(Kind kind);
+
+    // Return nullptr and set errno on failure
+    //
+    static LuaFile* WARN_UNUSED Open(const char* fileName, const char* mode);
+    static LuaFile* WARN_UNUSED OpenProcess(const char* command, const char* mode);
+    static LuaFile* WARN_UNUSED OpenTemporaryFile();
+
+    // Closes the file if it has not been closed
+    //
+    ~LuaFile();
+
+    bool IsClosed() { return m_isClosed; }
+    bool IsStandardStream() { return m_kind == Kind::Stdin || m_kind == Kind::Stdout || m_kind == Kind::Stderr; }
+
+    // Return false and set errno on failure. The file is considered closed even if fclose fails.
+    //
+    bool WARN_UNUSED Close();
+
+    // Each function below returns false if the value cannot be read because the end of file is reached (or on error).
+    // ReadLine and ReadChars set errno to EFBIG if the value is too long to fit in a string, and to 0 otherwise.
+    //
+    // Read a line. The '\n' is included in the string only if 'keepNewline' is true.
+    //
+    bool WARN_UNUSED ReadLine(VM* vm, bool keepNewline, UserHeapPointer<HeapString>& result /*out*/);
+    bool WARN_UNUSED ReadChars(VM* vm, size_t numChars, UserHeapPointer<HeapString>& result /*out*/);
+    bool WARN_UNUSED ReadNumber(double& result /*out*/);
+    // Return false only if the end of file is reached, the behavior of 'read(0)'
+    //
+    bool WARN_UNUSED TestEof();
+    // Read the rest of the file. This always succeeds (returns the empty string) at the end of file,
+    // but returns false if the file is too large to fit in a string, or on I/O error.
+    //
+    bool WARN_UNUSED ReadAll(VM* vm, UserHeapPointer<HeapString>& result /*out*/);
+
+    // Return false and set errno on failure
+    //
+    bool WARN_UNUSED Write(const void* data, size_t len);
+    bool WARN_UNUSED Flush();
+    bool WARN_UNUSED Seek(int whence, int64_t offset, int64_t& newPosition /*out*/);
+    bool WARN_UNUSED SetVBuf(int mode, size_t size);
+
+    static constexpr size_t x_initialBufferSize = 65536;
+
+    // The longest string that can be read, as string lengths are 32-bit
+    //
+    static constexpr size_t x_maxStringLength = std::numeric_limits<uint32_t>::max();
+
+    // Each read into the buffer asks for at least this many bytes, so we never issue tiny reads
+    //
+    static constexpr size_t x_minReadSize = 4096;
+
+    // When reading the rest of a regular file larger than this, mmap the file instead of reading it into the buffer
+    //
+    static constexpr size_t x_mmapThresholdForReadAll = 1048576;
+
+private:
+    LuaFile(Kind kind, FILE* fp);
+
+    FILE* GetFILE();
+
+    // Called before reading from the file
+    //
+    void PrepareForRead();
+
+    // Called before writing to the file
+    //
+    void PrepareForWrite();
+
+    // Rewind the file by the unconsumed data in the buffer and empty the buffer
+    //
+    void DiscardReadBuffer();
+
+    // Make sure at least 'numBytes' bytes can be appended to the buffer, by moving the unconsumed data to the front
+    // of the buffer, or growing the buffer if that is not enough.
+    //
+    void EnsureBufferSpace(size_t numBytes);
+
+    // Read more data from the file into the buffer, growing the buffer if it is full.
+    // Returns false if nothing can be read (end of file or error).
+    //
+    bool WARN_UNUSED FillBuffer();
+
+    size_t GetNumBufferedBytes() { return m_bufEnd - m_bufStart; }
+
+    // Create a string from the next 'len' bytes in the buffer and consume them
+    //
+    UserHeapPointer<HeapString> WARN_UNUSED ConsumeBufferAsString(VM* vm, size_t len);
+
+    enum class LastOperation : uint8_t
+    {
+        None,
+        Read,
+        Write
+    };
+
+    Kind m_kind;
+    bool m_isClosed;
+    bool m_isRegularFile;
+    LastOperation m_lastOperation;
+    FILE* m_fp;
+
+    // The unconsumed data is [m_bufStart, m_bufEnd)
+    //
+    char* m_buf;
+    size_t m_bufCapacity;
+    size_t m_bufStart;
+    size_t m_bufEnd;
+};
+
+// Create the userdata for a file handle, which takes the ownership of 'file'
+//
+HeapPtr<HeapCDataObject> WARN_UNUSED CreateLuaFileObject(VM* vm, LuaFile* file);
+
+// Return nullptr if 'tv' is not a file handle
+//
+LuaFile* WARN_UNUSED TryGetLuaFile(TValue tv);
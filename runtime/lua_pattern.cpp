@@ -0,0 +1,711 @@
+#include "lua_pattern.h"
+#include "vm.h"
+
+#include <cctype>
+
+namespace {
+
+// The 'len' of a capture whose ')' has not been reached yet
+//
+constexpr size_t x_unfinishedCapture = static_cast<size_t>(-1);
+
+// Compiled patterns in the cache are dropped all at once when the cache grows beyond this size
+//
+constexpr size_t x_maxCachedLuaPatterns = 1024;
+
+// Same as 'match_class' in Lua's lstrlib
+//
+bool WARN_UNUSED CharMatchesClass(int c, int cl)
+{
+    bool res;
+    switch (tolower(cl))
+    {
+    case 'a': res = isalpha(c); break;
+    case 'c': res = iscntrl(c); break;
+    case 'd': res = isdigit(c); break;
+    case 'l': res = islower(c); break;
+    case 'p': res = ispunct(c); break;
+    case 's': res = isspace(c); break;
+    case 'u': res = isupper(c); break;
+    case 'w': res = isalnum(c); break;
+    case 'x': res = isxdigit(c); break;
+    case 'z': res = (c == 0); break;
+    default: return (cl == c);
+    }   /*switch*/
+    if (isupper(cl))
+    {
+        res = !res;
+    }
+    return res;
+}
+
+}   // anonymous namespace
+
+bool WARN_UNUSED LuaPattern::HasSpecialCharacters(const char* str, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = str[i];
+        if (c == '^' || c == '$' || c == '*' || c == '+' || c == '?' || c == '.' || c == '(' || c == '[' || c == '%' || c == '-')
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* WARN_UNUSED LuaPattern::ParseCharClass(const char* p, const char* end, CharSet& result /*out*/, const char*& errMsg /*out*/)
+{
+    memset(result.m_bits, 0, sizeof(result.m_bits));
+
+    auto addClass = [&](int cl)
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            if (CharMatchesClass(c, cl))
+            {
+                result.Add(static_cast<uint8_t>(c));
+            }
+        }
+    };
+
+    assert(p < end);
+    if (*p == '%')
+    {
+        if (p + 1 >= end)
+        {
+            errMsg = "malformed pattern (ends with '%')";
+            return nullptr;
+        }
+        addClass(static_cast<uint8_t>(p[1]));
+        return p + 2;
+    }
+
+    if (*p == '.')
+    {
+        result.Invert();
+        return p + 1;
+    }
+
+    if (*p != '[')
+    {
+        result.Add(static_cast<uint8_t>(*p));
+        return p + 1;
+    }
+
+    // A set. Same as Lua, a ']' right after the '[' (or '[^') is an ordinary character, and '%' escapes the next character.
+    //
+    const char* setBegin = p + 1;
+    bool isComplement = false;
+    if (setBegin < end && *setBegin == '^')
+    {
+        isComplement = true;
+        setBegin++;
+    }
+
+    const char* setEnd = setBegin;
+    do
+    {
+        if (setEnd >= end)
+        {
+            errMsg = "malformed pattern (missing ']')";
+            return nullptr;
+        }
+        char c = *setEnd;
+        setEnd++;
+        if (c == '%' && setEnd < end)
+        {
+            setEnd++;
+        }
+    }
+    while (setEnd >= end || *setEnd != ']');
+
+    for (const char* q = setBegin; q < setEnd; q++)
+    {
+        if (*q == '%')
+        {
+            q++;
+            addClass(static_cast<uint8_t>(*q));
+        }
+        else if (q + 2 < setEnd && q[1] == '-')
+        {
+            for (int c = static_cast<uint8_t>(q[0]); c <= static_cast<uint8_t>(q[2]); c++)
+            {
+                result.Add(static_cast<uint8_t>(c));
+            }
+            q += 2;
+        }
+        else
+        {
+            result.Add(static_cast<uint8_t>(*q));
+        }
+    }
+
+    if (isComplement)
+    {
+        result.Invert();
+    }
+    return setEnd + 1;
+}
+
+LuaPattern* WARN_UNUSED LuaPattern::Compile(const char* pattern, size_t len, bool handleAnchor, const char*& errMsg /*out*/)
+{
+    std::unique_ptr<LuaPattern> r(new LuaPattern());
+    const char* p = pattern;
+    const char* end = pattern + len;
+
+    r->m_isAnchored = false;
+    if (handleAnchor && p < end && *p == '^')
+    {
+        r->m_isAnchored = true;
+        p++;
+    }
+
+    // A ')' is still parsed so that an unmatched one is reported
+    //
+    r->m_isLiteral = !HasSpecialCharacters(p, static_cast<size_t>(end - p)) && memchr(p, ')', static_cast<size_t>(end - p)) == nullptr;
+    r->m_numCaptures = 0;
+    r->m_hasLiteralFirstChar = false;
+    r->m_literalFirstChar = 0;
+    if (r->m_isLiteral)
+    {
+        r->m_literal = std::string(p, static_cast<size_t>(end - p));
+        return r.release();
+    }
+
+    // Whether each capture has been closed, for checking back references and unbalanced parentheses
+    //
+    bool isCaptureClosed[x_maxCaptures];
+
+    auto addNode = [&](NodeKind kind) -> Node&
+    {
+        r->m_nodes.push_back(Node {
+            .m_kind = kind,
+            .m_quantifier = Quantifier::One,
+            .m_arg0 = 0,
+            .m_arg1 = 0,
+            .m_charSetOrd = 0
+        });
+        return r->m_nodes.back();
+    };
+
+    while (p < end)
+    {
+        switch (*p)
+        {
+        case '(':
+        {
+            if (r->m_numCaptures >= x_maxCaptures)
+            {
+                errMsg = "too many captures";
+                return nullptr;
+            }
+            if (p + 1 < end && p[1] == ')')
+            {
+                addNode(NodeKind::PositionCapture);
+                isCaptureClosed[r->m_numCaptures] = true;
+                p += 2;
+            }
+            else
+            {
+                addNode(NodeKind::OpenCapture);
+                isCaptureClosed[r->m_numCaptures] = false;
+                p++;
+            }
+            r->m_numCaptures++;
+            continue;
+        }
+        case ')':
+        {
+            // Close the innermost capture that is still open
+            //
+            uint32_t ord = r->m_numCaptures;
+            while (ord > 0 && isCaptureClosed[ord - 1])
+            {
+                ord--;
+            }
+            if (ord == 0)
+            {
+                errMsg = "invalid pattern capture";
+                return nullptr;
+            }
+            isCaptureClosed[ord - 1] = true;
+            addNode(NodeKind::CloseCapture);
+            p++;
+            continue;
+        }
+        case '$':
+        {
+            // '$' is only special at the end of the pattern
+            //
+            if (p + 1 == end)
+            {
+                addNode(NodeKind::EndAnchor);
+                p++;
+                continue;
+            }
+            break;
+        }
+        case '%':
+        {
+            if (p + 1 >= end)
+            {
+                break;
+            }
+            if (p[1] == 'b')
+            {
+                if (p + 4 > end)
+                {
+                    errMsg = "unbalanced pattern";
+                    return nullptr;
+                }
+                Node& node = addNode(NodeKind::Balance);
+                node.m_arg0 = static_cast<uint8_t>(p[2]);
+                node.m_arg1 = static_cast<uint8_t>(p[3]);
+                p += 4;
+                continue;
+            }
+            if (p[1] == 'f')
+            {
+                p += 2;
+                if (p >= end || *p != '[')
+                {
+                    errMsg = "missing '[' after '%f' in pattern";
+                    return nullptr;
+                }
+                CharSet cs;
+                p = ParseCharClass(p, end, cs /*out*/, errMsg /*out*/);
+                if (p == nullptr)
+                {
+                    return nullptr;
+                }
+                Node& node = addNode(NodeKind::Frontier);
+                node.m_charSetOrd = static_cast<uint32_t>(r->m_charSets.size());
+                r->m_charSets.push_back(cs);
+                continue;
+            }
+            if (isdigit(static_cast<uint8_t>(p[1])))
+            {
+                int ord = p[1] - '1';
+                if (ord < 0 || ord >= static_cast<int>(r->m_numCaptures) || !isCaptureClosed[ord])
+                {
+                    errMsg = "invalid capture index";
+                    return nullptr;
+                }
+                Node& node = addNode(NodeKind::BackReference);
+                node.m_arg0 = static_cast<uint8_t>(ord);
+                p += 2;
+                continue;
+            }
+            break;
+        }
+        default:
+        {
+            break;
+        }
+        }   /*switch*/
+
+        // A single character class, optionally followed by a quantifier
+        //
+        CharSet cs;
+        p = ParseCharClass(p, end, cs /*out*/, errMsg /*out*/);
+        if (p == nullptr)
+        {
+            return nullptr;
+        }
+        Quantifier quantifier = Quantifier::One;
+        if (p < end)
+        {
+            switch (*p)
+            {
+            case '*': quantifier = Quantifier::ZeroOrMore; p++; break;
+            case '+': quantifier = Quantifier::OneOrMore; p++; break;
+            case '-': quantifier = Quantifier::ZeroOrMoreLazy; p++; break;
+            case '?': quantifier = Quantifier::ZeroOrOne; p++; break;
+            default: break;
+            }   /*switch*/
+        }
+        Node& node = addNode(NodeKind::Single);
+        node.m_quantifier = quantifier;
+        node.m_charSetOrd = static_cast<uint32_t>(r->m_charSets.size());
+        r->m_charSets.push_back(cs);
+    }
+
+    for (uint32_t i = 0; i < r->m_numCaptures; i++)
+    {
+        if (!isCaptureClosed[i])
+        {
+            errMsg = "unfinished capture";
+            return nullptr;
+        }
+    }
+
+    // If the first character matched must be one specific character, only the positions holding that character need to be tried
+    //
+    for (const Node& node : r->m_nodes)
+    {
+        if (node.m_kind == NodeKind::OpenCapture || node.m_kind == NodeKind::PositionCapture)
+        {
+            continue;
+        }
+        if (node.m_kind == NodeKind::Single && (node.m_quantifier == Quantifier::One || node.m_quantifier == Quantifier::OneOrMore))
+        {
+            const CharSet& cs = r->m_charSets[node.m_charSetOrd];
+            size_t numChars = 0;
+            for (uint64_t v : cs.m_bits)
+            {
+                numChars += static_cast<size_t>(__builtin_popcountll(v));
+            }
+            if (numChars == 1)
+            {
+                r->m_hasLiteralFirstChar = true;
+                for (int c = 0; c < 256; c++)
+                {
+                    if (cs.Contains(static_cast<uint8_t>(c)))
+                    {
+                        r->m_literalFirstChar = static_cast<uint8_t>(c);
+                        break;
+                    }
+                }
+            }
+        }
+        break;
+    }
+
+    return r.release();
+}
+
+const char* WARN_UNUSED LuaPattern::MatchBalance(MatchState& ms, const char* s, const Node& node)
+{
+    if (s >= ms.m_srcEnd || static_cast<uint8_t>(*s) != node.m_arg0)
+    {
+        return nullptr;
+    }
+    uint32_t depth = 1;
+    for (const char* q = s + 1; q < ms.m_srcEnd; q++)
+    {
+        uint8_t c = static_cast<uint8_t>(*q);
+        if (c == node.m_arg1)
+        {
+            depth--;
+            if (depth == 0)
+            {
+                return q + 1;
+            }
+        }
+        else if (c == node.m_arg0)
+        {
+            depth++;
+        }
+    }
+    return nullptr;
+}
+
+const char* WARN_UNUSED LuaPattern::MaxExpand(MatchState& ms, const char* s, uint32_t nodeOrd)
+{
+    const CharSet& cs = m_charSets[m_nodes[nodeOrd].m_charSetOrd];
+    size_t n = 0;
+    while (s + n < ms.m_srcEnd && cs.Contains(static_cast<uint8_t>(s[n])))
+    {
+        n++;
+    }
+    // Try to match the rest of the pattern with the maximum repetition, and give back one character at a time
+    //
+    while (true)
+    {
+        const char* res = DoMatch(ms, s + n, nodeOrd + 1);
+        if (res != nullptr)
+        {
+            return res;
+        }
+        if (n == 0)
+        {
+            return nullptr;
+        }
+        n--;
+    }
+}
+
+const char* WARN_UNUSED LuaPattern::MinExpand(MatchState& ms, const char* s, uint32_t nodeOrd)
+{
+    const CharSet& cs = m_charSets[m_nodes[nodeOrd].m_charSetOrd];
+    while (true)
+    {
+        const char* res = DoMatch(ms, s, nodeOrd + 1);
+        if (res != nullptr)
+        {
+            return res;
+        }
+        if (s < ms.m_srcEnd && cs.Contains(static_cast<uint8_t>(*s)))
+        {
+            s++;
+        }
+        else
+        {
+            return nullptr;
+        }
+    }
+}
+
+const char* WARN_UNUSED LuaPattern::DoMatch(MatchState& ms, const char* s, uint32_t nodeOrd)
+{
+    if (ms.m_depthLeft == 0)
+    {
+        ms.m_tooComplex = true;
+        return nullptr;
+    }
+    ms.m_depthLeft--;
+
+    const char* result;
+    uint32_t numNodes = static_cast<uint32_t>(m_nodes.size());
+    while (true)
+    {
+        if (nodeOrd == numNodes)
+        {
+            result = s;
+            break;
+        }
+
+        const Node& node = m_nodes[nodeOrd];
+        switch (node.m_kind)
+        {
+        case NodeKind::Single:
+        {
+            const CharSet& cs = m_charSets[node.m_charSetOrd];
+            bool isMatch = s < ms.m_srcEnd && cs.Contains(static_cast<uint8_t>(*s));
+            switch (node.m_quantifier)
+            {
+            case Quantifier::One:
+            {
+                if (!isMatch)
+                {
+                    result = nullptr;
+                    goto end;
+                }
+                s++;
+                nodeOrd++;
+                continue;
+            }
+            case Quantifier::ZeroOrOne:
+            {
+                if (isMatch)
+                {
+                    const char* res = DoMatch(ms, s + 1, nodeOrd + 1);
+                    if (res != nullptr)
+                    {
+                        result = res;
+                        goto end;
+                    }
+                }
+                nodeOrd++;
+                continue;
+            }
+            case Quantifier::ZeroOrMore:
+            {
+                result = MaxExpand(ms, s, nodeOrd);
+                goto end;
+            }
+            case Quantifier::OneOrMore:
+            {
+                result = isMatch ? MaxExpand(ms, s + 1, nodeOrd) : nullptr;
+                goto end;
+            }
+            case Quantifier::ZeroOrMoreLazy:
+            {
+                result = MinExpand(ms, s, nodeOrd);
+                goto end;
+            }
+            }   /*switch*/
+            __builtin_unreachable();
+        }
+        case NodeKind::OpenCapture:
+        case NodeKind::PositionCapture:
+        {
+            Capture& cap = ms.m_captures[ms.m_level];
+            cap.m_start = s;
+            cap.m_len = (node.m_kind == NodeKind::PositionCapture) ? x_positionCapture : x_unfinishedCapture;
+            ms.m_level++;
+            result = DoMatch(ms, s, nodeOrd + 1);
+            if (result == nullptr)
+            {
+                ms.m_level--;
+            }
+            goto end;
+        }
+        case NodeKind::CloseCapture:
+        {
+            uint32_t ord = ms.m_level;
+            do
+            {
+                assert(ord > 0);
+                ord--;
+            }
+            while (ms.m_captures[ord].m_len != x_unfinishedCapture);
+            ms.m_captures[ord].m_len = static_cast<size_t>(s - ms.m_captures[ord].m_start);
+            result = DoMatch(ms, s, nodeOrd + 1);
+            if (result == nullptr)
+            {
+                ms.m_captures[ord].m_len = x_unfinishedCapture;
+            }
+            goto end;
+        }
+        case NodeKind::Balance:
+        {
+            s = MatchBalance(ms, s, node);
+            if (s == nullptr)
+            {
+                result = nullptr;
+                goto end;
+            }
+            nodeOrd++;
+            continue;
+        }
+        case NodeKind::Frontier:
+        {
+            const CharSet& cs = m_charSets[node.m_charSetOrd];
+            uint8_t prev = (s == ms.m_srcBegin) ? 0 : static_cast<uint8_t>(s[-1]);
+            uint8_t cur = (s < ms.m_srcEnd) ? static_cast<uint8_t>(*s) : 0;
+            if (cs.Contains(prev) || !cs.Contains(cur))
+            {
+                result = nullptr;
+                goto end;
+            }
+            nodeOrd++;
+            continue;
+        }
+        case NodeKind::BackReference:
+        {
+            const Capture& cap = ms.m_captures[node.m_arg0];
+            assert(cap.m_len != x_unfinishedCapture);
+            // A position capture never matches, same as in Lua
+            //
+            if (cap.m_len == x_positionCapture || cap.m_len > static_cast<size_t>(ms.m_srcEnd - s) || memcmp(cap.m_start, s, cap.m_len) != 0)
+            {
+                result = nullptr;
+                goto end;
+            }
+            s += cap.m_len;
+            nodeOrd++;
+            continue;
+        }
+        case NodeKind::EndAnchor:
+        {
+            assert(nodeOrd + 1 == numNodes);
+            result = (s == ms.m_srcEnd) ? s : nullptr;
+            goto end;
+        }
+        }   /*switch*/
+    }
+
+end:
+    ms.m_depthLeft++;
+    return result;
+}
+
+LuaPattern::MatchResult WARN_UNUSED LuaPattern::MatchAt(MatchState& ms, const char* s, const char*& matchEnd /*out*/)
+{
+    assert(ms.m_srcBegin <= s && s <= ms.m_srcEnd);
+    ms.m_level = 0;
+    if (m_isLiteral)
+    {
+        size_t len = m_literal.length();
+        if (len > static_cast<size_t>(ms.m_srcEnd - s) || memcmp(s, m_literal.data(), len) != 0)
+        {
+            return MatchResult::NotMatched;
+        }
+        matchEnd = s + len;
+        return MatchResult::Matched;
+    }
+
+    ms.m_depthLeft = x_maxMatchDepth;
+    ms.m_tooComplex = false;
+    const char* res = DoMatch(ms, s, 0 /*nodeOrd*/);
+    if (unlikely(ms.m_tooComplex))
+    {
+        return MatchResult::TooComplex;
+    }
+    if (res == nullptr)
+    {
+        return MatchResult::NotMatched;
+    }
+    matchEnd = res;
+    return MatchResult::Matched;
+}
+
+LuaPattern::MatchResult WARN_UNUSED LuaPattern::Find(MatchState& ms, const char* s, const char*& matchStart /*out*/, const char*& matchEnd /*out*/)
+{
+    assert(ms.m_srcBegin <= s && s <= ms.m_srcEnd);
+    if (m_isLiteral && !m_isAnchored)
+    {
+        ms.m_level = 0;
+        size_t len = m_literal.length();
+        const char* pos = reinterpret_cast<const char*>(memmem(s, static_cast<size_t>(ms.m_srcEnd - s), m_literal.data(), len));
+        if (pos == nullptr)
+        {
+            return MatchResult::NotMatched;
+        }
+        matchStart = pos;
+        matchEnd = pos + len;
+        return MatchResult::Matched;
+    }
+
+    if (m_isAnchored)
+    {
+        matchStart = s;
+        return MatchAt(ms, s, matchEnd /*out*/);
+    }
+
+    while (true)
+    {
+        if (m_hasLiteralFirstChar)
+        {
+            s = reinterpret_cast<const char*>(memchr(s, m_literalFirstChar, static_cast<size_t>(ms.m_srcEnd - s)));
+            if (s == nullptr)
+            {
+                return MatchResult::NotMatched;
+            }
+        }
+        MatchResult res = MatchAt(ms, s, matchEnd /*out*/);
+        if (res != MatchResult::NotMatched)
+        {
+            matchStart = s;
+            return res;
+        }
+        // Note that an empty match at the end of the string is possible, so the end of the string is also tried
+        //
+        if (s == ms.m_srcEnd)
+        {
+            return MatchResult::NotMatched;
+        }
+        s++;
+    }
+}
+
+LuaPattern* WARN_UNUSED GetCompiledLuaPattern(VM* vm, HeapString* pattern, bool handleAnchor, const char*& errMsg /*out*/)
+{
+    // Strings are 8-byte aligned, so the low bit of the key tells whether '^' is an anchor
+    //
+    uintptr_t key = reinterpret_cast<uintptr_t>(pattern) | (handleAnchor ? 0 : 1);
+    std::unordered_map<uintptr_t, LuaPattern*>& cache = vm->GetCompiledLuaPatternCache();
+    auto it = cache.find(key);
+    if (likely(it != cache.end()))
+    {
+        return it->second;
+    }
+
+    LuaPattern* res = LuaPattern::Compile(reinterpret_cast<const char*>(pattern->m_string), pattern->m_length, handleAnchor, errMsg /*out*/);
+    if (res == nullptr)
+    {
+        return nullptr;
+    }
+    if (cache.size() >= x_maxCachedLuaPatterns)
+    {
+        for (auto& entry : cache)
+        {
+            delete entry.second;
+        }
+        cache.clear();
+    }
+    cache[key] = res;
+    return res;
+}
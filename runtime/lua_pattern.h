@@ -0,0 +1,209 @@
+#pragma once
+
+#include "common_utils.h"
+
+class VM;
+class HeapString;
+
+// A Lua pattern (https://www.lua.org/manual/5.1/manual.html#5.4.1), compiled for string.find, string.match, string.gmatch and string.gsub
+//
+// Compiling decodes the pattern once into a list of nodes, where every single-character class (a literal character, '.', '%a', a set
+// like '[%w_]', etc) becomes a 256-bit bitmap, so matching a character is a single bit test no matter how complex the class is.
+// The matcher is the usual backtracking matcher of Lua's lstrlib, running over the nodes instead of re-parsing the pattern text at
+// every step.
+//
+// On top of that, the searching loop avoids trying the matcher at every position when possible:
+// a pattern without any special character is searched with memmem, and a pattern that starts with a literal character only tries
+// the positions found by memchr (both are vectorized in glibc).
+//
+// Compiled patterns are cached by the VM, keyed by the address of the (interned) pattern string, see GetCompiledLuaPattern.
+//
+class LuaPattern
+{
+    MAKE_NONCOPYABLE(LuaPattern);
+    MAKE_NONMOVABLE(LuaPattern);
+
+public:
+    static constexpr size_t x_maxCaptures = 32;
+
+    // The recursion depth limit of the matcher, same as Lua 5.2+
+    //
+    static constexpr uint32_t x_maxMatchDepth = 200;
+
+    // The 'len' of a capture that records a position ('()') instead of a substring
+    //
+    static constexpr size_t x_positionCapture = static_cast<size_t>(-2);
+
+    // If 'handleAnchor' is true, a leading '^' anchors the match at the start position (string.find, string.match and string.gsub).
+    // Otherwise it is an ordinary character (string.gmatch).
+    // Return nullptr and set 'errMsg' if the pattern is malformed.
+    //
+    static LuaPattern* WARN_UNUSED Compile(const char* pattern, size_t len, bool handleAnchor, const char*& errMsg /*out*/);
+
+    // Whether the string contains any of the characters that Lua's string.find checks to decide if a pattern can be
+    // searched as a plain string. Note that ')' is not one of them, same as Lua.
+    //
+    static bool WARN_UNUSED HasSpecialCharacters(const char* str, size_t len);
+
+    bool IsAnchored() { return m_isAnchored; }
+
+    // The number of captures in the pattern, not counting the implicit whole-match capture
+    //
+    size_t GetNumCaptures() { return m_numCaptures; }
+
+    struct Capture
+    {
+        const char* m_start;
+        // x_positionCapture for position captures
+        //
+        size_t m_len;
+    };
+
+    enum class MatchResult
+    {
+        Matched,
+        NotMatched,
+        // The recursion depth limit is exceeded, Lua reports this as "pattern too complex"
+        //
+        TooComplex
+    };
+
+    // The state of one match of the pattern against a string [srcBegin, srcEnd)
+    //
+    struct MatchState
+    {
+        MatchState(const char* srcBegin, const char* srcEnd)
+            : m_srcBegin(srcBegin)
+            , m_srcEnd(srcEnd)
+            , m_depthLeft(x_maxMatchDepth)
+            , m_level(0)
+            , m_tooComplex(false)
+        { }
+
+        const char* m_srcBegin;
+        const char* m_srcEnd;
+        uint32_t m_depthLeft;
+        uint32_t m_level;
+        bool m_tooComplex;
+        Capture m_captures[x_maxCaptures];
+    };
+
+    // Try to match the pattern starting exactly at 's'. On success, 'matchEnd' is set to the end of the match, and the captures are in 'ms'.
+    //
+    MatchResult WARN_UNUSED MatchAt(MatchState& ms, const char* s, const char*& matchEnd /*out*/);
+
+    // Find the first match that starts at or after 's' (only at 's' if the pattern is anchored).
+    // On success, 'matchStart' and 'matchEnd' are set to the range of the match, and the captures are in 'ms'.
+    //
+    MatchResult WARN_UNUSED Find(MatchState& ms, const char* s, const char*& matchStart /*out*/, const char*& matchEnd /*out*/);
+
+private:
+    LuaPattern() = default;
+
+    struct CharSet
+    {
+        bool ALWAYS_INLINE Contains(uint8_t c) const
+        {
+            return (m_bits[c / 64] >> (c % 64)) & 1;
+        }
+
+        void Add(uint8_t c)
+        {
+            m_bits[c / 64] |= static_cast<uint64_t>(1) << (c % 64);
+        }
+
+        void Invert()
+        {
+            for (uint64_t& v : m_bits) { v = ~v; }
+        }
+
+        uint64_t m_bits[4];
+    };
+
+    enum class NodeKind : uint8_t
+    {
+        // Matches one character in m_charSet, with a quantifier
+        //
+        Single,
+        // '('
+        //
+        OpenCapture,
+        // '()'
+        //
+        PositionCapture,
+        // ')'
+        //
+        CloseCapture,
+        // '%bxy'
+        //
+        Balance,
+        // '%f[set]'
+        //
+        Frontier,
+        // '%1' to '%9'
+        //
+        BackReference,
+        // A '$' at the end of the pattern
+        //
+        EndAnchor
+    };
+
+    enum class Quantifier : uint8_t
+    {
+        One,
+        // '*'
+        //
+        ZeroOrMore,
+        // '+'
+        //
+        OneOrMore,
+        // '-'
+        //
+        ZeroOrMoreLazy,
+        // '?'
+        //
+        ZeroOrOne
+    };
+
+    struct Node
+    {
+        NodeKind m_kind;
+        Quantifier m_quantifier;
+        // The two characters of '%bxy', or the capture ordinal of a back reference
+        //
+        uint8_t m_arg0;
+        uint8_t m_arg1;
+        // Index into m_charSets for Single and Frontier
+        //
+        uint32_t m_charSetOrd;
+    };
+
+    static const char* WARN_UNUSED ParseCharClass(const char* p, const char* end, CharSet& result /*out*/, const char*& errMsg /*out*/);
+
+    const char* WARN_UNUSED DoMatch(MatchState& ms, const char* s, uint32_t nodeOrd);
+    const char* WARN_UNUSED MaxExpand(MatchState& ms, const char* s, uint32_t nodeOrd);
+    const char* WARN_UNUSED MinExpand(MatchState& ms, const char* s, uint32_t nodeOrd);
+    const char* WARN_UNUSED MatchBalance(MatchState& ms, const char* s, const Node& node);
+
+    std::vector<Node> m_nodes;
+    std::vector<CharSet> m_charSets;
+
+    // If the pattern has no special characters at all, the literal string (after removing the anchor).
+    // The pattern is then matched with memcmp/memmem.
+    //
+    bool m_isLiteral;
+    bool m_isAnchored;
+    // If the first node matches exactly one literal character, the match can only start at that character
+    //
+    bool m_hasLiteralFirstChar;
+    uint8_t m_literalFirstChar;
+    uint32_t m_numCaptures;
+    std::string m_literal;
+};
+
+// Get the compiled pattern from the VM's cache, compiling and caching it if needed.
+// The cache holds the pattern string weakly: the entry goes away when the string is collected (see SweepWeakReferences).
+// So the returned pattern stays valid as long as 'pattern' is alive and no other pattern is compiled.
+// Return nullptr and set 'errMsg' if the pattern is malformed.
+//
+LuaPattern* WARN_UNUSED GetCompiledLuaPattern(VM* vm, HeapString* pattern, bool handleAnchor, const char*& errMsg /*out*/);
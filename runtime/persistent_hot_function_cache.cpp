@@ -0,0 +1,162 @@
+#include "persistent_hot_function_cache.h"
+#include "runtime_utils.h"
+#include "hash_functions.h"
+
+PersistentHotFunctionCache::PersistentHotFunctionCache(const std::string& path)
+    : m_path(path)
+    , m_mappedFile(nullptr)
+    , m_mappedFileSize(0)
+    , m_persistedKeys(nullptr)
+    , m_numPersistedKeys(0)
+{ }
+
+PersistentHotFunctionCache::~PersistentHotFunctionCache()
+{
+    if (m_mappedFile != nullptr)
+    {
+        munmap(m_mappedFile, m_mappedFileSize);
+    }
+}
+
+PersistentHotFunctionCache* WARN_UNUSED PersistentHotFunctionCache::Open(const std::string& path)
+{
+    PersistentHotFunctionCache* cache = new PersistentHotFunctionCache(path);
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return cache;
+    }
+    Auto(close(fd));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+    {
+        return cache;
+    }
+    size_t fileSize = static_cast<size_t>(st.st_size);
+
+    void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0 /*offset*/);
+    if (mapped == MAP_FAILED)
+    {
+        return cache;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(mapped);
+    if (header->m_magic != x_magic || header->m_version != x_version || fileSize != sizeof(Header) + sizeof(uint64_t) * header->m_numKeys)
+    {
+        munmap(mapped, fileSize);
+        return cache;
+    }
+
+    cache->m_mappedFile = mapped;
+    cache->m_mappedFileSize = fileSize;
+    cache->m_persistedKeys = reinterpret_cast<const uint64_t*>(header + 1);
+    cache->m_numPersistedKeys = header->m_numKeys;
+    return cache;
+}
+
+uint64_t WARN_UNUSED PersistentHotFunctionCache::ComputeKey(UnlinkedCodeBlock* ucb)
+{
+    XXH3_state_t state;
+    [[maybe_unused]] XXH_errorcode err = XXH3_64bits_reset(&state);
+    assert(err == XXH_OK);
+
+    auto update = [&](const void* data, size_t len)
+    {
+        [[maybe_unused]] XXH_errorcode e = XXH3_64bits_update(&state, data, len);
+        assert(e == XXH_OK);
+    };
+
+    uint32_t shape[6] = {
+        ucb->m_numFixedArguments,
+        static_cast<uint32_t>(ucb->m_hasVariadicArguments),
+        ucb->m_numUpvalues,
+        ucb->m_stackFrameNumSlots,
+        ucb->m_cstTableLength,
+        ucb->m_bytecodeLength
+    };
+    update(shape, sizeof(shape));
+    update(ucb->m_bytecode, ucb->m_bytecodeLength);
+
+    // String constants are hashed by content. Other constants are not hashed at all: they cannot be told apart from
+    // the raw UnlinkedCodeBlock pointers of the child functions (see comments on the constant table), which differ between runs.
+    // So two functions differing only in a numeric constant share the key, which is harmless for a tier-up hint.
+    //
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    for (uint32_t i = 0; i < ucb->m_cstTableLength; i++)
+    {
+        TValue tv(ucb->m_cstTable[i]);
+        if (tv.Is<tString>())
+        {
+            HeapString* s = TranslateToRawPointer(vm, tv.As<tString>());
+            uint32_t idx = i;
+            update(&idx, sizeof(uint32_t));
+            update(s->m_string, s->m_length);
+        }
+    }
+
+    return XXH3_64bits_digest(&state);
+}
+
+bool WARN_UNUSED PersistentHotFunctionCache::ContainsHotFunction(uint64_t key)
+{
+    if (std::binary_search(m_persistedKeys, m_persistedKeys + m_numPersistedKeys, key))
+    {
+        return true;
+    }
+    return m_newKeys.count(key) > 0;
+}
+
+void PersistentHotFunctionCache::RecordHotFunction(uint64_t key)
+{
+    if (std::binary_search(m_persistedKeys, m_persistedKeys + m_numPersistedKeys, key))
+    {
+        return;
+    }
+    m_newKeys.insert(key);
+}
+
+bool WARN_UNUSED PersistentHotFunctionCache::Flush()
+{
+    if (m_newKeys.empty())
+    {
+        return true;
+    }
+
+    std::vector<uint64_t> keys(m_persistedKeys, m_persistedKeys + m_numPersistedKeys);
+    keys.insert(keys.end(), m_newKeys.begin(), m_newKeys.end());
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    if (keys.size() > std::numeric_limits<uint32_t>::max())
+    {
+        return false;
+    }
+
+    Header header {
+        .m_magic = x_magic,
+        .m_version = x_version,
+        .m_numKeys = static_cast<uint32_t>(keys.size())
+    };
+
+    // Write to a temporary file and rename it over the cache file, so readers never see a partially-written file
+    //
+    std::string tmpPath = m_path + ".tmp." + std::to_string(getpid());
+    FILE* fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        return false;
+    }
+    bool success = (fwrite(&header, sizeof(Header), 1, fp) == 1);
+    if (success && keys.size() > 0)
+    {
+        success = (fwrite(keys.data(), sizeof(uint64_t), keys.size(), fp) == keys.size());
+    }
+    success = (fclose(fp) == 0) && success;
+    if (!success || rename(tmpPath.c_str(), m_path.c_str()) != 0)
+    {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
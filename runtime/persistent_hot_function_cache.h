@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common_utils.h"
+
+class UnlinkedCodeBlock;
+
+// An optional on-disk cache that remembers, across process restarts, which functions got hot enough to tier up to the baseline JIT.
+// Only the keys identifying the hot functions are persisted, not the code of the functions.
+//
+// On a warm start, a CodeBlock whose function is in the cache is compiled to baseline JIT code right when it is created,
+// so the function does not spend its warm-up in the interpreter and does not pause for the tier-up later.
+//
+// Functions are identified by a hash of their UnlinkedCodeBlock content (see ComputeKey), so the cache stays valid as
+// long as the script is unchanged, and an edited function simply misses the cache.
+//
+// Note that the JIT code itself is not persisted: the baseline JIT patches process-specific absolute addresses
+// (CodeBlock, constant table, inline cache and runtime function addresses) into the stencils, and we do not keep a
+// relocation record for them. The baseline JIT codegen is a single linear pass over the bytecode, so it is not what
+// dominates the warm-up latency anyway.
+//
+// File format: [ Header ] [ sorted uint64_t keys ]
+// The file is mmap'ed read-only when opened. New keys are kept in memory, and written out by Flush, which atomically
+// replaces the file, so concurrent processes sharing one cache file never see a partially-written file.
+//
+class PersistentHotFunctionCache
+{
+    MAKE_NONCOPYABLE(PersistentHotFunctionCache);
+    MAKE_NONMOVABLE(PersistentHotFunctionCache);
+
+public:
+    // A missing, unreadable or malformed file is treated as an empty cache
+    //
+    static PersistentHotFunctionCache* WARN_UNUSED Open(const std::string& path);
+
+    ~PersistentHotFunctionCache();
+
+    static uint64_t WARN_UNUSED ComputeKey(UnlinkedCodeBlock* ucb);
+
+    bool WARN_UNUSED ContainsHotFunction(uint64_t key);
+
+    void RecordHotFunction(uint64_t key);
+
+    // Write the cache file if new hot functions have been recorded since it was opened.
+    // Return false on I/O error.
+    //
+    bool WARN_UNUSED Flush();
+
+    size_t GetNumPersistedHotFunctions() { return m_numPersistedKeys; }
+    size_t GetNumNewHotFunctions() { return m_newKeys.size(); }
+
+    struct Header
+    {
+        uint64_t m_magic;
+        uint32_t m_version;
+        uint32_t m_numKeys;
+    };
+    static_assert(sizeof(Header) == 16);
+
+    static constexpr uint64_t x_magic = 0x314354494A524A4CULL;     // "LJRJITC1"
+
+    // Bump this when ComputeKey changes
+    //
+    static constexpr uint32_t x_version = 1;
+
+private:
+    PersistentHotFunctionCache(const std::string& path);
+
+    std::string m_path;
+    void* m_mappedFile;
+    size_t m_mappedFileSize;
+    const uint64_t* m_persistedKeys;
+    size_t m_numPersistedKeys;
+    std::unordered_set<uint64_t> m_newKeys;
+};
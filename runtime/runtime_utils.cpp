@@ -7,6 +7,7 @@
 #include "generated/get_guest_language_function_interpreter_entry_point.h"
 #include "json_utils.h"
 #include "bytecode_builder.h"
+#include "persistent_hot_function_cache.h"
 #include "drt/baseline_jit_codegen_helper.h"
 
 const size_t x_num_bytecode_metadata_struct_kinds_ = x_num_bytecode_metadata_struct_kinds;
@@ -25,10 +26,6 @@ TValue WARN_UNUSED MakeErrorMessageForUnableToCall(TValue badValue)
     {
         snprintf(msg, 100, "attempt to call a %s value", ty);
     };
-    auto makeMsg2 = [&](int d)
-    {
-        snprintf(msg, 100, "attempt to call a (internal type %d) value", d);
-    };
 
     if (badValue.IsInt32())
     {
@@ -73,9 +70,8 @@ TValue WARN_UNUSED MakeErrorMessageForUnableToCall(TValue badValue)
         }
         else
         {
-            // TODO: handle userdata type
-            //
-            makeMsg2(static_cast<int>(p->m_type));
+            assert(p->m_type == HeapEntityType::Userdata);
+            makeMsg("userdata");
         }
     }
     return MakeErrorMessage(msg);
@@ -86,6 +82,15 @@ void* WARN_UNUSED UnlinkedCodeBlock::GetInterpreterEntryPoint()
     return generated::GetGuestLanguageFunctionEntryPointForInterpreter(m_hasVariadicArguments, m_numFixedArguments);
 }
 
+void* WARN_UNUSED UnlinkedCodeBlock::GetInterpreterExactArityEntryPoint()
+{
+    if (m_numFixedArguments > x_interpreterMaxSpecializedNumFixedParams)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<void*>(deegen_interpreter_exact_arity_entry_table[m_hasVariadicArguments][m_numFixedArguments][1]);
+}
+
 CodeBlock* WARN_UNUSED CodeBlock::Create(VM* vm, UnlinkedCodeBlock* ucb, UserHeapPointer<TableObject> globalObject)
 {
     assert(ucb->m_bytecodeMetadataLength % 8 == 0);
@@ -120,15 +125,22 @@ CodeBlock* WARN_UNUSED CodeBlock::Create(VM* vm, UnlinkedCodeBlock* ucb, UserHea
     }
     cb->m_floCodeBlock = nullptr;
     cb->m_owner = ucb;
+    vm->GetUserHeapGarbageCollector()->RegisterCodeBlock(cb);
 
     ForEachBytecodeMetadata(cb, []<typename T>(T* md) ALWAYS_INLINE {
         md->Init();
     });
 
-    // Immediately compile the CodeBlock to baseline JIT code if requested by user.
+    // Immediately compile the CodeBlock to baseline JIT code if requested by user,
+    // or if the function got hot in an earlier run (so it would tier up soon anyway).
     // Note that this must be done after we have set up all the fields in the CodeBlock
     //
-    if (vm->IsEngineStartingTierBaselineJit())
+    bool shouldCompileNow = vm->IsEngineStartingTierBaselineJit();
+    if (!shouldCompileNow && vm->InterpreterCanTierUpFurther() && vm->GetPersistentHotFunctionCache() != nullptr)
+    {
+        shouldCompileNow = vm->GetPersistentHotFunctionCache()->ContainsHotFunction(PersistentHotFunctionCache::ComputeKey(ucb));
+    }
+    if (shouldCompileNow)
     {
         BaselineCodeBlock* bcb = deegen_baseline_jit_do_codegen(cb);
         assert(cb->m_baselineCodeBlock == bcb);
@@ -157,8 +169,10 @@ void CodeBlock::UpdateBestEntryPoint(void* newEntryPoint)
                 break;
             }
             // We rely on the ABI layout that the codePtr resides right before the doubly link
+            // If the call site passes a constant number of arguments, the IC may cache the exact-arity interpreter entry instead
             //
-            assert(UnalignedLoad<void*>(curAnchor - 8) == oldBestEntryPoint);
+            assert(UnalignedLoad<void*>(curAnchor - 8) == oldBestEntryPoint ||
+                   (oldBestEntryPoint == m_owner->GetInterpreterEntryPoint() && UnalignedLoad<void*>(curAnchor - 8) == m_owner->GetInterpreterExactArityEntryPoint()));
             UnalignedStore<void*>(curAnchor - 8, newEntryPoint);
         }
     }
@@ -223,6 +237,9 @@ UserHeapPointer<FunctionObject> WARN_UNUSED NO_INLINE FunctionObject::CreateAndF
         AssertIff(!uvmt.m_isImmutable, (uv.IsPointer() && uv.GetHeapEntityType() == HeapEntityType::Upvalue));
         TCSet(r->m_upvalues[ord], uv);
     }
+    // Creating the upvalues may have triggered a garbage collection that promoted 'r'
+    //
+    WriteBarrier(r);
     return r;
 }
 
@@ -236,21 +253,170 @@ CoroutineRuntimeContext* CoroutineRuntimeContext::Create(VM* vm, UserHeapPointer
     r->m_numVariadicRets = 0;
     r->m_variadicRetSlotBegin = 0;
     r->m_upvalueList.m_value = 0;
-    size_t bytesToAllocate = numStackSlots * sizeof(TValue);
-    bytesToAllocate = RoundUpToMultipleOf<VM::x_pageSize>(bytesToAllocate);
-    void* stackAreaWithOverflowProtection = mmap(nullptr, bytesToAllocate + x_stackOverflowProtectionAreaSize * 2,
+    r->m_suspendPointStackBase = nullptr;
+    assert(numStackSlots <= x_maxStackSlots);
+    std::vector<TValue*>& stackPool = vm->GetCoroutineStackPool();
+    if (numStackSlots == x_defaultStackSlots && !stackPool.empty())
+    {
+        r->m_stackBegin = stackPool.back();
+        stackPool.pop_back();
+    }
+    else
+    {
+        r->m_stackBegin = AllocateStack(numStackSlots + x_stackReservedSlots);
+    }
+    r->m_numStackSlots = static_cast<uint32_t>(numStackSlots + x_stackReservedSlots);
+    vm->GetUserHeapGarbageCollector()->RegisterCoroutine(r);
+    return r;
+}
+
+TValue* WARN_UNUSED CoroutineRuntimeContext::AllocateStack(size_t numSlots)
+{
+    size_t bytesToAllocate = RoundUpToMultipleOf<VM::x_pageSize>(numSlots * sizeof(TValue));
+    void* stackAreaWithOverflowProtection = mmap(nullptr, bytesToAllocate + x_stackOverflowProtectionAreaSize,
                                                  PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
     VM_FAIL_WITH_ERRNO_IF(stackAreaWithOverflowProtection == MAP_FAILED,
                           "Failed to reserve address range of length %llu",
-                          static_cast<unsigned long long>(bytesToAllocate + x_stackOverflowProtectionAreaSize * 2));
+                          static_cast<unsigned long long>(bytesToAllocate + x_stackOverflowProtectionAreaSize));
 
-    void* stackArea = mmap(reinterpret_cast<uint8_t*>(stackAreaWithOverflowProtection) + x_stackOverflowProtectionAreaSize,
-                           bytesToAllocate, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    void* stackArea = mmap(stackAreaWithOverflowProtection, bytesToAllocate, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
     VM_FAIL_WITH_ERRNO_IF(stackArea == MAP_FAILED,
                           "Out of Memory: Allocation of length %llu failed", static_cast<unsigned long long>(bytesToAllocate));
-    assert(stackArea == reinterpret_cast<uint8_t*>(stackAreaWithOverflowProtection) + x_stackOverflowProtectionAreaSize);
-    r->m_stackBegin = reinterpret_cast<TValue*>(stackArea);
-    return r;
+    assert(stackArea == stackAreaWithOverflowProtection);
+    return reinterpret_cast<TValue*>(stackArea);
+}
+
+void CoroutineRuntimeContext::FreeStack(TValue* stackBegin, size_t numSlots)
+{
+    size_t stackBytes = RoundUpToMultipleOf<VM::x_pageSize>(numSlots * sizeof(TValue));
+    int r = munmap(stackBegin, stackBytes + x_stackOverflowProtectionAreaSize);
+    LOG_WARNING_WITH_ERRNO_IF(r != 0, "Cannot unmap coroutine stack");
+}
+
+void CoroutineRuntimeContext::ReleaseStack()
+{
+    assert(m_coroutineStatus.IsDead());
+    assert(m_stackBegin != nullptr);
+    CloseUpvalues(m_stackBegin);
+    assert(m_upvalueList.m_value == 0);
+
+    TValue* stackBegin = m_stackBegin;
+    uint32_t numStackSlots = m_numStackSlots;
+    m_stackBegin = nullptr;
+    m_suspendPointStackBase = nullptr;
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    std::vector<TValue*>& stackPool = vm->GetCoroutineStackPool();
+    if (numStackSlots == x_defaultStackSlots + x_stackReservedSlots && stackPool.size() < x_maxPooledStacks)
+    {
+        // The GC scans the whole stack (including the reserved slots) conservatively, so every stale value must be cleared,
+        // otherwise it would keep dead objects alive for the whole lifetime of the next coroutine using this stack.
+        // The first x_defaultStackSlots slots hold the stack frames and are almost certainly dirty, so they are cleared by memset.
+        // The reserved slots are rarely touched (only by library functions that return lots of values), so their pages are
+        // dropped instead, which makes them read as zero without committing the untouched pages.
+        //
+        static_assert((x_defaultStackSlots * sizeof(TValue)) % VM::x_pageSize == 0);
+        memset(stackBegin, 0, sizeof(TValue) * x_defaultStackSlots);
+        int r = madvise(stackBegin + x_defaultStackSlots, sizeof(TValue) * x_stackReservedSlots, MADV_DONTNEED);
+        if (unlikely(r != 0))
+        {
+            memset(stackBegin + x_defaultStackSlots, 0, sizeof(TValue) * x_stackReservedSlots);
+        }
+        stackPool.push_back(stackBegin);
+    }
+    else
+    {
+        // The GC thread may be scanning the stack, just like when the stack is grown
+        //
+        vm->GetUserHeapGarbageCollector()->FreeStackMaybeInUseByMarker(stackBegin, numStackSlots);
+    }
+}
+
+TValue* WARN_UNUSED NO_INLINE CoroutineRuntimeContext::GrowStack(TValue* stackBase, size_t numSlotsNeeded)
+{
+    TValue* oldBegin = m_stackBegin;
+    size_t oldNumSlots = m_numStackSlots;
+    TValue* oldEnd = oldBegin + oldNumSlots;
+    assert(oldBegin <= stackBase && stackBase <= oldEnd);
+    assert(oldNumSlots > x_stackReservedSlots);
+
+    size_t slotsInUse = static_cast<size_t>(stackBase - oldBegin) + numSlotsNeeded;
+    VM_FAIL_IF(slotsInUse > x_maxStackSlots,
+               "Stack overflow: the stack of a coroutine cannot grow beyond %llu slots", static_cast<unsigned long long>(x_maxStackSlots));
+
+    size_t newNumUsableSlots = (oldNumSlots - x_stackReservedSlots) * 2;
+    while (newNumUsableSlots < slotsInUse)
+    {
+        newNumUsableSlots *= 2;
+    }
+    newNumUsableSlots = std::min(newNumUsableSlots, x_maxStackSlots);
+    size_t newNumSlots = newNumUsableSlots + x_stackReservedSlots;
+
+    // Nothing past the 'numSlotsNeeded' slots starting at 'stackBase' can be live, so copying only the slots in use
+    // avoids touching the pages of the reserved slots that were never used
+    //
+    TValue* newBegin = AllocateStack(newNumSlots);
+    memcpy(newBegin, oldBegin, sizeof(TValue) * std::min(slotsInUse, oldNumSlots));
+
+    auto rebase = [&]<typename T>(T* ptr) -> T*
+    {
+        TValue* p = reinterpret_cast<TValue*>(ptr);
+        if (oldBegin <= p && p < oldEnd)
+        {
+            return reinterpret_cast<T*>(newBegin + (p - oldBegin));
+        }
+        return ptr;
+    };
+
+    // Rebase the caller chain. The chain ends at a stack frame whose caller is nullptr: the frame set up by
+    // DeegenEnterVMFromC for the root coroutine, or the dummy frame set up by coroutine.create.
+    //
+    TValue* newStackBase = rebase(stackBase);
+    {
+        TValue* frameBase = newStackBase;
+        while (true)
+        {
+            StackFrameHeader* hdr = StackFrameHeader::Get(frameBase);
+            if (hdr->m_caller == nullptr)
+            {
+                break;
+            }
+            TValue* oldCaller = reinterpret_cast<TValue*>(hdr->m_caller);
+            assert(oldBegin <= oldCaller && oldCaller < oldEnd);
+            TValue* newCaller = rebase(oldCaller);
+            hdr->m_caller = newCaller;
+            frameBase = newCaller;
+        }
+    }
+
+    // Rebase the open upvalues. They all point into this stack, and the list order (by descending address) is preserved.
+    //
+    {
+        VM* vm = VM::GetActiveVMForCurrentThread();
+        UserHeapPointer<Upvalue> cur = m_upvalueList;
+        while (cur.m_value != 0)
+        {
+            Upvalue* uv = TranslateToRawPointer(vm, cur.As());
+            assert(!uv->m_isClosed);
+            assert(oldBegin <= uv->m_ptr && uv->m_ptr < oldEnd);
+            uv->m_ptr = rebase(uv->m_ptr);
+            cur = uv->m_prev;
+        }
+    }
+
+    // This is stale if the coroutine is running, but rebasing it is harmless
+    //
+    m_suspendPointStackBase = rebase(m_suspendPointStackBase);
+
+    // The concurrent marker reads m_numStackSlots before m_stackBegin, so the new stack must be published first,
+    // and the old stack must stay alive until marking completes
+    //
+    m_stackBegin = newBegin;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    m_numStackSlots = static_cast<uint32_t>(newNumSlots);
+    VM::GetActiveVMForCurrentThread()->GetUserHeapGarbageCollector()->FreeStackMaybeInUseByMarker(oldBegin, static_cast<uint32_t>(oldNumSlots));
+
+    return newStackBase;
 }
 
 BaselineCodeBlock* WARN_UNUSED BaselineCodeBlock::Create(CodeBlock* cb,
@@ -270,10 +436,6 @@ BaselineCodeBlock* WARN_UNUSED BaselineCodeBlock::Create(CodeBlock* cb,
     res->m_slowPathDataStreamLength = slowPathDataStreamLength;
     res->m_jitRegionStart = jitRegionStart;
     res->m_jitRegionSize = jitRegionSize;
-
-    TestAssert(cb->m_baselineCodeBlock == nullptr);
-    cb->m_baselineCodeBlock = res;
-
     return res;
 }
 
@@ -310,6 +472,13 @@ JitCallInlineCacheEntry* WARN_UNUSED JitCallInlineCacheEntry::Create(VM* vm,
         assert(entry->IsOnDoublyLinkedList());
     }
 
+    // A direct-call IC keeps the cached FunctionObject alive
+    //
+    if (trait->m_isDirectCallMode)
+    {
+        vm->GetUserHeapGarbageCollector()->RegisterDirectCallJitIcEntry(entry);
+    }
+
     return entry;
 }
 
@@ -320,6 +489,10 @@ void JitCallInlineCacheEntry::Destroy(VM* vm)
     {
         RemoveFromDoublyLinkedList();
     }
+    if (GetIcTrait()->m_isDirectCallMode)
+    {
+        vm->GetUserHeapGarbageCollector()->UnregisterDirectCallJitIcEntry(this);
+    }
     vm->GetJITMemoryAlloc()->Free(GetJitRegionStart());
     vm->DeallocateSpdsRegionObject(this);
 }
@@ -496,3 +669,42 @@ void* WARN_UNUSED JitCallInlineCacheSite::InsertInClosureCallMode(uint16_t dcIcT
     m_numEntries++;
     return entry->GetJitRegionStart();
 }
+
+JitCallMegamorphicProfile* WARN_UNUSED JitCallMegamorphicProfile::Create(VM* vm)
+{
+    JitCallMegamorphicProfile* profile = vm->AllocateFromSpdsRegionUninitialized<JitCallMegamorphicProfile>();
+    ConstructInPlace(profile);
+    for (Slot& slot : profile->m_slots)
+    {
+        slot.m_target.m_value = 0;
+        slot.m_count = 0;
+    }
+    profile->m_numUntrackedCalls = 0;
+    return profile;
+}
+
+#ifdef ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
+void JitCallInlineCacheSite::RecordMegamorphicCallTarget(SystemHeapPointer<ExecutableCode> target)
+{
+    assert(m_numEntries == x_maxEntries);
+
+    VM* vm = VM::GetActiveVMForCurrentThread();
+    SpdsPtr<JitCallMegamorphicProfile> profile = TCGet(m_megamorphicProfile);
+    if (unlikely(profile.IsInvalidPtr()))
+    {
+        profile = JitCallMegamorphicProfile::Create(vm);
+        TCSet(m_megamorphicProfile, profile);
+    }
+    TranslateToRawPointer(vm, profile.AsPtr())->Record(target);
+}
+
+JitCallMegamorphicProfile* WARN_UNUSED JitCallInlineCacheSite::GetMegamorphicProfile(VM* vm)
+{
+    SpdsPtr<JitCallMegamorphicProfile> profile = TCGet(m_megamorphicProfile);
+    if (profile.IsInvalidPtr())
+    {
+        return nullptr;
+    }
+    return TranslateToRawPointer(vm, profile.AsPtr());
+}
+#endif
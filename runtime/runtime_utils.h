@@ -5,6 +5,7 @@
 #include "lj_strscan.h"
 #include "memory_ptr.h"
 #include "vm.h"
+#include "gc.h"
 #include "structure.h"
 #include "table_object.h"
 #include "spds_doubly_linked_list.h"
@@ -77,47 +78,6 @@ class CodeBlock;
 
 class Upvalue;
 
-inline void NO_RETURN WriteBarrierSlowPath(void* /*obj*/, uint8_t* /*cellState*/)
-{
-    // TODO: implement
-    ReleaseAssert(false && "unimplemented");
-}
-
-template<size_t cellStateOffset, typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, uint8_t>>>
-void NO_INLINE WriteBarrierSlowPathEnter(T ptr)
-{
-    uint8_t* raw = TranslateToRawPointer(ptr);
-    WriteBarrierSlowPath(raw, raw + cellStateOffset);
-}
-
-template void NO_INLINE WriteBarrierSlowPathEnter<offsetof_member_v<&UserHeapGcObjectHeader::m_cellState>, uint8_t*, void>(uint8_t* ptr);
-template void NO_INLINE WriteBarrierSlowPathEnter<offsetof_member_v<&UserHeapGcObjectHeader::m_cellState>, HeapPtr<uint8_t>, void>(HeapPtr<uint8_t> ptr);
-template void NO_INLINE WriteBarrierSlowPathEnter<offsetof_member_v<&SystemHeapGcObjectHeader::m_cellState>, uint8_t*, void>(uint8_t* ptr);
-template void NO_INLINE WriteBarrierSlowPathEnter<offsetof_member_v<&SystemHeapGcObjectHeader::m_cellState>, HeapPtr<uint8_t>, void>(HeapPtr<uint8_t> ptr);
-
-template<size_t cellStateOffset, typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, uint8_t>>>
-void ALWAYS_INLINE WriteBarrierImpl(T ptr)
-{
-    uint8_t cellState = ptr[cellStateOffset];
-    constexpr uint8_t blackThreshold = 0;
-    if (likely(cellState > blackThreshold))
-    {
-        return;
-    }
-    WriteBarrierSlowPathEnter<cellStateOffset>(ptr);
-}
-
-template<typename T>
-void WriteBarrier(T ptr)
-{
-    static_assert(std::is_pointer_v<T>);
-    using RawType = std::remove_pointer_t<remove_heap_ptr_t<T>>;
-    static_assert(std::is_same_v<value_type_of_member_object_pointer_t<decltype(&RawType::m_cellState)>, GcCellState>);
-    constexpr size_t x_offset = offsetof_member_v<&RawType::m_cellState>;
-    static_assert(x_offset == offsetof_member_v<&UserHeapGcObjectHeader::m_cellState> || x_offset == offsetof_member_v<&SystemHeapGcObjectHeader::m_cellState>);
-    WriteBarrierImpl<x_offset>(ReinterpretCastPreservingAddressSpace<uint8_t*>(ptr));
-}
-
 struct CoroutineStatus
 {
     // Must start with the coroutine distinguish-bit set because this class occupies the ArrayType field
@@ -175,15 +135,77 @@ class alignas(8) CoroutineRuntimeContext
 {
 public:
     static constexpr uint32_t x_hiddenClassForCoroutineRuntimeContext = 0x10;
-    static constexpr size_t x_defaultStackSlots = 4096;
-    static constexpr size_t x_rootCoroutineDefaultStackSlots = 16384;
+
+    // Every function entry makes sure that at least this many slots are available past the end of its stack frame.
+    //
+    // Builtin library functions cannot grow the stack, since the stack base of a library function cannot be changed while it runs.
+    // So they may only write into these reserved slots, and the ones that return an unbounded number of values (e.g., unpack)
+    // must check for it with HasSpaceForValues, similar to luaL_checkstack in official Lua
+    // (where C functions are similarly limited to LUAI_MAXCSTACK = 8000 slots).
+    //
+    // The stack is mmap'ed, so the reserved slots do not take physical memory until they are used.
+    //
+    static constexpr size_t x_stackReservedSlots = 8192;
+
+    // The stack starts small and is grown on demand by relocating it (see GrowStack), so creating lots of coroutines is cheap.
+    // These are the number of slots excluding the reserved slots.
+    //
+    static constexpr size_t x_defaultStackSlots = 512;
+    static constexpr size_t x_rootCoroutineDefaultStackSlots = 4096;
+    static constexpr size_t x_maxStackSlots = 1 << 22;
+
+    // A PROT_NONE area is placed after the stack, so a bug that overflows the reserved slots crashes immediately
+    //
     static constexpr size_t x_stackOverflowProtectionAreaSize = 65536;
     static_assert(x_stackOverflowProtectionAreaSize % VM::x_pageSize == 0);
+    static_assert((x_stackReservedSlots * sizeof(TValue)) % VM::x_pageSize == 0);
 
     static CoroutineRuntimeContext* Create(VM* vm, UserHeapPointer<TableObject> globalObject, size_t numStackSlots = x_defaultStackSlots);
 
     void CloseUpvalues(TValue* base);
 
+    // Return true if the 'numSlots' slots starting at 'stackBase' are within the stack
+    //
+    bool WARN_UNUSED HasSpaceForValues(TValue* stackBase, size_t numSlots)
+    {
+        assert(m_stackBegin <= stackBase && stackBase <= m_stackBegin + m_numStackSlots);
+        return numSlots <= static_cast<size_t>(m_stackBegin + m_numStackSlots - stackBase);
+    }
+
+    // Make sure that the 'numSlotsNeeded' slots starting at 'stackBase', plus the reserved slots past them, can be used, growing the stack if needed.
+    // 'stackBase' must be the stack base of the topmost stack frame of this coroutine, or the suspend point if the coroutine is suspended.
+    // Returns the new location of 'stackBase', since growing the stack moves it.
+    //
+    TValue* WARN_UNUSED ALWAYS_INLINE EnsureStackSpace(TValue* stackBase, size_t numSlotsNeeded)
+    {
+        if (likely(HasSpaceForValues(stackBase, numSlotsNeeded + x_stackReservedSlots)))
+        {
+            return stackBase;
+        }
+        return GrowStack(stackBase, numSlotsNeeded);
+    }
+
+    // 'numSlots' includes the reserved slots
+    //
+    static TValue* WARN_UNUSED AllocateStack(size_t numSlots);
+    static void FreeStack(TValue* stackBegin, size_t numSlots);
+
+    // Called when the coroutine finishes execution, successfully or by an error, after the values passed to the parent
+    // coroutine have been copied out of the stack. The stack is never used again, so close the open upvalues and
+    // put the stack into the VM's pool, so that the next coroutine created can reuse it.
+    //
+    // Only stacks that have never grown are pooled, so the pool never holds on to a big stack.
+    //
+    void ReleaseStack();
+
+    static constexpr size_t x_maxPooledStacks = 64;
+
+    // Relocate the stack to a larger one, and rebase every pointer into the stack: the caller chain of the stack frames
+    // starting at 'stackBase', the open upvalues and the suspend point.
+    // Fails the VM if the stack would exceed x_maxStackSlots plus the reserved slots.
+    //
+    TValue* WARN_UNUSED NO_INLINE GrowStack(TValue* stackBase, size_t numSlotsNeeded);
+
     uint32_t m_hiddenClass;  // Always x_hiddenClassForCoroutineRuntimeContext
     HeapEntityType m_type;
     GcCellState m_cellState;
@@ -225,7 +247,14 @@ public:
 
     // The beginning of the stack
     //
+    // The GC thread may be scanning the stack concurrently, so when the stack is grown, m_stackBegin is published
+    // before m_numStackSlots, and the old stack is kept alive until marking completes.
+    //
     TValue* m_stackBegin;
+
+    // The number of slots in the stack including the reserved slots, which the garbage collector scans conservatively
+    //
+    uint32_t m_numStackSlots;
 };
 
 UserHeapPointer<TableObject> CreateGlobalObject(VM* vm);
@@ -293,6 +322,20 @@ public:
 };
 static_assert(sizeof(ExecutableCode) == 24);
 
+// The interpreter function entry is specialized for functions taking at most this many fixed parameters
+//
+constexpr size_t x_interpreterMaxSpecializedNumFixedParams = 6;
+
+// For each specialized interpreter function entry, there is also an exact-arity entry that skips the argument fixup
+// (populating nil to unprovided parameters, or setting up the variadic arguments). So it is only valid if the caller
+// passes exactly 'numFixedParams' arguments, or for functions not taking variadic arguments, at least 'numFixedParams' arguments.
+//
+// The interpreter call IC uses it when the number of arguments at the call site is a constant.
+//
+// Generated by Deegen, indexed by [takesVarArgs][numFixedParams], each element is { normal entry, exact-arity entry }
+//
+extern "C" void (* const deegen_interpreter_exact_arity_entry_table[2][x_interpreterMaxSpecializedNumFixedParams + 1][2])();
+
 class BaselineCodeBlock;
 class FLOCodeBlock;
 
@@ -407,6 +450,83 @@ public:
 };
 static_assert(sizeof(JitCallInlineCacheEntry) == 24);
 
+// Call target profile of a JIT call IC site that has already created x_maxJitCallInlineCacheEntries IC entries
+//
+// Once the site is full, every call to a target not cached by the ICs goes to the IC miss slow path without creating an IC.
+// The slow path records the ExecutableCode of the target into this small open-addressing hash table with a call counter,
+// so that higher tiers can know which targets are hot at a megamorphic call site.
+// If the table is already full, the call is only counted in 'm_numUntrackedCalls'.
+//
+// Note that the recorded ExecutableCode pointers are not kept alive, so they are only hints and may become stale.
+//
+// This is only a profile: nothing dispatches on it, and a full site still calls every uncached target through the IC miss slow path.
+// A megamorphic dispatch stub (a guarded lookup keyed by the target that falls back to the slow path) is not generated,
+// since the slow path of a full site already only loads the entry point from the target's ExecutableCode, which is what such
+// a stub would do. The profile is meant to be consumed by a higher tier, e.g., to guard on and inline the hottest targets.
+//
+// The profile is only recorded when the JIT_CALL_MEGAMORPHIC_PROFILING build option is on (see deegen_options.h).
+// Otherwise JitCallInlineCacheSite does not have the 'm_megamorphicProfile' field and the slow path is unchanged.
+//
+// This struct always resides in the VM short-pointer data structure region
+//
+class JitCallMegamorphicProfile
+{
+public:
+    static constexpr size_t x_numSlots = 16;
+    static_assert(is_power_of_2(x_numSlots));
+
+    struct Slot
+    {
+        // 0 if the slot is empty
+        //
+        SystemHeapPointer<ExecutableCode> m_target;
+        uint32_t m_count;
+    };
+
+    static JitCallMegamorphicProfile* WARN_UNUSED Create(VM* vm);
+
+    void Record(SystemHeapPointer<ExecutableCode> target)
+    {
+        assert(target.m_value != 0);
+        size_t slotOrd = static_cast<size_t>(HashPrimitiveTypes(target.m_value)) & (x_numSlots - 1);
+        for (size_t i = 0; i < x_numSlots; i++)
+        {
+            Slot& slot = m_slots[slotOrd];
+            if (slot.m_target.m_value == target.m_value)
+            {
+                slot.m_count += (slot.m_count != std::numeric_limits<uint32_t>::max()) ? 1 : 0;
+                return;
+            }
+            if (slot.m_target.m_value == 0)
+            {
+                slot.m_target = target;
+                slot.m_count = 1;
+                return;
+            }
+            slotOrd = (slotOrd + 1) & (x_numSlots - 1);
+        }
+        m_numUntrackedCalls += (m_numUntrackedCalls != std::numeric_limits<uint32_t>::max()) ? 1 : 0;
+    }
+
+    // Returns 0 if the target is not recorded
+    //
+    uint32_t WARN_UNUSED GetCount(SystemHeapPointer<ExecutableCode> target)
+    {
+        for (Slot& slot : m_slots)
+        {
+            if (slot.m_target.m_value == target.m_value)
+            {
+                return slot.m_count;
+            }
+        }
+        return 0;
+    }
+
+    Slot m_slots[x_numSlots];
+    uint32_t m_numUntrackedCalls;
+};
+static_assert(sizeof(JitCallMegamorphicProfile) == 8 * JitCallMegamorphicProfile::x_numSlots + 4);
+
 // Describes one call site in JIT'ed code that employs inline caching
 // Note that this must have a 1-byte alignment since this struct currently lives in the SlowPathData stream
 //
@@ -421,6 +541,9 @@ struct __attribute__((__packed__, __aligned__(1))) JitCallInlineCacheSite
         , m_numEntries(0)
         , m_mode(Mode::DirectCall)
         , m_bloomFilter(0)
+#ifdef ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
+        , m_megamorphicProfile(SpdsPtr<JitCallMegamorphicProfile> { 0 })
+#endif
     { }
 
     // The singly-linked list head of all the IC entries owned by this site
@@ -454,6 +577,12 @@ struct __attribute__((__packed__, __aligned__(1))) JitCallInlineCacheSite
     //
     uint16_t m_bloomFilter;
 
+#ifdef ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
+    // The call target profile, only created once the site has x_maxEntries IC entries and another target is seen, 0 otherwise
+    //
+    Packed<SpdsPtr<JitCallMegamorphicProfile>> m_megamorphicProfile;
+#endif
+
     bool WARN_UNUSED ObservedNoTarget()
     {
         AssertImp(m_numEntries == 0, m_mode == Mode::DirectCall);
@@ -486,8 +615,23 @@ struct __attribute__((__packed__, __aligned__(1))) JitCallInlineCacheSite
     // Note that the passed in IcTraitKind is the DC one, not the CC one!
     //
     __attribute__((__malloc__)) void* WARN_UNUSED InsertInClosureCallMode(uint16_t dcIcTraitKind, TValue tv);
+
+#ifdef ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
+    // May only be called if m_numEntries == x_maxEntries, i.e., no more IC entries will be created for the site
+    // Record that 'target' is called by the site, creating the profile if needed
+    //
+    void RecordMegamorphicCallTarget(SystemHeapPointer<ExecutableCode> target);
+
+    // Returns nullptr if the site has never seen a target beyond the cached ones
+    //
+    JitCallMegamorphicProfile* WARN_UNUSED GetMegamorphicProfile(VM* vm);
+#endif
 };
+#ifdef ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
+static_assert(sizeof(JitCallInlineCacheSite) == 12);
+#else
 static_assert(sizeof(JitCallInlineCacheSite) == 8);
+#endif
 static_assert(alignof(JitCallInlineCacheSite) == 1);
 
 class UnlinkedCodeBlock;
@@ -580,6 +724,7 @@ public:
         ucb->m_parent = nullptr;
         ucb->m_defaultCodeBlock = nullptr;
         ucb->m_parserUVGetFixupList = nullptr;
+        vm->GetUserHeapGarbageCollector()->RegisterUnlinkedCodeBlock(ucb);
         return ucb;
     }
 
@@ -620,6 +765,10 @@ public:
 
     void* WARN_UNUSED GetInterpreterEntryPoint();
 
+    // Returns nullptr if the interpreter entry for this function is not specialized
+    //
+    void* WARN_UNUSED GetInterpreterExactArityEntryPoint();
+
     // For assertion purpose only
     //
     bool m_uvFixUpCompleted;
@@ -914,6 +1063,7 @@ inline void CoroutineRuntimeContext::CloseUpvalues(TValue* base)
         cur = uv->m_prev;
         assert(cur.m_value == 0 || cur.As()->m_ptr < uv->m_ptr);
         uv->Close();
+        WriteBarrier(uv);
     }
     m_upvalueList = cur;
     if (cur.m_value != 0)
@@ -5,6 +5,7 @@
 #include "memory_ptr.h"
 #include "heap_object_common.h"
 #include "vm.h"
+#include "gc.h"
 #include "array_type.h"
 #include "butterfly.h"
 
@@ -1218,7 +1219,12 @@ static_assert(sizeof(StructureIterator) == 16);
 
 UserHeapPointer<void> WARN_UNUSED GetPolyMetatableFromObjectWithStructureHiddenClass(TableObject* obj, uint32_t slot, uint32_t inlineCapacity);
 
-class CacheableDictionary final : public SystemHeapGcObjectHeader
+// The hidden class of a table in dictionary mode, used when the table has too many properties for a Structure
+//
+// The dictionary is 1-on-1 with the object, and inline caches may cache the slot ordinal of a property in the dictionary.
+// So a key is never removed once inserted (assigning nil only clears the value), since the slot ordinals must stay stable.
+//
+class CacheableDictionary : public SystemHeapGcObjectHeader
 {
 public:
     ~CacheableDictionary()
@@ -1227,6 +1233,10 @@ public:
         {
             delete [] m_hashTable;
         }
+        if (m_globalValueWatchState != nullptr)
+        {
+            delete [] m_globalValueWatchState;
+        }
     }
 
     struct HashTableEntry
@@ -1242,6 +1252,7 @@ public:
     {
         CacheableDictionary* r = TranslateToRawPointer(vm, vm->AllocFromSystemHeap(sizeof(CacheableDictionary)).AsNoAssert<CacheableDictionary>());
         SystemHeapGcObjectHeader::Populate(r);
+        vm->GetUserHeapGarbageCollector()->RegisterSystemHeapObject(r);
         r->m_shouldNeverTransitToUncacheableDictionary = shouldNeverTransitToUncacheableDictionary;
         r->m_inlineNamedStorageCapacity = inlineCapacity;
         r->m_butterflyNamedStorageCapacity = 0;
@@ -1251,6 +1262,8 @@ public:
         r->m_slotCount = 0;
         r->m_hashTable = new HashTableEntry[hashTableMask + 1];
         r->m_metatable.m_value = 0;
+        r->m_globalValueWatchState = nullptr;
+        r->m_globalValueWatchStateCapacity = 0;
         memset(r->m_hashTable, 0, sizeof(HashTableEntry) * (hashTableMask + 1));
         return r;
     }
@@ -1259,26 +1272,72 @@ public:
     //
     CacheableDictionary* WARN_UNUSED RelocateForAddingOrRemovingMetatable(VM* vm)
     {
-        CacheableDictionary* r = TranslateToRawPointer(vm, vm->AllocFromSystemHeap(sizeof(CacheableDictionary)).AsNoAssert<CacheableDictionary>());
         // m_metatable field is intentionally not populated because it shall be populated by our caller
         //
-        SystemHeapGcObjectHeader::Populate(r);
-        r->m_shouldNeverTransitToUncacheableDictionary = m_shouldNeverTransitToUncacheableDictionary;
-        r->m_inlineNamedStorageCapacity = m_inlineNamedStorageCapacity;
-        r->m_butterflyNamedStorageCapacity = m_butterflyNamedStorageCapacity;
-        r->m_hashTableMask = m_hashTableMask;
-        r->m_slotCount = m_slotCount;
-        r->m_hashTable = m_hashTable;
-        // Since CacheableDictionary and object is 1-on-1, 'this' will never be used anymore, so just have the new dictionary steal our hash table
-        //
-        m_hashTable = nullptr;
+        return RelocateImpl(vm);
+    }
+
+    // Relocate the dictionary without changing anything, so all the inline caches keyed on 'this' will never hit again
+    //
+    CacheableDictionary* WARN_UNUSED RelocateForInvalidatingInlineCaches(VM* vm)
+    {
+        CacheableDictionary* r = RelocateImpl(vm);
+        r->m_metatable = m_metatable;
         return r;
     }
 
+    // The flags in m_globalValueWatchState, see TableObject::TryWatchGlobalValueForConstantFolding
+    //
+    // A store to the slot may have been inline cached on this dictionary, so the slot may change without notice
+    //
+    static constexpr uint8_t x_globalValueMayBeStored = 1;
+    // The value of the slot has been folded into an inline cache keyed on this dictionary
+    //
+    static constexpr uint8_t x_globalValueFolded = 2;
+    // The dictionary has once been relocated so the value of the slot can be folded
+    //
+    static constexpr uint8_t x_globalValueRelocatedForFolding = 4;
+    // A folded value of the slot has been overwritten, so it is never folded again
+    //
+    static constexpr uint8_t x_globalValueNeverFold = 8;
+    // The flags that are kept when the dictionary is relocated, the others are about inline caches keyed on the old dictionary
+    //
+    static constexpr uint8_t x_globalValuePersistentFlags = x_globalValueRelocatedForFolding | x_globalValueNeverFold;
+
+    void EnableGlobalValueWatch()
+    {
+        assert(m_globalValueWatchState == nullptr);
+        m_globalValueWatchStateCapacity = RoundUpToPowerOfTwo(std::max(m_slotCount, 128U));
+        m_globalValueWatchState = new uint8_t[m_globalValueWatchStateCapacity];
+        memset(m_globalValueWatchState, 0, m_globalValueWatchStateCapacity);
+    }
+
+    bool WARN_UNUSED IsGlobalValueWatchEnabled()
+    {
+        return m_globalValueWatchState != nullptr;
+    }
+
+    uint8_t& WARN_UNUSED GetGlobalValueWatchState(uint32_t slotOrd)
+    {
+        assert(IsGlobalValueWatchEnabled() && slotOrd < m_slotCount);
+        if (unlikely(slotOrd >= m_globalValueWatchStateCapacity))
+        {
+            uint32_t newCapacity = RoundUpToPowerOfTwo(slotOrd + 1);
+            uint8_t* newState = new uint8_t[newCapacity];
+            memcpy(newState, m_globalValueWatchState, m_globalValueWatchStateCapacity);
+            memset(newState + m_globalValueWatchStateCapacity, 0, newCapacity - m_globalValueWatchStateCapacity);
+            delete [] m_globalValueWatchState;
+            m_globalValueWatchState = newState;
+            m_globalValueWatchStateCapacity = newCapacity;
+        }
+        return m_globalValueWatchState[slotOrd];
+    }
+
     CacheableDictionary* WARN_UNUSED Clone(VM* vm)
     {
         CacheableDictionary* r = TranslateToRawPointer(vm, vm->AllocFromSystemHeap(sizeof(CacheableDictionary)).AsNoAssert<CacheableDictionary>());
         SystemHeapGcObjectHeader::Populate(r);
+        vm->GetUserHeapGarbageCollector()->RegisterSystemHeapObject(r);
         r->m_shouldNeverTransitToUncacheableDictionary = m_shouldNeverTransitToUncacheableDictionary;
         r->m_inlineNamedStorageCapacity = m_inlineNamedStorageCapacity;
         r->m_butterflyNamedStorageCapacity = m_butterflyNamedStorageCapacity;
@@ -1287,6 +1346,10 @@ public:
         r->m_hashTable = new HashTableEntry[m_hashTableMask + 1];
         memcpy(r->m_hashTable, m_hashTable, sizeof(HashTableEntry) * (m_hashTableMask + 1));
         r->m_metatable = m_metatable;
+        // The clone belongs to a different object, which is not the global object
+        //
+        r->m_globalValueWatchState = nullptr;
+        r->m_globalValueWatchStateCapacity = 0;
         return r;
     }
 
@@ -1422,6 +1485,14 @@ public:
         m_hashTable[slot].m_slot = slotOrdinal;
     }
 
+    // Remove all keys from the hash table, the hash table size is unchanged
+    //
+    void ClearHashTable()
+    {
+        memset(m_hashTable, 0, sizeof(HashTableEntry) * (m_hashTableMask + 1));
+        m_slotCount = 0;
+    }
+
     // After an insertion, resize the hash table if needed. Return true if the hash table is resized.
     //
     // If returned true, the caller should check if the CacheableDictionary should transit to UncacheableDictionary
@@ -1597,7 +1668,104 @@ public:
     // Whenever this value is changed from zero to non-zero, or from non-zero to zero, we must relocate the structure, otherwise we would break the IC!
     //
     UserHeapPointer<void> m_metatable;
+    // Only exists for the global object, the x_globalValue* flags for each slot ordinal < m_globalValueWatchStateCapacity
+    // (slots beyond the capacity have no flag set). See TableObject::TryWatchGlobalValueForConstantFolding.
+    //
+    uint8_t* m_globalValueWatchState;
+    uint32_t m_globalValueWatchStateCapacity;
+
+private:
+    CacheableDictionary* WARN_UNUSED RelocateImpl(VM* vm)
+    {
+        CacheableDictionary* r = TranslateToRawPointer(vm, vm->AllocFromSystemHeap(sizeof(CacheableDictionary)).AsNoAssert<CacheableDictionary>());
+        SystemHeapGcObjectHeader::Populate(r);
+        vm->GetUserHeapGarbageCollector()->RegisterSystemHeapObject(r);
+        r->m_shouldNeverTransitToUncacheableDictionary = m_shouldNeverTransitToUncacheableDictionary;
+        r->m_inlineNamedStorageCapacity = m_inlineNamedStorageCapacity;
+        r->m_butterflyNamedStorageCapacity = m_butterflyNamedStorageCapacity;
+        r->m_hashTableMask = m_hashTableMask;
+        r->m_slotCount = m_slotCount;
+        r->m_hashTable = m_hashTable;
+        r->m_globalValueWatchState = m_globalValueWatchState;
+        r->m_globalValueWatchStateCapacity = m_globalValueWatchStateCapacity;
+        // Since CacheableDictionary and object is 1-on-1, 'this' will never be used anymore, so just have the new dictionary steal our hash table
+        //
+        m_hashTable = nullptr;
+        m_globalValueWatchState = nullptr;
+        m_globalValueWatchStateCapacity = 0;
+
+        // No inline cache is keyed on the new dictionary yet
+        //
+        for (uint32_t i = 0; i < r->m_globalValueWatchStateCapacity; i++)
+        {
+            r->m_globalValueWatchState[i] &= x_globalValuePersistentFlags;
+        }
+        return r;
+    }
+};
+
+// The hidden class of a dictionary-mode table that inline caches never cache on
+//
+// A table used as a hash map with keys coming and going (caches, symbol tables, etc) would grow its CacheableDictionary and its
+// named storage without bound, since keys are never removed. Such a table transitions to an UncacheableDictionary (see
+// TableObject::CheckForTransitionToUncacheableDictionary), which has exactly the same layout, but since no inline cache depends on
+// its slot ordinals, the keys whose value is nil can be removed and the slots of the remaining keys compacted (see
+// TableObject::CompactUncacheableDictionary).
+//
+// The compaction only happens when a new key is inserted, so keys are never removed during a traversal that only assigns to
+// existing fields, which Lua allows.
+//
+class UncacheableDictionary final : public CacheableDictionary
+{
+public:
+    // Create an UncacheableDictionary for the object currently using 'dict', which steals the hash table of 'dict'
+    // Like RelocateForAddingOrRemovingMetatable, 'dict' must never be used after this, so the inline caches on it will never hit again.
+    //
+    static UncacheableDictionary* WARN_UNUSED CreateFromCacheableDictionary(VM* vm, CacheableDictionary* dict)
+    {
+        assert(dict->m_type == HeapEntityType::CacheableDictionary);
+        assert(!dict->m_shouldNeverTransitToUncacheableDictionary);
+        UncacheableDictionary* r = Allocate(vm);
+        r->m_shouldNeverTransitToUncacheableDictionary = false;
+        r->m_inlineNamedStorageCapacity = dict->m_inlineNamedStorageCapacity;
+        r->m_butterflyNamedStorageCapacity = dict->m_butterflyNamedStorageCapacity;
+        r->m_hashTableMask = dict->m_hashTableMask;
+        r->m_slotCount = dict->m_slotCount;
+        r->m_hashTable = dict->m_hashTable;
+        r->m_metatable = dict->m_metatable;
+        assert(dict->m_globalValueWatchState == nullptr);
+        r->m_globalValueWatchState = nullptr;
+        r->m_globalValueWatchStateCapacity = 0;
+        dict->m_hashTable = nullptr;
+        return r;
+    }
+
+    UncacheableDictionary* WARN_UNUSED Clone(VM* vm)
+    {
+        UncacheableDictionary* r = Allocate(vm);
+        r->m_shouldNeverTransitToUncacheableDictionary = false;
+        r->m_inlineNamedStorageCapacity = m_inlineNamedStorageCapacity;
+        r->m_butterflyNamedStorageCapacity = m_butterflyNamedStorageCapacity;
+        r->m_hashTableMask = m_hashTableMask;
+        r->m_slotCount = m_slotCount;
+        r->m_hashTable = new HashTableEntry[m_hashTableMask + 1];
+        memcpy(r->m_hashTable, m_hashTable, sizeof(HashTableEntry) * (m_hashTableMask + 1));
+        r->m_metatable = m_metatable;
+        r->m_globalValueWatchState = nullptr;
+        r->m_globalValueWatchStateCapacity = 0;
+        return r;
+    }
+
+private:
+    static UncacheableDictionary* WARN_UNUSED Allocate(VM* vm)
+    {
+        UncacheableDictionary* r = TranslateToRawPointer(vm, vm->AllocFromSystemHeap(sizeof(UncacheableDictionary)).AsNoAssert<UncacheableDictionary>());
+        SystemHeapGcObjectHeader::Populate(r);
+        vm->GetUserHeapGarbageCollector()->RegisterSystemHeapObject(r);
+        return r;
+    }
 };
+static_assert(sizeof(UncacheableDictionary) == sizeof(CacheableDictionary));
 
 inline StructureAnchorHashTable* WARN_UNUSED StructureAnchorHashTable::Create(VM* vm, Structure* shc)
 {
@@ -2021,6 +2189,7 @@ end_setup:
     ConstructInPlace(r);
 
     SystemHeapGcObjectHeader::Populate(r);
+    vm->GetUserHeapGarbageCollector()->RegisterSystemHeapObject(r);
     r->m_numSlots = newNumSlots;
     r->m_nonFullBlockLen = nonFullBlockCopyLengthForNewNode + static_cast<uint8_t>(shouldAddKey);
     assert(r->m_nonFullBlockLen == ComputeNonFullBlockLength(r->m_numSlots));
@@ -2331,6 +2500,7 @@ inline Structure* WARN_UNUSED Structure::CreateInitialStructure(VM* vm, uint8_t
     ConstructInPlace(r);
 
     SystemHeapGcObjectHeader::Populate(r);
+    vm->GetUserHeapGarbageCollector()->RegisterSystemHeapObject(r);
     r->m_numSlots = 0;
     r->m_nonFullBlockLen = 0;
     r->m_arrayType = ArrayType::GetInitialArrayType();
@@ -3,30 +3,43 @@
 #include "common_utils.h"
 #include "memory_ptr.h"
 #include "vm.h"
+#include "gc.h"
 #include "structure.h"
 #include "butterfly.h"
+#include "heap_cdata_object.h"
 
 // This doesn't really need to inherit the GC header, but for now let's make thing simple..
 //
+// The sparse map is an open-addressed hash table with linear probing, mapping a double key (the array index) to a TValue.
+//
+// The storage is a single array of 2 * (m_hashMask + 1) words, holding all the values first, then all the keys:
+// (1) The keys are stored separately from the values, so the probing only touches the keys, and compares 4 keys at a time with SIMD.
+//     A key is stored as the bit pattern of the double (with -0 canonicalized to 0), so comparison is an integer compare.
+//     An empty slot is represented by the bit pattern of quiet NaN, which is fine because Lua doesn't allow NaN as a table key.
+// (2) The value of an empty slot is always nil, so the GC can mark all the values without looking at the keys, and never sees a
+//     half-written entry. Since the values come first, a concurrent marker that reads the old m_hashMask together with the new
+//     storage (see Rebuild) still only reads values.
+//
 class alignas(8) ArraySparseMap final : public UserHeapGcObjectHeader
 {
 public:
     static constexpr uint32_t x_hiddenClassForArraySparseMap = 0x20;
 
-    using StorageType = std::unordered_map<double, TValue>;
+    // The number of keys compared at a time during probing
+    //
+    static constexpr uint32_t x_probeGroupSize = 4;
 
-    struct HashTableEntry
-    {
-        // An empty slot is represented by m_key == NaN
-        // This is fine because Lua doesn't allow NaN to be used as an array index
-        //
-        double m_key;
-        TValue m_value;
-    };
+    // The capacity of a newly created sparse map, must be a multiple of x_probeGroupSize
+    //
+    static constexpr uint32_t x_initialCapacity = 4;
+    static_assert(is_power_of_2(x_initialCapacity) && x_initialCapacity % x_probeGroupSize == 0);
+
+    static constexpr uint64_t x_emptyKey = 0x7ff8000000000000ULL;
+    static_assert(x_emptyKey == cxx2a_bit_cast<uint64_t>(std::numeric_limits<double>::quiet_NaN()));
 
     ~ArraySparseMap()
     {
-        delete [] m_hashTable;
+        delete [] m_storage;
     }
 
     static ArraySparseMap* WARN_UNUSED AllocateEmptyArraySparseMap(VM* vm)
@@ -36,11 +49,9 @@ public:
         ConstructInPlace(r);
         UserHeapGcObjectHeader::Populate(r);
         r->m_hiddenClass = ArraySparseMap::x_hiddenClassForArraySparseMap;
-        r->m_hashMask = 1;
+        r->m_hashMask = x_initialCapacity - 1;
         r->m_elementCount = 0;
-        r->m_hashTable = new HashTableEntry[2];
-        r->m_hashTable[0].m_key = std::numeric_limits<double>::quiet_NaN();
-        r->m_hashTable[1].m_key = std::numeric_limits<double>::quiet_NaN();
+        r->m_storage = AllocateEmptyStorage(x_initialCapacity - 1);
         return r;
     }
 
@@ -53,11 +64,73 @@ public:
         r->m_hiddenClass = ArraySparseMap::x_hiddenClassForArraySparseMap;
         r->m_hashMask = m_hashMask;
         r->m_elementCount = m_elementCount;
-        r->m_hashTable = new HashTableEntry[m_hashMask + 1];
-        memcpy(r->m_hashTable, m_hashTable, sizeof(HashTableEntry) * (m_hashMask + 1));
+        r->m_storage = new uint64_t[(m_hashMask + 1) * 2];
+        memcpy(r->m_storage, m_storage, sizeof(uint64_t) * (m_hashMask + 1) * 2);
         return r;
     }
 
+    static uint64_t* WARN_UNUSED AllocateEmptyStorage(uint32_t hashMask)
+    {
+        uint64_t* storage = new uint64_t[(static_cast<size_t>(hashMask) + 1) * 2];
+        uint64_t nilVal = TValue::Nil().m_value;
+        for (size_t i = 0; i <= hashMask; i++)
+        {
+            storage[i] = nilVal;
+            storage[hashMask + 1 + i] = x_emptyKey;
+        }
+        return storage;
+    }
+
+    uint32_t GetCapacity() { return m_hashMask + 1; }
+    TValue* GetValues() { return reinterpret_cast<TValue*>(m_storage); }
+    uint64_t* GetKeys() { return m_storage + m_hashMask + 1; }
+
+    static bool WARN_UNUSED ALWAYS_INLINE IsEmptyKey(uint64_t keyBits) { return keyBits == x_emptyKey; }
+    static double WARN_UNUSED ALWAYS_INLINE GetKeyFromBits(uint64_t keyBits) { return cxx2a_bit_cast<double>(keyBits); }
+
+    // -0 and 0 are the same key, so -0 is canonicalized to 0
+    //
+    static uint64_t WARN_UNUSED ALWAYS_INLINE GetKeyBits(double key)
+    {
+        assert(!IsNaN(key));
+        return cxx2a_bit_cast<uint64_t>(key + 0.0);
+    }
+
+    // Return the slot of 'keyBits', or the negated (one's complement) slot where it should be inserted if it doesn't exist
+    //
+    static int64_t WARN_UNUSED ALWAYS_INLINE FindSlot(uint64_t* keys, uint32_t hashMask, uint64_t keyBits)
+    {
+        assert(!IsEmptyKey(keyBits));
+        size_t slot = HashPrimitiveTypes(keyBits) & hashMask;
+        size_t groupStart = slot & ~static_cast<size_t>(x_probeGroupSize - 1);
+        // In the first group, the slots before 'slot' are not on the probing sequence, so an empty slot there doesn't end the search.
+        // However, a matching key there (only possible after wrapping around) is still the key we want, since keys are unique.
+        //
+        uint32_t emptyLaneMask = ~((1U << (slot - groupStart)) - 1);
+        __m128i target = _mm_set1_epi64x(static_cast<int64_t>(keyBits));
+        __m128i empty = _mm_set1_epi64x(static_cast<int64_t>(x_emptyKey));
+        while (true)
+        {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + groupStart));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + groupStart + 2));
+            uint32_t matchMask = static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(lo, target)))) |
+                (static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(hi, target)))) << 2);
+            if (matchMask != 0)
+            {
+                return static_cast<int64_t>(groupStart + static_cast<uint32_t>(__builtin_ctz(matchMask)));
+            }
+            uint32_t emptyMask = static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(lo, empty)))) |
+                (static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(hi, empty)))) << 2);
+            emptyMask &= emptyLaneMask;
+            if (emptyMask != 0)
+            {
+                return ~static_cast<int64_t>(groupStart + static_cast<uint32_t>(__builtin_ctz(emptyMask)));
+            }
+            groupStart = (groupStart + x_probeGroupSize) & hashMask;
+            emptyLaneMask = static_cast<uint32_t>(-1);
+        }
+    }
+
     void ResizeIfNeeded()
     {
         if (likely(m_elementCount * 2 <= m_hashMask + 1))
@@ -70,67 +143,63 @@ public:
     void NO_INLINE ResizeImpl()
     {
         assert(is_power_of_2(m_hashMask + 1));
-        uint32_t oldMask = m_hashMask;
-        uint32_t newMask = oldMask * 2 + 1;
-        ReleaseAssert(newMask < std::numeric_limits<uint32_t>::max());
-        m_hashMask = newMask;
+        uint32_t newMask = m_hashMask * 2 + 1;
+        ReleaseAssert(newMask < std::numeric_limits<uint32_t>::max() / 2);
+        Rebuild(newMask, [](double /*key*/) { return false; });
+    }
 
-        HashTableEntry* oldHt = m_hashTable;
-        m_hashTable = new HashTableEntry[newMask + 1];
-        for (size_t i = 0; i <= newMask; i++)
-        {
-             m_hashTable[i].m_key = std::numeric_limits<double>::quiet_NaN();
-        }
+    // Rehash every entry with non-nil value into a new storage with mask 'newMask', except those for which 'shouldDrop(key)' is true
+    //
+    template<typename Func>
+    void Rebuild(uint32_t newMask, const Func& shouldDrop)
+    {
+        uint64_t* newStorage = AllocateEmptyStorage(newMask);
+        TValue* newValues = reinterpret_cast<TValue*>(newStorage);
+        uint64_t* newKeys = newStorage + newMask + 1;
 
         DEBUG_ONLY(uint32_t cnt = 0;)
         uint32_t nonNilElement = 0;
-        HashTableEntry* oldHtEnd = oldHt + oldMask + 1;
-        HashTableEntry* curEntry = oldHt;
-        while (curEntry < oldHtEnd)
+        TValue* oldValues = GetValues();
+        uint64_t* oldKeys = GetKeys();
+        for (uint32_t i = 0; i <= m_hashMask; i++)
         {
-            double key = curEntry->m_key;
-            if (!IsNaN(key))
+            uint64_t keyBits = oldKeys[i];
+            if (!IsEmptyKey(keyBits))
             {
-                TValue value = curEntry->m_value;
-                if (!value.IsNil())
+                TValue value = oldValues[i];
+                if (!value.IsNil() && !shouldDrop(GetKeyFromBits(keyBits)))
                 {
-                    size_t slot = HashPrimitiveTypes(key) & newMask;
-                    while (!IsNaN(m_hashTable[slot].m_key))
-                    {
-                        assert(!UnsafeFloatEqual(m_hashTable[slot].m_key, key));
-                        slot = (slot + 1) & newMask;
-                    }
-                    m_hashTable[slot].m_key = key;
-                    m_hashTable[slot].m_value = value;
+                    int64_t slot = FindSlot(newKeys, newMask, keyBits);
+                    assert(slot < 0);
+                    slot = ~slot;
+                    newKeys[slot] = keyBits;
+                    newValues[slot] = value;
                     nonNilElement++;
                 }
                 DEBUG_ONLY(cnt++;)
             }
-            curEntry++;
         }
         assert(cnt == m_elementCount);
         m_elementCount = nonNilElement;
 
-        delete [] oldHt;
+        // The concurrent marker reads m_hashMask before m_storage, so the new storage must be published first,
+        // and the old storage must stay alive until marking completes
+        //
+        uint64_t* oldStorage = m_storage;
+        m_storage = newStorage;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        m_hashMask = newMask;
+        VM::GetActiveVMForCurrentThread()->GetUserHeapGarbageCollector()->DeleteArrayMaybeInUseByMarker(oldStorage);
     }
 
     TValue GetByVal(double key)
     {
-        size_t hashMask = m_hashMask;
-        size_t slot = HashPrimitiveTypes(key) & hashMask;
-        while (true)
+        int64_t slot = FindSlot(GetKeys(), m_hashMask, GetKeyBits(key));
+        if (slot < 0)
         {
-            HashTableEntry& entry = m_hashTable[slot];
-            if (UnsafeFloatEqual(entry.m_key, key))
-            {
-                return entry.m_value;
-            }
-            if (IsNaN(entry.m_key))
-            {
-                return TValue::Nil();
-            }
-            slot = (slot + 1) & hashMask;
+            return TValue::Nil();
         }
+        return GetValues()[slot];
     }
 
     // Return -1 if the key isn't found in the hashtable
@@ -138,51 +207,46 @@ public:
     //
     uint32_t GetHashSlotOrdinal(double key)
     {
-        size_t hashMask = m_hashMask;
-        size_t slot = HashPrimitiveTypes(key) & hashMask;
-        while (true)
+        int64_t slot = FindSlot(GetKeys(), m_hashMask, GetKeyBits(key));
+        if (slot < 0)
         {
-            HashTableEntry& entry = m_hashTable[slot];
-            if (UnsafeFloatEqual(entry.m_key, key))
-            {
-                return static_cast<uint32_t>(slot);
-            }
-            if (IsNaN(entry.m_key))
-            {
-                return static_cast<uint32_t>(-1);
-            }
-            slot = (slot + 1) & hashMask;
+            return static_cast<uint32_t>(-1);
         }
+        return static_cast<uint32_t>(slot);
     }
 
-    void Insert(double key, TValue value)
+    // Return true if the storage is rehashed
+    //
+    bool Insert(double key, TValue value)
     {
-        assert(!IsNaN(key));
-        size_t hashMask = m_hashMask;
-        size_t slot = HashPrimitiveTypes(key) & hashMask;
-        while (true)
+        uint64_t keyBits = GetKeyBits(key);
+        int64_t slot = FindSlot(GetKeys(), m_hashMask, keyBits);
+        if (slot >= 0)
         {
-            HashTableEntry& entry = m_hashTable[slot];
-            if (UnsafeFloatEqual(entry.m_key, key))
-            {
-                entry.m_value = value;
-                return;
-            }
-            if (IsNaN(entry.m_key))
-            {
-                entry.m_key = key;
-                entry.m_value = value;
-                m_elementCount++;
-                ResizeIfNeeded();
-                return;
-            }
-            slot = (slot + 1) & hashMask;
+            GetValues()[slot] = value;
+            return false;
         }
+        if (value.IsNil())
+        {
+            // The key doesn't exist and the value is nil, no-op
+            //
+            return false;
+        }
+        slot = ~slot;
+        GetValues()[slot] = value;
+        GetKeys()[slot] = keyBits;
+        m_elementCount++;
+        if (likely(m_elementCount * 2 <= m_hashMask + 1))
+        {
+            return false;
+        }
+        ResizeImpl();
+        return true;
     }
 
     uint32_t m_hashMask;
     uint32_t m_elementCount;
-    HashTableEntry* m_hashTable;
+    uint64_t* m_storage;
 };
 
 struct GetByIdICInfo
@@ -191,7 +255,8 @@ struct GetByIdICInfo
     //
     enum class ICKind : uint8_t
     {
-        // The hidden class is a UncachableDictionary
+        // The hidden class is a UncacheableDictionary, which must not be cached since its slot ordinals may change
+        // m_slot is the slot ordinal of the property, or -1 if the property doesn't exist
         //
         UncachableDictionary,
         // The GetById must return nil because the property doesn't exist
@@ -281,6 +346,7 @@ struct PutByIdICInfo
     //
     bool m_mayHaveMetatable;
     // Whether this PutById is cacheable
+    // It is not cacheable for TransitionedToDictionaryMode, and when the hidden class is (or has just become) an UncacheableDictionary
     //
     bool m_isInlineCacheable;
     int32_t m_slot;
@@ -329,6 +395,14 @@ struct PutByIntegerIndexICInfo
         NoCheck
     };
 
+    // Whether a value that passed the check can never be a reference to a heap object, so the put needs no write barrier
+    //
+    static constexpr bool ValueCheckImpliesNoReference(ValueCheckKind valueCheckKind)
+    {
+        return valueCheckKind == ValueCheckKind::Int32 || valueCheckKind == ValueCheckKind::Int32OrNil ||
+            valueCheckKind == ValueCheckKind::Double || valueCheckKind == ValueCheckKind::DoubleOrNil;
+    }
+
     IndexCheckKind m_indexCheckKind;
     ValueCheckKind m_valueCheckKind;
     bool m_mayHaveMetatable;
@@ -339,6 +413,125 @@ struct PutByIntegerIndexICInfo
     SystemHeapPointer<void> m_newHiddenClass;
 };
 
+// A global cache of GetById and PutById lookups on Structures, keyed by (structure, property name)
+//
+// PrepareGetById and PreparePutById probe this cache before looking up the property in the hidden class.
+// This mostly benefits megamorphic GetById / PutById sites, which have exhausted their inline cache entries
+// (see x_maxJitGenericInlineCacheEntries) and otherwise would do a full hidden class lookup on every execution.
+//
+// Dictionaries are never cached, since they are mutable. A Structure is immutable and never freed, and the AddProperty transition
+// of a Structure never changes once created, so an entry never becomes stale as long as its property name is alive.
+// The name of a property that exists in the structure is kept alive by the structure, but the name of a non-existent property is not,
+// so the GC drops all entries whose property name is dead (see SweepWeakReferences), otherwise the address could be reused by another string.
+//
+class MegamorphicPropertyCache
+{
+    MAKE_NONCOPYABLE(MegamorphicPropertyCache);
+    MAKE_NONMOVABLE(MegamorphicPropertyCache);
+
+public:
+    // The number of entries of each of the direct-mapped GetById and PutById caches, must be a power of 2
+    //
+    static constexpr size_t x_numEntries = 2048;
+    static_assert(is_power_of_2(x_numEntries));
+
+    MegamorphicPropertyCache() { Clear(); }
+
+    void Clear()
+    {
+        for (size_t i = 0; i < x_numEntries; i++)
+        {
+            m_getByIdEntries[i].m_hiddenClass = 0;
+            m_putByIdEntries[i].m_hiddenClass = 0;
+        }
+    }
+
+    bool WARN_UNUSED ALWAYS_INLINE TryGetForGetById(SystemHeapPointer<void> hiddenClass, UserHeapPointer<void> propertyName, GetByIdICInfo& icInfo /*out*/)
+    {
+        GetByIdEntry& entry = m_getByIdEntries[GetEntryOrdinal(hiddenClass, propertyName)];
+        if (entry.m_hiddenClass == hiddenClass.m_value && entry.m_propertyName == propertyName.m_value)
+        {
+            icInfo = entry.m_icInfo;
+            return true;
+        }
+        return false;
+    }
+
+    void ALWAYS_INLINE InsertForGetById(SystemHeapPointer<void> hiddenClass, UserHeapPointer<void> propertyName, const GetByIdICInfo& icInfo)
+    {
+        assert(hiddenClass.m_value != 0);
+        GetByIdEntry& entry = m_getByIdEntries[GetEntryOrdinal(hiddenClass, propertyName)];
+        entry.m_hiddenClass = hiddenClass.m_value;
+        entry.m_propertyName = propertyName.m_value;
+        entry.m_icInfo = icInfo;
+    }
+
+    bool WARN_UNUSED ALWAYS_INLINE TryGetForPutById(SystemHeapPointer<void> hiddenClass, UserHeapPointer<void> propertyName, PutByIdICInfo& icInfo /*out*/)
+    {
+        PutByIdEntry& entry = m_putByIdEntries[GetEntryOrdinal(hiddenClass, propertyName)];
+        if (entry.m_hiddenClass == hiddenClass.m_value && entry.m_propertyName == propertyName.m_value)
+        {
+            icInfo = entry.m_icInfo;
+            return true;
+        }
+        return false;
+    }
+
+    void ALWAYS_INLINE InsertForPutById(SystemHeapPointer<void> hiddenClass, UserHeapPointer<void> propertyName, const PutByIdICInfo& icInfo)
+    {
+        assert(hiddenClass.m_value != 0);
+        assert(icInfo.m_isInlineCacheable);
+        PutByIdEntry& entry = m_putByIdEntries[GetEntryOrdinal(hiddenClass, propertyName)];
+        entry.m_hiddenClass = hiddenClass.m_value;
+        entry.m_propertyName = propertyName.m_value;
+        entry.m_icInfo = icInfo;
+    }
+
+    // Drop every entry whose property name satisfies 'isDead', which takes the value of the UserHeapPointer of the property name
+    //
+    template<typename Func>
+    void RemoveEntriesWithDeadPropertyName(const Func& isDead)
+    {
+        for (size_t i = 0; i < x_numEntries; i++)
+        {
+            if (m_getByIdEntries[i].m_hiddenClass != 0 && isDead(m_getByIdEntries[i].m_propertyName))
+            {
+                m_getByIdEntries[i].m_hiddenClass = 0;
+            }
+            if (m_putByIdEntries[i].m_hiddenClass != 0 && isDead(m_putByIdEntries[i].m_propertyName))
+            {
+                m_putByIdEntries[i].m_hiddenClass = 0;
+            }
+        }
+    }
+
+private:
+    static size_t WARN_UNUSED ALWAYS_INLINE GetEntryOrdinal(SystemHeapPointer<void> hiddenClass, UserHeapPointer<void> propertyName)
+    {
+        uint64_t key = static_cast<uint64_t>(propertyName.m_value) ^ (static_cast<uint64_t>(hiddenClass.m_value) << 32);
+        return static_cast<size_t>(HashPrimitiveTypes(key)) & (x_numEntries - 1);
+    }
+
+    // m_hiddenClass == 0 means the entry is empty
+    //
+    struct GetByIdEntry
+    {
+        int64_t m_propertyName;
+        uint32_t m_hiddenClass;
+        GetByIdICInfo m_icInfo;
+    };
+
+    struct PutByIdEntry
+    {
+        int64_t m_propertyName;
+        uint32_t m_hiddenClass;
+        PutByIdICInfo m_icInfo;
+    };
+
+    GetByIdEntry m_getByIdEntries[x_numEntries];
+    PutByIdEntry m_putByIdEntries[x_numEntries];
+};
+
 class alignas(8) TableObject
 {
 public:
@@ -678,6 +871,30 @@ public:
         }
     }
 
+    template<typename U>
+    static void PrepareGetByIdImplForUncacheableDictionary(SystemHeapPointer<void> hiddenClass, UserHeapPointer<U> propertyName, GetByIdICInfo& icInfo /*out*/)
+    {
+        assert(hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::UncacheableDictionary);
+
+        // UncacheableDictionary has the same layout as CacheableDictionary, so the lookup is the same
+        //
+        HeapPtr<CacheableDictionary> dict = hiddenClass.As<CacheableDictionary>();
+        icInfo.m_icKind = GetByIdICInfo::ICKind::UncachableDictionary;
+        icInfo.m_mayHaveMetatable = (dict->m_metatable.m_value != 0);
+
+        uint32_t slotOrd;
+        bool found;
+        if constexpr(std::is_same_v<U, HeapString>)
+        {
+            found = CacheableDictionary::GetSlotOrdinalFromStringProperty(dict, propertyName, slotOrd /*out*/);
+        }
+        else
+        {
+            found = CacheableDictionary::GetSlotOrdinalFromMaybeNonStringProperty(dict, propertyName, slotOrd /*out*/);
+        }
+        icInfo.m_slot = found ? static_cast<int32_t>(slotOrd) : -1;
+    }
+
     template<typename U>
     static void PrepareGetByIdImpl(SystemHeapPointer<void> hiddenClass, UserHeapPointer<U> propertyName, GetByIdICInfo& icInfo /*out*/)
     {
@@ -688,7 +905,13 @@ public:
 
         if (likely(ty == HeapEntityType::Structure))
         {
+            MegamorphicPropertyCache* cache = VM::GetActiveVMForCurrentThread()->GetMegamorphicPropertyCache();
+            if (likely(cache->TryGetForGetById(hiddenClass, propertyName.template As<void>(), icInfo /*out*/)))
+            {
+                return;
+            }
             PrepareGetByIdImplForStructure(hiddenClass, propertyName, icInfo /*out*/);
+            cache->InsertForGetById(hiddenClass, propertyName.template As<void>(), icInfo);
         }
         else if (likely(ty == HeapEntityType::CacheableDictionary))
         {
@@ -696,10 +919,7 @@ public:
         }
         else
         {
-            // TODO: support UncacheableDictionary
-            //
-            assert(false && "unimplemented");
-            __builtin_unreachable();
+            PrepareGetByIdImplForUncacheableDictionary(hiddenClass, propertyName, icInfo /*out*/);
         }
     }
 
@@ -748,9 +968,13 @@ public:
             return self->m_butterfly->GetNamedProperty(icInfo.m_slot);
         }
 
-        // TODO: support UncacheableDictionary
-        assert(false && "not implemented");
-        __builtin_unreachable();
+        assert(icInfo.m_icKind == GetByIdICInfo::ICKind::UncachableDictionary);
+        if (icInfo.m_slot < 0)
+        {
+            return TValue::Nil();
+        }
+        HeapPtr<CacheableDictionary> dict = TCGet(self->m_hiddenClass).template As<CacheableDictionary>();
+        return GetValueForSlot(self, static_cast<uint32_t>(icInfo.m_slot), dict->m_inlineNamedStorageCapacity);
     }
 
     template<typename T, typename U, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
@@ -758,6 +982,42 @@ public:
     {
         assert(TCGet(self->m_hiddenClass).template As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::CacheableDictionary);
         assert(TCGet(self->m_hiddenClass).template As<CacheableDictionary>() == dict);
+        PreparePutByIdForDictionaryImpl(self, dict, propertyName, icInfo /*out*/);
+    }
+
+    template<typename T, typename U, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
+    static void PreparePutByIdForUncacheableDictionary(T self, HeapPtr<CacheableDictionary> dict, UserHeapPointer<U> propertyName, PutByIdICInfo& icInfo /*out*/)
+    {
+        assert(TCGet(self->m_hiddenClass).template As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::UncacheableDictionary);
+        assert(TCGet(self->m_hiddenClass).template As<CacheableDictionary>() == dict);
+
+        // If the property doesn't exist and the named storage is full, get rid of the keys with nil value before growing the storage
+        //
+        if (unlikely(dict->m_slotCount == dict->m_inlineNamedStorageCapacity + dict->m_butterflyNamedStorageCapacity))
+        {
+            uint32_t slotOrdUnused;
+            bool found;
+            if constexpr(std::is_same_v<U, HeapString>)
+            {
+                found = CacheableDictionary::GetSlotOrdinalFromStringProperty(dict, propertyName, slotOrdUnused /*out*/);
+            }
+            else
+            {
+                found = CacheableDictionary::GetSlotOrdinalFromMaybeNonStringProperty(dict, propertyName, slotOrdUnused /*out*/);
+            }
+            if (!found)
+            {
+                TranslateToRawPointer(self)->CompactUncacheableDictionary(TranslateToRawPointer(dict));
+            }
+        }
+
+        PreparePutByIdForDictionaryImpl(self, dict, propertyName, icInfo /*out*/);
+        assert(!icInfo.m_isInlineCacheable);
+    }
+
+    template<typename T, typename U, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
+    static void PreparePutByIdForDictionaryImpl(T self, HeapPtr<CacheableDictionary> dict, UserHeapPointer<U> propertyName, PutByIdICInfo& icInfo /*out*/)
+    {
         CacheableDictionary::PutByIdResult res;
         if constexpr(std::is_same_v<U, HeapString>)
         {
@@ -768,6 +1028,14 @@ public:
             CacheableDictionary::PreparePutByMaybeNonStringKey(dict, propertyName, res /*out*/);
         }
 
+        if (unlikely(dict->m_globalValueWatchState != nullptr))
+        {
+            // This may relocate the hidden class, so reload it
+            //
+            NotifyStoreToGlobalObjectSlot(self, res.m_slot);
+            dict = TCGet(self->m_hiddenClass).template As<CacheableDictionary>();
+        }
+
         // Since the dictionary is 1-on-1 with the object, this step *is* idempotent.
         //
         if (unlikely(res.m_shouldGrowButterfly))
@@ -778,10 +1046,15 @@ public:
             dict->m_butterflyNamedStorageCapacity = res.m_newButterflyCapacity;
         }
 
-        if (unlikely(res.m_shouldCheckForTransitionToUncacheableDictionary))
+        bool isCacheable = (dict->m_type == HeapEntityType::CacheableDictionary);
+        if (unlikely(res.m_shouldCheckForTransitionToUncacheableDictionary) && isCacheable)
         {
-           // TODO: check for transition to UncacheableDictionary
-           //
+            // Note that 'dict' is still usable after the transition (only its hash table is stolen), and the slot ordinal is unchanged
+            //
+            if (TranslateToRawPointer(self)->CheckForTransitionToUncacheableDictionary(TranslateToRawPointer(dict)))
+            {
+                isCacheable = false;
+            }
         }
 
         // For Dictionary, since it is 1-on-1 with the object, we always insert the property if it doesn't exist (and this step is idempotent)
@@ -790,7 +1063,7 @@ public:
         //
         // Since we have inserted the property above, for the IC, the property should always appear to be existent
         //
-        icInfo.m_isInlineCacheable = true;
+        icInfo.m_isInlineCacheable = isCacheable;
         icInfo.m_propertyExists = true;
         icInfo.m_shouldGrowButterfly = false;
         icInfo.m_mayHaveMetatable = (dict->m_metatable.m_value != 0);
@@ -885,8 +1158,20 @@ public:
 
         if (likely(ty == HeapEntityType::Structure))
         {
+            MegamorphicPropertyCache* cache = VM::GetActiveVMForCurrentThread()->GetMegamorphicPropertyCache();
+            if (likely(cache->TryGetForPutById(hiddenClass, propertyName.template As<void>(), icInfo /*out*/)))
+            {
+                return;
+            }
             HeapPtr<Structure> structure = hiddenClass.As<Structure>();
             PreparePutByIdForStructure(structure, propertyName, icInfo /*out*/);
+
+            // A transition to dictionary mode is not cacheable, since the PutById must perform the transition
+            //
+            if (likely(icInfo.m_isInlineCacheable))
+            {
+                cache->InsertForPutById(hiddenClass, propertyName.template As<void>(), icInfo);
+            }
         }
         else if (ty == HeapEntityType::CacheableDictionary)
         {
@@ -895,10 +1180,8 @@ public:
         }
         else
         {
-            // icInfo.m_isInlineCacheable = false;
-            // TODO: support UncacheableDictionary
-            assert(false && "unimplemented");
-            __builtin_unreachable();
+            HeapPtr<CacheableDictionary> dict = hiddenClass.As<CacheableDictionary>();
+            PreparePutByIdForUncacheableDictionary(self, dict, propertyName, icInfo /*out*/);
         }
     }
 
@@ -917,6 +1200,85 @@ public:
         PreparePutByIdForCacheableDictionary(self, dict, propertyName, icInfo /*out*/);
     }
 
+    // GlobalGet may fold the current value of a global variable into its inline cache, which is keyed on the hidden class of the global object.
+    // This is only correct if the value doesn't change as long as the global object keeps its hidden class.
+    //
+    // Every store to the global object goes through PreparePutById (whether the store is inline cached or not), which relocates the hidden
+    // class before a folded value is overwritten (see NotifyStoreToGlobalObjectSlot), so the inline caches that folded the value never hit again.
+    // But a store that has been inline cached on the current hidden class doesn't go through PreparePutById anymore, so the value of such a slot
+    // can only be folded after relocating the hidden class once, which also gets rid of those stores.
+    //
+    // To bound the number of relocations, a slot is relocated for at most once for folding, and once a folded value is overwritten, it is never folded again.
+    //
+    // Returns true if the value of 'propertyName' may be folded into an inline cache keyed on the current hidden class.
+    // Note that the hidden class may be relocated even if false is returned.
+    //
+    static bool WARN_UNUSED TryWatchGlobalValueForConstantFolding(HeapPtr<TableObject> self, UserHeapPointer<HeapString> propertyName)
+    {
+        VM* vm = VM::GetActiveVMForCurrentThread();
+        TableObject* rawSelf = TranslateToRawPointer(vm, self);
+        assert(rawSelf->m_hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::CacheableDictionary);
+        CacheableDictionary* dict = TranslateToRawPointer(vm, rawSelf->m_hiddenClass.As<CacheableDictionary>());
+        if (!dict->IsGlobalValueWatchEnabled())
+        {
+            return false;
+        }
+
+        uint32_t slotOrd;
+        if (!CacheableDictionary::GetSlotOrdinalFromStringProperty(dict, propertyName, slotOrd /*out*/))
+        {
+            return false;
+        }
+
+        uint8_t state = dict->GetGlobalValueWatchState(slotOrd);
+        if (state & CacheableDictionary::x_globalValueNeverFold)
+        {
+            return false;
+        }
+
+        if (state & CacheableDictionary::x_globalValueMayBeStored)
+        {
+            if (state & CacheableDictionary::x_globalValueRelocatedForFolding)
+            {
+                return false;
+            }
+
+            // The inline cache being created is keyed on the old hidden class, so the value can only be folded the next time
+            //
+            CacheableDictionary* newDict = dict->RelocateForInvalidatingInlineCaches(vm);
+            rawSelf->m_hiddenClass = newDict;
+            newDict->GetGlobalValueWatchState(slotOrd) |= CacheableDictionary::x_globalValueRelocatedForFolding;
+            return false;
+        }
+
+        dict->GetGlobalValueWatchState(slotOrd) |= CacheableDictionary::x_globalValueFolded;
+        return true;
+    }
+
+    // Must be called before the value in 'slotOrd' of the global object may be changed, see TryWatchGlobalValueForConstantFolding
+    //
+    template<typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
+    static void NO_INLINE NotifyStoreToGlobalObjectSlot(T self, uint32_t slotOrd)
+    {
+        VM* vm = VM::GetActiveVMForCurrentThread();
+        TableObject* rawSelf = TranslateToRawPointer(vm, self);
+        assert(rawSelf->m_hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::CacheableDictionary);
+        CacheableDictionary* dict = TranslateToRawPointer(vm, rawSelf->m_hiddenClass.As<CacheableDictionary>());
+        assert(dict->IsGlobalValueWatchEnabled());
+
+        uint8_t& state = dict->GetGlobalValueWatchState(slotOrd);
+        if (unlikely(state & CacheableDictionary::x_globalValueFolded))
+        {
+            CacheableDictionary* newDict = dict->RelocateForInvalidatingInlineCaches(vm);
+            rawSelf->m_hiddenClass = newDict;
+            newDict->GetGlobalValueWatchState(slotOrd) |= CacheableDictionary::x_globalValueNeverFold | CacheableDictionary::x_globalValueMayBeStored;
+        }
+        else
+        {
+            state |= CacheableDictionary::x_globalValueMayBeStored;
+        }
+    }
+
     template<typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
     static bool WARN_UNUSED PutByIdNeedToCheckMetatable(T self, PutByIdICInfo icInfo)
     {
@@ -969,13 +1331,11 @@ public:
         {
             assert(m_hiddenClass.As<Structure>()->m_butterflyNamedStorageCapacity == 0);
         }
-        else if (m_hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::CacheableDictionary)
-        {
-            assert(m_hiddenClass.As<CacheableDictionary>()->m_butterflyNamedStorageCapacity == 0);
-        }
         else
         {
-           // TODO: assert for UncacheableDictionary
+            assert(m_hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::CacheableDictionary ||
+                   m_hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::UncacheableDictionary);
+            assert(m_hiddenClass.As<CacheableDictionary>()->m_butterflyNamedStorageCapacity == 0);
         }
 #endif
         uint64_t* butterflyStart = new uint64_t[newCapacity + 1];
@@ -1041,15 +1401,10 @@ public:
             {
                 assert(oldNamedStorageCapacity == m_hiddenClass.As<Structure>()->m_butterflyNamedStorageCapacity);
             }
-            else if (hiddenClassTy == HeapEntityType::CacheableDictionary)
-            {
-                assert(oldNamedStorageCapacity == m_hiddenClass.As<CacheableDictionary>()->m_butterflyNamedStorageCapacity);
-            }
             else
             {
-                assert(hiddenClassTy == HeapEntityType::UncacheableDictionary);
-                // TODO: support UncacheableDictionary
-                assert(false && "unimplemented");
+                assert(hiddenClassTy == HeapEntityType::CacheableDictionary || hiddenClassTy == HeapEntityType::UncacheableDictionary);
+                assert(oldNamedStorageCapacity == m_hiddenClass.As<CacheableDictionary>()->m_butterflyNamedStorageCapacity);
             }
 #endif
             uint32_t oldButterflySlots = oldArrayStorageCapacity + oldNamedStorageCapacity + 1;
@@ -1100,7 +1455,9 @@ public:
                 }
             }
 
-            delete [] oldButterflyStart;
+            // The concurrent marker may be reading the old butterfly
+            //
+            VM::GetActiveVMForCurrentThread()->GetUserHeapGarbageCollector()->DeleteArrayMaybeInUseByMarker(oldButterflyStart);
             uint32_t offset = newButterflyNamedStorageCapacity + static_cast<uint32_t>(1 - ArrayGrowthPolicy::x_arrayBaseOrd);
             Butterfly* butterfly = reinterpret_cast<Butterfly*>(newButterflyStart + offset);
             if constexpr(!isGrowNamedStorage)
@@ -1120,18 +1477,131 @@ public:
         {
             oldNamedStorageCapacity = m_hiddenClass.As<Structure>()->m_butterflyNamedStorageCapacity;
         }
-        else if (hiddenClassTy == HeapEntityType::CacheableDictionary)
+        else
         {
+            // UncacheableDictionary has the same layout as CacheableDictionary
+            //
+            assert(hiddenClassTy == HeapEntityType::CacheableDictionary || hiddenClassTy == HeapEntityType::UncacheableDictionary);
             oldNamedStorageCapacity = m_hiddenClass.As<CacheableDictionary>()->m_butterflyNamedStorageCapacity;
         }
-        else
+        GrowButterflyKnowingNamedStorageCapacity<isGrowNamedStorage>(oldNamedStorageCapacity, newCapacity);
+    }
+
+    // The CacheableDictionary transitions to UncacheableDictionary if at least this fraction of its keys have nil value
+    // when its hash table is resized. Such a table is most likely used as a hash map with keys coming and going.
+    //
+    static constexpr uint32_t x_uncacheableDictionaryTransitionNilRatioNumerator = 1;
+    static constexpr uint32_t x_uncacheableDictionaryTransitionNilRatioDenominator = 2;
+
+    // Called after the hash table of the CacheableDictionary 'dict' (which must be our hidden class) is resized.
+    // Transition to UncacheableDictionary if most of the keys have nil value. Return true if the transition happened.
+    //
+    // The slot ordinals are unchanged by the transition, and 'dict' keeps its fields (but not its hash table), so the caller
+    // may continue to use the slot ordinal and the storage capacities it has just computed.
+    //
+    bool WARN_UNUSED CheckForTransitionToUncacheableDictionary(CacheableDictionary* dict)
+    {
+        assert(m_hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::CacheableDictionary);
+        assert(TranslateToRawPointer(m_hiddenClass.As<CacheableDictionary>()) == dict);
+        if (dict->m_shouldNeverTransitToUncacheableDictionary)
         {
-            assert(hiddenClassTy == HeapEntityType::UncacheableDictionary);
-            // TODO: support UncacheableDictionary
-            assert(false && "unimplemented");
-            __builtin_unreachable();
+            return false;
         }
-        GrowButterflyKnowingNamedStorageCapacity<isGrowNamedStorage>(oldNamedStorageCapacity, newCapacity);
+
+        uint32_t numNilSlots = 0;
+        uint8_t inlineCapacity = dict->m_inlineNamedStorageCapacity;
+        for (uint32_t slotOrd = 0; slotOrd < dict->m_slotCount; slotOrd++)
+        {
+            if (GetValueForSlot(this, slotOrd, inlineCapacity).IsNil())
+            {
+                numNilSlots++;
+            }
+        }
+
+        if (numNilSlots * x_uncacheableDictionaryTransitionNilRatioDenominator < dict->m_slotCount * x_uncacheableDictionaryTransitionNilRatioNumerator)
+        {
+            return false;
+        }
+
+        VM* vm = VM::GetActiveVMForCurrentThread();
+        UncacheableDictionary* newDict = UncacheableDictionary::CreateFromCacheableDictionary(vm, dict);
+        m_hiddenClass = newDict;
+        return true;
+    }
+
+    // Remove the keys with nil value from the UncacheableDictionary 'dict' (which must be our hidden class),
+    // and compact the slots of the remaining keys to [0, numKeys), preserving their relative order.
+    // If the named storage is still mostly full afterwards, it is grown, so the compaction is not repeated on every insertion.
+    //
+    // This changes the slot ordinal of existing keys, which is why it is only allowed on UncacheableDictionary.
+    //
+    void NO_INLINE CompactUncacheableDictionary(CacheableDictionary* dict)
+    {
+        assert(m_hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::UncacheableDictionary);
+        assert(TranslateToRawPointer(m_hiddenClass.As<CacheableDictionary>()) == dict);
+
+        uint8_t inlineCapacity = dict->m_inlineNamedStorageCapacity;
+        uint32_t oldSlotCount = dict->m_slotCount;
+
+        std::vector<CacheableDictionary::HashTableEntry> liveEntries;
+        {
+            CacheableDictionary::HashTableEntry* ht = dict->m_hashTable;
+            CacheableDictionary::HashTableEntry* htEnd = ht + dict->m_hashTableMask + 1;
+            while (ht < htEnd)
+            {
+                if (ht->m_key.m_value != 0 && !GetValueForSlot(this, ht->m_slot, inlineCapacity).IsNil())
+                {
+                    liveEntries.push_back(*ht);
+                }
+                ht++;
+            }
+        }
+        std::sort(liveEntries.begin(), liveEntries.end(), [](const CacheableDictionary::HashTableEntry& lhs, const CacheableDictionary::HashTableEntry& rhs) {
+            return lhs.m_slot < rhs.m_slot;
+        });
+
+        auto setValueForSlot = [&](uint32_t slotOrd, TValue value) ALWAYS_INLINE
+        {
+            if (slotOrd < inlineCapacity)
+            {
+                m_inlineStorage[slotOrd] = value;
+            }
+            else
+            {
+                *m_butterfly->GetNamedPropertyAddr(Butterfly::GetOutlineStorageIndex(slotOrd, inlineCapacity)) = value;
+            }
+        };
+
+        // Since the entries are sorted by slot ordinal, the destination slot never exceeds the source slot, so moving in order is safe
+        //
+        dict->ClearHashTable();
+        uint32_t newSlotCount = static_cast<uint32_t>(liveEntries.size());
+        for (uint32_t i = 0; i < newSlotCount; i++)
+        {
+            uint32_t oldSlot = liveEntries[i].m_slot;
+            assert(i <= oldSlot);
+            if (i != oldSlot)
+            {
+                setValueForSlot(i, GetValueForSlot(this, oldSlot, inlineCapacity));
+            }
+            UserHeapPointer<void> key = liveEntries[i].m_key.As();
+            dict->InsertNonExistentPropertyForInitOrResize(key, StructureKeyHashHelper::GetHashValueForMaybeNonStringKey(key), i);
+        }
+        for (uint32_t slotOrd = newSlotCount; slotOrd < oldSlotCount; slotOrd++)
+        {
+            setValueForSlot(slotOrd, TValue::Nil());
+        }
+        dict->m_slotCount = newSlotCount;
+
+        uint32_t totalCapacity = inlineCapacity + dict->m_butterflyNamedStorageCapacity;
+        if (newSlotCount * 4 >= totalCapacity * 3)
+        {
+            uint32_t newButterflyCapacity = CacheableDictionary::GetInitOrNextButterflyCapacity(dict);
+            GrowButterflyKnowingNamedStorageCapacity<true /*isGrowNamedStorage*/>(dict->m_butterflyNamedStorageCapacity, newButterflyCapacity);
+            dict->m_butterflyNamedStorageCapacity = newButterflyCapacity;
+        }
+
+        WriteBarrier(this);
     }
 
     template<bool isGrowNamedStorage>
@@ -1197,6 +1667,7 @@ public:
         TableObject* rawSelf = TranslateToRawPointer(vm, self);
         assert(rawSelf->m_hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::Structure);
         rawSelf->PutByIdTransitionToDictionaryImpl(vm, propertyName, newValue);
+        WriteBarrier(rawSelf);
     }
 
     template<typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
@@ -1227,6 +1698,8 @@ public:
         {
             TCSet(*(self->m_butterfly->GetNamedPropertyAddr(icInfo.m_slot)), newValue);
         }
+
+        WriteBarrier(self);
     }
 
     template<typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
@@ -1272,13 +1745,12 @@ public:
                     Structure* newStructure = structure->UpdateArrayType(vm, newArrType);
                     icInfo.m_newHiddenClass = newStructure;
                 }
-                else if (ty == HeapEntityType::CacheableDictionary)
-                {
-                    icInfo.m_newHiddenClass = icInfo.m_hiddenClass;
-                }
                 else
                 {
-                    assert(false && "unimplemented");
+                    // The array part is not described by a dictionary, so the hidden class is unchanged
+                    //
+                    assert(ty == HeapEntityType::CacheableDictionary || ty == HeapEntityType::UncacheableDictionary);
+                    icInfo.m_newHiddenClass = icInfo.m_hiddenClass;
                 }
                 icInfo.m_newArrayType = newArrType;
             };
@@ -1523,7 +1995,15 @@ public:
         }
     }
 
+    // The write barrier must be executed after the store (see the concurrent marking protocol in gc.h)
+    //
     void PutByIntegerIndexSlow(VM* vm, int64_t index64, TValue value)
+    {
+        PutByIntegerIndexSlowImpl(vm, index64, value);
+        WriteBarrier(this);
+    }
+
+    void PutByIntegerIndexSlowImpl(VM* vm, int64_t index64, TValue value)
     {
         if (index64 < ArrayGrowthPolicy::x_arrayBaseOrd || index64 > ArrayGrowthPolicy::x_unconditionallySparseMapCutoff)
         {
@@ -1901,6 +2381,83 @@ public:
         }
     }
 
+    // Move all the vector-qualifying indices in the sparse map into the vector storage, growing it if needed,
+    // if the result satisfies the same density requirement (ArrayGrowthPolicy::x_densityCutoff) as growing the vector storage.
+    // Return true on success, in which case the sparse map no longer contains any vector-qualifying index.
+    //
+    bool WARN_UNUSED NO_INLINE TryMigrateSparseMapIntoVectorStorage(ArraySparseMap* sparseMap)
+    {
+        assert(m_butterfly != nullptr && m_butterfly->GetHeader()->HasSparseMap());
+        assert(TranslateToRawPointer(m_butterfly->GetHeader()->GetSparseMap()) == sparseMap);
+
+        uint64_t numVectorIndices = 0;
+        int64_t maxVectorIndex = 0;
+        {
+            TValue* values = sparseMap->GetValues();
+            uint64_t* keys = sparseMap->GetKeys();
+            for (uint32_t i = 0; i <= sparseMap->m_hashMask; i++)
+            {
+                if (values[i].IsNil())
+                {
+                    continue;
+                }
+                int64_t idx64;
+                if (IsInt64Index(ArraySparseMap::GetKeyFromBits(keys[i]), idx64 /*out*/) &&
+                    idx64 >= ArrayGrowthPolicy::x_arrayBaseOrd && idx64 <= ArrayGrowthPolicy::x_unconditionallySparseMapCutoff)
+                {
+                    if (idx64 > ArrayGrowthPolicy::x_sparseMapUnlessContinuousCutoff)
+                    {
+                        // The growth policy would never put this index into the vector storage
+                        //
+                        return false;
+                    }
+                    numVectorIndices++;
+                    maxVectorIndex = std::max(maxVectorIndex, idx64);
+                }
+            }
+        }
+
+        uint32_t currentCapacity = m_butterfly->GetHeader()->m_arrayStorageCapacity;
+        uint32_t newCapacity = std::max(currentCapacity, static_cast<uint32_t>(maxVectorIndex + 1 - ArrayGrowthPolicy::x_arrayBaseOrd));
+        if (newCapacity > currentCapacity)
+        {
+            uint64_t nonNilCount = numVectorIndices;
+            for (int32_t i = ArrayGrowthPolicy::x_arrayBaseOrd; i < static_cast<int32_t>(currentCapacity) + ArrayGrowthPolicy::x_arrayBaseOrd; i++)
+            {
+                if (!m_butterfly->UnsafeGetInVectorIndexAddr(i)->IsNil())
+                {
+                    nonNilCount++;
+                }
+            }
+            if (newCapacity > nonNilCount * ArrayGrowthPolicy::x_densityCutoff)
+            {
+                return false;
+            }
+            GrowButterfly<false /*isGrowNamedStorage*/>(newCapacity);
+        }
+
+        {
+            TValue* values = sparseMap->GetValues();
+            uint64_t* keys = sparseMap->GetKeys();
+            for (uint32_t i = 0; i <= sparseMap->m_hashMask; i++)
+            {
+                if (values[i].IsNil())
+                {
+                    continue;
+                }
+                double key = ArraySparseMap::GetKeyFromBits(keys[i]);
+                if (IsVectorQualifyingIndex(key))
+                {
+                    int64_t idx64 = static_cast<int64_t>(key);
+                    assert(m_butterfly->GetHeader()->IndexFitsInVectorCapacity(idx64));
+                    *m_butterfly->UnsafeGetInVectorIndexAddr(idx64) = values[i];
+                }
+            }
+        }
+        sparseMap->Rebuild(sparseMap->m_hashMask, [](double key) { return IsVectorQualifyingIndex(key); });
+        return true;
+    }
+
     void PutIndexIntoSparseMap(VM* vm, bool isVectorQualifyingIndex, double index, TValue value)
     {
 #ifndef NDEBUG
@@ -1941,7 +2498,18 @@ public:
         newArrayType.SetArrayKind(ArrayType::Kind::Any);
 
         ArraySparseMap* sparseMap = GetOrAllocateSparseMap(vm);
-        sparseMap->Insert(index, value);
+        bool didRehash = sparseMap->Insert(index, value);
+        if (unlikely(didRehash) && newArrayType.SparseMapContainsVectorIndex())
+        {
+            // The sparse map has grown, check if its vector-qualifying indices have become dense enough to live in the vector storage.
+            // This is only done when the sparse map is rehashed, so the cost of the check is amortized.
+            //
+            if (TryMigrateSparseMapIntoVectorStorage(sparseMap))
+            {
+                newArrayType.SetSparseMapContainsVectorIndex(false);
+            }
+        }
+        WriteBarrier(this);
 
         if (arrType.m_asValue != newArrayType.m_asValue)
         {
@@ -1961,6 +2529,21 @@ public:
 
     template<typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
     static bool WARN_UNUSED TryPutByValIntegerIndexFastNoIC(T self, int64_t index, TValue value)
+    {
+        // The fast path never changes the array kind, and for an Int32 or Double array it only succeeds
+        // if the value passes the kind check, so no reference is stored
+        //
+        ArrayType arrType = TCGet(self->m_arrayType);
+        bool success = TryPutByValIntegerIndexFastNoICImpl(self, index, value);
+        if (likely(success) && !arrType.ArrayPartHasNoReference())
+        {
+            WriteBarrier(self);
+        }
+        return success;
+    }
+
+    template<typename T, typename = std::enable_if_t<IsPtrOrHeapPtr<T, TableObject>>>
+    static bool WARN_UNUSED TryPutByValIntegerIndexFastNoICImpl(T self, int64_t index, TValue value)
     {
         ArrayType arrType = TCGet(self->m_arrayType);
         AssertImp(TCGet(self->m_hiddenClass).template As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::Structure,
@@ -2136,6 +2719,7 @@ public:
     {
         uint8_t inlineCapacity = Structure::x_maxNumSlots;
         CacheableDictionary* hc = CacheableDictionary::CreateEmptyDictionary(vm, 128 /*anticipatedNumSlots*/, inlineCapacity, true /*shouldNeverTransitToUncacheableDictionary*/);
+        hc->EnableGlobalValueWatch();
         HeapPtr<TableObject> r = AllocateObjectImpl(vm, inlineCapacity);
         TCSet(r->m_hiddenClass, SystemHeapPointer<void> { hc });
         r->m_butterfly = nullptr;
@@ -2157,15 +2741,10 @@ public:
         {
             assert(butterflyNamedStorageCapacity == m_hiddenClass.As<Structure>()->m_butterflyNamedStorageCapacity);
         }
-        else if (hiddenClassTy == HeapEntityType::CacheableDictionary)
-        {
-            assert(butterflyNamedStorageCapacity == m_hiddenClass.As<CacheableDictionary>()->m_butterflyNamedStorageCapacity);
-        }
         else
         {
-            assert(hiddenClassTy == HeapEntityType::UncacheableDictionary);
-            // TODO: support UncacheableDictionary
-            ReleaseAssert(false && "unimplemented");
+            assert(hiddenClassTy == HeapEntityType::CacheableDictionary || hiddenClassTy == HeapEntityType::UncacheableDictionary);
+            assert(butterflyNamedStorageCapacity == m_hiddenClass.As<CacheableDictionary>()->m_butterflyNamedStorageCapacity);
         }
 #endif
         uint32_t butterflySlots = arrayStorageCapacity + butterflyNamedStorageCapacity + 1;
@@ -2217,8 +2796,11 @@ public:
         }
         else
         {
-            // TODO: support UncacheableDictionary
-            ReleaseAssert(false && "unimplemented");
+            UncacheableDictionary* ud = TranslateToRawPointer(m_hiddenClass.As<UncacheableDictionary>());
+            UncacheableDictionary* cloneUd = ud->Clone(vm);
+            inlineCapacity = ud->m_inlineNamedStorageCapacity;
+            butterflyNamedStorageCapacity = ud->m_butterflyNamedStorageCapacity;
+            newHiddenClass = cloneUd;
         }
 
         TableObject* r = TranslateToRawPointer(vm, AllocateObjectImpl(vm, inlineCapacity));
@@ -2259,8 +2841,10 @@ public:
     // These are just some artificial configuration limits for specialized TableDup opcodes
     // Maybe the config shouldn't be put here, but let's think about that later..
     //
-    static constexpr uint8_t TableDupMaxInlineCapacitySteppingForNoButterflyCase() { return 3; }
-    static constexpr uint8_t TableDupMaxInlineCapacitySteppingForHasButterflyCase() { return 2; }
+    // The limits are expressed as inline capacities, since the steppings depend on the size classes of the allocator
+    //
+    static constexpr uint8_t TableDupMaxInlineCapacitySteppingForNoButterflyCase() { return internal::x_optimalInlineCapacitySteppingArray[14]; }
+    static constexpr uint8_t TableDupMaxInlineCapacitySteppingForHasButterflyCase() { return internal::x_optimalInlineCapacitySteppingArray[6]; }
 
     // Specialized ShallowCloneTableObject for TableDup, which leverages the statically known information for better code.
     // This function is ALWAYS_INLINE because by design the arguments will be constants after inlining.
@@ -2355,8 +2939,13 @@ public:
         }
         else
         {
-            // TODO: support UncacheableDictionary
-            ReleaseAssert(false && "unimplemented");
+            // UncacheableDictionary changes its metatable in place, so the result must not be cached on the hidden class
+            //
+            HeapPtr<UncacheableDictionary> ud = hc.As<UncacheableDictionary>();
+            return GetMetatableResult {
+                .m_result = TCGet(ud->m_metatable),
+                .m_isCacheable = false
+            };
         }
     }
 
@@ -2391,6 +2980,7 @@ public:
                     assert(m_butterfly != nullptr);
                     *m_butterfly->GetNamedPropertyAddr(Butterfly::GetOutlineStorageIndex(result.m_slotOrdinal, inlineStorageCapacity)) = TValue::CreatePointer(newMetatable);
                 }
+                WriteBarrier(this);
             }
             m_hiddenClass = result.m_newStructure.As();
             m_arrayType = TCGet(result.m_newStructure.As()->m_arrayType);
@@ -2413,8 +3003,11 @@ public:
         }
         else
         {
-            // TODO: support UncacheableDictionary
-            ReleaseAssert(false && "unimplemented");
+            // No inline cache depends on an UncacheableDictionary, so no need to relocate it
+            //
+            UncacheableDictionary* ud = TranslateToRawPointer(vm, hc.As<UncacheableDictionary>());
+            ud->m_metatable = newMetatable.As();
+            m_arrayType.SetMayHaveMetatable(true);
         }
     }
 
@@ -2465,8 +3058,9 @@ public:
         }
         else
         {
-            // TODO: support UncacheableDictionary
-            ReleaseAssert(false && "unimplemented");
+            UncacheableDictionary* ud = TranslateToRawPointer(vm, hc.As<UncacheableDictionary>());
+            ud->m_metatable.m_value = 0;
+            m_arrayType.SetMayHaveMetatable(false);
         }
     }
 
@@ -2702,8 +3296,8 @@ inline UserHeapPointer<void> GetMetatableForValue(TValue value)
             return VM::GetActiveVMForCurrentThread()->m_metatableForCoroutine;
         }
 
-        // TODO: support USERDATA type
-        ReleaseAssert(false && "unimplemented");
+        assert(ty == HeapEntityType::Userdata);
+        return value.As<tUserdata>()->m_metatable;
     }
 
     if (value.IsMIV())
@@ -2780,8 +3374,8 @@ inline HeapPtr<FunctionObject> WARN_UNUSED NO_INLINE GetCallTargetViaMetatable(T
             return GetCallMetamethodFromMetatableImpl(VM::GetActiveVMForCurrentThread()->m_metatableForCoroutine);
         }
 
-        // TODO: support USERDATA type
-        ReleaseAssert(false && "unimplemented");
+        assert(ty == HeapEntityType::Userdata);
+        return GetCallMetamethodFromMetatableImpl(value.As<tUserdata>()->m_metatable);
     }
 
     if (value.Is<tNil>())
@@ -2809,11 +3403,12 @@ inline HeapPtr<FunctionObject> WARN_UNUSED NO_INLINE GetCallTargetViaMetatable(T
 // Lua explicitly states that if new keys are added, the behavior for iterator is undefined. So we don't need to worry
 // about correctness when there's a change in hidden class, as long as we don't crash or cause data corruptions in such cases.
 //
-// The story could be more difficult once we support UncacheableDictionary, as Lua explicitly allows deletion of keys during a traversal.
-// Here's the proposal to deal with this issue: transition from CacheableDictionary to UncacheableDictionary, or resizing (including
-// shrinking) of UncacheableDictionary's hash table should be made to only happen upon key insertion, never at other times. Now, if
-// the table transited to UncacheableDictionary or the UncacheableDictionary's hash table gets rehashed during a traversal, it means
-// the user must have already violated the Lua standard by inserted a new key, so we are free to exhibit undefined behavior, so we are good.
+// The story is more difficult for UncacheableDictionary, as Lua explicitly allows deletion of keys during a traversal, and an
+// UncacheableDictionary may remove keys and rehash its hash table. To deal with this issue, the transition from CacheableDictionary to
+// UncacheableDictionary, and the compaction (and rehashing) of UncacheableDictionary's hash table only happen upon key insertion, never
+// at other times. Now, if the table transited to UncacheableDictionary or the UncacheableDictionary's hash table gets rehashed during a
+// traversal, it means the user must have already violated the Lua standard by inserted a new key, so we are free to exhibit undefined
+// behavior, so we are good.
 //
 // TODO: we probably should make this a buffered iterator living on the heap for better performance, but this will complicate the design a lot..
 //
@@ -2860,19 +3455,15 @@ struct TableObjectIterator
                 m_namedPropertyOrd = static_cast<uint32_t>(-1);
                 goto try_get_next_structure_prop;
             }
-            else if (hcType == HeapEntityType::CacheableDictionary)
+            else
             {
+                // UncacheableDictionary has the same layout as CacheableDictionary, so it is iterated in the same way
+                //
                 cacheableDict = TCGet(obj->m_hiddenClass).As<CacheableDictionary>();
                 m_state = IteratorState::NamedProperty;
                 m_namedPropertyOrd = 0;
                 goto try_find_and_get_cd_prop;
             }
-            else
-            {
-                // TODO: support UncacheableDictionary
-                assert(false && "unimplemented");
-                __builtin_unreachable();
-            }
         }
 
         if (m_state == IteratorState::NamedProperty)
@@ -2925,7 +3516,7 @@ try_get_next_structure_prop:
                     .m_value = value
                 };
             }
-            else if (hcType == HeapEntityType::CacheableDictionary)
+            else
             {
                 cacheableDict = TCGet(obj->m_hiddenClass).As<CacheableDictionary>();
                 m_namedPropertyOrd++;
@@ -2951,12 +3542,6 @@ try_find_and_get_cd_prop:
                 }
                 goto try_start_iterating_vector_storage;
             }
-            else
-            {
-                // TODO: support UncacheableDictionary
-                assert(false && "unimplemented");
-                __builtin_unreachable();
-            }
 
 try_start_iterating_vector_storage:
             if (unlikely(obj->m_butterfly == nullptr))
@@ -3008,18 +3593,17 @@ try_find_next_vector_entry:
 try_find_next_sparse_map_entry:
         while (m_sparseMapOrd <= sparseMap->m_hashMask)
         {
-            ArraySparseMap::HashTableEntry& entry = sparseMap->m_hashTable[m_sparseMapOrd];
-            double key = entry.m_key;
-            if (!IsNaN(key))
+            // An empty slot always has nil value, so only the value needs to be checked
+            //
+            TValue value = sparseMap->GetValues()[m_sparseMapOrd];
+            if (!value.IsNil())
             {
-                TValue value = entry.m_value;
-                if (!value.IsNil())
-                {
-                    return KeyValuePair {
-                        .m_key = TValue::CreateDouble(key),
-                        .m_value = value
-                    };
-                }
+                uint64_t keyBits = sparseMap->GetKeys()[m_sparseMapOrd];
+                assert(!ArraySparseMap::IsEmptyKey(keyBits));
+                return KeyValuePair {
+                    .m_key = TValue::CreateDouble(ArraySparseMap::GetKeyFromBits(keyBits)),
+                    .m_value = value
+                };
             }
             m_sparseMapOrd++;
         }
@@ -3085,7 +3669,7 @@ finished_iteration:
                 out = iter.Advance(obj);
                 return true;
             }
-            else if (hcType == HeapEntityType::CacheableDictionary)
+            else
             {
                 HeapPtr<CacheableDictionary> cacheableDict = TCGet(obj->m_hiddenClass).As<CacheableDictionary>();
                 uint32_t hashTableSlot = CacheableDictionary::GetHashTableSlotNumberForProperty(cacheableDict, prop);
@@ -3099,11 +3683,6 @@ finished_iteration:
                 out = iter.Advance(obj);
                 return true;
             }
-            else
-            {
-                // TODO: support UncacheableDictionary
-                ReleaseAssert(false && "unimplemented");
-            }
         }
 
         if (key.IsInt32())
@@ -1,5 +1,11 @@
 #include "vm.h"
 #include "runtime_utils.h"
+#include "gc.h"
+#include "baseline_jit_background_compiler.h"
+#include "persistent_hot_function_cache.h"
+#include "lua_pattern.h"
+#include "interpreter_opcode_profiler.h"
+#include "deegen_options.h"
 
 VM* WARN_UNUSED VM::Create()
 {
@@ -133,33 +139,21 @@ bool WARN_UNUSED VM::InitializeVMBase()
     }
 
     m_totalBaselineJitCompilations = 0;
+    m_isBackgroundBaselineJitCompilationEnabled = false;
+    m_baselineJitBackgroundCompiler = nullptr;
+    m_persistentHotFunctionCache = nullptr;
+
+    m_megamorphicPropertyCache = new (std::nothrow) MegamorphicPropertyCache;
+    CHECK_LOG_ERROR(m_megamorphicPropertyCache != nullptr, "Failed to allocate space for megamorphic property cache");
+
+    m_userHeapGc = new UserHeapGarbageCollector(this);
 
     return true;
 }
 
-void __attribute__((__preserve_most__)) VM::BumpUserHeap()
+void __attribute__((__preserve_most__)) VM::AllocFromUserHeapSlowPath(uint32_t length)
 {
-    assert(m_userHeapCurPtr < m_userHeapPtrLimit);
-    VM_FAIL_IF(m_userHeapCurPtr < -static_cast<intptr_t>(x_vmBaseOffset),
-               "Resource limit exceeded: user heap overflowed %dGB memory limit.", static_cast<int>(x_vmUserHeapSize >> 30));
-
-    constexpr size_t x_allocationSize = 65536;
-    // TODO: consider allocating smaller sizes on the first few allocations
-    //
-    intptr_t newHeapLimit = m_userHeapCurPtr & (~static_cast<intptr_t>(x_allocationSize - 1));
-    assert(newHeapLimit <= m_userHeapCurPtr && newHeapLimit % static_cast<int64_t>(x_pageSize) == 0 && newHeapLimit < m_userHeapPtrLimit);
-    size_t lengthToAllocate = static_cast<size_t>(m_userHeapPtrLimit - newHeapLimit);
-    assert(lengthToAllocate % x_pageSize == 0);
-
-    uintptr_t allocAddr = VMBaseAddress() + static_cast<uint64_t>(newHeapLimit);
-    void* r = mmap(reinterpret_cast<void*>(allocAddr), lengthToAllocate, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE | MAP_FIXED, -1, 0);
-    VM_FAIL_WITH_ERRNO_IF(r == MAP_FAILED,
-                          "Out of Memory: Allocation of length %llu failed", static_cast<unsigned long long>(lengthToAllocate));
-    assert(r == reinterpret_cast<void*>(allocAddr));
-
-    m_userHeapPtrLimit = newHeapLimit;
-    assert(m_userHeapPtrLimit <= m_userHeapCurPtr);
-    assert(m_userHeapPtrLimit >= -static_cast<intptr_t>(x_vmBaseOffset));
+    m_userHeapGc->AllocationSlowPath(length);
 }
 
 void VM::BumpSystemHeap()
@@ -306,6 +300,9 @@ bool WARN_UNUSED VM::InitializeVMGlobalData()
     m_metatableForString = UserHeapPointer<void>();
     m_metatableForFunction = UserHeapPointer<void>();
     m_metatableForCoroutine = UserHeapPointer<void>();
+    m_metatableForFile = UserHeapPointer<void>();
+    m_ioDefaultInput = UserHeapPointer<HeapCDataObject>();
+    m_ioDefaultOutput = UserHeapPointer<HeapCDataObject>();
 
     m_emptyString = nullptr;
     m_toStringString.m_value = 0;
@@ -321,14 +318,21 @@ bool WARN_UNUSED VM::InitializeVMGlobalData()
 bool WARN_UNUSED VM::InitializeVMStringManager()
 {
     static constexpr uint32_t x_initialSize = 1024;
-    m_hashTable = new (std::nothrow) GeneralHeapPointer<HeapString>[x_initialSize];
+    m_hashTable = new (std::nothrow) StringHtEntry[x_initialSize];
     CHECK_LOG_ERROR(m_hashTable != nullptr, "Failed to allocate space for initial hash table");
 
     static_assert(x_stringConserHtNonexistentValue == 0, "required for memset");
-    memset(m_hashTable, 0, sizeof(GeneralHeapPointer<HeapString>) * x_initialSize);
+    memset(m_hashTable, 0, sizeof(StringHtEntry) * x_initialSize);
 
     m_hashTableSizeMask = x_initialSize - 1;
     m_elementCount = 0;
+    m_oldHashTable = nullptr;
+    m_oldHashTableSizeMask = 0;
+    m_hashTableMigrationCursor = 0;
+
+    m_concatHashResumeState = new (std::nothrow) IncrementalStringHasher;
+    CHECK_LOG_ERROR(m_concatHashResumeState != nullptr, "Failed to allocate space for concatenation hash state");
+    m_concatHashResumeString = nullptr;
 
     // Create a special key used as an exotic index into the table
     //
@@ -376,6 +380,11 @@ void VM::CleanupVMStringManager()
     {
         delete [] m_hashTable;
     }
+    if (m_oldHashTable != nullptr)
+    {
+        delete [] m_oldHashTable;
+    }
+    delete m_concatHashResumeState;
 }
 
 bool WARN_UNUSED VM::Initialize()
@@ -393,7 +402,47 @@ bool WARN_UNUSED VM::Initialize()
 
 void VM::Cleanup()
 {
+    // The compiler thread must be stopped before the JIT memory it is writing to goes away
+    //
+    delete m_baselineJitBackgroundCompiler;
+    if (m_persistentHotFunctionCache != nullptr)
+    {
+        // Failing to write the cache only makes the next run start cold
+        //
+        std::ignore = m_persistentHotFunctionCache->Flush();
+        delete m_persistentHotFunctionCache;
+    }
+    for (TValue* stack : m_coroutineStackPool)
+    {
+        CoroutineRuntimeContext::FreeStack(stack, CoroutineRuntimeContext::x_defaultStackSlots + CoroutineRuntimeContext::x_stackReservedSlots);
+    }
+    for (auto& entry : m_compiledLuaPatternCache)
+    {
+        delete entry.second;
+    }
+    delete m_megamorphicPropertyCache;
+    if (x_enable_interpreter_opcode_profiling)
+    {
+        InterpreterOpcodeProfiler::WriteReportToFileAndReset();
+    }
     CleanupVMStringManager();
+    delete m_userHeapGc;
+}
+
+BaselineJitBackgroundCompiler* VM::GetBaselineJitBackgroundCompiler()
+{
+    assert(IsExecutionThread());
+    if (m_baselineJitBackgroundCompiler == nullptr)
+    {
+        m_baselineJitBackgroundCompiler = new BaselineJitBackgroundCompiler(this);
+    }
+    return m_baselineJitBackgroundCompiler;
+}
+
+void VM::OpenPersistentHotFunctionCache(const std::string& path)
+{
+    assert(m_persistentHotFunctionCache == nullptr);
+    m_persistentHotFunctionCache = PersistentHotFunctionCache::Open(path);
 }
 
 namespace {
@@ -467,16 +516,66 @@ HeapString* WARN_UNUSED ALWAYS_INLINE MaterializeMultiPieceString(VM* vm, Iterat
 
 }   // anonymous namespace
 
-void VM::ReinsertDueToResize(GeneralHeapPointer<HeapString>* hashTable, uint32_t hashTableSizeMask, GeneralHeapPointer<HeapString> e)
+void VM::InsertIntoStringHtForResize(StringHtEntry* hashTable, uint32_t hashTableSizeMask, StringHtEntry e)
 {
-    uint32_t slot = e.As<HeapString>()->m_hashLow & hashTableSizeMask;
-    while (hashTable[slot].m_value != x_stringConserHtNonexistentValue)
+    assert(!e.IsNonExistent());
+    uint32_t slot = e.m_hashLow & hashTableSizeMask;
+    uint32_t dist = 0;
+    while (!hashTable[slot].IsNonExistent())
     {
+        // Robin Hood: the entry further away from its home slot takes the slot, and the other one continues probing
+        //
+        uint32_t curDist = GetStringHtProbeDistance(hashTable[slot], slot, hashTableSizeMask);
+        if (curDist < dist)
+        {
+            std::swap(hashTable[slot], e);
+            dist = curDist;
+        }
         slot = (slot + 1) & hashTableSizeMask;
+        dist++;
     }
     hashTable[slot] = e;
 }
 
+void VM::DeleteFromStringHt(StringHtEntry* hashTable, uint32_t hashTableSizeMask, uint32_t slot)
+{
+    assert(!hashTable[slot].IsNonExistent());
+    while (true)
+    {
+        uint32_t nextSlot = (slot + 1) & hashTableSizeMask;
+        StringHtEntry next = hashTable[nextSlot];
+        if (next.IsNonExistent() || GetStringHtProbeDistance(next, nextSlot, hashTableSizeMask) == 0)
+        {
+            break;
+        }
+        hashTable[slot] = next;
+        slot = nextSlot;
+    }
+    static_assert(x_stringConserHtNonexistentValue == 0);
+    hashTable[slot] = StringHtEntry { };
+}
+
+void VM::MigrateStringConserHashTableSlots(uint32_t maxSlots)
+{
+    assert(IsStringConserHashTableMigrationInProgress());
+    uint32_t oldSize = m_oldHashTableSizeMask + 1;
+    uint32_t end = m_hashTableMigrationCursor + std::min(maxSlots, oldSize - m_hashTableMigrationCursor);
+    for (uint32_t i = m_hashTableMigrationCursor; i < end; i++)
+    {
+        if (!m_oldHashTable[i].IsNonExistent())
+        {
+            InsertIntoStringHtForResize(m_hashTable, m_hashTableSizeMask, m_oldHashTable[i]);
+        }
+    }
+    m_hashTableMigrationCursor = end;
+
+    if (end == oldSize)
+    {
+        delete [] m_oldHashTable;
+        m_oldHashTable = nullptr;
+    }
+}
+
 void VM::ExpandStringConserHashTableIfNeeded()
 {
     if (likely(m_elementCount <= (m_hashTableSizeMask >> x_stringht_loadfactor_denominator_shift) * x_stringht_loadfactor_numerator))
@@ -485,104 +584,221 @@ void VM::ExpandStringConserHashTableIfNeeded()
     }
 
     assert(m_hashTable != nullptr && is_power_of_2(m_hashTableSizeMask + 1));
+
+    // x_stringht_numSlotsMigratedPerInsertion is chosen so that this cannot happen, but it costs nothing to be defensive
+    //
+    if (unlikely(IsStringConserHashTableMigrationInProgress()))
+    {
+        MigrateStringConserHashTableSlots(static_cast<uint32_t>(-1));
+    }
+
     VM_FAIL_IF(m_hashTableSizeMask >= (1U << 29),
                "Global string hash table has grown beyond 2^30 slots");
     uint32_t newSize = (m_hashTableSizeMask + 1) * 2;
-    uint32_t newMask = newSize - 1;
-    GeneralHeapPointer<HeapString>* newHt = new (std::nothrow) GeneralHeapPointer<HeapString>[newSize];
+    StringHtEntry* newHt = new (std::nothrow) StringHtEntry[newSize];
     VM_FAIL_IF(newHt == nullptr,
                "Out of memory, failed to resize global string hash table to size %u", static_cast<unsigned>(newSize));
 
     static_assert(x_stringConserHtNonexistentValue == 0, "we are relying on this to do memset");
-    memset(newHt, 0, sizeof(GeneralHeapPointer<HeapString>) * newSize);
+    memset(newHt, 0, sizeof(StringHtEntry) * newSize);
+
+    // The entries are migrated lazily by subsequent insertions, see InsertMultiPieceString
+    //
+    m_oldHashTable = m_hashTable;
+    m_oldHashTableSizeMask = m_hashTableSizeMask;
+    m_hashTableMigrationCursor = 0;
+    m_hashTable = newHt;
+    m_hashTableSizeMask = newSize - 1;
+}
 
-    GeneralHeapPointer<HeapString>* cur = m_hashTable;
-    GeneralHeapPointer<HeapString>* end = m_hashTable + m_hashTableSizeMask + 1;
-    while (cur < end)
+uint32_t WARN_UNUSED VM::ValidateGlobalStringHashConserAndGetMaxProbeDistance()
+{
+    uint32_t maxDist = 0;
+    uint32_t numEntries = 0;
+    auto validateTable = [&](StringHtEntry* hashTable, uint32_t hashTableSizeMask, uint32_t begin)
     {
-        if (!StringHtCellValueIsNonExistentOrDeleted(cur->m_value))
+        for (uint32_t slot = 0; slot <= hashTableSizeMask; slot++)
         {
-            ReinsertDueToResize(newHt, newMask, *cur);
+            StringHtEntry entry = hashTable[slot];
+            if (entry.IsNonExistent())
+            {
+                continue;
+            }
+            HeapPtr<HeapString> s = entry.m_ptr.As<HeapString>();
+            VM_FAIL_IF(s->m_type != HeapEntityType::String || s->m_hashLow != entry.m_hashLow,
+                       "Global string hash table slot %u does not hold the string it claims to", static_cast<unsigned>(slot));
+
+            // Robin Hood ordering: the next entry in the probe sequence is at most one slot further from its home slot
+            //
+            uint32_t dist = GetStringHtProbeDistance(entry, slot, hashTableSizeMask);
+            uint32_t nextSlot = (slot + 1) & hashTableSizeMask;
+            VM_FAIL_IF(!hashTable[nextSlot].IsNonExistent() && GetStringHtProbeDistance(hashTable[nextSlot], nextSlot, hashTableSizeMask) > dist + 1,
+                       "Global string hash table slot %u violates Robin Hood ordering", static_cast<unsigned>(nextSlot));
+            maxDist = std::max(maxDist, dist);
+
+            // The slots of the old table before the migration cursor have been copied to the new table, and are already counted
+            //
+            if (slot >= begin)
+            {
+                numEntries++;
+            }
         }
-        cur++;
+    };
+
+    validateTable(m_hashTable, m_hashTableSizeMask, 0 /*begin*/);
+    if (IsStringConserHashTableMigrationInProgress())
+    {
+        validateTable(m_oldHashTable, m_oldHashTableSizeMask, m_hashTableMigrationCursor /*begin*/);
     }
-    delete [] m_hashTable;
-    m_hashTable = newHt;
-    m_hashTableSizeMask = newMask;
+    VM_FAIL_IF(numEntries != m_elementCount,
+               "Global string hash table has %u entries, but the element count is %u", static_cast<unsigned>(numEntries), static_cast<unsigned>(m_elementCount));
+    return maxDist;
 }
 
-// Insert an abstract multi-piece string into the hash table if it does not exist
-// Return the HeapString
-//
 template<typename Iterator>
-UserHeapPointer<HeapString> WARN_UNUSED VM::InsertMultiPieceString(Iterator iterator)
+HeapString* WARN_UNUSED VM::LookupMultiPieceStringInStringHt(StringHtEntry* hashTable, uint32_t hashTableSizeMask, Iterator iterator, uint32_t expectedHashLow, uint8_t expectedHashHigh, size_t length)
 {
     HeapPtrTranslator translator = GetHeapPtrTranslator();
 
-    StringLengthAndHash lenAndHash = HashMultiPieceString(iterator);
-    uint64_t hash = lenAndHash.m_hashValue;
-    size_t length = lenAndHash.m_length;
-    uint8_t expectedHashHigh = static_cast<uint8_t>(hash >> 56);
-    uint32_t expectedHashLow = BitwiseTruncateTo<uint32_t>(hash);
-
-    uint32_t slotForInsertion = static_cast<uint32_t>(-1);
-    uint32_t slot = static_cast<uint32_t>(hash) & m_hashTableSizeMask;
+    uint32_t slot = expectedHashLow & hashTableSizeMask;
+    uint32_t dist = 0;
     while (true)
     {
+        StringHtEntry entry = hashTable[slot];
+        if (entry.IsNonExistent())
+        {
+            return nullptr;
+        }
+
+        // If the entry is closer to its home slot than our string would be, our string would have taken this slot
+        //
+        if (GetStringHtProbeDistance(entry, slot, hashTableSizeMask) < dist)
+        {
+            return nullptr;
+        }
+
+        if (entry.m_hashLow == expectedHashLow)
         {
-            GeneralHeapPointer<HeapString> ptr = m_hashTable[slot];
-            if (StringHtCellValueIsNonExistentOrDeleted(ptr))
+            HeapPtr<HeapString> s = entry.m_ptr.As<HeapString>();
+            assert(s->m_hashLow == expectedHashLow);
+            if (s->m_hashHigh == expectedHashHigh && s->m_length == length)
             {
-                // If this string turns out to be non-existent, this can be a slot to insert the string
-                //
-                if (slotForInsertion == static_cast<uint32_t>(-1))
+                HeapString* rawPtr = translator.TranslateToRawPtr(s);
+                if (CompareMultiPieceStringEqual(iterator, rawPtr))
                 {
-                    slotForInsertion = slot;
-                }
-                if (StringHtCellValueIsNonExistent(ptr))
-                {
-                    break;
-                }
-                else
-                {
-                    goto next_slot;
+                    return rawPtr;
                 }
             }
+        }
 
-            HeapPtr<HeapString> s = ptr.As<HeapString>();
-            if (s->m_hashHigh != expectedHashHigh || s->m_hashLow != expectedHashLow || s->m_length != length)
-            {
-                goto next_slot;
-            }
+        slot = (slot + 1) & hashTableSizeMask;
+        dist++;
+    }
+}
 
-            HeapString* rawPtr = translator.TranslateToRawPtr(s);
-            if (!CompareMultiPieceStringEqual(iterator, rawPtr))
-            {
-                goto next_slot;
-            }
+// Insert an abstract multi-piece string into the hash table if it does not exist
+// Return the HeapString
+//
+template<typename Iterator>
+UserHeapPointer<HeapString> WARN_UNUSED VM::InsertMultiPieceString(Iterator iterator)
+{
+    return InsertMultiPieceStringWithKnownHash(iterator, HashMultiPieceString(iterator));
+}
 
-            // We found the string
-            //
-            return translator.TranslateToUserHeapPtr(rawPtr);
-        }
-next_slot:
-        slot = (slot + 1) & m_hashTableSizeMask;
+template<typename Iterator>
+UserHeapPointer<HeapString> WARN_UNUSED VM::InsertMultiPieceStringWithKnownHash(Iterator iterator, StringLengthAndHash lenAndHash)
+{
+    HeapPtrTranslator translator = GetHeapPtrTranslator();
+
+    uint64_t hash = lenAndHash.m_hashValue;
+    size_t length = lenAndHash.m_length;
+    uint8_t expectedHashHigh = static_cast<uint8_t>(hash >> 56);
+    uint32_t expectedHashLow = BitwiseTruncateTo<uint32_t>(hash);
+
+    HeapString* found = LookupMultiPieceStringInStringHt(m_hashTable, m_hashTableSizeMask, iterator, expectedHashLow, expectedHashHigh, length);
+    if (found == nullptr && unlikely(IsStringConserHashTableMigrationInProgress()))
+    {
+        found = LookupMultiPieceStringInStringHt(m_oldHashTable, m_oldHashTableSizeMask, iterator, expectedHashLow, expectedHashHigh, length);
+    }
+    if (found != nullptr)
+    {
+        return translator.TranslateToUserHeapPtr(found);
     }
 
     // The string is not found, insert it into the hash table
     //
-    assert(slotForInsertion != static_cast<uint32_t>(-1));
-    assert(StringHtCellValueIsNonExistentOrDeleted(m_hashTable[slotForInsertion]));
-
     m_elementCount++;
     HeapString* element = MaterializeMultiPieceString(this, iterator, lenAndHash);
-    m_hashTable[slotForInsertion] = translator.TranslateToGeneralHeapPtr(element);
+    InsertIntoStringHtForResize(m_hashTable, m_hashTableSizeMask, StringHtEntry {
+        .m_ptr = translator.TranslateToGeneralHeapPtr(element),
+        .m_hashLow = expectedHashLow
+    });
+
+    if (unlikely(IsStringConserHashTableMigrationInProgress()))
+    {
+        MigrateStringConserHashTableSlots(x_stringht_numSlotsMigratedPerInsertion);
+    }
 
     ExpandStringConserHashTableIfNeeded();
 
     return translator.TranslateToUserHeapPtr(element);
 }
 
+template<typename Iterator, typename RestIterator>
+UserHeapPointer<HeapString> WARN_UNUSED VM::InsertConcatenatedString(HeapString* firstPiece, Iterator iterator, RestIterator restIterator)
+{
+    IncrementalStringHasher* hasher = m_concatHashResumeState;
+    if (firstPiece == m_concatHashResumeString)
+    {
+        // The hasher holds the state right after hashing 'firstPiece', so only the rest needs to be hashed
+        //
+        assert(hasher->m_length == firstPiece->m_length);
+        while (restIterator.HasMore())
+        {
+            const void* str;
+            size_t len;
+            std::tie(str, len) = restIterator.GetAndAdvance();
+            hasher->Update(str, len);
+        }
+    }
+    else
+    {
+        size_t totalLength = 0;
+        {
+            Iterator it = iterator;
+            while (it.HasMore())
+            {
+                totalLength += it.GetAndAdvance().second;
+            }
+        }
+        if (totalLength < x_minLengthForConcatHashResumption)
+        {
+            return InsertMultiPieceString(iterator);
+        }
+
+        hasher->Reset();
+        Iterator it = iterator;
+        while (it.HasMore())
+        {
+            const void* str;
+            size_t len;
+            std::tie(str, len) = it.GetAndAdvance();
+            hasher->Update(str, len);
+        }
+    }
+
+    StringLengthAndHash lenAndHash = hasher->Digest();
+    assert(lenAndHash.m_hashValue == HashMultiPieceString(iterator).m_hashValue);
+
+    // The hasher no longer corresponds to the old string
+    //
+    m_concatHashResumeString = nullptr;
+
+    UserHeapPointer<HeapString> result = InsertMultiPieceStringWithKnownHash(iterator, lenAndHash);
+    m_concatHashResumeString = GetHeapPtrTranslator().TranslateToRawPtr(result.As<HeapString>());
+    return result;
+}
+
 UserHeapPointer<HeapString> WARN_UNUSED VM::CreateStringObjectFromConcatenation(TValue* start, size_t len)
 {
 #ifndef NDEBUG
@@ -612,11 +828,28 @@ UserHeapPointer<HeapString> WARN_UNUSED VM::CreateStringObjectFromConcatenation(
         HeapPtrTranslator m_translator;
     };
 
-    return InsertMultiPieceString(Iterator {
-        .m_cur = start,
-        .m_end = start + len,
-        .m_translator = GetHeapPtrTranslator()
-    });
+    if (len == 0)
+    {
+        return InsertMultiPieceString(Iterator {
+            .m_cur = start,
+            .m_end = start,
+            .m_translator = GetHeapPtrTranslator()
+        });
+    }
+
+    HeapPtrTranslator translator = GetHeapPtrTranslator();
+    return InsertConcatenatedString(
+        translator.TranslateToRawPtr(start[0].AsPointer().As<HeapString>()),
+        Iterator {
+            .m_cur = start,
+            .m_end = start + len,
+            .m_translator = translator
+        },
+        Iterator {
+            .m_cur = start + 1,
+            .m_end = start + len,
+            .m_translator = translator
+        });
 }
 
 UserHeapPointer<HeapString> WARN_UNUSED VM::CreateStringObjectFromConcatenation(std::pair<const void*, size_t>* start, size_t len)
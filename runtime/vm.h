@@ -119,7 +119,8 @@ constexpr int WARN_UNUSED GetLuaMetamethodOrdinalFromStringHash(uint8_t hashHigh
   /* C++ class name   Use lockfree freelist */  \
     (WatchpointSet,                 false)      \
   , (JitCallInlineCacheEntry,       false)      \
-  , (JitGenericInlineCacheEntry,    false)
+  , (JitGenericInlineCacheEntry,    false)      \
+  , (JitCallMegamorphicProfile,     false)
 
 #define SPDS_CPP_NAME(e) PP_TUPLE_GET_1(e)
 #define SPDS_USE_LOCKFREE_FREELIST(e) PP_TUPLE_GET_2(e)
@@ -292,11 +293,42 @@ private:
 namespace internal
 {
 
+// The size classes of the user heap allocator, in 8-byte slots.
+// An allocation of at most x_userHeapMaxSizeClassSlots slots is rounded up to the least fitting size class, so that a dead
+// cell can be reused as-is by any later allocation of the same size class (see UserHeapGarbageCollector::Sweep).
+// Above 8 slots the classes are spaced at most 25% apart, which bounds the internal fragmentation.
+//
+constexpr size_t x_numUserHeapSizeClasses = 27;
+constexpr std::array<uint16_t, x_numUserHeapSizeClasses> x_userHeapSizeClassSlots = {
+    2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 28, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256
+};
+constexpr uint32_t x_userHeapMaxSizeClassSlots = x_userHeapSizeClassSlots[x_numUserHeapSizeClasses - 1];
+
+constexpr std::array<uint8_t, x_userHeapMaxSizeClassSlots + 1> ComputeUserHeapSizeClassForSlotsArray()
+{
+    std::array<uint8_t, x_userHeapMaxSizeClassSlots + 1> r;
+    size_t sizeClass = 0;
+    for (uint32_t i = 0; i <= x_userHeapMaxSizeClassSlots; i++)
+    {
+        while (x_userHeapSizeClassSlots[sizeClass] < i) { sizeClass++; }
+        r[i] = static_cast<uint8_t>(sizeClass);
+    }
+    return r;
+}
+
+// x_userHeapSizeClassForSlots[n] is the ordinal of the least size class that can hold 'n' slots
+//
+constexpr std::array<uint8_t, x_userHeapMaxSizeClassSlots + 1> x_userHeapSizeClassForSlots = ComputeUserHeapSizeClassForSlotsArray();
+
 constexpr uint32_t GetLeastFitCellSizeInSlots(uint32_t slotToFit)
 {
-    // TODO: we haven't implemented the segregated allocator yet, so this function is dummy
-    //
-    return RoundUpToPowerOfTwo(slotToFit);
+    if (slotToFit > x_userHeapMaxSizeClassSlots)
+    {
+        // Large cells are not segregated by size, so they are allocated exactly
+        //
+        return slotToFit;
+    }
+    return x_userHeapSizeClassSlots[x_userHeapSizeClassForSlots[slotToFit]];
 }
 
 constexpr uint32_t x_maxInlineCapacity = 253;
@@ -498,6 +530,11 @@ public:
 static_assert(sizeof(HeapString) == 16);
 
 class ScriptModule;
+class UserHeapGarbageCollector;
+class BaselineJitBackgroundCompiler;
+class PersistentHotFunctionCache;
+class LuaPattern;
+class MegamorphicPropertyCache;
 
 // [ 12GB user heap ] [ 2GB padding ] [ 2GB short-pointer data structures ] [ 2GB system heap ]
 //                                                                          ^
@@ -590,19 +627,61 @@ public:
     // Allocate a chunk of memory from the user heap
     // Only execution thread may do this
     //
+    // Small allocations are rounded up to a size class, and are served from the free list of dead cells of that
+    // size class if it is not empty. Otherwise the fast path bumps the pointer in the current allocation region
+    // handed out by the garbage collector, and records the start of the new cell in the cell start bitmap.
+    // The slow path may trigger a garbage collection.
+    //
     UserHeapPointer<void> WARN_UNUSED AllocFromUserHeap(uint32_t length)
     {
         assert(length > 0 && length % 8 == 0);
-        // TODO: we currently do not have GC, so it's only a bump allocator..
-        //
+        if (likely(length <= internal::x_userHeapMaxSizeClassSlots * 8))
+        {
+            size_t sizeClass = internal::x_userHeapSizeClassForSlots[length / 8];
+            length = static_cast<uint32_t>(internal::x_userHeapSizeClassSlots[sizeClass]) * 8;
+            int64_t freeCell = m_userHeapSizeClassFreeList[sizeClass];
+            if (freeCell != 0)
+            {
+                // Reuse a dead cell of the same size class. Its cell start bit is still set.
+                //
+                uint8_t* rawCell = reinterpret_cast<uint8_t*>(reinterpret_cast<intptr_t>(this) + freeCell);
+                m_userHeapSizeClassFreeList[sizeClass] = UnalignedLoad<int64_t>(rawCell + x_userHeapFreeCellNextOffset);
+                memset(rawCell, 0, length);
+                return UserHeapPointer<void> { reinterpret_cast<HeapPtr<void>>(freeCell) };
+            }
+        }
         m_userHeapCurPtr -= static_cast<int64_t>(length);
         if (unlikely(m_userHeapCurPtr < m_userHeapPtrLimit))
         {
-            BumpUserHeap();
+            AllocFromUserHeapSlowPath(length);
         }
+        uint64_t granuleOrd = GetUserHeapGranuleOrdinal(m_userHeapCurPtr);
+        m_userHeapCellStartBitmap[granuleOrd / 64] |= static_cast<uint64_t>(1) << (granuleOrd % 64);
         return UserHeapPointer<void> { reinterpret_cast<HeapPtr<void>>(m_userHeapCurPtr) };
     }
 
+    // Each 8-byte granule of the user heap corresponds to one bit in the cell start bitmap
+    //
+    static uint64_t ALWAYS_INLINE GetUserHeapGranuleOrdinal(int64_t userHeapOffset)
+    {
+        assert(-static_cast<int64_t>(x_vmBaseOffset) <= userHeapOffset && userHeapOffset < -static_cast<int64_t>(x_vmBaseOffset - x_vmUserHeapSize));
+        assert(userHeapOffset % 8 == 0);
+        return static_cast<uint64_t>(userHeapOffset + static_cast<int64_t>(x_vmBaseOffset)) / 8;
+    }
+
+    UserHeapGarbageCollector* GetUserHeapGarbageCollector()
+    {
+        return m_userHeapGc;
+    }
+
+    // A cell whose GcCellState is not greater than the threshold takes the write barrier slow path.
+    // This is read through the segment register, so it is only meaningful on the execution thread.
+    //
+    static uint8_t ALWAYS_INLINE GetWriteBarrierThreshold()
+    {
+        return reinterpret_cast<HeapPtr<VM>>(0)->m_writeBarrierThreshold;
+    }
+
     // Allocate a chunk of memory from the system heap
     // Only execution thread may do this
     //
@@ -684,6 +763,13 @@ public:
     // Create a string by concatenating start[0] ~ start[len-1]
     // Each TValue must be a string
     //
+    // If start[0] is the (long) string created by the last concatenation, only the other strings are hashed, see m_concatHashResumeState.
+    // So building a long string by 's = s .. x' does not rehash 's' every time.
+    //
+    // Note that only the hashing is resumed: the bytes of start[0] are still copied into the new string, so such a loop is still
+    // quadratic in memcpy. There is no append buffer that the next concatenation could append to in place, since strings are
+    // hash-consed and store their bytes inline (see HeapString), so a string cannot share or extend the storage of another one.
+    //
     UserHeapPointer<HeapString> WARN_UNUSED CreateStringObjectFromConcatenation(TValue* start, size_t len);
 
     // Create a string by concatenating start[0] ~ start[len-1]
@@ -716,6 +802,11 @@ public:
         return m_elementCount;
     }
 
+    // Check the invariants of the global string hash table (fails the VM if any is violated),
+    // and return the largest distance of an entry from its home slot. For tests.
+    //
+    uint32_t WARN_UNUSED ValidateGlobalStringHashConserAndGetMaxProbeDistance();
+
     UserHeapPointer<HeapString> GetSpecialKeyForMetadataSlot()
     {
         return m_specialKeyForMetatableSlot;
@@ -768,7 +859,9 @@ public:
         BaseIPairsIter,
         BaseToString,
         BaseLoad,
-        IoLinesIter,
+        // An io.lines iterator over stdin that keeps the '\n', used by 'load' to read a chunk from stdin
+        //
+        IoStdinChunkReader,
         // A special object denoting that the 'is_next' validation of a key-value for-loop has passed
         //
         BaseNextValidationOk,
@@ -780,6 +873,8 @@ public:
     enum class LibFnProto
     {
         CoroutineWrapCall,
+        IoLinesIter,
+        StringGmatchIter,
         // must be last member
         //
         X_END_OF_ENUM
@@ -925,8 +1020,44 @@ public:
     uint32_t GetNumTotalBaselineJitCompilations() { return m_totalBaselineJitCompilations; }
     void IncrementNumTotalBaselineJitCompilations() { m_totalBaselineJitCompilations++; }
 
+    // If enabled, a CodeBlock that should tier up to baseline JIT is compiled on a background compiler thread,
+    // and keeps running in the interpreter until the JIT code is ready.
+    // Does not affect the compilations done because the engine starting tier is baseline JIT.
+    //
+    void SetBackgroundBaselineJitCompilationEnabled(bool value) { m_isBackgroundBaselineJitCompilationEnabled = value; }
+    bool IsBackgroundBaselineJitCompilationEnabled() { return m_isBackgroundBaselineJitCompilationEnabled; }
+
+    // The compiler thread is created on first use
+    //
+    BaselineJitBackgroundCompiler* GetBaselineJitBackgroundCompiler();
+
+    // Use the on-disk cache file at 'path' to remember which functions got hot across runs (see PersistentHotFunctionCache).
+    // The cache is written back when the VM is destroyed. Only affects CodeBlocks created after this call.
+    //
+    void OpenPersistentHotFunctionCache(const std::string& path);
+    PersistentHotFunctionCache* GetPersistentHotFunctionCache() { return m_persistentHotFunctionCache; }
+
+    // Stacks of finished coroutines, reused by new coroutines so creating a coroutine does not need to map a new stack
+    // (see CoroutineRuntimeContext::ReleaseStack)
+    //
+    std::vector<TValue*>& GetCoroutineStackPool() { return m_coroutineStackPool; }
+
+    // Compiled Lua patterns, keyed by the address of the pattern string (see GetCompiledLuaPattern)
+    //
+    std::unordered_map<uintptr_t, LuaPattern*>& GetCompiledLuaPatternCache() { return m_compiledLuaPatternCache; }
+
+    // The global cache of GetById / PutById lookups on Structures (see MegamorphicPropertyCache)
+    //
+    MegamorphicPropertyCache* GetMegamorphicPropertyCache() { return m_megamorphicPropertyCache; }
+
     static constexpr size_t x_pageSize = 4096;
 
+    // A free cell on a size class free list stores the offset of the next free cell at this offset
+    // (right after the cell header), so every size class must be at least 16 bytes
+    //
+    static constexpr size_t x_userHeapFreeCellNextOffset = 8;
+    static_assert(internal::x_userHeapSizeClassSlots[0] * 8 >= x_userHeapFreeCellNextOffset + sizeof(int64_t));
+
 private:
     static constexpr size_t x_vmLayoutLength = 18ULL << 30;
     // The start address of the VM is always at 16GB % 32GB, this makes sure the VM base is aligned at 32GB
@@ -945,7 +1076,7 @@ private:
         return result;
     }
 
-    void __attribute__((__preserve_most__)) BumpUserHeap();
+    void __attribute__((__preserve_most__)) AllocFromUserHeapSlowPath(uint32_t length);
     void BumpSystemHeap();
 
     bool WARN_UNUSED SpdsAllocateTryGetFreeListPage(int32_t* out)
@@ -984,31 +1115,78 @@ private:
     // In Lua all strings are hash-consed
     // The global string conser implementation
     //
+    // The hash table is an open-addressing hash table with Robin Hood ordering: entries in a probe sequence are kept sorted by
+    // their distance to their home slot, so a lookup can stop as soon as it sees an entry closer to its home slot than the probed
+    // string would be, and deletion shifts the following entries back instead of leaving tombstones.
+    //
+    // Growing the table is incremental: when the load factor is exceeded, a table of twice the size is allocated, and every
+    // insertion afterwards migrates a bounded number of slots from the old table into the new one. While the migration is in
+    // progress, new strings are inserted into the new table, and lookups probe the new table and then the old table.
+    // The old table is left untouched during the migration (migrated entries are copied, not moved), so its probe sequences stay valid.
+    //
 
     // The hash table stores GeneralHeapPointer
-    // We know that they must be UserHeapPointer, so the below values should never appear as valid values
+    // We know that they must be UserHeapPointer, so the below value should never appear as a valid value
     //
     static constexpr int32_t x_stringConserHtNonexistentValue = 0;
-    static constexpr int32_t x_stringConserHtDeletedValue = 4;
 
-    static bool WARN_UNUSED StringHtCellValueIsNonExistentOrDeleted(GeneralHeapPointer<HeapString> ptr)
+    struct StringHtEntry
     {
-        AssertIff(ptr.m_value >= 0, ptr.m_value == x_stringConserHtNonexistentValue || ptr.m_value == x_stringConserHtDeletedValue);
-        return ptr.m_value >= 0;
-    }
+        bool WARN_UNUSED IsNonExistent() const
+        {
+            AssertIff(m_ptr.m_value >= 0, m_ptr.m_value == x_stringConserHtNonexistentValue);
+            return m_ptr.m_value >= 0;
+        }
+
+        GeneralHeapPointer<HeapString> m_ptr;
+        // The m_hashLow of the string, so that probing never needs to dereference the string to learn its home slot
+        //
+        uint32_t m_hashLow;
+    };
+    static_assert(sizeof(StringHtEntry) == 8);
 
-    static bool WARN_UNUSED StringHtCellValueIsNonExistent(GeneralHeapPointer<HeapString> ptr)
+    // The distance from the home slot of the entry in 'slot'
+    //
+    static uint32_t WARN_UNUSED ALWAYS_INLINE GetStringHtProbeDistance(StringHtEntry entry, uint32_t slot, uint32_t hashTableSizeMask)
     {
-        return ptr.m_value == x_stringConserHtNonexistentValue;
+        return (slot - entry.m_hashLow) & hashTableSizeMask;
     }
 
     // max load factor is x_stringht_loadfactor_numerator / (2^x_stringht_loadfactor_denominator_shift)
     //
-    static constexpr uint32_t x_stringht_loadfactor_denominator_shift = 1;
-    static constexpr uint32_t x_stringht_loadfactor_numerator = 1;
+    static constexpr uint32_t x_stringht_loadfactor_denominator_shift = 2;
+    static constexpr uint32_t x_stringht_loadfactor_numerator = 3;
+
+    // The number of old table slots migrated by each insertion during an incremental resize
+    // The resize starts when the new table is at most 3/8 full, and there are (new table size / 2) slots to migrate,
+    // so any value >= 2 guarantees the migration is done before the new table needs to grow again
+    //
+    static constexpr uint32_t x_stringht_numSlotsMigratedPerInsertion = 16;
+
+    // Insert a string known to be not in the table
+    //
+    static void InsertIntoStringHtForResize(StringHtEntry* hashTable, uint32_t hashTableSizeMask, StringHtEntry e);
 
-    static void ReinsertDueToResize(GeneralHeapPointer<HeapString>* hashTable, uint32_t hashTableSizeMask, GeneralHeapPointer<HeapString> e);
+    // Delete the entry in 'slot' by shifting back the entries after it
+    //
+    static void DeleteFromStringHt(StringHtEntry* hashTable, uint32_t hashTableSizeMask, uint32_t slot);
+
+    // Look up the string in one table, return nullptr if not found
+    //
+    template<typename Iterator>
+    HeapString* WARN_UNUSED LookupMultiPieceStringInStringHt(StringHtEntry* hashTable, uint32_t hashTableSizeMask, Iterator iterator, uint32_t expectedHashLow, uint8_t expectedHashHigh, size_t length);
 
+    bool IsStringConserHashTableMigrationInProgress() const
+    {
+        return m_oldHashTable != nullptr;
+    }
+
+    // Migrate at most 'maxSlots' slots from the old table to the new table, and free the old table if the migration is complete
+    //
+    void MigrateStringConserHashTableSlots(uint32_t maxSlots);
+
+    // Start an incremental resize if the load factor is exceeded
+    //
     // TODO: when we have GC thread we need to figure out how this interacts with GC
     //
     void ExpandStringConserHashTableIfNeeded();
@@ -1019,6 +1197,22 @@ private:
     template<typename Iterator>
     UserHeapPointer<HeapString> WARN_UNUSED InsertMultiPieceString(Iterator iterator);
 
+    // Same as above, but the length and hash of the string are already computed
+    //
+    template<typename Iterator>
+    UserHeapPointer<HeapString> WARN_UNUSED InsertMultiPieceStringWithKnownHash(Iterator iterator, StringLengthAndHash lenAndHash);
+
+    // Concatenations producing strings shorter than this do not use or replace m_concatHashResumeState (which only saves the hashing, not the copying),
+    // as hashing them from scratch is cheap anyway
+    //
+    static constexpr size_t x_minLengthForConcatHashResumption = 256;
+
+    // Insert the concatenation of the pieces in 'iterator', where 'firstPiece' is the first piece and 'restIterator' yields the other pieces
+    // Use and update m_concatHashResumeState when possible
+    //
+    template<typename Iterator, typename RestIterator>
+    UserHeapPointer<HeapString> WARN_UNUSED InsertConcatenatedString(HeapString* firstPiece, Iterator iterator, RestIterator restIterator);
+
     static std::mt19937* WARN_UNUSED NO_INLINE GetUserPRNGSlow()
     {
         VM* vm = VM::GetActiveVMForCurrentThread();
@@ -1035,6 +1229,8 @@ private:
     void Cleanup();
     void CreateRootCoroutine();
 
+    friend class UserHeapGarbageCollector;
+
     // The data members
     //
 
@@ -1047,15 +1243,31 @@ private:
 
     alignas(64) SpdsAllocImpl<VM, false /*isTempAlloc*/> m_executionThreadSpdsAlloc;
 
-    // user heap region grows from high address to low address
-    // highest physically mapped address of the user heap region (offsets from m_self)
+    // The user heap allocator bump-allocates from high address to low address in the current allocation region
+    // [m_userHeapPtrLimit, m_userHeapCurPtr), which is handed out by the garbage collector.
+    // lower bound of the current allocation region (offsets from m_self)
     //
     int64_t m_userHeapPtrLimit;
 
-    // lowest logically used address of the user heap region (offsets from m_self)
+    // lowest logically used address of the current allocation region (offsets from m_self)
     //
     int64_t m_userHeapCurPtr;
 
+    // One bit for each 8-byte granule in the user heap, set if a cell starts at that granule
+    //
+    uint64_t* m_userHeapCellStartBitmap;
+
+    // The heads of the free lists of dead cells for each size class (offsets from m_self, 0 if empty).
+    // The free cells are linked through the word at x_userHeapFreeCellNextOffset. The lists are rebuilt by every sweep,
+    // and are emptied during a concurrent cycle, since the GC thread may be sweeping these cells.
+    //
+    int64_t m_userHeapSizeClassFreeList[internal::x_numUserHeapSizeClasses];
+
+    // Normally only Black cells take the write barrier slow path.
+    // During concurrent marking, the garbage collector raises the threshold so that White cells take it as well.
+    //
+    uint8_t m_writeBarrierThreshold;
+
     // system heap region grows from low address to high address
     // lowest physically unmapped address of the system heap region (offsets from m_self)
     //
@@ -1071,6 +1283,13 @@ private:
 
     uint32_t m_totalBaselineJitCompilations;
 
+    bool m_isBackgroundBaselineJitCompilationEnabled;
+    BaselineJitBackgroundCompiler* m_baselineJitBackgroundCompiler;
+    PersistentHotFunctionCache* m_persistentHotFunctionCache;
+    std::vector<TValue*> m_coroutineStackPool;
+    std::unordered_map<uintptr_t, LuaPattern*> m_compiledLuaPatternCache;
+    MegamorphicPropertyCache* m_megamorphicPropertyCache;
+
     alignas(64) std::mutex m_spdsAllocationMutex;
 
     // SPDS region grows from high address to low address
@@ -1083,11 +1302,26 @@ private:
     SpdsPtr<void> m_spdsCompilerThreadFreeList[x_numSpdsAllocatableClassNotUsingLfFreelist];
 
     uint32_t m_hashTableSizeMask;
+    // The number of strings in the hash table (for an in-progress resize, the strings in either table, each counted once)
+    //
     uint32_t m_elementCount;
-    // use GeneralHeapPointer because it's 4 bytes
     // All pointers are actually always HeapPtr<HeapString>
     //
-    GeneralHeapPointer<HeapString>* m_hashTable;
+    StringHtEntry* m_hashTable;
+
+    // The table being migrated from by an in-progress incremental resize, nullptr if no resize is in progress
+    // Slots [0, m_hashTableMigrationCursor) of the old table have been copied to m_hashTable
+    //
+    StringHtEntry* m_oldHashTable;
+    uint32_t m_oldHashTableSizeMask;
+    uint32_t m_hashTableMigrationCursor;
+
+    // The hasher state right after hashing m_concatHashResumeString, the last long string created by concatenation (nullptr if none).
+    // A concatenation whose first piece is m_concatHashResumeString resumes hashing from this state.
+    // The GC resets m_concatHashResumeString to nullptr if the string is dead, so the address cannot be reused by another string.
+    //
+    IncrementalStringHasher* m_concatHashResumeState;
+    HeapString* m_concatHashResumeString;
 
     // In PolyMetatable mode, the metatable is stored in a property slot
     // For simplicity, we always assign this special key (which is used exclusively for this purpose) to this slot
@@ -1111,6 +1345,8 @@ private:
     //
     std::mt19937* m_usrPRNG;
 
+    UserHeapGarbageCollector* m_userHeapGc;
+
     // Allow unit test to hook stdout and stderr to a custom temporary file
     //
     FILE* m_filePointerForStdout;
@@ -1126,6 +1362,15 @@ public:
     UserHeapPointer<void> m_metatableForFunction;
     UserHeapPointer<void> m_metatableForCoroutine;
 
+    // The metatable shared by all file handles of the io library
+    //
+    UserHeapPointer<void> m_metatableForFile;
+
+    // The default input and output files of the io library
+    //
+    UserHeapPointer<HeapCDataObject> m_ioDefaultInput;
+    UserHeapPointer<HeapCDataObject> m_ioDefaultOutput;
+
     // The string ""
     //
     HeapPtr<HeapString> m_emptyString;
@@ -1,5 +1,8 @@
 #include "runtime_utils.h"
 #include "lj_parser_wrapper.h"
+#include "persistent_hot_function_cache.h"
+#include "interpreter_opcode_profiler.h"
+#include "deegen_options.h"
 
 #define LJR_VERSION_MAJOR_NUMBER 0
 #define LJR_VERSION_MINOR_NUMBER 0
@@ -27,6 +30,18 @@ static void LaunchScript(int argc, char** argv)
     assert(argc >= 2);
     VM* vm = VM::Create();
 
+    // Do not pause the script while the baseline JIT compiles hot functions
+    //
+    vm->SetBackgroundBaselineJitCompilationEnabled(true);
+
+    // Optionally remember the hot functions across runs, so that they start in baseline JIT on the next run
+    //
+    const char* hotFunctionCachePath = getenv("LJR_HOT_FUNCTION_CACHE_FILE");
+    if (hotFunctionCachePath != nullptr && hotFunctionCachePath[0] != '\0')
+    {
+        vm->OpenPersistentHotFunctionCache(hotFunctionCachePath);
+    }
+
     // According to Lua Standard:
     //     Before starting to run the script, lua collects all arguments in the command line in a global table called arg.
     //     The script name is stored at index 0, the first argument after the script name goes to index 1, and so on.
@@ -60,6 +75,20 @@ static void LaunchScript(int argc, char** argv)
     }
 
     vm->LaunchScript(pr.m_scriptModule.get());
+
+    // We exit without destroying the VM, so write back the cache explicitly
+    //
+    if (vm->GetPersistentHotFunctionCache() != nullptr && !vm->GetPersistentHotFunctionCache()->Flush())
+    {
+        fprintf(stderr, "[WARNING] Failed to write hot function cache file '%s'\n", hotFunctionCachePath);
+    }
+
+    // Same for the opcode profile, if the interpreter is built with opcode profiling
+    //
+    if (x_enable_interpreter_opcode_profiling)
+    {
+        InterpreterOpcodeProfiler::WriteReportToFileAndReset();
+    }
 }
 
 int main(int argc, char** argv)
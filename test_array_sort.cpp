@@ -0,0 +1,62 @@
+#include "gtest/gtest.h"
+#include "runtime_utils.h"
+#include "array_sort.h"
+
+namespace {
+
+// Check that SortDoubleArray produces the same result as std::sort
+// (up to the relative order of -0 and 0, which is unspecified for both)
+//
+void CheckSortDoubleArray(std::vector<double> values)
+{
+    std::vector<double> expected = values;
+    std::sort(expected.begin(), expected.end());
+    SortDoubleArray(values.data(), values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        ReleaseAssert(UnsafeFloatEqual(values[i], expected[i]));
+    }
+}
+
+TEST(ArraySort, SortDoubleArray)
+{
+    std::mt19937_64 rng(12345);
+    std::uniform_real_distribution<double> smallRange(-1000.0, 1000.0);
+    std::uniform_real_distribution<double> unitRange(0.0, 1.0);
+    std::uniform_int_distribution<int> expRange(-300, 300);
+
+    // The sizes cover std::sort, the radix sort and the parallel sort
+    //
+    for (size_t n : { 0U, 1U, 2U, 7U, 1023U, 1024U, 1025U, 5000U, 100000U, 262143U, 262144U, 1000003U })
+    {
+        for (int kind = 0; kind < 5; kind++)
+        {
+            std::vector<double> values;
+            values.resize(n);
+            for (size_t i = 0; i < n; i++)
+            {
+                switch (kind)
+                {
+                case 0: values[i] = smallRange(rng); break;
+                case 1: values[i] = unitRange(rng); break;
+                case 2: values[i] = std::ldexp(smallRange(rng), expRange(rng)); break;
+                case 3: values[i] = static_cast<double>(rng() % 16) - 8.0; break;
+                case 4: values[i] = static_cast<double>(n - i); break;
+                default: ReleaseAssert(false);
+                }
+            }
+            if (n > 10)
+            {
+                values[0] = std::numeric_limits<double>::infinity();
+                values[1] = -std::numeric_limits<double>::infinity();
+                values[2] = -0.0;
+                values[3] = 0.0;
+                values[4] = std::numeric_limits<double>::denorm_min();
+                values[5] = -std::numeric_limits<double>::max();
+            }
+            CheckSortDoubleArray(values);
+        }
+    }
+}
+
+}   // anonymous namespace
@@ -0,0 +1,274 @@
+#include "runtime_utils.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string GetStringContent(VM* vm, UserHeapPointer<HeapString> p)
+{
+    HeapString* s = TranslateToRawPointer(vm, p.As());
+    return std::string(reinterpret_cast<const char*>(s->m_string), s->m_length);
+}
+
+TEST(UserHeapGC, GarbageIsReclaimed)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+
+    // Allocate about 1GB of strings that immediately become garbage
+    //
+    std::string buf(4000, 'a');
+    for (size_t i = 0; i < 250000; i++)
+    {
+        memcpy(buf.data(), &i, sizeof(size_t));
+        std::ignore = vm->CreateStringObjectFromRawString(buf.data(), static_cast<uint32_t>(buf.length()));
+    }
+
+    ReleaseAssert(gc->GetNumEdenCollections() + gc->GetNumFullCollections() > 0);
+    ReleaseAssert(gc->GetHeapSizeBytes() < (512ULL << 20));
+}
+
+TEST(UserHeapGC, LiveObjectsSurvive)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+
+    std::vector<UserHeapPointer<HeapString>> live;
+    for (size_t i = 0; i < 2000; i++)
+    {
+        std::string s = "live_" + std::to_string(i);
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(s.data(), static_cast<uint32_t>(s.length()));
+        gc->AddPermanentRoot(TValue::CreatePointer(p));
+        live.push_back(p);
+    }
+
+    for (size_t round = 0; round < 3; round++)
+    {
+        for (size_t i = 0; i < 20000; i++)
+        {
+            std::string s = "dead_" + std::to_string(round) + "_" + std::to_string(i);
+            std::ignore = vm->CreateStringObjectFromRawString(s.data(), static_cast<uint32_t>(s.length()));
+        }
+        gc->Collect(round == 1 ? UserHeapGarbageCollector::CollectionKind::Full : UserHeapGarbageCollector::CollectionKind::Eden);
+    }
+
+    ReleaseAssert(gc->GetNumEdenCollections() >= 2);
+    ReleaseAssert(gc->GetNumFullCollections() >= 1);
+
+    // The live strings must be intact, and the string conser must still find them
+    //
+    for (size_t i = 0; i < live.size(); i++)
+    {
+        std::string s = "live_" + std::to_string(i);
+        ReleaseAssert(GetStringContent(vm, live[i]) == s);
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(s.data(), static_cast<uint32_t>(s.length()));
+        ReleaseAssert(p == live[i]);
+    }
+
+    // Strings that were collected can be created again
+    //
+    for (size_t i = 0; i < 1000; i++)
+    {
+        std::string s = "dead_0_" + std::to_string(i);
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(s.data(), static_cast<uint32_t>(s.length()));
+        ReleaseAssert(GetStringContent(vm, p) == s);
+    }
+}
+
+TEST(UserHeapGC, ConcurrentMarking)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+    ReleaseAssert(gc->IsConcurrentMarkingEnabled());
+
+    Structure* initStructure = Structure::CreateInitialStructure(vm, 4 /*inlineCap*/);
+    HeapPtr<TableObject> table = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*initButterflyCap*/);
+    gc->AddPermanentRoot(TValue::CreatePointer(UserHeapPointer<TableObject>(table)));
+
+    // Keep storing new strings into the table (which also keeps growing its butterfly) while allocating lots of garbage,
+    // so that many writes happen while the GC thread is marking
+    //
+    constexpr int64_t x_numStrings = 200000;
+    constexpr int64_t x_keepEvery = 8;
+    std::string buf(2000, 'b');
+    for (int64_t i = 1; i <= x_numStrings; i++)
+    {
+        memcpy(buf.data(), &i, sizeof(int64_t));
+        UserHeapPointer<HeapString> str = vm->CreateStringObjectFromRawString(buf.data(), static_cast<uint32_t>(buf.length()));
+        if (i % x_keepEvery == 0)
+        {
+            TableObject::RawPutByValIntegerIndex(table, i / x_keepEvery, TValue::CreatePointer(str));
+        }
+    }
+
+    gc->CompleteConcurrentCycle();
+    ReleaseAssert(!gc->IsConcurrentCycleInProgress());
+    ReleaseAssert(gc->GetNumEdenCollections() + gc->GetNumFullCollections() > 0);
+    gc->Collect(UserHeapGarbageCollector::CollectionKind::Full);
+
+    for (int64_t i = x_keepEvery; i <= x_numStrings; i += x_keepEvery)
+    {
+        GetByIntegerIndexICInfo icInfo;
+        TableObject::PrepareGetByIntegerIndex(table, icInfo /*out*/);
+        TValue val = TableObject::GetByIntegerIndex(table, i / x_keepEvery, icInfo);
+        ReleaseAssert(val.IsPointer());
+        memcpy(buf.data(), &i, sizeof(int64_t));
+        ReleaseAssert(GetStringContent(vm, val.AsPointer<HeapString>()) == buf);
+    }
+}
+
+TEST(UserHeapGC, DoubleArrayBecomesAnyArray)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+
+    Structure* initStructure = Structure::CreateInitialStructure(vm, 0 /*inlineCap*/);
+    HeapPtr<TableObject> table = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*initButterflyCap*/);
+    gc->AddPermanentRoot(TValue::CreatePointer(UserHeapPointer<TableObject>(table)));
+
+    // The array part of a Double array is not scanned by the GC, and puts into it execute no write barrier
+    //
+    constexpr int64_t x_numElements = 20000;
+    for (int64_t i = 1; i <= x_numElements; i++)
+    {
+        TableObject::RawPutByValIntegerIndex(table, i, TValue::CreateDouble(static_cast<double>(i) + 0.5));
+    }
+    ReleaseAssert(TCGet(table->m_arrayType).ArrayKind() == ArrayType::Kind::Double);
+    ReleaseAssert(TCGet(table->m_arrayType).ArrayPartHasNoReference());
+
+    // Overwrite some of the elements with strings while lots of garbage is allocated, so the array becomes an Any array
+    // while the GC thread may be marking, and the strings must be kept alive
+    //
+    constexpr int64_t x_keepEvery = 4;
+    std::string buf(2000, 'c');
+    for (int64_t i = 1; i <= x_numElements * x_keepEvery; i++)
+    {
+        memcpy(buf.data(), &i, sizeof(int64_t));
+        UserHeapPointer<HeapString> str = vm->CreateStringObjectFromRawString(buf.data(), static_cast<uint32_t>(buf.length()));
+        if (i % (x_keepEvery * x_keepEvery) == 0)
+        {
+            TableObject::RawPutByValIntegerIndex(table, i / x_keepEvery, TValue::CreatePointer(str));
+        }
+    }
+    ReleaseAssert(TCGet(table->m_arrayType).ArrayKind() == ArrayType::Kind::Any);
+
+    gc->CompleteConcurrentCycle();
+    gc->Collect(UserHeapGarbageCollector::CollectionKind::Full);
+
+    for (int64_t i = 1; i <= x_numElements; i++)
+    {
+        GetByIntegerIndexICInfo icInfo;
+        TableObject::PrepareGetByIntegerIndex(table, icInfo /*out*/);
+        TValue val = TableObject::GetByIntegerIndex(table, i, icInfo);
+        if (i % x_keepEvery == 0)
+        {
+            ReleaseAssert(val.IsPointer());
+            int64_t k = i * x_keepEvery;
+            memcpy(buf.data(), &k, sizeof(int64_t));
+            ReleaseAssert(GetStringContent(vm, val.AsPointer<HeapString>()) == buf);
+        }
+        else
+        {
+            ReleaseAssert(val.IsDouble() && UnsafeFloatEqual(val.AsDouble(), static_cast<double>(i) + 0.5));
+        }
+    }
+}
+
+TEST(UserHeapGC, SizeClassCellsAreReused)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+
+    Structure* rootStructure = Structure::CreateInitialStructure(vm, 0 /*inlineCap*/);
+    HeapPtr<TableObject> root = TableObject::CreateEmptyTableObject(vm, rootStructure, 0 /*initButterflyCap*/);
+    gc->AddPermanentRoot(TValue::CreatePointer(UserHeapPointer<TableObject>(root)));
+
+    // Allocate tables of the same size class, keeping every other one alive, so each dead table is an isolated hole
+    //
+    constexpr size_t x_numTables = 20000;
+    Structure* initStructure = Structure::CreateInitialStructure(vm, internal::x_optimalInlineCapacityArray[7]);
+    ReleaseAssert(initStructure->m_inlineNamedStorageCapacity == 8);
+    std::set<int64_t> deadTables;
+    for (size_t i = 0; i < x_numTables; i++)
+    {
+        HeapPtr<TableObject> t = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*initButterflyCap*/);
+        UserHeapPointer<TableObject> p(t);
+        if (i % 2 == 0)
+        {
+            TableObject::RawPutByValIntegerIndex(root, static_cast<int64_t>(i / 2 + 1), TValue::CreatePointer(p));
+        }
+        else
+        {
+            deadTables.insert(p.m_value);
+        }
+    }
+
+    gc->Collect(UserHeapGarbageCollector::CollectionKind::Full);
+    size_t heapSizeAfterCollection = gc->GetHeapSizeBytes();
+
+    // New tables of the same size class should fill the holes without taking any new memory.
+    // A few dead tables may be kept alive by conservative stack scanning, so don't use up all of them.
+    //
+    for (size_t i = 0; i < x_numTables / 2 - 100; i++)
+    {
+        HeapPtr<TableObject> t = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*initButterflyCap*/);
+        ReleaseAssert(deadTables.count(UserHeapPointer<TableObject>(t).m_value));
+    }
+    ReleaseAssert(gc->GetHeapSizeBytes() == heapSizeAfterCollection);
+
+    // The surviving tables are intact
+    //
+    for (size_t i = 0; i < x_numTables / 2; i++)
+    {
+        GetByIntegerIndexICInfo icInfo;
+        TableObject::PrepareGetByIntegerIndex(root, icInfo /*out*/);
+        TValue val = TableObject::GetByIntegerIndex(root, static_cast<int64_t>(i + 1), icInfo);
+        ReleaseAssert(val.IsPointer());
+        TableObject* tab = TranslateToRawPointer(vm, val.AsPointer<TableObject>().As());
+        ReleaseAssert(tab->m_type == HeapEntityType::Table);
+        ReleaseAssert(!deadTables.count(val.AsPointer<TableObject>().m_value));
+    }
+}
+
+// A stack put into the coroutine stack pool must be fully cleared, including the reserved slots,
+// otherwise the stale values would keep dead objects alive while the next coroutine uses the stack
+//
+TEST(UserHeapGC, PooledCoroutineStackIsCleared)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    UserHeapPointer<TableObject> globalObject = vm->GetRootCoroutine()->m_globalObject;
+    CoroutineRuntimeContext* coro = CoroutineRuntimeContext::Create(vm, globalObject);
+    TValue* stack = coro->m_stackBegin;
+    uint32_t numStackSlots = coro->m_numStackSlots;
+    ReleaseAssert(numStackSlots == CoroutineRuntimeContext::x_defaultStackSlots + CoroutineRuntimeContext::x_stackReservedSlots);
+
+    std::string s = "stale_value";
+    TValue staleValue = TValue::CreatePointer(vm->CreateStringObjectFromRawString(s.data(), static_cast<uint32_t>(s.length())));
+    stack[10] = staleValue;
+    stack[CoroutineRuntimeContext::x_defaultStackSlots + 100] = staleValue;
+    stack[numStackSlots - 1] = staleValue;
+
+    coro->m_coroutineStatus.SetDead(true);
+    coro->ReleaseStack();
+
+    CoroutineRuntimeContext* newCoro = CoroutineRuntimeContext::Create(vm, globalObject);
+    ReleaseAssert(newCoro->m_stackBegin == stack);
+    ReleaseAssert(newCoro->m_numStackSlots == numStackSlots);
+    for (uint32_t i = 0; i < numStackSlots; i++)
+    {
+        ReleaseAssert(stack[i].m_value == 0);
+    }
+}
+
+}   // anonymous namespace
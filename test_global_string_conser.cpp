@@ -118,4 +118,167 @@ TEST(GlobalStringHashConser, Stress)
     ReleaseAssert(vec.size() == expectedMap.size());
 }
 
+TEST(GlobalStringHashConser, RepeatedAppend)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    // Build long strings by repeatedly appending to them (which resumes hashing from the previous result),
+    // interleaved with unrelated concatenations, and check that they are hash-consed with the same strings created directly
+    //
+    std::string expected[2];
+    UserHeapPointer<HeapString> cur[2];
+    for (int k = 0; k < 2; k++)
+    {
+        cur[k] = vm->CreateStringObjectFromRawString("", 0);
+    }
+
+    for (int testcase = 0; testcase < 3000; testcase++)
+    {
+        int k = (rand() % 4 == 0) ? 1 : 0;
+        int numPieces = rand() % 3 + 1;
+        TValue v[4];
+        v[0] = TValue::CreatePointer(cur[k]);
+        for (int i = 1; i <= numPieces; i++)
+        {
+            std::string piece;
+            int length = rand() % 40;
+            for (int j = 0; j < length; j++) piece += char('a' + rand() % 26);
+            v[i] = TValue::CreatePointer(vm->CreateStringObjectFromRawString(piece.c_str(), static_cast<uint32_t>(piece.length())));
+            expected[k] += piece;
+        }
+        cur[k] = vm->CreateStringObjectFromConcatenation(v, static_cast<size_t>(numPieces + 1));
+        CheckStringObjectIsAsExpected(cur[k], expected[k].c_str(), expected[k].length());
+
+        if (rand() % 10 == 0)
+        {
+            UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(expected[k].c_str(), static_cast<uint32_t>(expected[k].length()));
+            ReleaseAssert(p == cur[k]);
+        }
+    }
+}
+
+// Strings with the same home slot form one long probe sequence. Deleting the dead ones during GC shifts the survivors back,
+// which must keep the Robin Hood ordering and leave every survivor findable.
+//
+TEST(GlobalStringHashConser, CollidingStringsAndGc)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+    gc->SetAutomaticCollectionEnabled(false);
+
+    uint32_t hashTableSize = vm->GetGlobalStringHashConserCurrentHashTableSize();
+    uint32_t hashTableSizeMask = hashTableSize - 1;
+
+    constexpr size_t x_numColliding = 64;
+    std::vector<std::string> collidingStrings;
+    uint32_t homeSlot = 0;
+    for (size_t i = 0; collidingStrings.size() < x_numColliding; i++)
+    {
+        std::string str = "colliding_" + std::to_string(i);
+        uint32_t slot = static_cast<uint32_t>(HashString(str.data(), str.length())) & hashTableSizeMask;
+        if (collidingStrings.empty())
+        {
+            homeSlot = slot;
+        }
+        if (slot == homeSlot)
+        {
+            collidingStrings.push_back(str);
+        }
+    }
+
+    std::vector<UserHeapPointer<HeapString>> ptrs;
+    for (const std::string& str : collidingStrings)
+    {
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(str.data(), static_cast<uint32_t>(str.length()));
+        CheckStringObjectIsAsExpected(p, str.data(), str.length());
+        ptrs.push_back(p);
+    }
+    ReleaseAssert(vm->GetGlobalStringHashConserCurrentHashTableSize() == hashTableSize);
+    ReleaseAssert(vm->ValidateGlobalStringHashConserAndGetMaxProbeDistance() >= x_numColliding - 1);
+
+    uint32_t elementCount = vm->GetGlobalStringHashConserCurrentElementCount();
+    for (size_t i = 0; i < x_numColliding; i++)
+    {
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(collidingStrings[i].data(), static_cast<uint32_t>(collidingStrings[i].length()));
+        ReleaseAssert(p == ptrs[i]);
+    }
+    ReleaseAssert(vm->GetGlobalStringHashConserCurrentElementCount() == elementCount);
+
+    // Keep every third string alive, so the dead strings are interleaved with the survivors in the probe sequence
+    //
+    for (size_t i = 0; i < x_numColliding; i += 3)
+    {
+        gc->AddPermanentRoot(TValue::CreatePointer(ptrs[i]));
+    }
+    gc->Collect(UserHeapGarbageCollector::CollectionKind::Full);
+    std::ignore = vm->ValidateGlobalStringHashConserAndGetMaxProbeDistance();
+
+    // A few dead strings may be kept alive by conservative stack scanning
+    //
+    size_t numDead = x_numColliding - (x_numColliding + 2) / 3;
+    ReleaseAssert(vm->GetGlobalStringHashConserCurrentElementCount() + numDead <= elementCount + 8);
+
+    for (size_t i = 0; i < x_numColliding; i += 3)
+    {
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(collidingStrings[i].data(), static_cast<uint32_t>(collidingStrings[i].length()));
+        ReleaseAssert(p == ptrs[i]);
+        CheckStringObjectIsAsExpected(p, collidingStrings[i].data(), collidingStrings[i].length());
+    }
+
+    // The dead strings can be created again, and are hash-consed again
+    //
+    for (size_t i = 0; i < x_numColliding; i++)
+    {
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(collidingStrings[i].data(), static_cast<uint32_t>(collidingStrings[i].length()));
+        CheckStringObjectIsAsExpected(p, collidingStrings[i].data(), collidingStrings[i].length());
+        ptrs[i] = p;
+    }
+    for (size_t i = 0; i < x_numColliding; i++)
+    {
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(collidingStrings[i].data(), static_cast<uint32_t>(collidingStrings[i].length()));
+        ReleaseAssert(p == ptrs[i]);
+    }
+    std::ignore = vm->ValidateGlobalStringHashConserAndGetMaxProbeDistance();
+}
+
+// Grow the table through many incremental resizes, checking the table also in the middle of migrations.
+// With Robin Hood ordering, the probe distances stay short at the max load factor.
+//
+TEST(GlobalStringHashConser, GrowthAndProbeDistance)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    vm->GetUserHeapGarbageCollector()->SetAutomaticCollectionEnabled(false);
+
+    uint32_t initialHashTableSize = vm->GetGlobalStringHashConserCurrentHashTableSize();
+
+    constexpr size_t x_numStrings = 200000;
+    std::vector<UserHeapPointer<HeapString>> ptrs;
+    for (size_t i = 0; i < x_numStrings; i++)
+    {
+        std::string str = "growth_" + std::to_string(i);
+        ptrs.push_back(vm->CreateStringObjectFromRawString(str.data(), static_cast<uint32_t>(str.length())));
+        if (i % 9973 == 0)
+        {
+            std::ignore = vm->ValidateGlobalStringHashConserAndGetMaxProbeDistance();
+        }
+    }
+
+    uint32_t hashTableSize = vm->GetGlobalStringHashConserCurrentHashTableSize();
+    ReleaseAssert(hashTableSize > initialHashTableSize);
+    ReleaseAssert(vm->GetGlobalStringHashConserCurrentElementCount() >= x_numStrings);
+    ReleaseAssert(vm->GetGlobalStringHashConserCurrentElementCount() <= hashTableSize / 4 * 3);
+    ReleaseAssert(vm->ValidateGlobalStringHashConserAndGetMaxProbeDistance() <= 64);
+
+    for (size_t i = 0; i < x_numStrings; i++)
+    {
+        std::string str = "growth_" + std::to_string(i);
+        UserHeapPointer<HeapString> p = vm->CreateStringObjectFromRawString(str.data(), static_cast<uint32_t>(str.length()));
+        ReleaseAssert(p == ptrs[i]);
+        CheckStringObjectIsAsExpected(p, str.data(), str.length());
+    }
+}
+
 }   // anonymous namespace
@@ -183,11 +183,11 @@ void TestOneCase(bool calleeAcceptsVarArgs, uint64_t numFixedArgs, bool isTailCa
     ReleaseAssert(g_expectedResult.m_checkerFnCalled);
 }
 
-void TestModule(bool calleeAcceptsVarArgs, size_t specializedNumFixedParams)
+void TestModule(bool calleeAcceptsVarArgs, size_t specializedNumFixedParams, bool isExactArity = false)
 {
     std::unique_ptr<LLVMContext> llvmCtxHolder(new LLVMContext);
     LLVMContext& ctx = *llvmCtxHolder.get();
-    DeegenFunctionEntryLogicCreator ifi(ctx, DeegenEngineTier::Interpreter, calleeAcceptsVarArgs, specializedNumFixedParams);
+    DeegenFunctionEntryLogicCreator ifi(ctx, DeegenEngineTier::Interpreter, calleeAcceptsVarArgs, specializedNumFixedParams, isExactArity);
     std::unique_ptr<Module> module = ifi.GetInterpreterModule();
 
     Function* func = module->getFunction(ifi.GetFunctionName());
@@ -270,6 +270,12 @@ void TestModule(bool calleeAcceptsVarArgs, size_t specializedNumFixedParams)
 
             for (size_t numProvidedArgs : numProvidedArgsChoices)
             {
+                // The exact-arity entry is only valid if the caller provides exactly the fixed params (or more if not taking varargs)
+                //
+                if (isExactArity && (calleeAcceptsVarArgs ? (numProvidedArgs != numCalleeFixedArgs) : (numProvidedArgs < numCalleeFixedArgs)))
+                {
+                    continue;
+                }
                 TestOneCase(calleeAcceptsVarArgs, numCalleeFixedArgs, isTailCall, numProvidedArgs, testFnAddr);
                 numTests++;
             }
@@ -277,7 +283,7 @@ void TestModule(bool calleeAcceptsVarArgs, size_t specializedNumFixedParams)
     }
     // Just sanity check we didn't screw any of our loop conditions to enumerate test cases..
     //
-    ReleaseAssert(numTests > 10);
+    ReleaseAssert(numTests > (isExactArity && calleeAcceptsVarArgs ? 1 : 10));
 }
 
 }   // anonymous namespace
@@ -307,3 +313,19 @@ TEST(DeegenAst, InterpreterFunctionEntry_TakesVarArgs_GenericFixedArgs)
 {
     TestModule(true /*acceptVarArgs*/, static_cast<size_t>(-1) /*numFixedArgs*/);
 }
+
+TEST(DeegenAst, InterpreterFunctionEntry_NoVarArgs_ExactArity)
+{
+    for (size_t i = 0; i < 10; i++)
+    {
+        TestModule(false /*acceptVarArgs*/, i /*numFixedArgs*/, true /*isExactArity*/);
+    }
+}
+
+TEST(DeegenAst, InterpreterFunctionEntry_TakesVarArgs_ExactArity)
+{
+    for (size_t i = 0; i < 10; i++)
+    {
+        TestModule(true /*acceptVarArgs*/, i /*numFixedArgs*/, true /*isExactArity*/);
+    }
+}
@@ -0,0 +1,72 @@
+#include "gtest/gtest.h"
+#include "runtime_utils.h"
+#include "interpreter_opcode_profiler.h"
+
+extern "C" const char* const deegen_interpreter_opcode_name_table[];
+
+namespace {
+
+std::string GetReport()
+{
+    FILE* fp = tmpfile();
+    ReleaseAssert(fp != nullptr);
+    Auto(fclose(fp));
+    InterpreterOpcodeProfiler::WriteReport(fp);
+    rewind(fp);
+    std::string res;
+    char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        res.append(buf, len);
+    }
+    return res;
+}
+
+std::string OpcodeEntry(uint16_t opcode, uint64_t count, uint64_t slowPathCount)
+{
+    return std::string("{ \"name\": \"") + deegen_interpreter_opcode_name_table[opcode] + "\", \"count\": " + std::to_string(count) +
+        ", \"quickening_slow_path_count\": " + std::to_string(slowPathCount) + " }";
+}
+
+std::string PairEntry(const char* prev, uint16_t next, uint64_t count)
+{
+    return std::string("{ \"prev\": \"") + prev + "\", \"next\": \"" + deegen_interpreter_opcode_name_table[next] + "\", \"count\": " + std::to_string(count) + " }";
+}
+
+TEST(InterpreterOpcodeProfiler, Sanity)
+{
+    InterpreterOpcodeProfiler::Reset();
+
+    uint16_t seq[] = { 0, 1, 0, 1, 0, 2 };
+    for (uint16_t opcode : seq)
+    {
+        InterpreterOpcodeProfiler::RecordOpcode(opcode);
+    }
+    InterpreterOpcodeProfiler::RecordQuickeningSlowPath(2);
+
+    std::string report = GetReport();
+    ReleaseAssert(report.find("\"total_count\": 6,") != std::string::npos);
+
+    // The opcodes are sorted by execution count
+    //
+    size_t pos0 = report.find(OpcodeEntry(0, 3, 0));
+    size_t pos1 = report.find(OpcodeEntry(1, 2, 0));
+    size_t pos2 = report.find(OpcodeEntry(2, 1, 1));
+    ReleaseAssert(pos0 != std::string::npos && pos1 != std::string::npos && pos2 != std::string::npos);
+    ReleaseAssert(pos0 < pos1 && pos1 < pos2);
+
+    ReleaseAssert(report.find(PairEntry("(start)", 0, 1)) != std::string::npos);
+    ReleaseAssert(report.find(PairEntry(deegen_interpreter_opcode_name_table[0], 1, 2)) != std::string::npos);
+    ReleaseAssert(report.find(PairEntry(deegen_interpreter_opcode_name_table[1], 0, 2)) != std::string::npos);
+    ReleaseAssert(report.find(PairEntry(deegen_interpreter_opcode_name_table[0], 2, 1)) != std::string::npos);
+    ReleaseAssert(report.find(PairEntry(deegen_interpreter_opcode_name_table[1], 2, 1)) == std::string::npos);
+
+    InterpreterOpcodeProfiler::Reset();
+    report = GetReport();
+    ReleaseAssert(report.find("\"total_count\": 0,") != std::string::npos);
+    ReleaseAssert(report.find("\"opcodes\": [],") != std::string::npos);
+    ReleaseAssert(report.find("\"pairs\": []") != std::string::npos);
+}
+
+}   // anonymous namespace
@@ -0,0 +1,59 @@
+#include "gtest/gtest.h"
+#include "runtime_utils.h"
+
+// The profile only exists with the JIT_CALL_MEGAMORPHIC_PROFILING build option
+//
+#ifdef ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
+
+namespace {
+
+TEST(JitCallMegamorphicProfile, Sanity)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    JitCallInlineCacheSite site;
+    ReleaseAssert(site.GetMegamorphicProfile(vm) == nullptr);
+    site.m_numEntries = JitCallInlineCacheSite::x_maxEntries;
+
+    constexpr size_t numTargets = JitCallMegamorphicProfile::x_numSlots + 4;
+    std::vector<SystemHeapPointer<ExecutableCode>> targets;
+    for (size_t i = 0; i < numTargets; i++)
+    {
+        targets.push_back(ExecutableCode::CreateCFunction(vm, reinterpret_cast<void*>(i + 1)));
+    }
+
+    // Target i is called i + 1 times, the targets beyond the table capacity are not tracked
+    //
+    uint32_t expectedNumUntrackedCalls = 0;
+    for (size_t i = 0; i < numTargets; i++)
+    {
+        for (size_t k = 0; k <= i; k++)
+        {
+            site.RecordMegamorphicCallTarget(targets[i]);
+        }
+        if (i >= JitCallMegamorphicProfile::x_numSlots)
+        {
+            expectedNumUntrackedCalls += static_cast<uint32_t>(i + 1);
+        }
+    }
+
+    JitCallMegamorphicProfile* profile = site.GetMegamorphicProfile(vm);
+    ReleaseAssert(profile != nullptr);
+    for (size_t i = 0; i < numTargets; i++)
+    {
+        uint32_t expectedCount = (i < JitCallMegamorphicProfile::x_numSlots) ? static_cast<uint32_t>(i + 1) : 0;
+        ReleaseAssert(profile->GetCount(targets[i]) == expectedCount);
+    }
+    ReleaseAssert(profile->m_numUntrackedCalls == expectedNumUntrackedCalls);
+
+    // Recording more calls reuses the same profile
+    //
+    site.RecordMegamorphicCallTarget(targets[0]);
+    ReleaseAssert(site.GetMegamorphicProfile(vm) == profile);
+    ReleaseAssert(profile->GetCount(targets[0]) == 2);
+}
+
+}   // anonymous namespace
+
+#endif  // ENABLE_JIT_CALL_MEGAMORPHIC_PROFILING
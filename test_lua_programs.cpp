@@ -6,6 +6,9 @@
 #include "test_vm_utils.h"
 #include "lj_parser_wrapper.h"
 #include "drt/baseline_jit_codegen_helper.h"
+#include "drt/baseline_jit_background_compiler.h"
+#include "persistent_hot_function_cache.h"
+#include "bytecode_snapshot.h"
 #include "test_lua_file_utils.h"
 
 namespace {
@@ -196,6 +199,66 @@ TEST(LuaTestTierUpToBaselineJit, Fib_upvalue)
     RunSimpleLuaTest("luatests/fib_upvalue.lua", LuaTestOption::UpToBaselineJit);
 }
 
+TEST(LuaTest, global_value_folding)
+{
+    RunSimpleLuaTest("luatests/global_value_folding.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaTestForceBaselineJit, global_value_folding)
+{
+    RunSimpleLuaTest("luatests/global_value_folding.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaTestTierUpToBaselineJit, global_value_folding)
+{
+    RunSimpleLuaTest("luatests/global_value_folding.lua", LuaTestOption::UpToBaselineJit);
+}
+
+TEST(LuaTest, upvalue_table_get_by_id_fusion)
+{
+    RunSimpleLuaTest("luatests/upvalue_table_get_by_id_fusion.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaTestForceBaselineJit, upvalue_table_get_by_id_fusion)
+{
+    RunSimpleLuaTest("luatests/upvalue_table_get_by_id_fusion.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaTestTierUpToBaselineJit, upvalue_table_get_by_id_fusion)
+{
+    RunSimpleLuaTest("luatests/upvalue_table_get_by_id_fusion.lua", LuaTestOption::UpToBaselineJit);
+}
+
+TEST(LuaTest, call_ic_exact_arity)
+{
+    RunSimpleLuaTest("luatests/call_ic_exact_arity.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaTestForceBaselineJit, call_ic_exact_arity)
+{
+    RunSimpleLuaTest("luatests/call_ic_exact_arity.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaTestTierUpToBaselineJit, call_ic_exact_arity)
+{
+    RunSimpleLuaTest("luatests/call_ic_exact_arity.lua", LuaTestOption::UpToBaselineJit);
+}
+
+TEST(LuaTest, call_site_megamorphic)
+{
+    RunSimpleLuaTest("luatests/call_site_megamorphic.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaTestForceBaselineJit, call_site_megamorphic)
+{
+    RunSimpleLuaTest("luatests/call_site_megamorphic.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaTestTierUpToBaselineJit, call_site_megamorphic)
+{
+    RunSimpleLuaTest("luatests/call_site_megamorphic.lua", LuaTestOption::UpToBaselineJit);
+}
+
 TEST(LuaTest, LinearSieve)
 {
     RunSimpleLuaTest("luatests/linear_sieve.lua", LuaTestOption::ForceInterpreter);
@@ -331,6 +394,17 @@ TEST(LuaTestTierUpToBaselineJit, LengthOperator)
     RunSimpleLuaTest("luatests/length_operator.lua", LuaTestOption::UpToBaselineJit);
 }
 
+// Replace the (not yet used) stack of the root coroutine with one that has 'numUsableSlots' slots before the reserved slots.
+// A small stack makes a test that checks the stack never grows catch even a small leak of stack slots.
+//
+static void ReplaceRootCoroutineStackForTest(VM* vm, size_t numUsableSlots)
+{
+    CoroutineRuntimeContext* rc = vm->GetRootCoroutine();
+    vm->GetUserHeapGarbageCollector()->FreeStackMaybeInUseByMarker(rc->m_stackBegin, rc->m_numStackSlots);
+    rc->m_stackBegin = CoroutineRuntimeContext::AllocateStack(numUsableSlots + CoroutineRuntimeContext::x_stackReservedSlots);
+    rc->m_numStackSlots = static_cast<uint32_t>(numUsableSlots + CoroutineRuntimeContext::x_stackReservedSlots);
+}
+
 static void LuaTest_TailCall_Impl(LuaTestOption testOption)
 {
     VM* vm = VM::Create();
@@ -341,10 +415,11 @@ static void LuaTest_TailCall_Impl(LuaTestOption testOption)
 
     std::unique_ptr<ScriptModule> module = ParseLuaScriptOrFail("luatests/tail_call.lua", testOption);
 
-    // Manually lower the stack size
+    // Manually lower the stack size, and check that the deep tail recursions did not grow it
     //
     CoroutineRuntimeContext* rc = vm->GetRootCoroutine();
-    rc->m_stackBegin = new TValue[200];
+    ReplaceRootCoroutineStackForTest(vm, 200 /*numUsableSlots*/);
+    uint32_t numStackSlots = rc->m_numStackSlots;
 
     vm->LaunchScript(module.get());
 
@@ -352,6 +427,7 @@ static void LuaTest_TailCall_Impl(LuaTestOption testOption)
     std::string err = vmoutput.GetAndResetStdErr();
     AssertIsExpectedOutput(out);
     ReleaseAssert(err == "");
+    ReleaseAssert(rc->m_numStackSlots == numStackSlots);
 }
 
 TEST(LuaTest, TailCall)
@@ -379,10 +455,11 @@ static void LuaTest_VariadicTailCall_1_Impl(LuaTestOption testOption)
 
     std::unique_ptr<ScriptModule> module = ParseLuaScriptOrFail("luatests/variadic_tail_call_1.lua", testOption);
 
-    // Manually lower the stack size
+    // Manually lower the stack size, and check that the deep tail recursions did not grow it
     //
     CoroutineRuntimeContext* rc = vm->GetRootCoroutine();
-    rc->m_stackBegin = new TValue[200];
+    ReplaceRootCoroutineStackForTest(vm, 200 /*numUsableSlots*/);
+    uint32_t numStackSlots = rc->m_numStackSlots;
 
     vm->LaunchScript(module.get());
 
@@ -390,6 +467,7 @@ static void LuaTest_VariadicTailCall_1_Impl(LuaTestOption testOption)
     std::string err = vmoutput.GetAndResetStdErr();
     AssertIsExpectedOutput(out);
     ReleaseAssert(err == "");
+    ReleaseAssert(rc->m_numStackSlots == numStackSlots);
 }
 
 TEST(LuaTest, VariadicTailCall_1)
@@ -417,10 +495,11 @@ static void LuaTest_VariadicTailCall_2_Impl(LuaTestOption testOption)
 
     std::unique_ptr<ScriptModule> module = ParseLuaScriptOrFail("luatests/variadic_tail_call_2.lua", testOption);
 
-    // Manually lower the stack size
+    // Manually lower the stack size, and check that the deep tail recursions did not grow it
     //
     CoroutineRuntimeContext* rc = vm->GetRootCoroutine();
-    rc->m_stackBegin = new TValue[200];
+    ReplaceRootCoroutineStackForTest(vm, 200 /*numUsableSlots*/);
+    uint32_t numStackSlots = rc->m_numStackSlots;
 
     vm->LaunchScript(module.get());
 
@@ -428,6 +507,7 @@ static void LuaTest_VariadicTailCall_2_Impl(LuaTestOption testOption)
     std::string err = vmoutput.GetAndResetStdErr();
     AssertIsExpectedOutput(out);
     ReleaseAssert(err == "");
+    ReleaseAssert(rc->m_numStackSlots == numStackSlots);
 }
 
 TEST(LuaTest, VariadicTailCall_2)
@@ -455,10 +535,11 @@ static void LuaTest_VariadicTailCall_3_Impl(LuaTestOption testOption)
 
     std::unique_ptr<ScriptModule> module = ParseLuaScriptOrFail("luatests/variadic_tail_call_3.lua", testOption);
 
-    // Manually lower the stack size
+    // Manually lower the stack size, and check that the deep tail recursions did not grow it
     //
     CoroutineRuntimeContext* rc = vm->GetRootCoroutine();
-    rc->m_stackBegin = new TValue[200];
+    ReplaceRootCoroutineStackForTest(vm, 200 /*numUsableSlots*/);
+    uint32_t numStackSlots = rc->m_numStackSlots;
 
     vm->LaunchScript(module.get());
 
@@ -466,6 +547,7 @@ static void LuaTest_VariadicTailCall_3_Impl(LuaTestOption testOption)
     std::string err = vmoutput.GetAndResetStdErr();
     AssertIsExpectedOutput(out);
     ReleaseAssert(err == "");
+    ReleaseAssert(rc->m_numStackSlots == numStackSlots);
 }
 
 TEST(LuaTest, VariadicTailCall_3)
@@ -975,10 +1057,9 @@ static void LuaBenchmark_Ack_Impl(LuaTestOption testOption)
 
     std::unique_ptr<ScriptModule> module = ParseLuaScriptOrFail("luatests/ack.lua", testOption);
 
-    // This benchmark needs a larger stack
+    // This benchmark needs a large stack. Start from a small one, so the stack is grown (and relocated) many times.
     //
-    CoroutineRuntimeContext* rc = vm->GetRootCoroutine();
-    rc->m_stackBegin = new TValue[1000000];
+    ReplaceRootCoroutineStackForTest(vm, 200 /*numUsableSlots*/);
 
     vm->LaunchScript(module.get());
 
@@ -986,6 +1067,7 @@ static void LuaBenchmark_Ack_Impl(LuaTestOption testOption)
     std::string err = vmoutput.GetAndResetStdErr();
     AssertIsExpectedOutput(out);
     ReleaseAssert(err == "");
+    ReleaseAssert(vm->GetRootCoroutine()->m_numStackSlots > CoroutineRuntimeContext::x_rootCoroutineDefaultStackSlots + CoroutineRuntimeContext::x_stackReservedSlots);
 }
 
 TEST(LuaBenchmark, Ack)
@@ -2578,6 +2660,36 @@ TEST(LuaLibTierUpToBaselineJit, coroutine_ring)
     RunSimpleLuaTest("luatests/coroutine_ring.lua", LuaTestOption::UpToBaselineJit);
 }
 
+TEST(LuaLib, coroutine_stack_growth)
+{
+    RunSimpleLuaTest("luatests/coroutine_stack_growth.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaLibForceBaselineJit, coroutine_stack_growth)
+{
+    RunSimpleLuaTest("luatests/coroutine_stack_growth.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaLibTierUpToBaselineJit, coroutine_stack_growth)
+{
+    RunSimpleLuaTest("luatests/coroutine_stack_growth.lua", LuaTestOption::UpToBaselineJit);
+}
+
+TEST(LuaLib, coroutine_recycle)
+{
+    RunSimpleLuaTest("luatests/coroutine_recycle.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaLibForceBaselineJit, coroutine_recycle)
+{
+    RunSimpleLuaTest("luatests/coroutine_recycle.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaLibTierUpToBaselineJit, coroutine_recycle)
+{
+    RunSimpleLuaTest("luatests/coroutine_recycle.lua", LuaTestOption::UpToBaselineJit);
+}
+
 TEST(LuaLib, coroutine_error_1)
 {
     RunSimpleLuaTest("luatests/coroutine_error_1.lua", LuaTestOption::ForceInterpreter);
@@ -3193,6 +3305,36 @@ TEST(LuaLibTierUpToBaselineJit, table_sort_4)
     RunSimpleLuaTest("luatests/table_sort_4.lua", LuaTestOption::UpToBaselineJit);
 }
 
+TEST(LuaLib, table_sort_5)
+{
+    RunSimpleLuaTest("luatests/table_sort_5.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaLibForceBaselineJit, table_sort_5)
+{
+    RunSimpleLuaTest("luatests/table_sort_5.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaLibTierUpToBaselineJit, table_sort_5)
+{
+    RunSimpleLuaTest("luatests/table_sort_5.lua", LuaTestOption::UpToBaselineJit);
+}
+
+TEST(LuaLib, table_insert_remove)
+{
+    RunSimpleLuaTest("luatests/table_insert_remove.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaLibForceBaselineJit, table_insert_remove)
+{
+    RunSimpleLuaTest("luatests/table_insert_remove.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaLibTierUpToBaselineJit, table_insert_remove)
+{
+    RunSimpleLuaTest("luatests/table_insert_remove.lua", LuaTestOption::UpToBaselineJit);
+}
+
 TEST(LuaLib, table_lib_concat)
 {
     RunSimpleLuaTest("luatests/table_lib_concat.lua", LuaTestOption::ForceInterpreter);
@@ -3478,6 +3620,71 @@ TEST(LuaLibTierUpToBaselineJit, base_load)
     RunSimpleLuaTest("luatests/base_load.lua", LuaTestOption::UpToBaselineJit);
 }
 
+TEST(LuaLib, string_dump)
+{
+    RunSimpleLuaTest("luatests/string_dump.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaLibForceBaselineJit, string_dump)
+{
+    RunSimpleLuaTest("luatests/string_dump.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaLibTierUpToBaselineJit, string_dump)
+{
+    RunSimpleLuaTest("luatests/string_dump.lua", LuaTestOption::UpToBaselineJit);
+}
+
+// Run the script from source, then dump it to a bytecode snapshot file, load the file in a fresh VM, and check the output is the same
+//
+static void TestBytecodeSnapshotRoundTrip_Impl(const std::string& filename)
+{
+    std::string snapshotFile = "/tmp/ljr_test_bytecode_snapshot_" + std::to_string(getpid());
+    unlink(snapshotFile.c_str());
+    Auto(unlink(snapshotFile.c_str()));
+
+    std::string expectedOut;
+    {
+        VM* vm = VM::Create();
+        Auto(vm->Destroy());
+        VMOutputInterceptor vmoutput(vm);
+
+        std::unique_ptr<ScriptModule> module = ParseLuaScriptOrFail(filename, LuaTestOption::ForceInterpreter);
+        std::string snapshot;
+        ReleaseAssert(BytecodeSnapshot::Dump(module->m_unlinkedCodeBlocks.back(), snapshot /*out*/));
+        ReleaseAssert(BytecodeSnapshot::IsSnapshot(snapshot.data(), snapshot.length()));
+        FILE* fp = fopen(snapshotFile.c_str(), "wb");
+        ReleaseAssert(fp != nullptr);
+        ReleaseAssert(fwrite(snapshot.data(), 1, snapshot.length(), fp) == snapshot.length());
+        ReleaseAssert(fclose(fp) == 0);
+
+        vm->LaunchScript(module.get());
+        expectedOut = vmoutput.GetAndResetStdOut();
+        ReleaseAssert(vmoutput.GetAndResetStdErr() == "");
+    }
+
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    VMOutputInterceptor vmoutput(vm);
+
+    ParseResult res = ParseLuaScriptFromFile(vm->GetRootCoroutine(), snapshotFile.c_str());
+    ReleaseAssert(res.m_scriptModule.get() != nullptr);
+    std::unique_ptr<ScriptModule> module = std::move(res.m_scriptModule);
+    vm->LaunchScript(module.get());
+
+    ReleaseAssert(vmoutput.GetAndResetStdOut() == expectedOut);
+    ReleaseAssert(vmoutput.GetAndResetStdErr() == "");
+}
+
+TEST(LuaTest, bytecode_snapshot_roundtrip)
+{
+    TestBytecodeSnapshotRoundTrip_Impl("luatests/table_dup.lua");
+    TestBytecodeSnapshotRoundTrip_Impl("luatests/table_dup2.lua");
+    TestBytecodeSnapshotRoundTrip_Impl("luatests/table_dup3.lua");
+    TestBytecodeSnapshotRoundTrip_Impl("luatests/fib_upvalue.lua");
+    TestBytecodeSnapshotRoundTrip_Impl("luatests/deltablue.lua");
+}
+
 TEST(LuaLib, base_loadfile)
 {
     RunSimpleLuaTest("luatests/base_loadfile.lua", LuaTestOption::ForceInterpreter);
@@ -3568,6 +3775,36 @@ TEST(LuaLibTierUpToBaselineJit, base_lib_dofile_throw)
     RunSimpleLuaTest("luatests/base_lib_dofile_throw.lua", LuaTestOption::UpToBaselineJit);
 }
 
+TEST(LuaLib, io_file)
+{
+    RunSimpleLuaTest("luatests/io_file.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaLibForceBaselineJit, io_file)
+{
+    RunSimpleLuaTest("luatests/io_file.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaLibTierUpToBaselineJit, io_file)
+{
+    RunSimpleLuaTest("luatests/io_file.lua", LuaTestOption::UpToBaselineJit);
+}
+
+TEST(LuaLib, string_pattern)
+{
+    RunSimpleLuaTest("luatests/string_pattern.lua", LuaTestOption::ForceInterpreter);
+}
+
+TEST(LuaLibForceBaselineJit, string_pattern)
+{
+    RunSimpleLuaTest("luatests/string_pattern.lua", LuaTestOption::ForceBaselineJit);
+}
+
+TEST(LuaLibTierUpToBaselineJit, string_pattern)
+{
+    RunSimpleLuaTest("luatests/string_pattern.lua", LuaTestOption::UpToBaselineJit);
+}
+
 TEST(LuaBenchmark, fasta)
 {
     RunSimpleLuaTest("luatests/fasta.lua", LuaTestOption::ForceInterpreter);
@@ -3907,4 +4144,106 @@ TEST(LuaTestTierUp, interp_to_baseline_osr_entry_kv_loop_4)
     TestInterpToBaselineTierUpSanity_1_Impl("luatests/interp_to_baseline_osr_entry_kv_loop_4.lua", 2 /*numExpectedCompilations*/);
 }
 
+void TestInterpToBaselineBackgroundCompilation_Impl(std::string filename)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    vm->SetEngineStartingTier(VM::EngineStartingTier::Interpreter);
+    vm->SetEngineMaxTier(VM::EngineMaxTier::BaselineJIT);
+    vm->SetBackgroundBaselineJitCompilationEnabled(true);
+    VMOutputInterceptor vmoutput(vm);
+
+    std::unique_ptr<ScriptModule> module = ParseLuaScriptOrFail(filename, LuaTestOption::UpToBaselineJit);
+
+    UnlinkedCodeBlock* targetUcb = nullptr;
+    for (UnlinkedCodeBlock* ucb : module->m_unlinkedCodeBlocks)
+    {
+        if (ucb->m_numFixedArguments == 1 && !ucb->m_hasVariadicArguments)
+        {
+            ReleaseAssert(targetUcb == nullptr);
+            targetUcb = ucb;
+        }
+    }
+    ReleaseAssert(targetUcb != nullptr);
+
+    CodeBlock* targetCb = targetUcb->GetCodeBlock(module->m_defaultGlobalObject);
+
+    vm->LaunchScript(module.get());
+
+    std::string out = vmoutput.GetAndResetStdOut();
+    std::string err = vmoutput.GetAndResetStdErr();
+
+    AssertIsExpectedOutput(out);
+    ReleaseAssert(err == "");
+
+    // The function may or may not have entered the JIT code while the script was running,
+    // depending on how fast the compiler thread is, but it must have been enqueued
+    //
+    BaselineJitBackgroundCompiler* compiler = vm->GetBaselineJitBackgroundCompiler();
+    compiler->WaitForAllCompilations();
+    ReleaseAssert(compiler->GetNumEnqueuedCodeBlocks() == 0);
+    ReleaseAssert(targetCb->m_baselineCodeBlock != nullptr);
+    ReleaseAssert(vm->GetNumTotalBaselineJitCompilations() >= 1);
+}
+
+TEST(LuaTestTierUp, interp_to_baseline_background_compilation_1)
+{
+    TestInterpToBaselineBackgroundCompilation_Impl("luatests/interp_to_baseline_tier_up_1.lua");
+}
+
+TEST(LuaTestTierUp, interp_to_baseline_background_compilation_2)
+{
+    TestInterpToBaselineBackgroundCompilation_Impl("luatests/interp_to_baseline_osr_entry_while_loop_1.lua");
+}
+
+TEST(LuaTestTierUp, persistent_hot_function_cache)
+{
+    std::string cacheFile = "/tmp/ljr_test_persistent_hot_function_cache_" + std::to_string(getpid());
+    unlink(cacheFile.c_str());
+    Auto(unlink(cacheFile.c_str()));
+
+    // On the first run the function tiers up as usual, and is recorded in the cache when the VM is destroyed.
+    // On the second run it should be compiled right when it is loaded.
+    //
+    for (bool isWarmStart : { false, true })
+    {
+        VM* vm = VM::Create();
+        Auto(vm->Destroy());
+        vm->SetEngineStartingTier(VM::EngineStartingTier::Interpreter);
+        vm->SetEngineMaxTier(VM::EngineMaxTier::BaselineJIT);
+        vm->OpenPersistentHotFunctionCache(cacheFile);
+        VMOutputInterceptor vmoutput(vm);
+
+        ReleaseAssert(vm->GetPersistentHotFunctionCache()->GetNumPersistedHotFunctions() == (isWarmStart ? 1 : 0));
+
+        std::unique_ptr<ScriptModule> module = ParseLuaScriptOrFail("luatests/interp_to_baseline_tier_up_1.lua", LuaTestOption::UpToBaselineJit);
+
+        UnlinkedCodeBlock* targetUcb = nullptr;
+        for (UnlinkedCodeBlock* ucb : module->m_unlinkedCodeBlocks)
+        {
+            if (ucb->m_numFixedArguments == 1 && !ucb->m_hasVariadicArguments)
+            {
+                ReleaseAssert(targetUcb == nullptr);
+                targetUcb = ucb;
+            }
+        }
+        ReleaseAssert(targetUcb != nullptr);
+
+        CodeBlock* targetCb = targetUcb->GetCodeBlock(module->m_defaultGlobalObject);
+        ReleaseAssert((targetCb->m_baselineCodeBlock != nullptr) == isWarmStart);
+
+        vm->LaunchScript(module.get());
+
+        std::string out = vmoutput.GetAndResetStdOut();
+        std::string err = vmoutput.GetAndResetStdErr();
+
+        AssertIsExpectedOutput(out);
+        ReleaseAssert(err == "");
+
+        ReleaseAssert(targetCb->m_baselineCodeBlock != nullptr);
+        ReleaseAssert(vm->GetNumTotalBaselineJitCompilations() == 1);
+        ReleaseAssert(vm->GetPersistentHotFunctionCache()->GetNumNewHotFunctions() == (isWarmStart ? 0 : 1));
+    }
+}
+
 }   // anonymous namespace
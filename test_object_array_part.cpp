@@ -1139,4 +1139,67 @@ TEST(ObjectArrayPart, DensityTest2)
     ObjectArrayPartDensityTest(vm, 2000 /*numProps*/);
 }
 
+// Test that once the vector-qualifying indices in the sparse map become dense enough,
+// they are migrated into the vector storage when the sparse map rehashes
+//
+TEST(ObjectArrayPart, SparseMapMigrateToVector)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+
+    Structure* initStructure = Structure::CreateInitialStructure(vm, 2 /*inlineCap*/);
+    HeapPtr<TableObject> obj = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*butterflyCap*/);
+
+    constexpr int32_t maxIndex = ArrayGrowthPolicy::x_alwaysVectorCutoff * 2;
+    std::vector<TValue> expected;
+    expected.resize(static_cast<size_t>(maxIndex + 1), TValue::Nil());
+
+    // The first put goes into the sparse map, and since the sparse map now contains a vector index,
+    // the vector storage never grows, so all the following puts go into the sparse map as well
+    //
+    bool migrated = false;
+    for (int32_t index = maxIndex; index > 0; index--)
+    {
+        TValue val = TValue::CreateInt32(index * 3 + 1);
+        TableObject::RawPutByValIntegerIndex(obj, index, val);
+        expected[static_cast<size_t>(index)] = val;
+
+        ArrayType arrType = TCGet(obj->m_arrayType);
+        SystemHeapPointer<void> hiddenClass = TCGet(obj->m_hiddenClass);
+        ReleaseAssert(hiddenClass.As<SystemHeapGcObjectHeader>()->m_type == HeapEntityType::Structure);
+        ReleaseAssert(arrType.m_asValue == hiddenClass.As<Structure>()->m_arrayType.m_asValue);
+        ReleaseAssert(!arrType.IsContinuous());
+        ReleaseAssert(arrType.HasSparseMap());
+
+        uint32_t numPut = static_cast<uint32_t>(maxIndex - index + 1);
+        if (!migrated)
+        {
+            if (!arrType.SparseMapContainsVectorIndex())
+            {
+                // The migration only happens once the indices satisfy the density requirement
+                //
+                ReleaseAssert(static_cast<uint64_t>(numPut) * ArrayGrowthPolicy::x_densityCutoff >= static_cast<uint64_t>(maxIndex));
+                ReleaseAssert(obj->m_butterfly->GetHeader()->m_arrayStorageCapacity >= static_cast<uint32_t>(maxIndex));
+                migrated = true;
+            }
+        }
+        else
+        {
+            // After the migration, the remaining puts go into the vector storage
+            //
+            ReleaseAssert(!arrType.SparseMapContainsVectorIndex());
+        }
+    }
+    ReleaseAssert(migrated);
+
+    for (size_t i = 0; i < expected.size() + 10; i++)
+    {
+        GetByIntegerIndexICInfo icInfo;
+        TableObject::PrepareGetByIntegerIndex(obj, icInfo /*out*/);
+        TValue result = TableObject::GetByInt32Val(obj, static_cast<int32_t>(i), icInfo);
+        TValue expectedVal = (i < expected.size()) ? expected[i] : TValue::Nil();
+        ReleaseAssert(result.m_value == expectedVal.m_value);
+    }
+}
+
 }   // anonymous namespace
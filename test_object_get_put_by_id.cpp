@@ -424,4 +424,468 @@ TEST(ObjectGetPutById, MissedGetByIdIsUncacheableForCacheableDicitonary)
     }
 }
 
+// A table used as a hash map with keys coming and going should transition to UncacheableDictionary,
+// and the keys with nil value should be removed so the table doesn't grow without bound
+//
+TEST(ObjectGetPutById, UncacheableDictionaryAfterKeyChurn)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    const uint32_t numStrings = x_isDebugBuild ? 3000 : 10000;
+    const uint32_t numLiveKeys = 40;
+    StringList strings = GetStringList(VM::GetActiveVMForCurrentThread(), numStrings);
+    Structure* initStructure = Structure::CreateInitialStructure(VM::GetActiveVMForCurrentThread(), 8 /*inlineCapacity*/);
+    HeapPtr<TableObject> curObject = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*initArraySize*/);
+
+    auto put = [&](UserHeapPointer<HeapString> prop, TValue val)
+    {
+        PutByIdICInfo icInfo;
+        TableObject::PreparePutById(curObject, prop, icInfo /*out*/);
+        TableObject::PutById(curObject, prop.As<void>(), val, icInfo);
+    };
+
+    auto get = [&](UserHeapPointer<HeapString> prop) -> TValue
+    {
+        GetByIdICInfo icInfo;
+        TableObject::PrepareGetById(curObject, prop, icInfo /*out*/);
+        return TableObject::GetById(curObject, prop.As<void>(), icInfo);
+    };
+
+    auto getHiddenClassType = [&]() -> HeapEntityType
+    {
+        return TCGet(curObject->m_hiddenClass).As<SystemHeapGcObjectHeader>()->m_type;
+    };
+
+    bool sawUncacheableDictionary = false;
+    uint32_t capacityAtTransition = 0;
+    for (uint32_t i = 0; i < numStrings; i++)
+    {
+        put(strings[i], TValue::CreateInt32(static_cast<int32_t>(i + 456)));
+        if (i >= numLiveKeys)
+        {
+            put(strings[i - numLiveKeys], TValue::Nil());
+        }
+
+        if (getHiddenClassType() == HeapEntityType::UncacheableDictionary)
+        {
+            HeapPtr<CacheableDictionary> dict = TCGet(curObject->m_hiddenClass).As<CacheableDictionary>();
+            uint32_t capacity = dict->m_inlineNamedStorageCapacity + dict->m_butterflyNamedStorageCapacity;
+            if (!sawUncacheableDictionary)
+            {
+                sawUncacheableDictionary = true;
+                capacityAtTransition = capacity;
+            }
+            // The named storage should be bounded by the number of live keys, not the number of keys ever inserted
+            //
+            ReleaseAssert(capacity == capacityAtTransition);
+            ReleaseAssert(dict->m_slotCount <= capacity);
+        }
+        else
+        {
+            // Once transitioned, the table never goes back
+            //
+            ReleaseAssert(!sawUncacheableDictionary);
+        }
+
+        if (i % 97 == 0)
+        {
+            uint32_t lo = (i >= numLiveKeys) ? i - numLiveKeys + 1 : 0;
+            for (uint32_t k = 0; k <= i; k++)
+            {
+                TValue result = get(strings[k]);
+                if (k >= lo)
+                {
+                    ReleaseAssert(result.IsInt32() && result.AsInt32() == static_cast<int32_t>(k + 456));
+                }
+                else
+                {
+                    ReleaseAssert(result.IsNil());
+                }
+            }
+        }
+    }
+    ReleaseAssert(sawUncacheableDictionary);
+
+    // Queries on an UncacheableDictionary must not be inline cached, whether the property exists or not
+    //
+    {
+        GetByIdICInfo icInfo;
+        TableObject::PrepareGetById(curObject, strings[numStrings - 1], icInfo /*out*/);
+        ReleaseAssert(icInfo.m_icKind == GetByIdICInfo::ICKind::UncachableDictionary);
+        TableObject::PrepareGetById(curObject, strings[0], icInfo /*out*/);
+        ReleaseAssert(icInfo.m_icKind == GetByIdICInfo::ICKind::UncachableDictionary);
+        ReleaseAssert(icInfo.m_slot == -1);
+
+        PutByIdICInfo putIcInfo;
+        TableObject::PreparePutById(curObject, strings[numStrings - 1], putIcInfo /*out*/);
+        ReleaseAssert(!putIcInfo.m_isInlineCacheable);
+    }
+
+    // The iterator should see exactly the live keys
+    //
+    {
+        std::set<int64_t> expectedKeys;
+        for (uint32_t k = numStrings - numLiveKeys; k < numStrings; k++)
+        {
+            expectedKeys.insert(strings[k].m_value);
+        }
+        TableObjectIterator iter;
+        while (true)
+        {
+            TableObjectIterator::KeyValuePair kv = iter.Advance(curObject);
+            if (kv.m_key.IsNil())
+            {
+                break;
+            }
+            ReleaseAssert(kv.m_key.IsPointer());
+            int64_t key = kv.m_key.AsPointer().m_value;
+            ReleaseAssert(expectedKeys.count(key));
+            expectedKeys.erase(key);
+        }
+        ReleaseAssert(expectedKeys.empty());
+    }
+}
+
+// Accesses to the same property names on tables of many different shapes go through the megamorphic property cache.
+// The cached results must be the same as the ones computed from the structure.
+//
+TEST(ObjectGetPutById, MegamorphicPropertyCache)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    const uint32_t numStrings = 40;
+    const uint32_t numObjects = 300;
+    StringList strings = GetStringList(VM::GetActiveVMForCurrentThread(), numStrings);
+    Structure* initStructure = Structure::CreateInitialStructure(VM::GetActiveVMForCurrentThread(), 4 /*inlineCapacity*/);
+    MegamorphicPropertyCache* cache = vm->GetMegamorphicPropertyCache();
+
+    std::vector<HeapPtr<TableObject>> objects;
+    std::vector<std::vector<uint32_t>> propsOfObject;
+    for (uint32_t i = 0; i < numObjects; i++)
+    {
+        HeapPtr<TableObject> obj = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*initArraySize*/);
+        std::vector<uint32_t> props;
+        uint32_t numProps = 1 + static_cast<uint32_t>(rand()) % 12;
+        for (uint32_t k = 0; k < numProps; k++)
+        {
+            uint32_t prop = static_cast<uint32_t>(rand()) % numStrings;
+            PutByIdICInfo icInfo;
+            TableObject::PreparePutById(obj, strings[prop], icInfo /*out*/);
+            TableObject::PutById(obj, strings[prop].As<void>(), TValue::CreateInt32(static_cast<int32_t>(i * 1000 + prop)), icInfo);
+            if (std::find(props.begin(), props.end(), prop) == props.end())
+            {
+                props.push_back(prop);
+            }
+        }
+        objects.push_back(obj);
+        propsOfObject.push_back(props);
+    }
+
+    for (uint32_t round = 0; round < 3; round++)
+    {
+        for (uint32_t i = 0; i < numObjects; i++)
+        {
+            HeapPtr<TableObject> obj = objects[i];
+            for (uint32_t prop = 0; prop < numStrings; prop++)
+            {
+                bool exists = std::find(propsOfObject[i].begin(), propsOfObject[i].end(), prop) != propsOfObject[i].end();
+
+                GetByIdICInfo icInfo;
+                TableObject::PrepareGetById(obj, strings[prop], icInfo /*out*/);
+                TValue result = TableObject::GetById(obj, strings[prop].As<void>(), icInfo);
+                if (exists)
+                {
+                    ReleaseAssert(result.IsInt32() && result.AsInt32() == static_cast<int32_t>(i * 1000 + prop));
+                }
+                else
+                {
+                    ReleaseAssert(result.IsNil());
+                }
+
+                GetByIdICInfo expectedIcInfo;
+                TableObject::PrepareGetByIdImplForStructure(TCGet(obj->m_hiddenClass), strings[prop], expectedIcInfo /*out*/);
+                ReleaseAssert(icInfo.m_icKind == expectedIcInfo.m_icKind);
+                ReleaseAssert(icInfo.m_slot == expectedIcInfo.m_slot);
+                ReleaseAssert(icInfo.m_mayHaveMetatable == expectedIcInfo.m_mayHaveMetatable);
+
+                // Overwriting an existing property doesn't change the structure, so it is always cacheable
+                //
+                if (exists)
+                {
+                    PutByIdICInfo putIcInfo;
+                    TableObject::PreparePutById(obj, strings[prop], putIcInfo /*out*/);
+                    ReleaseAssert(putIcInfo.m_isInlineCacheable && putIcInfo.m_propertyExists);
+                    TableObject::PutById(obj, strings[prop].As<void>(), TValue::CreateInt32(static_cast<int32_t>(i * 1000 + prop)), putIcInfo);
+                }
+            }
+        }
+
+        // The cache only memoizes the lookups, so the results must not change after it is cleared
+        //
+        if (round == 1)
+        {
+            cache->Clear();
+        }
+    }
+}
+
+// A lookup misses the megamorphic property cache the first time, and hits it afterwards.
+// The cache is keyed by the hidden class, so a cached lookup is never used after the hidden class of the table changes.
+//
+TEST(ObjectGetPutById, MegamorphicPropertyCacheHitAndHiddenClassChange)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    StringList strings = GetStringList(VM::GetActiveVMForCurrentThread(), 2);
+    UserHeapPointer<HeapString> a = strings[0];
+    UserHeapPointer<HeapString> b = strings[1];
+    Structure* initStructure = Structure::CreateInitialStructure(VM::GetActiveVMForCurrentThread(), 4 /*inlineCapacity*/);
+    MegamorphicPropertyCache* cache = vm->GetMegamorphicPropertyCache();
+    cache->Clear();
+
+    HeapPtr<TableObject> obj = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*initArraySize*/);
+    {
+        PutByIdICInfo icInfo;
+        TableObject::PreparePutById(obj, a, icInfo /*out*/);
+        TableObject::PutById(obj, a.As<void>(), TValue::CreateInt32(1), icInfo);
+    }
+    SystemHeapPointer<void> hc1 = TCGet(obj->m_hiddenClass);
+
+    auto checkGetByIdIsCachedAfterWarmUp = [&](SystemHeapPointer<void> hc, UserHeapPointer<HeapString> prop, GetByIdICInfo::ICKind expectedKind)
+    {
+        GetByIdICInfo cached;
+        ReleaseAssert(!cache->TryGetForGetById(hc, prop.As<void>(), cached /*out*/));
+
+        GetByIdICInfo icInfo;
+        TableObject::PrepareGetById(obj, prop, icInfo /*out*/);
+        ReleaseAssert(icInfo.m_icKind == expectedKind);
+
+        ReleaseAssert(cache->TryGetForGetById(hc, prop.As<void>(), cached /*out*/));
+        ReleaseAssert(cached.m_icKind == icInfo.m_icKind);
+        ReleaseAssert(cached.m_slot == icInfo.m_slot);
+        ReleaseAssert(cached.m_mayHaveMetatable == icInfo.m_mayHaveMetatable);
+    };
+
+    // Both an existing and a non-existent property are cached
+    //
+    checkGetByIdIsCachedAfterWarmUp(hc1, a, GetByIdICInfo::ICKind::InlinedStorage);
+    checkGetByIdIsCachedAfterWarmUp(hc1, b, GetByIdICInfo::ICKind::MustBeNil);
+
+    {
+        PutByIdICInfo cached;
+        ReleaseAssert(!cache->TryGetForPutById(hc1, a.As<void>(), cached /*out*/));
+
+        PutByIdICInfo icInfo;
+        TableObject::PreparePutById(obj, a, icInfo /*out*/);
+        ReleaseAssert(icInfo.m_isInlineCacheable && icInfo.m_propertyExists);
+
+        ReleaseAssert(cache->TryGetForPutById(hc1, a.As<void>(), cached /*out*/));
+        ReleaseAssert(cached.m_isInlineCacheable && cached.m_propertyExists);
+        ReleaseAssert(cached.m_slot == icInfo.m_slot);
+        TableObject::PutById(obj, a.As<void>(), TValue::CreateInt32(2), cached);
+    }
+
+    // Adding 'b' transitions the table to another structure. The cached "'b' does not exist" result is keyed by the old structure,
+    // so the lookup on the new structure misses, and finds 'b'.
+    //
+    {
+        PutByIdICInfo icInfo;
+        TableObject::PreparePutById(obj, b, icInfo /*out*/);
+        ReleaseAssert(!icInfo.m_propertyExists);
+        TableObject::PutById(obj, b.As<void>(), TValue::CreateInt32(3), icInfo);
+    }
+    SystemHeapPointer<void> hc2 = TCGet(obj->m_hiddenClass);
+    ReleaseAssert(hc2.m_value != hc1.m_value);
+
+    checkGetByIdIsCachedAfterWarmUp(hc2, b, GetByIdICInfo::ICKind::InlinedStorage);
+    {
+        GetByIdICInfo icInfo;
+        TableObject::PrepareGetById(obj, b, icInfo /*out*/);
+        TValue result = TableObject::GetById(obj, b.As<void>(), icInfo);
+        ReleaseAssert(result.IsInt32() && result.AsInt32() == 3);
+        TableObject::PrepareGetById(obj, a, icInfo /*out*/);
+        result = TableObject::GetById(obj, a.As<void>(), icInfo);
+        ReleaseAssert(result.IsInt32() && result.AsInt32() == 2);
+    }
+
+    // The entry of the old structure is still correct for the old structure
+    //
+    {
+        GetByIdICInfo cached;
+        ReleaseAssert(cache->TryGetForGetById(hc1, b.As<void>(), cached /*out*/));
+        ReleaseAssert(cached.m_icKind == GetByIdICInfo::ICKind::MustBeNil);
+    }
+}
+
+// The name of a non-existent property is not kept alive by the cache, so the GC must drop the entries of dead property names,
+// otherwise a new string allocated at the same address would hit a stale entry
+//
+TEST(ObjectGetPutById, MegamorphicPropertyCacheDropsDeadPropertyNames)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    UserHeapGarbageCollector* gc = vm->GetUserHeapGarbageCollector();
+    MegamorphicPropertyCache* cache = vm->GetMegamorphicPropertyCache();
+    cache->Clear();
+
+    Structure* initStructure = Structure::CreateInitialStructure(vm, 4 /*inlineCapacity*/);
+    HeapPtr<TableObject> obj = TableObject::CreateEmptyTableObject(vm, initStructure, 0 /*initArraySize*/);
+    gc->AddPermanentRoot(TValue::CreatePointer(UserHeapPointer<TableObject>(obj)));
+    SystemHeapPointer<void> hc = TCGet(obj->m_hiddenClass);
+
+    auto createString = [&](const std::string& s) -> UserHeapPointer<HeapString>
+    {
+        return vm->CreateStringObjectFromRawString(s.data(), static_cast<uint32_t>(s.length()));
+    };
+
+    auto isCached = [&](UserHeapPointer<HeapString> prop) -> bool
+    {
+        GetByIdICInfo icInfo;
+        return cache->TryGetForGetById(hc, prop.As<void>(), icInfo /*out*/);
+    };
+
+    constexpr size_t x_numDeadNames = 500;
+    std::vector<UserHeapPointer<HeapString>> deadNames;
+    for (size_t i = 0; i < x_numDeadNames; i++)
+    {
+        UserHeapPointer<HeapString> prop = createString("dead_property_name_" + std::to_string(i));
+        GetByIdICInfo icInfo;
+        TableObject::PrepareGetById(obj, prop, icInfo /*out*/);
+        ReleaseAssert(icInfo.m_icKind == GetByIdICInfo::ICKind::MustBeNil);
+        deadNames.push_back(prop);
+    }
+
+    UserHeapPointer<HeapString> liveName = createString("live_property_name");
+    gc->AddPermanentRoot(TValue::CreatePointer(liveName));
+    {
+        GetByIdICInfo icInfo;
+        TableObject::PrepareGetById(obj, liveName, icInfo /*out*/);
+    }
+    ReleaseAssert(isCached(liveName));
+
+    // Some entries may have been evicted by others mapped to the same slot
+    //
+    size_t numCachedBeforeGc = 0;
+    for (UserHeapPointer<HeapString> prop : deadNames)
+    {
+        numCachedBeforeGc += isCached(prop) ? 1 : 0;
+    }
+    ReleaseAssert(numCachedBeforeGc > x_numDeadNames / 2);
+
+    gc->Collect(UserHeapGarbageCollector::CollectionKind::Full);
+
+    // A few of the strings may be kept alive by conservative stack scanning
+    //
+    size_t numCachedAfterGc = 0;
+    for (UserHeapPointer<HeapString> prop : deadNames)
+    {
+        numCachedAfterGc += isCached(prop) ? 1 : 0;
+    }
+    ReleaseAssert(numCachedAfterGc <= 10);
+    ReleaseAssert(isCached(liveName));
+}
+
+// A global value folded into an inline cache must not change as long as the global object keeps its hidden class
+//
+TEST(ObjectGetPutById, GlobalValueConstantFolding)
+{
+    VM* vm = VM::Create();
+    Auto(vm->Destroy());
+    StringList strings = GetStringList(VM::GetActiveVMForCurrentThread(), 3);
+    UserHeapPointer<HeapString> x = strings[0];
+    UserHeapPointer<HeapString> y = strings[1];
+    UserHeapPointer<HeapString> z = strings[2];
+    HeapPtr<TableObject> globalObject = TableObject::CreateEmptyGlobalObject(vm);
+
+    auto put = [&](UserHeapPointer<HeapString> prop, int32_t val)
+    {
+        PutByIdICInfo icInfo;
+        TableObject::PreparePutByIdForGlobalObject(globalObject, prop, icInfo /*out*/);
+        TableObject::PutById(globalObject, prop.As<void>(), TValue::CreateInt32(val), icInfo);
+    };
+
+    auto get = [&](UserHeapPointer<HeapString> prop) -> TValue
+    {
+        GetByIdICInfo icInfo;
+        TableObject::PrepareGetByIdForGlobalObject(globalObject, prop, icInfo /*out*/);
+        return TableObject::GetById(globalObject, prop.As<void>(), icInfo);
+    };
+
+    auto getHiddenClass = [&]() -> uint32_t
+    {
+        return TCGet(globalObject->m_hiddenClass).m_value;
+    };
+
+    put(x, 1);
+    put(y, 2);
+
+    // The stores to 'x' and 'y' may have been inline cached, so the hidden class must be relocated before 'x' can be folded
+    //
+    uint32_t hc0 = getHiddenClass();
+    ReleaseAssert(!TableObject::TryWatchGlobalValueForConstantFolding(globalObject, x));
+    uint32_t hc1 = getHiddenClass();
+    ReleaseAssert(hc1 != hc0);
+
+    // Now both 'x' and 'y' can be folded without relocation
+    //
+    ReleaseAssert(TableObject::TryWatchGlobalValueForConstantFolding(globalObject, x));
+    ReleaseAssert(TableObject::TryWatchGlobalValueForConstantFolding(globalObject, y));
+    ReleaseAssert(getHiddenClass() == hc1);
+
+    // Storing to a global that is not folded doesn't relocate the hidden class
+    //
+    put(z, 3);
+    put(z, 4);
+    ReleaseAssert(getHiddenClass() == hc1);
+
+    // Storing to a folded global relocates the hidden class, and the global is never folded again
+    //
+    put(x, 5);
+    uint32_t hc2 = getHiddenClass();
+    ReleaseAssert(hc2.m_value != hc1.m_value);
+    ReleaseAssert(!TableObject::TryWatchGlobalValueForConstantFolding(globalObject, x));
+    put(x, 6);
+    ReleaseAssert(getHiddenClass() == hc2);
+
+    // No inline cache is keyed on the new hidden class, so 'y' can be folded again
+    //
+    ReleaseAssert(TableObject::TryWatchGlobalValueForConstantFolding(globalObject, y));
+    ReleaseAssert(getHiddenClass() == hc2);
+
+    // The relocation also got rid of the stores to 'z' cached on the old hidden class, so 'z' can be folded,
+    // but after another store, it can only be folded after another relocation
+    //
+    put(z, 7);
+    ReleaseAssert(getHiddenClass() == hc2);
+    ReleaseAssert(!TableObject::TryWatchGlobalValueForConstantFolding(globalObject, z));
+    uint32_t hc3 = getHiddenClass();
+    ReleaseAssert(hc3 != hc2);
+    ReleaseAssert(TableObject::TryWatchGlobalValueForConstantFolding(globalObject, z));
+
+    // The relocation also got rid of the folding of 'y', so storing to it doesn't relocate
+    //
+    put(y, 8);
+    ReleaseAssert(getHiddenClass() == hc3);
+    ReleaseAssert(!TableObject::TryWatchGlobalValueForConstantFolding(globalObject, y));
+    uint32_t hc4 = getHiddenClass();
+    ReleaseAssert(hc4 != hc3);
+    ReleaseAssert(TableObject::TryWatchGlobalValueForConstantFolding(globalObject, y));
+    put(y, 9);
+    uint32_t hc5 = getHiddenClass();
+    ReleaseAssert(hc5 != hc4);
+    ReleaseAssert(!TableObject::TryWatchGlobalValueForConstantFolding(globalObject, y));
+    ReleaseAssert(getHiddenClass() == hc5);
+
+    // The hidden class has already been relocated once for folding 'z', so it is not relocated for it again
+    //
+    put(z, 10);
+    ReleaseAssert(getHiddenClass() == hc5);
+    ReleaseAssert(!TableObject::TryWatchGlobalValueForConstantFolding(globalObject, z));
+    ReleaseAssert(getHiddenClass() == hc5);
+
+    ReleaseAssert(get(x).IsInt32() && get(x).AsInt32() == 6);
+    ReleaseAssert(get(y).IsInt32() && get(y).AsInt32() == 9);
+    ReleaseAssert(get(z).IsInt32() && get(z).AsInt32() == 10);
+}
+
 }   // anonymous namespace